@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+#define MEMTRACK_TAG MEMTRACK_TAG_ARENA
+#include "memtrack.h"
+
+/* enough for any type we store, including double */
+#define ARENA_ALIGN 8
+
+typedef struct _ArenaChunk ArenaChunk;
+
+struct _ArenaChunk
+{
+	ArenaChunk *next;
+	size_t size;
+	size_t used;
+	unsigned char data[];
+};
+
+struct _Arena
+{
+	size_t chunk_size;
+
+	/* current chunk is the head, first allocated chunk is the tail */
+	ArenaChunk *chunks;
+};
+
+static ArenaChunk *
+arena_chunk_new (size_t size)
+{
+	ArenaChunk *chunk;
+
+	chunk = memtrack_malloc (sizeof (ArenaChunk) + size);
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+static void *
+arena_chunk_alloc (ArenaChunk * chunk, size_t size)
+{
+	uintptr_t addr = (uintptr_t) (chunk->data + chunk->used);
+	size_t pad = (ARENA_ALIGN - (addr & (ARENA_ALIGN - 1))) &
+		(ARENA_ALIGN - 1);
+
+	if (chunk->used + pad + size > chunk->size)
+		return NULL;
+
+	chunk->used += pad + size;
+	return (void *) (addr + pad);
+}
+
+Arena *
+arena_new (size_t chunk_size)
+{
+	Arena *arena;
+
+	arena = memtrack_malloc (sizeof (Arena));
+	if (arena == NULL)
+		return NULL;
+
+	arena->chunk_size = chunk_size;
+	arena->chunks = arena_chunk_new (chunk_size);
+	if (arena->chunks == NULL) {
+		memtrack_free (arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+void
+arena_reset (Arena * arena)
+{
+	ArenaChunk *chunk = arena->chunks;
+
+	/* keep only the first chunk, which is the last of the list */
+	while (chunk->next != NULL) {
+		ArenaChunk *next = chunk->next;
+		memtrack_free (chunk);
+		chunk = next;
+	}
+
+	chunk->used = 0;
+	arena->chunks = chunk;
+}
+
+void
+arena_free (Arena * arena)
+{
+	if (arena == NULL)
+		return;
+
+	arena_reset (arena);
+	memtrack_free (arena->chunks);
+	memtrack_free (arena);
+}
+
+void *
+arena_alloc (Arena * arena, size_t size)
+{
+	ArenaChunk *chunk;
+	void *ptr;
+
+	ptr = arena_chunk_alloc (arena->chunks, size);
+	if (ptr)
+		return ptr;
+
+	/* current chunk is full, chain a new one with room for alignment */
+	if (size + ARENA_ALIGN > arena->chunk_size)
+		chunk = arena_chunk_new (size + ARENA_ALIGN);
+	else
+		chunk = arena_chunk_new (arena->chunk_size);
+
+	if (chunk == NULL)
+		return NULL;
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	return arena_chunk_alloc (chunk, size);
+}
+
+void *
+arena_calloc (Arena * arena, size_t size)
+{
+	void *ptr;
+
+	ptr = arena_alloc (arena, size);
+	if (ptr)
+		memset (ptr, 0, size);
+
+	return ptr;
+}
+
+char *
+arena_strdup (Arena * arena, const char * str)
+{
+	size_t len = strlen (str) + 1;
+	char *copy;
+
+	copy = arena_alloc (arena, len);
+	if (copy)
+		memcpy (copy, str, len);
+
+	return copy;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Simple bump allocator. Memory is carved from chunks allocated on demand
+ * and is only given back to the system all at once, either by
+ * arena_reset () or arena_free ().
+ */
+typedef struct _Arena Arena;
+
+/**
+ * Create a new arena
+ *
+ * @chunk_size : size of chunks allocated from heap, allocations bigger
+ * than this get a dedicated chunk
+ */
+Arena *arena_new (size_t chunk_size);
+void arena_free (Arena * arena);
+
+/* release all allocations but keep first chunk for reuse */
+void arena_reset (Arena * arena);
+
+void *arena_alloc (Arena * arena, size_t size);
+void *arena_calloc (Arena * arena, size_t size);
+char *arena_strdup (Arena * arena, const char * str);
+
+#endif
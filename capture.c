@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "capture.h"
+#include "metrics.h"
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_CAPTURE
+#include "psplog.h"
+
+/* records waiting for writer thread, must be a power of 2. Navdata and
+ * events together are well below 100 per second */
+#define CAPTURE_RING_SIZE 256
+
+/* writer thread wakes up periodically, or when ring is half full, and
+ * writes pending records in as few large writes as possible */
+#define CAPTURE_WRITER_PERIOD 500000 /* us */
+#define CAPTURE_WRITER_PRIORITY 0x30
+#define CAPTURE_WRITER_STACK_SIZE 0x1000
+#define CAPTURE_WRITE_BUFFER_LEN 16384
+
+#define CAPTURE_BARRIER() PLATFORM_BARRIER ()
+
+typedef struct _CaptureSlot CaptureSlot;
+
+struct _CaptureSlot
+{
+	volatile int ready;
+	CaptureRecordHeader header;
+	uint8_t payload[CAPTURE_PAYLOAD_MAX];
+};
+
+/* both reader threads of drone.c produce, they reserve slots with
+ * interrupts disabled for a few instructions */
+static CaptureSlot capture_ring[CAPTURE_RING_SIZE];
+static volatile unsigned int capture_ring_head = 0;
+static volatile unsigned int capture_ring_tail = 0;
+
+/* producers between slot reservation and publication, writer waits for
+ * them once recording is off so that no slot is published after last flush */
+static volatile unsigned int capture_producers = 0;
+
+static volatile int capture_recording = 0;
+static int capture_fd = -1;
+static int capture_writer = -1;
+static int capture_writer_semaphore = -1;
+/* set by writer once file is closed, it can then be joined */
+static volatile int capture_writer_done = 0;
+
+/* memory stick prefers 64 bytes aligned buffers */
+static uint8_t capture_write_buffer[CAPTURE_WRITE_BUFFER_LEN]
+	__attribute__((aligned(64)));
+
+static void
+capture_ring_flush (void)
+{
+	size_t len = 0;
+
+	for (;;) {
+		CaptureSlot *slot =
+			&capture_ring[capture_ring_tail & (CAPTURE_RING_SIZE - 1)];
+		size_t size;
+
+		if (capture_ring_tail == capture_ring_head || !slot->ready)
+			break;
+
+		CAPTURE_BARRIER ();
+
+		size = sizeof (slot->header) + slot->header.size;
+		if (len + size > CAPTURE_WRITE_BUFFER_LEN) {
+			platform_file_write (capture_fd, capture_write_buffer,
+					len);
+			len = 0;
+		}
+
+		memcpy (capture_write_buffer + len, &slot->header,
+				sizeof (slot->header));
+		memcpy (capture_write_buffer + len + sizeof (slot->header),
+				slot->payload, slot->header.size);
+		len += size;
+
+		slot->ready = 0;
+		CAPTURE_BARRIER ();
+		capture_ring_tail++;
+	}
+
+	if (len > 0)
+		platform_file_write (capture_fd, capture_write_buffer, len);
+}
+
+static int
+capture_writer_run (void * data)
+{
+	while (capture_recording) {
+		platform_sema_wait (capture_writer_semaphore,
+				CAPTURE_WRITER_PERIOD);
+		capture_ring_flush ();
+	}
+
+	while (capture_producers > 0)
+		platform_delay (1000);
+
+	/* records queued after last wake up */
+	capture_ring_flush ();
+
+	platform_file_close (capture_fd);
+	capture_fd = -1;
+
+	PSPLOG_INFO ("capture stopped");
+
+	CAPTURE_BARRIER ();
+	capture_writer_done = 1;
+
+	return 0;
+}
+
+int
+capture_start (const char * path)
+{
+	int i;
+
+	if (capture_recording)
+		return 0;
+
+	if (capture_finish (0) < 0) {
+		PSPLOG_ERROR ("previous capture still being written");
+		return -1;
+	}
+
+	capture_fd = platform_file_create (path);
+	if (capture_fd < 0)
+		goto no_file;
+
+	platform_file_write (capture_fd, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+
+	capture_ring_head = capture_ring_tail = 0;
+	for (i = 0; i < CAPTURE_RING_SIZE; i++)
+		capture_ring[i].ready = 0;
+
+	capture_writer_semaphore = platform_sema_create (
+			"capture_writer_semaphore", 0, 1);
+	if (capture_writer_semaphore < 0)
+		goto no_writer;
+
+	capture_recording = 1;
+	capture_writer_done = 0;
+
+	capture_writer = platform_thread_create ("capture_writer",
+			capture_writer_run, NULL, CAPTURE_WRITER_PRIORITY,
+			CAPTURE_WRITER_STACK_SIZE);
+	if (capture_writer < 0)
+		goto no_writer;
+
+	PSPLOG_INFO ("capturing navdata and events to %s", path);
+
+	return 0;
+
+no_file:
+	PSPLOG_ERROR ("failed to open %s", path);
+	return -1;
+
+no_writer:
+	PSPLOG_ERROR ("failed to start capture writer");
+	capture_recording = 0;
+	if (capture_writer_semaphore >= 0)
+		platform_sema_delete (capture_writer_semaphore);
+	capture_writer_semaphore = -1;
+	platform_file_close (capture_fd);
+	capture_fd = -1;
+	return -1;
+}
+
+void
+capture_stop (void)
+{
+	int intr;
+
+	if (!capture_recording)
+		return;
+
+	intr = platform_critical_enter ();
+	capture_recording = 0;
+	platform_critical_leave (intr);
+
+	/* writer does last flush and closes file */
+	platform_sema_signal (capture_writer_semaphore);
+}
+
+int
+capture_finish (int wait)
+{
+	if (capture_writer < 0)
+		return 0;
+
+	if (!wait && !capture_writer_done)
+		return -1;
+
+	platform_thread_join (capture_writer);
+	platform_sema_delete (capture_writer_semaphore);
+	capture_writer = -1;
+	capture_writer_semaphore = -1;
+
+	return 1;
+}
+
+int
+capture_is_recording (void)
+{
+	return capture_recording;
+}
+
+void
+capture_record (int buffer_id, const uint8_t * data, int size)
+{
+	CaptureSlot *slot;
+	unsigned int index;
+	int intr;
+
+	if (!capture_recording)
+		return;
+
+	if (size > CAPTURE_PAYLOAD_MAX) {
+		metrics_counter_inc (METRICS_CAPTURE_DROPPED);
+		return;
+	}
+
+	intr = platform_critical_enter ();
+
+	/* capture_stop () may have been called since first check */
+	if (!capture_recording) {
+		platform_critical_leave (intr);
+		return;
+	}
+
+	if (capture_ring_head - capture_ring_tail >= CAPTURE_RING_SIZE) {
+		platform_critical_leave (intr);
+		metrics_counter_inc (METRICS_CAPTURE_DROPPED);
+		return;
+	}
+
+	index = capture_ring_head++;
+	capture_producers++;
+	platform_critical_leave (intr);
+
+	if (index - capture_ring_tail == CAPTURE_RING_SIZE / 2)
+		platform_sema_signal (capture_writer_semaphore);
+
+	slot = &capture_ring[index & (CAPTURE_RING_SIZE - 1)];
+	slot->header.timestamp = platform_get_time ();
+	slot->header.buffer_id = buffer_id;
+	slot->header.reserved = 0;
+	slot->header.size = size;
+	memcpy (slot->payload, data, size);
+
+	CAPTURE_BARRIER ();
+	slot->ready = 1;
+
+	intr = platform_critical_enter ();
+	capture_producers--;
+	platform_critical_leave (intr);
+
+	metrics_counter_inc (METRICS_CAPTURE_RECORDS);
+}
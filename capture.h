@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+/*
+ * Capture of device to controller buffers
+ *
+ * Payloads are recorded exactly as ARNETWORK_Manager_ReadDataWithTimeout ()
+ * returns them, so that a flight can be decoded again on host, see
+ * tools/capture-replay.c. File starts with magic, then each record has a
+ * header followed by payload, all little endian.
+ */
+#define CAPTURE_MAGIC "PSPDCCP1"
+#define CAPTURE_MAGIC_LEN 8
+
+/* same as dataCopyMaxSize of d2c buffers in drone.c, larger payloads are
+ * dropped and counted */
+#define CAPTURE_PAYLOAD_MAX 128
+
+typedef struct _CaptureRecordHeader CaptureRecordHeader;
+
+struct _CaptureRecordHeader
+{
+	uint32_t timestamp; /* us, as platform_get_time () */
+	uint8_t buffer_id;
+	uint8_t reserved;
+	uint16_t size;
+};
+
+/* open file and start writer thread, recording is off by default so that
+ * capture points cost a test when not in use */
+int capture_start (const char * path);
+/* never blocks, writer thread writes pending records and closes file */
+void capture_stop (void);
+/* join writer once it closed file, or wait for it if @wait is set. Return 1
+ * when it was joined, 0 if there was none, -1 if it is still writing */
+int capture_finish (int wait);
+int capture_is_recording (void);
+
+/* queue a payload for writer thread, never blocks, payload is dropped if
+ * writer is late */
+void capture_record (int buffer_id, const uint8_t * data, int size);
+
+#endif
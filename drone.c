@@ -34,17 +34,24 @@
 #include <libARDiscovery/ARDiscovery.h>
 #include <libARCommands/ARCommands.h>
 
+#include "capture.h"
 #include "drone.h"
+#include "flightrec.h"
+#include "latency.h"
+#include "metrics.h"
+#include "platform.h"
+#include "trace.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_DRONE
 #include "psplog.h"
 
-#define DRONE_COMMAND_NO_ACK_ID 10
-#define DRONE_COMMAND_ACK_ID 11
-#define DRONE_COMMAND_EMERGENCY_ID 12
-#define DRONE_EVENT_ID 126
-#define DRONE_NAVDATA_ID 127
-
 #define COMMAND_BUFFER_SIZE 512
 
+/* largest d2c buffer data, a reader buffer of this size is enough */
+#define DRONE_DATA_MAX_SIZE 128
+
+/* also bounds time taken by drone_disconnect () to stop reader threads */
+#define DRONE_READ_TIMEOUT 100 /* ms */
+
 /* client to device buffers definition */
 static ARNETWORK_IOBufferParam_t c2d_buf_params[] = {
 	/* non-acknowledged commands */
@@ -55,7 +62,7 @@ static ARNETWORK_IOBufferParam_t c2d_buf_params[] = {
 		.ackTimeoutMs = ARNETWORK_IOBUFFERPARAM_INFINITE_NUMBER,
 		.numberOfRetry = ARNETWORK_IOBUFFERPARAM_INFINITE_NUMBER,
 		.numberOfCell = 2,
-		.dataCopyMaxSize = 128,
+		.dataCopyMaxSize = DRONE_DATA_MAX_SIZE,
 		.isOverwriting = 1,
 	},
 	/* acknowledged commands */
@@ -66,7 +73,7 @@ static ARNETWORK_IOBufferParam_t c2d_buf_params[] = {
 		.ackTimeoutMs = 500,
 		.numberOfRetry = 3,
 		.numberOfCell = 20,
-		.dataCopyMaxSize = 128,
+		.dataCopyMaxSize = DRONE_DATA_MAX_SIZE,
 		.isOverwriting = 0,
 	},
 	/* emergency commands */
@@ -77,7 +84,7 @@ static ARNETWORK_IOBufferParam_t c2d_buf_params[] = {
 		.ackTimeoutMs = 100,
 		.numberOfRetry = ARNETWORK_IOBUFFERPARAM_INFINITE_NUMBER,
 		.numberOfCell = 1,
-		.dataCopyMaxSize = 128,
+		.dataCopyMaxSize = DRONE_DATA_MAX_SIZE,
 		.isOverwriting = 0,
 	}
 };
@@ -93,7 +100,7 @@ static ARNETWORK_IOBufferParam_t d2c_buf_params[] = {
 		.ackTimeoutMs = 500,
 		.numberOfRetry = 3,
 		.numberOfCell = 20,
-		.dataCopyMaxSize = 128,
+		.dataCopyMaxSize = DRONE_DATA_MAX_SIZE,
 		.isOverwriting = 0,
 	},
 	/* event buffer */
@@ -104,38 +111,74 @@ static ARNETWORK_IOBufferParam_t d2c_buf_params[] = {
 		.ackTimeoutMs = ARNETWORK_IOBUFFERPARAM_INFINITE_NUMBER,
 		.numberOfRetry = ARNETWORK_IOBUFFERPARAM_INFINITE_NUMBER,
 		.numberOfCell = 20,
-		.dataCopyMaxSize = 128,
+		.dataCopyMaxSize = DRONE_DATA_MAX_SIZE,
 		.isOverwriting = 0,
 	}
 };
 static const size_t n_d2c_buf_params = sizeof (d2c_buf_params) / sizeof (ARNETWORK_IOBufferParam_t);
 
+static ARNETWORK_IOBufferParam_t *
+drone_find_buffer_params (int id)
+{
+	size_t i;
+
+	for (i = 0; i < n_c2d_buf_params; i++) {
+		if (c2d_buf_params[i].ID == id)
+			return &c2d_buf_params[i];
+	}
+
+	for (i = 0; i < n_d2c_buf_params; i++) {
+		if (d2c_buf_params[i].ID == id)
+			return &d2c_buf_params[i];
+	}
+
+	return NULL;
+}
+
 static eARNETWORK_MANAGER_CALLBACK_RETURN
 ar_network_command_cb (int buffer_id, uint8_t * data, void * userdata,
 		eARNETWORK_MANAGER_CALLBACK_STATUS status)
 {
-	/*
-	PSPLOG_DEBUG ("command callback with buffer id %d, status %d",
+	PSPLOG_TRACE ("command callback with buffer id %d, status %d",
 			buffer_id, status);
-			*/
 
-	if (status == ARNETWORK_MANAGER_CALLBACK_STATUS_TIMEOUT)
+	if (status == ARNETWORK_MANAGER_CALLBACK_STATUS_SENT) {
+		metrics_counter_inc (METRICS_DRONE_COMMANDS_SENT);
+		trace_instant ("command_sent");
+	}
+
+	if (status == ARNETWORK_MANAGER_CALLBACK_STATUS_TIMEOUT) {
+		metrics_counter_inc (METRICS_DRONE_COMMANDS_TIMEOUT);
 		return ARNETWORK_MANAGER_CALLBACK_RETURN_DATA_POP;
+	}
 
 	return ARNETWORK_MANAGER_CALLBACK_RETURN_DEFAULT;
 }
 
+/* called from ARNetwork sending thread with the command latency tag */
+static eARNETWORK_MANAGER_CALLBACK_RETURN
+ar_network_pcmd_cb (int buffer_id, uint8_t * data, void * userdata,
+		eARNETWORK_MANAGER_CALLBACK_STATUS status)
+{
+	DroneLatencyTag *tag = userdata;
+
+	if (status == ARNETWORK_MANAGER_CALLBACK_STATUS_SENT && tag != NULL) {
+		unsigned int now = latency_now ();
+
+		latency_record (LATENCY_STAGE_SEND, now - tag->queued_time);
+		if (tag->input_time)
+			latency_record (LATENCY_STAGE_TOTAL,
+					now - tag->input_time);
+	}
+
+	return ar_network_command_cb (buffer_id, data, userdata, status);
+}
+
 static void *
 drone_navdata_buffer_thread (void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
-	uint8_t *buf;
-	const size_t bufsize = 128 * 1024;
-
-	/* allocate memory for incoming data */
-	buf = malloc (bufsize);
-	if (buf == NULL)
-		return NULL;
+	uint8_t buf[DRONE_DATA_MAX_SIZE];
 
 	while (drone->running) {
 		int skip = 0;
@@ -143,11 +186,14 @@ drone_navdata_buffer_thread (void * userdata)
 		eARNETWORK_ERROR error = ARNETWORK_OK;
 
 		error = ARNETWORK_Manager_ReadDataWithTimeout (drone->net,
-				DRONE_NAVDATA_ID, buf, bufsize, &size, 1000);
+				DRONE_NAVDATA_ID, buf, sizeof (buf), &size,
+				DRONE_READ_TIMEOUT);
 		if (error != ARNETWORK_OK) {
-			if (error != ARNETWORK_ERROR_BUFFER_EMPTY)
-				PSPLOG_ERROR ("ARNETWORK_Manager_ReadDataWithTimeout failed, reason: %s",
+			if (error != ARNETWORK_ERROR_BUFFER_EMPTY) {
+				metrics_counter_inc (METRICS_DRONE_READ_ERRORS);
+				PSPLOG_ERROR_LIMITED ("ARNETWORK_Manager_ReadDataWithTimeout failed, reason: %s",
 						ARNETWORK_Error_ToString (error));
+			}
 
 			skip = 1;
 		}
@@ -155,17 +201,28 @@ drone_navdata_buffer_thread (void * userdata)
 		if (!skip) {
 			eARCOMMANDS_DECODER_ERROR cmd_error;
 
+			metrics_counter_inc (METRICS_DRONE_NAVDATA_PACKETS);
+			capture_record (DRONE_NAVDATA_ID, buf, size);
+
+			trace_begin ("decode_navdata");
 			cmd_error = ARCOMMANDS_Decoder_DecodeBuffer (buf, size);
+			trace_end ("decode_navdata");
+
 			if ((cmd_error != ARCOMMANDS_DECODER_OK) &&
 					(cmd_error != ARCOMMANDS_DECODER_ERROR_NO_CALLBACK)) {
-				char msg[128];
-				ARCOMMANDS_Decoder_DescribeBuffer (buf, size, msg, sizeof(msg));
-				PSPLOG_INFO ("ARCOMMANDS_Decoder_DecodeBuffer () failed : %d %s", cmd_error, msg);
+				metrics_counter_inc (METRICS_DRONE_DECODE_ERRORS);
+
+				/* describing buffer is expensive, don't do it more
+				 * often than message is logged */
+				if (PSPLOG_LIMITED (PSPLOG_LEVEL_INFO)) {
+					char msg[128];
+					ARCOMMANDS_Decoder_DescribeBuffer (buf, size, msg, sizeof(msg));
+					PSPLOG_INFO ("ARCOMMANDS_Decoder_DecodeBuffer () failed : %d %s", cmd_error, msg);
+				}
 			}
 		}
 	}
 
-	free (buf);
 	return NULL;
 }
 
@@ -173,13 +230,7 @@ static void *
 drone_event_buffer_thread (void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
-	uint8_t *buf;
-	const size_t bufsize = 128 * 1024;
-
-	/* allocate memory for incoming data */
-	buf = malloc (bufsize);
-	if (buf == NULL)
-		return NULL;
+	uint8_t buf[DRONE_DATA_MAX_SIZE];
 
 	while (drone->running) {
 		int skip = 0;
@@ -187,11 +238,14 @@ drone_event_buffer_thread (void * userdata)
 		eARNETWORK_ERROR error = ARNETWORK_OK;
 
 		error = ARNETWORK_Manager_ReadDataWithTimeout (drone->net,
-				DRONE_EVENT_ID, buf, bufsize, &size, 1000);
+				DRONE_EVENT_ID, buf, sizeof (buf), &size,
+				DRONE_READ_TIMEOUT);
 		if (error != ARNETWORK_OK) {
-			if (error != ARNETWORK_ERROR_BUFFER_EMPTY)
-				PSPLOG_ERROR ("ARNETWORK_Manager_ReadDataWithTimeout failed, reason: %s",
+			if (error != ARNETWORK_ERROR_BUFFER_EMPTY) {
+				metrics_counter_inc (METRICS_DRONE_READ_ERRORS);
+				PSPLOG_ERROR_LIMITED ("ARNETWORK_Manager_ReadDataWithTimeout failed, reason: %s",
 						ARNETWORK_Error_ToString (error));
+			}
 
 			skip = 1;
 		}
@@ -199,17 +253,28 @@ drone_event_buffer_thread (void * userdata)
 		if (!skip) {
 			eARCOMMANDS_DECODER_ERROR cmd_error;
 
+			metrics_counter_inc (METRICS_DRONE_EVENT_PACKETS);
+			capture_record (DRONE_EVENT_ID, buf, size);
+
+			trace_begin ("decode_event");
 			cmd_error = ARCOMMANDS_Decoder_DecodeBuffer (buf, size);
+			trace_end ("decode_event");
+
 			if ((cmd_error != ARCOMMANDS_DECODER_OK) &&
 					(cmd_error != ARCOMMANDS_DECODER_ERROR_NO_CALLBACK)) {
-				char msg[128];
-				ARCOMMANDS_Decoder_DescribeBuffer (buf, size, msg, sizeof(msg));
-				PSPLOG_INFO ("ARCOMMANDS_Decoder_DecodeBuffer () failed : %d %s", cmd_error, msg);
+				metrics_counter_inc (METRICS_DRONE_DECODE_ERRORS);
+
+				/* describing buffer is expensive, don't do it more
+				 * often than message is logged */
+				if (PSPLOG_LIMITED (PSPLOG_LEVEL_INFO)) {
+					char msg[128];
+					ARCOMMANDS_Decoder_DescribeBuffer (buf, size, msg, sizeof(msg));
+					PSPLOG_INFO ("ARCOMMANDS_Decoder_DecodeBuffer () failed : %d %s", cmd_error, msg);
+				}
 			}
 		}
 	}
 
-	free (buf);
 	return NULL;
 }
 
@@ -254,7 +319,8 @@ on_battery_status_changed (uint8_t percent, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	drone->battery = percent;
+	drone->telemetry.battery = percent;
+	flightrec_set (FLIGHTREC_BATTERY, percent);
 }
 
 static void
@@ -285,29 +351,31 @@ on_flying_state_changed (eARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_S
 
 	switch (state) {
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED:
-			drone->state = DRONE_STATE_LANDED;
+			drone->telemetry.state = DRONE_STATE_LANDED;
 			break;
 
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_TAKINGOFF :
-			drone->state = DRONE_STATE_TAKING_OFF;
+			drone->telemetry.state = DRONE_STATE_TAKING_OFF;
 			break;
 
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING:
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_FLYING:
-			drone->state = DRONE_STATE_FLYING;
+			drone->telemetry.state = DRONE_STATE_FLYING;
 			break;
 
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDING:
-			drone->state = DRONE_STATE_LANDING;
+			drone->telemetry.state = DRONE_STATE_LANDING;
 			break;
 
 		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_EMERGENCY:
-			drone->state = DRONE_STATE_EMERGENCY;
+			drone->telemetry.state = DRONE_STATE_EMERGENCY;
 			break;
 
 		default:
 			break;
 	}
+
+	flightrec_set (FLIGHTREC_FLYING_STATE, drone->telemetry.state);
 }
 
 static void
@@ -315,7 +383,8 @@ on_hull_changed (uint8_t present, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	drone->hull = present;
+	drone->info.hull = present;
+	flightrec_set (FLIGHTREC_HULL, present);
 }
 
 static void
@@ -323,7 +392,8 @@ on_altitude_changed (double altitude, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	drone->altitude = (int) round(altitude);
+	drone->telemetry.altitude = (int) round(altitude);
+	flightrec_set (FLIGHTREC_ALTITUDE, (int32_t) round (altitude * 100));
 }
 
 static void
@@ -331,7 +401,8 @@ on_outdoor_flight_changed (uint8_t active, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	drone->outdoor = active;
+	drone->info.outdoor = active;
+	flightrec_set (FLIGHTREC_OUTDOOR, active);
 }
 
 static void
@@ -339,7 +410,8 @@ on_gps_fixed_changed (uint8_t gps_fixed, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	drone->gps_fixed = gps_fixed;
+	drone->telemetry.gps_fixed = gps_fixed;
+	flightrec_set (FLIGHTREC_GPS_FIXED, gps_fixed);
 }
 
 static void
@@ -347,10 +419,19 @@ on_position_changed (double latitude, double longitude, double altitude,
 		void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
-
-	drone->gps_latitude = latitude;
-	drone->gps_longitude = longitude;
-	drone->gps_altitude = altitude;
+	int intr;
+
+	/* doubles are not written atomically */
+	intr = platform_critical_enter ();
+	drone->telemetry.gps_latitude = latitude;
+	drone->telemetry.gps_longitude = longitude;
+	drone->telemetry.gps_altitude = altitude;
+	platform_critical_leave (intr);
+
+	flightrec_set (FLIGHTREC_LATITUDE, (int32_t) round (latitude * 1e6));
+	flightrec_set (FLIGHTREC_LONGITUDE, (int32_t) round (longitude * 1e6));
+	flightrec_set (FLIGHTREC_GPS_ALTITUDE,
+			(int32_t) round (altitude * 100));
 }
 
 static void
@@ -358,15 +439,10 @@ on_product_version_changed (char * software, char * hardware, void * userdata)
 {
 	Drone *drone = (Drone *) userdata;
 
-	if (drone->software_version)
-		free (drone->software_version);
-
-	drone->software_version = strdup (software);
-
-	if (drone->hardware_version)
-		free (drone->hardware_version);
-
-	drone->hardware_version = strdup (hardware);
+	snprintf (drone->info.software_version,
+			sizeof (drone->info.software_version), "%s", software);
+	snprintf (drone->info.hardware_version,
+			sizeof (drone->info.hardware_version), "%s", hardware);
 }
 
 static void
@@ -376,10 +452,8 @@ on_arcommand_version (char * version, void * userdata)
 
 	PSPLOG_INFO ("got arcommands version %s", version);
 
-	if (drone->arcommand_version)
-		free (drone->arcommand_version);
-
-	drone->arcommand_version = strdup (version);
+	snprintf (drone->info.arcommand_version,
+			sizeof (drone->info.arcommand_version), "%s", version);
 }
 
 static void
@@ -390,9 +464,12 @@ on_setting_altitude_limit_changed (float current, float min, float max,
 
 	PSPLOG_INFO ("got altitude limit %f <= %f <= %f", min, current, max);
 
-	drone->altitude_limit.current = current;
-	drone->altitude_limit.min = min;
-	drone->altitude_limit.max = max;
+	drone->info.altitude_limit.current = current;
+	drone->info.altitude_limit.min = min;
+	drone->info.altitude_limit.max = max;
+
+	flightrec_set (FLIGHTREC_ALTITUDE_LIMIT,
+			(int32_t) round (current * 100));
 }
 
 static void
@@ -404,9 +481,12 @@ on_setting_max_vertical_speed_changed (float current, float min, float max,
 	PSPLOG_INFO ("got max vertical speed limit %f <= %f <= %f", min,
 			current, max);
 
-	drone->vertical_speed_limit.current = current;
-	drone->vertical_speed_limit.min = min;
-	drone->vertical_speed_limit.max = max;
+	drone->info.vertical_speed_limit.current = current;
+	drone->info.vertical_speed_limit.min = min;
+	drone->info.vertical_speed_limit.max = max;
+
+	flightrec_set (FLIGHTREC_VERTICAL_SPEED_LIMIT,
+			(int32_t) round (current * 100));
 }
 
 static void
@@ -418,9 +498,12 @@ on_setting_max_rotation_speed_changed (float current, float min, float max,
 	PSPLOG_INFO ("got max rotation speed limit %f <= %f <= %f", min,
 			current, max);
 
-	drone->rotation_speed_limit.current = current;
-	drone->rotation_speed_limit.min = min;
-	drone->rotation_speed_limit.max = max;
+	drone->info.rotation_speed_limit.current = current;
+	drone->info.rotation_speed_limit.min = min;
+	drone->info.rotation_speed_limit.max = max;
+
+	flightrec_set (FLIGHTREC_ROTATION_SPEED_LIMIT,
+			(int32_t) round (current * 100));
 }
 
 static void
@@ -432,9 +515,11 @@ on_setting_max_tilt_changed (float current, float min, float max,
 	PSPLOG_INFO ("got max tilt limit %f <= %f <= %f", min,
 			current, max);
 
-	drone->tilt_limit.current = current;
-	drone->tilt_limit.min = min;
-	drone->tilt_limit.max = max;
+	drone->info.tilt_limit.current = current;
+	drone->info.tilt_limit.min = min;
+	drone->info.tilt_limit.max = max;
+
+	flightrec_set (FLIGHTREC_TILT_LIMIT, (int32_t) round (current * 100));
 }
 
 static void
@@ -562,44 +647,16 @@ drone_set_datetime (Drone * drone, time_t time)
 static void
 drone_reset (Drone * drone)
 {
-	if (drone->ipv4_addr)
-		free (drone->ipv4_addr);
-
-	drone->ipv4_addr = NULL;
+	drone->ipv4_addr[0] = '\0';
 
 	drone->connected = 0;
 
 	drone->state_sync = 0;
 	drone->settings_sync = 0;
-	drone->state = DRONE_STATE_LANDED;
-	drone->battery = 0;
-	drone->hull = 0;
-	drone->altitude = 0;
-	drone->outdoor = 0;
-	drone->gps_fixed = 0;
-	drone->gps_latitude = 0.0;
-	drone->gps_longitude = 0.0;
-	drone->gps_altitude = 0.0;
-
-	if (drone->software_version)
-		free (drone->software_version);
-
-	if (drone->hardware_version)
-		free (drone->hardware_version);
-
-	if (drone->arcommand_version)
-		free (drone->arcommand_version);
-
-	drone->software_version = NULL;
-	drone->hardware_version = NULL;
-	drone->arcommand_version = NULL;
-
-	memset (&drone->altitude_limit, 0, sizeof (drone->altitude_limit));
-	memset (&drone->vertical_speed_limit, 0,
-			sizeof (drone->vertical_speed_limit));
-	memset (&drone->rotation_speed_limit, 0,
-			sizeof (drone->rotation_speed_limit));
-	memset (&drone->tilt_limit, 0, sizeof (drone->tilt_limit));
+
+	/* DRONE_STATE_LANDED is 0 */
+	memset (&drone->telemetry, 0, sizeof (drone->telemetry));
+	memset (&drone->info, 0, sizeof (drone->info));
 }
 
 
@@ -671,15 +728,6 @@ drone_deinit (Drone * drone)
 		ARNETWORKAL_Manager_Delete (&drone->net_al);
 		drone->net_al = NULL;
 	}
-
-	if (drone->software_version)
-		free (drone->software_version);
-
-	if (drone->hardware_version)
-		free (drone->hardware_version);
-
-	if (drone->arcommand_version)
-		free (drone->arcommand_version);
 }
 
 int
@@ -690,7 +738,7 @@ drone_connect (Drone * drone, const char * ipv4, int discovery_port,
 	eARNETWORKAL_ERROR al_error;
 	eARNETWORK_ERROR error;
 
-	drone->ipv4_addr = strdup (ipv4);
+	snprintf (drone->ipv4_addr, sizeof (drone->ipv4_addr), "%s", ipv4);
 	drone->discovery_port = discovery_port;
 	drone->c2d_port = c2d_port;
 	drone->d2c_port = d2c_port;
@@ -848,6 +896,43 @@ drone_disconnect (Drone * drone)
 	return 0;
 }
 
+int
+drone_buffer_set_params (int id, int sending_wait_ms, int ack_timeout_ms,
+		int retries, int cells)
+{
+	ARNETWORK_IOBufferParam_t *params;
+
+	params = drone_find_buffer_params (id);
+	if (params == NULL) {
+		PSPLOG_ERROR ("no buffer with id %d", id);
+		return -1;
+	}
+
+	/* a latency tag is reused after DRONE_LATENCY_TAGS commands, each
+	 * queued piloting command must still own its tag */
+	if (id == DRONE_COMMAND_NO_ACK_ID && cells >= DRONE_LATENCY_TAGS) {
+		PSPLOG_ERROR ("buffer %d: %d cells, must be less than %d", id,
+				cells, DRONE_LATENCY_TAGS);
+		return -1;
+	}
+
+	if (sending_wait_ms >= 0)
+		params->sendingWaitTimeMs = sending_wait_ms;
+	if (ack_timeout_ms >= 0)
+		params->ackTimeoutMs = ack_timeout_ms;
+	if (retries >= 0)
+		params->numberOfRetry = retries;
+	if (cells >= 0)
+		params->numberOfCell = cells;
+
+	PSPLOG_INFO ("buffer %d: wait %d ms, ack timeout %d ms, %d retries, "
+			"%d cells", id, params->sendingWaitTimeMs,
+			params->ackTimeoutMs, params->numberOfRetry,
+			params->numberOfCell);
+
+	return 0;
+}
+
 int
 drone_sync_state (Drone * drone)
 {
@@ -869,6 +954,16 @@ drone_sync_state (Drone * drone)
 	return 0;
 }
 
+void
+drone_get_telemetry (Drone * drone, DroneTelemetry * telemetry)
+{
+	int intr;
+
+	intr = platform_critical_enter ();
+	*telemetry = drone->telemetry;
+	platform_critical_leave (intr);
+}
+
 int
 drone_sync_settings (Drone * drone)
 {
@@ -975,11 +1070,25 @@ drone_landing (Drone * drone)
 }
 
 int
-drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll)
+drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll,
+		unsigned int timestamp)
 {
 	eARCOMMANDS_GENERATOR_ERROR cmd_error;
 	uint8_t cmd[COMMAND_BUFFER_SIZE];
 	int32_t cmd_size;
+	DroneLatencyTag *tag;
+	unsigned int start;
+
+	start = latency_now ();
+	if (timestamp)
+		latency_record (LATENCY_STAGE_INPUT, start - timestamp);
+
+	/* tags are reused in turn, buffer has fewer cells than tags so a tag
+	 * is never reused before its command is sent or dropped */
+	tag = &drone->latency_tags[drone->latency_tag_index];
+	drone->latency_tag_index =
+		(drone->latency_tag_index + 1) % DRONE_LATENCY_TAGS;
+	tag->input_time = timestamp;
 
 	cmd_error = ARCOMMANDS_Generator_GenerateARDrone3PilotingPCMD (cmd,
 			COMMAND_BUFFER_SIZE, &cmd_size, 1, roll, pitch, yaw,
@@ -989,9 +1098,16 @@ drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll)
 		return -1;
 	}
 
-	PSPLOG_DEBUG ("send flight control parameters");
+	PSPLOG_TRACE ("send flight control parameters");
+	metrics_counter_inc (METRICS_DRONE_PCMD);
+
+	/* set before queuing since sending thread may pick it at once */
+	tag->queued_time = latency_now ();
+	latency_record (LATENCY_STAGE_QUEUE, tag->queued_time - start);
+	trace_begin ("send_pcmd");
 	ARNETWORK_Manager_SendData (drone->net, DRONE_COMMAND_NO_ACK_ID,
-			cmd, cmd_size, NULL, &ar_network_command_cb, 1);
+			cmd, cmd_size, tag, &ar_network_pcmd_cb, 1);
+	trace_end ("send_pcmd");
 
 	return 0;
 }
@@ -32,6 +32,13 @@
 #include <libARNetworkAL/ARNetworkAL.h>
 #include <libARNetwork/ARNetwork.h>
 
+/* ARNetwork buffers */
+#define DRONE_COMMAND_NO_ACK_ID 10
+#define DRONE_COMMAND_ACK_ID 11
+#define DRONE_COMMAND_EMERGENCY_ID 12
+#define DRONE_EVENT_ID 126
+#define DRONE_NAVDATA_ID 127
+
 typedef enum
 {
 	DRONE_STATE_LANDED = 0,
@@ -49,8 +56,15 @@ typedef enum
 	DRONE_FLIP_LEFT
 } DroneFlip;
 
+/* inline string buffers, longer values are truncated */
+#define DRONE_IPV4_LEN 16
+#define DRONE_VERSION_LEN 32
+
 typedef struct _drone Drone;
 typedef struct _drone_setting DroneSetting;
+typedef struct _drone_latency_tag DroneLatencyTag;
+typedef struct _drone_telemetry DroneTelemetry;
+typedef struct _drone_info DroneInfo;
 
 struct _drone_setting
 {
@@ -59,9 +73,52 @@ struct _drone_setting
 	int current;
 };
 
+/* follow a piloting command through ARNetwork for latency tracing */
+struct _drone_latency_tag
+{
+	unsigned int input_time;
+	unsigned int queued_time;
+};
+
+/* more than number of cells in non-acknowledged buffer */
+#define DRONE_LATENCY_TAGS 8
+
+/* drone state updated at navdata rate and read every frame, it fits in a
+ * single cache line so that a snapshot is one short copy */
+struct _drone_telemetry
+{
+	DroneState state;
+	unsigned int battery;
+	int altitude;
+	unsigned int gps_fixed;
+	double gps_latitude;
+	double gps_longitude;
+	double gps_altitude;
+} __attribute__((aligned (64)));
+
+/* drone state which seldom changes, strings are stored inline so that
+ * decoder callbacks never allocate */
+struct _drone_info
+{
+	char software_version[DRONE_VERSION_LEN];
+	char hardware_version[DRONE_VERSION_LEN];
+	char arcommand_version[DRONE_VERSION_LEN];
+	unsigned int hull;
+	unsigned int outdoor;
+
+	DroneSetting altitude_limit;
+	DroneSetting vertical_speed_limit;
+	DroneSetting rotation_speed_limit;
+	DroneSetting tilt_limit;
+};
+
 struct _drone
 {
-	char *ipv4_addr;
+	/* written by rx threads in critical sections, see
+	 * drone_get_telemetry () */
+	DroneTelemetry telemetry;
+
+	char ipv4_addr[DRONE_IPV4_LEN];
 	int discovery_port;
 	int d2c_port;
 	int c2d_port;
@@ -80,24 +137,10 @@ struct _drone
 	int state_sync;
 	int settings_sync;
 
-	/* drone state */
-	DroneState state;
-	unsigned int battery;
-	unsigned int hull;
-	int altitude;
-	unsigned int outdoor;
-	unsigned int gps_fixed;
-	double gps_latitude;
-	double gps_longitude;
-	double gps_altitude;
-	char *software_version;
-	char *hardware_version;
-	char *arcommand_version;
+	DroneInfo info;
 
-	DroneSetting altitude_limit;
-	DroneSetting vertical_speed_limit;
-	DroneSetting rotation_speed_limit;
-	DroneSetting tilt_limit;;
+	DroneLatencyTag latency_tags[DRONE_LATENCY_TAGS];
+	unsigned int latency_tag_index;
 };
 
 int drone_init (Drone * drone);
@@ -115,8 +158,21 @@ int drone_flat_trim (Drone * drone);
 
 int drone_sync_state (Drone * drone);
 
-/* piloting commands */
-int drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll);
+/* consistent copy of telemetry, fields are never torn */
+void drone_get_telemetry (Drone * drone, DroneTelemetry * telemetry);
+
+/* change ARNetwork buffer parameters used by next drone_connect (), to tune
+ * link behaviour. Negative values keep current setting. Non-acknowledged
+ * buffer must have less than DRONE_LATENCY_TAGS cells */
+int drone_buffer_set_params (int id, int sending_wait_ms, int ack_timeout_ms,
+		int retries, int cells);
+
+/* piloting commands
+ *
+ * @timestamp : time of controller sample which produced the command, as in
+ * PlatformPad.timestamp, or 0 if unknown */
+int drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll,
+		unsigned int timestamp);
 int drone_do_flip (Drone * drone, DroneFlip flip);
 
 /* settings commands */
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "flightrec.h"
+#include "metrics.h"
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_FLIGHTREC
+#include "psplog.h"
+
+/* chunks in memory, one being filled while writer catches up with the
+ * others. Memory used doesn't depend on flight duration */
+#define FLIGHTREC_CHUNKS 4
+
+/* widest possible row */
+#define FLIGHTREC_ROW_MAX_LEN (2 * FLIGHTREC_N_COLUMNS)
+
+#define FLIGHTREC_WRITER_PERIOD 1000000 /* us */
+#define FLIGHTREC_WRITER_PRIORITY 0x30
+#define FLIGHTREC_WRITER_STACK_SIZE 0x1000
+
+#define FLIGHTREC_BARRIER() PLATFORM_BARRIER ()
+
+typedef struct _FlightRecChunk FlightRecChunk;
+
+/* columns are FLIGHTREC_CHUNK_ROWS long while chunk is filled, writer packs
+ * them according to actual number of rows */
+struct _FlightRecChunk
+{
+	FlightRecChunkHeader header;
+	uint8_t columns[FLIGHTREC_ROW_MAX_LEN * FLIGHTREC_CHUNK_ROWS];
+} __attribute__((aligned(64)));
+
+/* indexed by FlightRecColumn */
+static const uint8_t flightrec_widths[FLIGHTREC_N_COLUMNS] = {
+	2, /* time, 16 ms per frame */
+	1, 1, 1, 1,
+	1,
+	1,
+	2,
+	1,
+	2, 2, 2,
+	1, 1,
+	2, 2, 2, 2,
+	1
+};
+
+static const char * const flightrec_names[FLIGHTREC_N_COLUMNS] = {
+	"time",
+	"gaz",
+	"yaw",
+	"pitch",
+	"roll",
+	"flying_state",
+	"battery",
+	"altitude",
+	"gps_fixed",
+	"latitude",
+	"longitude",
+	"gps_altitude",
+	"hull",
+	"outdoor",
+	"altitude_limit",
+	"vertical_speed_limit",
+	"rotation_speed_limit",
+	"tilt_limit",
+	"d2c_buffers"
+};
+
+/* offset of each column in a chunk being filled */
+static unsigned int flightrec_offsets[FLIGHTREC_N_COLUMNS];
+
+/* latest state, written by drone callbacks */
+static volatile int32_t flightrec_current[FLIGHTREC_N_COLUMNS];
+
+/* chunks are filled and written in turn, head is only changed by sampling
+ * thread and tail by writer */
+static FlightRecChunk flightrec_chunks[FLIGHTREC_CHUNKS];
+static volatile unsigned int flightrec_head = 0;
+static volatile unsigned int flightrec_tail = 0;
+
+/* sampling thread state */
+static FlightRecChunk *flightrec_chunk = NULL;
+static int32_t flightrec_prev[FLIGHTREC_N_COLUMNS];
+static long long flightrec_start_time;
+
+static volatile int flightrec_recording = 0;
+static int flightrec_fd = -1;
+static int flightrec_writer = -1;
+static int flightrec_writer_semaphore = -1;
+/* set by writer once file is closed, it can then be joined */
+static volatile int flightrec_writer_done = 0;
+
+int
+flightrec_column_get_width (FlightRecColumn column)
+{
+	return flightrec_widths[column];
+}
+
+const char *
+flightrec_column_get_name (FlightRecColumn column)
+{
+	if (column < FLIGHTREC_N_COLUMNS)
+		return flightrec_names[column];
+
+	return "unknown";
+}
+
+static void
+flightrec_write_chunk (FlightRecChunk * chunk)
+{
+	unsigned int n_rows = chunk->header.n_rows;
+	unsigned int len = 0;
+	int i;
+
+	/* destination never overlaps a column not moved yet */
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		unsigned int size = n_rows * flightrec_widths[i];
+
+		memmove (chunk->columns + len,
+				chunk->columns + flightrec_offsets[i], size);
+		len += size;
+	}
+
+	platform_file_write (flightrec_fd, chunk, sizeof (chunk->header) + len);
+}
+
+static void
+flightrec_flush (void)
+{
+	while (flightrec_tail != flightrec_head) {
+		FLIGHTREC_BARRIER ();
+		flightrec_write_chunk (
+				&flightrec_chunks[flightrec_tail % FLIGHTREC_CHUNKS]);
+		FLIGHTREC_BARRIER ();
+		flightrec_tail++;
+	}
+}
+
+static int
+flightrec_writer_run (void * data)
+{
+	while (flightrec_recording) {
+		platform_sema_wait (flightrec_writer_semaphore,
+				FLIGHTREC_WRITER_PERIOD);
+		flightrec_flush ();
+	}
+
+	/* chunks closed after last wake up */
+	flightrec_flush ();
+
+	platform_file_close (flightrec_fd);
+	flightrec_fd = -1;
+
+	PSPLOG_INFO ("flight recording stopped");
+
+	FLIGHTREC_BARRIER ();
+	flightrec_writer_done = 1;
+
+	return 0;
+}
+
+int
+flightrec_start (const char * path)
+{
+	FlightRecFileHeader header;
+	unsigned int offset = 0;
+	int i;
+
+	if (flightrec_recording)
+		return 0;
+
+	if (flightrec_finish (0) < 0) {
+		PSPLOG_ERROR ("previous flight recording still being written");
+		return -1;
+	}
+
+	flightrec_fd = platform_file_create (path);
+	if (flightrec_fd < 0)
+		goto no_file;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, FLIGHTREC_MAGIC, FLIGHTREC_MAGIC_LEN);
+	header.n_columns = FLIGHTREC_N_COLUMNS;
+	header.chunk_rows = FLIGHTREC_CHUNK_ROWS;
+	memcpy (header.widths, flightrec_widths, sizeof (header.widths));
+	platform_file_write (flightrec_fd, &header, sizeof (header));
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		flightrec_offsets[i] = offset;
+		offset += flightrec_widths[i] * FLIGHTREC_CHUNK_ROWS;
+	}
+
+	flightrec_head = flightrec_tail = 0;
+	flightrec_chunk = NULL;
+	flightrec_start_time = platform_get_time_wide ();
+
+	flightrec_writer_semaphore = platform_sema_create (
+			"flightrec_writer_semaphore", 0, 1);
+	if (flightrec_writer_semaphore < 0)
+		goto no_writer;
+
+	flightrec_recording = 1;
+	flightrec_writer_done = 0;
+
+	flightrec_writer = platform_thread_create ("flightrec_writer",
+			flightrec_writer_run, NULL, FLIGHTREC_WRITER_PRIORITY,
+			FLIGHTREC_WRITER_STACK_SIZE);
+	if (flightrec_writer < 0)
+		goto no_writer;
+
+	PSPLOG_INFO ("recording flight to %s", path);
+
+	return 0;
+
+no_file:
+	PSPLOG_ERROR ("failed to open %s", path);
+	return -1;
+
+no_writer:
+	PSPLOG_ERROR ("failed to start flight recorder writer");
+	flightrec_recording = 0;
+	if (flightrec_writer_semaphore >= 0)
+		platform_sema_delete (flightrec_writer_semaphore);
+	flightrec_writer_semaphore = -1;
+	platform_file_close (flightrec_fd);
+	flightrec_fd = -1;
+	return -1;
+}
+
+/* hand filled chunk to writer */
+static void
+flightrec_close_chunk (void)
+{
+	FlightRecChunk *chunk = flightrec_chunk;
+	unsigned int size = 0;
+	int i;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++)
+		size += chunk->header.n_rows * flightrec_widths[i];
+
+	chunk->header.magic = FLIGHTREC_CHUNK_MAGIC;
+	chunk->header.size = sizeof (chunk->header) + size;
+
+	FLIGHTREC_BARRIER ();
+	flightrec_head++;
+	flightrec_chunk = NULL;
+
+	platform_sema_signal (flightrec_writer_semaphore);
+}
+
+void
+flightrec_stop (void)
+{
+	if (!flightrec_recording)
+		return;
+
+	if (flightrec_chunk != NULL)
+		flightrec_close_chunk ();
+
+	/* writer writes chunks left and closes file */
+	FLIGHTREC_BARRIER ();
+	flightrec_recording = 0;
+	platform_sema_signal (flightrec_writer_semaphore);
+}
+
+int
+flightrec_finish (int wait)
+{
+	if (flightrec_writer < 0)
+		return 0;
+
+	if (!wait && !flightrec_writer_done)
+		return -1;
+
+	platform_thread_join (flightrec_writer);
+	platform_sema_delete (flightrec_writer_semaphore);
+	flightrec_writer = -1;
+	flightrec_writer_semaphore = -1;
+
+	return 1;
+}
+
+int
+flightrec_is_recording (void)
+{
+	return flightrec_recording;
+}
+
+void
+flightrec_set (FlightRecColumn column, int32_t value)
+{
+	flightrec_current[column] = value;
+}
+
+/* start a chunk with @row as base, return -1 if none is free */
+static int
+flightrec_open_chunk (const int32_t * row)
+{
+	FlightRecChunk *chunk;
+	int i;
+
+	if (flightrec_head - flightrec_tail >= FLIGHTREC_CHUNKS)
+		return -1;
+
+	chunk = &flightrec_chunks[flightrec_head % FLIGHTREC_CHUNKS];
+	chunk->header.n_rows = 1;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		chunk->header.base[i] = row[i];
+		memset (chunk->columns + flightrec_offsets[i], 0,
+				flightrec_widths[i]);
+	}
+
+	flightrec_chunk = chunk;
+
+	return 0;
+}
+
+/* append @row as differences with previous one, return -1 if one of them
+ * doesn't fit its column */
+static int
+flightrec_append (const int32_t * row)
+{
+	FlightRecChunk *chunk = flightrec_chunk;
+	unsigned int n = chunk->header.n_rows;
+	int32_t delta[FLIGHTREC_N_COLUMNS];
+	int i;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		delta[i] = row[i] - flightrec_prev[i];
+
+		if (flightrec_widths[i] == 1 ?
+				(delta[i] < INT8_MIN || delta[i] > INT8_MAX) :
+				(delta[i] < INT16_MIN || delta[i] > INT16_MAX))
+			return -1;
+	}
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		uint8_t *column = chunk->columns + flightrec_offsets[i];
+
+		if (flightrec_widths[i] == 1)
+			((int8_t *) column)[n] = delta[i];
+		else
+			((int16_t *) column)[n] = delta[i];
+	}
+
+	chunk->header.n_rows = n + 1;
+
+	return 0;
+}
+
+void
+flightrec_sample (int gaz, int yaw, int pitch, int roll)
+{
+	int32_t row[FLIGHTREC_N_COLUMNS];
+	MetricsValue navdata, events;
+	int i;
+
+	if (!flightrec_recording)
+		return;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++)
+		row[i] = flightrec_current[i];
+
+	row[FLIGHTREC_TIME] =
+		(platform_get_time_wide () - flightrec_start_time) / 1000;
+	row[FLIGHTREC_GAZ] = gaz;
+	row[FLIGHTREC_YAW] = yaw;
+	row[FLIGHTREC_PITCH] = pitch;
+	row[FLIGHTREC_ROLL] = roll;
+
+	metrics_get (METRICS_DRONE_NAVDATA_PACKETS, &navdata);
+	metrics_get (METRICS_DRONE_EVENT_PACKETS, &events);
+	row[FLIGHTREC_D2C_BUFFERS] = navdata.value + events.value;
+
+	if (flightrec_chunk != NULL && flightrec_append (row) < 0)
+		flightrec_close_chunk ();
+
+	if (flightrec_chunk == NULL && flightrec_open_chunk (row) < 0) {
+		metrics_counter_inc (METRICS_FLIGHTREC_DROPPED);
+		return;
+	}
+
+	memcpy (flightrec_prev, row, sizeof (row));
+	metrics_counter_inc (METRICS_FLIGHTREC_ROWS);
+
+	if (flightrec_chunk->header.n_rows == FLIGHTREC_CHUNK_ROWS)
+		flightrec_close_chunk ();
+}
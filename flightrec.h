@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+
+/*
+ * Flight data recorder
+ *
+ * Decoded drone state and piloting commands sent are sampled once per frame
+ * into rows of fixed width columns. Rows are grouped in chunks, each chunk
+ * header holds value of every column in its first row and columns store
+ * difference with previous row, which fit in one or two bytes. A chunk is
+ * closed early when a difference doesn't fit.
+ *
+ * File is a FlightRecFileHeader followed by chunks, each one is a
+ * FlightRecChunkHeader followed by columns, in FlightRecColumn order, of
+ * n_rows values of flightrec_column_get_width () bytes. First value of each
+ * column is always 0. Everything is little endian, as on PSP and PC, so
+ * files are read in place on host, see tools/flight-query.c.
+ */
+#define FLIGHTREC_MAGIC "PSPDCFR1"
+#define FLIGHTREC_MAGIC_LEN 8
+#define FLIGHTREC_CHUNK_MAGIC 0x4b4e4843 /* "CHNK" */
+
+/* rows per chunk, a chunk is about 10 s of flight at 60 frames per second */
+#define FLIGHTREC_CHUNK_ROWS 512
+
+typedef enum
+{
+	FLIGHTREC_TIME = 0,          /* ms since start of recording */
+	FLIGHTREC_GAZ,               /* piloting command sent, % */
+	FLIGHTREC_YAW,
+	FLIGHTREC_PITCH,
+	FLIGHTREC_ROLL,
+	FLIGHTREC_FLYING_STATE,      /* DroneState */
+	FLIGHTREC_BATTERY,           /* % */
+	FLIGHTREC_ALTITUDE,          /* cm */
+	FLIGHTREC_GPS_FIXED,
+	FLIGHTREC_LATITUDE,          /* 1e-6 degree, 500 degrees when unknown */
+	FLIGHTREC_LONGITUDE,
+	FLIGHTREC_GPS_ALTITUDE,      /* cm */
+	FLIGHTREC_HULL,
+	FLIGHTREC_OUTDOOR,
+	FLIGHTREC_ALTITUDE_LIMIT,    /* cm */
+	FLIGHTREC_VERTICAL_SPEED_LIMIT, /* cm/s */
+	FLIGHTREC_ROTATION_SPEED_LIMIT, /* 1e-2 degree/s */
+	FLIGHTREC_TILT_LIMIT,        /* 1e-2 degree */
+	FLIGHTREC_D2C_BUFFERS,       /* navdata and events received, wraps */
+	FLIGHTREC_N_COLUMNS
+} FlightRecColumn;
+
+typedef struct _FlightRecFileHeader FlightRecFileHeader;
+typedef struct _FlightRecChunkHeader FlightRecChunkHeader;
+
+struct _FlightRecFileHeader
+{
+	char magic[FLIGHTREC_MAGIC_LEN];
+	uint16_t n_columns;
+	uint16_t chunk_rows;
+	/* width of each column, to check reader agrees with writer */
+	uint8_t widths[FLIGHTREC_N_COLUMNS];
+	uint8_t padding[(4 - FLIGHTREC_N_COLUMNS % 4) % 4];
+};
+
+struct _FlightRecChunkHeader
+{
+	uint32_t magic;
+	/* header and columns */
+	uint32_t size;
+	uint32_t n_rows;
+	/* values of first row */
+	int32_t base[FLIGHTREC_N_COLUMNS];
+};
+
+int flightrec_column_get_width (FlightRecColumn column);
+const char *flightrec_column_get_name (FlightRecColumn column);
+
+/* open file and start writer thread */
+int flightrec_start (const char * path);
+/* close rows sampled so far, must be called from sampling thread. Never
+ * blocks, writer thread writes them and closes file */
+void flightrec_stop (void);
+/* join writer once it closed file, or wait for it if @wait is set. Return 1
+ * when it was joined, 0 if there was none, -1 if it is still writing */
+int flightrec_finish (int wait);
+int flightrec_is_recording (void);
+
+/* update a state column, from any thread. Values are kept while not
+ * recording, so that a recording started in flight has full state */
+void flightrec_set (FlightRecColumn column, int32_t value);
+
+/* append a row with current state and piloting command sent, or zero if
+ * none was sent. Called once per frame by a single thread, it never blocks
+ * and drops the row if writer is late */
+void flightrec_sample (int gaz, int yaw, int pitch, int roll);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "input.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_INPUT
+#include "psplog.h"
+
+/* in us, about 180 Hz which is the fastest controller sampling rate */
+#define INPUT_SAMPLING_CYCLE 5555
+
+/* must be a power of 2 */
+#define INPUT_QUEUE_SIZE 64
+
+#define INPUT_THREAD_PRIORITY 0x14
+#define INPUT_THREAD_STACK_SIZE 0x1000
+
+#define INPUT_BARRIER() PLATFORM_BARRIER ()
+
+static const unsigned int input_buttons[] = {
+	PLATFORM_BUTTON_SELECT,
+	PLATFORM_BUTTON_START,
+	PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_RIGHT,
+	PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_LEFT,
+	PLATFORM_BUTTON_LTRIGGER,
+	PLATFORM_BUTTON_RTRIGGER,
+	PLATFORM_BUTTON_TRIANGLE,
+	PLATFORM_BUTTON_CIRCLE,
+	PLATFORM_BUTTON_CROSS,
+	PLATFORM_BUTTON_SQUARE,
+};
+static const size_t n_input_buttons =
+	sizeof (input_buttons) / sizeof (input_buttons[0]);
+
+static int input_thread = -1;
+static volatile int input_running = 0;
+
+/* single producer (sampling thread), single consumer event ring */
+static InputEvent input_queue[INPUT_QUEUE_SIZE];
+static volatile unsigned int input_queue_head = 0;
+static volatile unsigned int input_queue_tail = 0;
+static volatile unsigned int input_dropped = 0;
+
+/* latest sample, sequence is odd while sample is being written */
+static PlatformPad input_state;
+static volatile unsigned int input_state_seq = 0;
+
+static void
+input_queue_push (InputEventType type, unsigned int button,
+		unsigned int timestamp)
+{
+	unsigned int head = input_queue_head;
+	InputEvent *event;
+
+	if (head - input_queue_tail >= INPUT_QUEUE_SIZE) {
+		input_dropped++;
+		return;
+	}
+
+	event = &input_queue[head & (INPUT_QUEUE_SIZE - 1)];
+	event->type = type;
+	event->button = button;
+	event->timestamp = timestamp;
+
+	INPUT_BARRIER ();
+	input_queue_head = head + 1;
+}
+
+static void
+input_state_publish (const PlatformPad * pad)
+{
+	input_state_seq++;
+	INPUT_BARRIER ();
+	input_state = *pad;
+	INPUT_BARRIER ();
+	input_state_seq++;
+}
+
+static int
+input_thread_run (void *data)
+{
+	PlatformPad pad;
+	unsigned int previous = 0;
+	size_t i;
+
+	while (input_running) {
+		unsigned int changed;
+
+		/* block until next sample */
+		if (platform_ctrl_read (&pad) < 0)
+			continue;
+
+		input_state_publish (&pad);
+
+		changed = pad.buttons ^ previous;
+		if (changed) {
+			for (i = 0; i < n_input_buttons; i++) {
+				unsigned int button = input_buttons[i];
+
+				if (!(changed & button))
+					continue;
+
+				input_queue_push ((pad.buttons & button) ?
+						INPUT_EVENT_PRESS :
+						INPUT_EVENT_RELEASE,
+						button, pad.timestamp);
+			}
+		}
+
+		previous = pad.buttons;
+	}
+
+	return 0;
+}
+
+int
+input_init (void)
+{
+	platform_ctrl_init (INPUT_SAMPLING_CYCLE);
+
+	memset (&input_state, 0, sizeof (input_state));
+	input_queue_head = input_queue_tail = 0;
+	input_dropped = 0;
+	input_running = 1;
+
+	input_thread = platform_thread_create ("input_thread",
+			input_thread_run, NULL, INPUT_THREAD_PRIORITY,
+			INPUT_THREAD_STACK_SIZE);
+	if (input_thread < 0)
+		goto create_thread_failed;
+
+	return 0;
+
+create_thread_failed:
+	PSPLOG_ERROR ("failed to create input thread");
+	input_running = 0;
+	return -1;
+}
+
+void
+input_deinit (void)
+{
+	if (input_thread < 0)
+		return;
+
+	input_running = 0;
+	platform_thread_join (input_thread);
+	input_thread = -1;
+
+	if (input_dropped)
+		PSPLOG_WARNING ("input: %u events dropped", input_dropped);
+}
+
+int
+input_poll_event (InputEvent * event)
+{
+	unsigned int tail = input_queue_tail;
+
+	if (tail == input_queue_head)
+		return 0;
+
+	INPUT_BARRIER ();
+	*event = input_queue[tail & (INPUT_QUEUE_SIZE - 1)];
+	INPUT_BARRIER ();
+	input_queue_tail = tail + 1;
+
+	return 1;
+}
+
+void
+input_flush (void)
+{
+	input_queue_tail = input_queue_head;
+}
+
+void
+input_get_state (PlatformPad * pad)
+{
+	unsigned int seq;
+
+	do {
+		seq = input_state_seq;
+		INPUT_BARRIER ();
+		*pad = input_state;
+		INPUT_BARRIER ();
+	} while ((seq & 1) || seq != input_state_seq);
+}
+
+unsigned int
+input_get_dropped_count (void)
+{
+	return input_dropped;
+}
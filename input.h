@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "platform.h"
+
+typedef enum
+{
+	INPUT_EVENT_PRESS = 0,
+	INPUT_EVENT_RELEASE
+} InputEventType;
+
+typedef struct _InputEvent InputEvent;
+
+struct _InputEvent
+{
+	InputEventType type;
+
+	/* a single PLATFORM_BUTTON_* button */
+	unsigned int button;
+
+	/* PlatformPad.timestamp of the sample which saw the transition */
+	unsigned int timestamp;
+};
+
+/**
+ * Start controller sampling thread
+ *
+ * Controller is sampled at a higher rate than display refresh and each
+ * button transition is queued as an event, so that presses shorter than a
+ * frame are not lost. There is a single event queue which must be consumed
+ * from one thread only.
+ */
+int input_init (void);
+void input_deinit (void);
+
+/* pop oldest event, return 1 if an event was available, 0 otherwise */
+int input_poll_event (InputEvent * event);
+
+/* drop all pending events, e.g. after a system dialog which had focus */
+void input_flush (void);
+
+/* get latest controller sample, for held buttons and analog stick */
+void input_get_state (PlatformPad * pad);
+
+/* number of events dropped because queue was full */
+unsigned int input_get_dropped_count (void);
+
+#endif
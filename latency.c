@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_LATENCY
+#include "psplog.h"
+
+#define LATENCY_DUMP_LINE_LEN 128
+
+static const char * const latency_stage_str[] = {
+	"input",
+	"queue",
+	"send",
+	"total"
+};
+
+unsigned int
+latency_now (void)
+{
+	return platform_get_time ();
+}
+
+void
+latency_reset (void)
+{
+	int stage;
+
+	for (stage = 0; stage < LATENCY_N_STAGES; stage++)
+		metrics_histogram_clear (METRICS_LATENCY_INPUT + stage);
+}
+
+void
+latency_record (LatencyStage stage, unsigned int delay)
+{
+	if (stage >= LATENCY_N_STAGES)
+		return;
+
+	metrics_histogram_record (METRICS_LATENCY_INPUT + stage, delay);
+}
+
+void
+latency_get_histogram (LatencyStage stage, MetricsValue * hist)
+{
+	if (stage >= LATENCY_N_STAGES) {
+		memset (hist, 0, sizeof (MetricsValue));
+		return;
+	}
+
+	metrics_get (METRICS_LATENCY_INPUT + stage, hist);
+}
+
+const char *
+latency_stage_get_name (LatencyStage stage)
+{
+	if (stage < LATENCY_N_STAGES)
+		return latency_stage_str[stage];
+	else
+		return "?????";
+}
+
+int
+latency_dump (const char * path)
+{
+	char line[LATENCY_DUMP_LINE_LEN];
+	int fd;
+	int stage;
+	int i;
+	int len;
+
+	fd = platform_file_create (path);
+	if (fd < 0) {
+		PSPLOG_ERROR ("failed to open %s", path);
+		return -1;
+	}
+
+	for (stage = 0; stage < LATENCY_N_STAGES; stage++) {
+		MetricsValue hist;
+
+		latency_get_histogram (stage, &hist);
+
+		len = snprintf (line, LATENCY_DUMP_LINE_LEN,
+				"%s: count %u min %u max %u avg %llu us\n",
+				latency_stage_get_name (stage), hist.value,
+				hist.min, hist.max,
+				hist.value ? hist.sum / hist.value : 0);
+		if (platform_file_write (fd, line, len) != len)
+			goto write_failed;
+
+		for (i = 0; i < METRICS_N_BUCKETS; i++) {
+			if (hist.buckets[i] == 0)
+				continue;
+
+			if (i == METRICS_N_BUCKETS - 1)
+				len = snprintf (line, LATENCY_DUMP_LINE_LEN,
+						"  >= %u us: %u\n",
+						1U << (i - 1), hist.buckets[i]);
+			else
+				len = snprintf (line, LATENCY_DUMP_LINE_LEN,
+						"  < %u us: %u\n", 1U << i,
+						hist.buckets[i]);
+
+			if (platform_file_write (fd, line, len) != len)
+				goto write_failed;
+		}
+	}
+
+	platform_file_close (fd);
+	return 0;
+
+write_failed:
+	PSPLOG_ERROR ("failed to write latency statistics");
+	platform_file_close (fd);
+	return -1;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "metrics.h"
+
+typedef enum
+{
+	/* controller sample to drone_flight_control () call */
+	LATENCY_STAGE_INPUT = 0,
+	/* drone_flight_control () call to command handed to ARNetwork */
+	LATENCY_STAGE_QUEUE,
+	/* command queued to sent by ARNetwork sending thread */
+	LATENCY_STAGE_SEND,
+	/* controller sample to command sent */
+	LATENCY_STAGE_TOTAL,
+	LATENCY_N_STAGES
+} LatencyStage;
+
+/* current time in us, same clock as PlatformPad.timestamp */
+unsigned int latency_now (void);
+
+void latency_reset (void);
+
+/**
+ * Record a stage delay in us
+ *
+ * Stages are histograms of metrics registry, from METRICS_LATENCY_INPUT on.
+ * Each stage must be recorded from a single thread, readers may see a
+ * partially updated histogram which is fine for statistics.
+ */
+void latency_record (LatencyStage stage, unsigned int delay);
+
+void latency_get_histogram (LatencyStage stage, MetricsValue * hist);
+
+const char *latency_stage_get_name (LatencyStage stage);
+
+/* write all histograms as text to given file, don't call it from flight
+ * loop */
+int latency_dump (const char * path);
+
+#endif
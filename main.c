@@ -25,117 +25,50 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <pspkernel.h>
-#include <pspdebug.h>
-#include <pspdisplay.h>
-#include <pspnet.h>
-#include <pspnet_inet.h>
-#include <pspnet_apctl.h>
-#include <psputility_netmodules.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <errno.h>
 #include <SDL/SDL.h>
 #include <SDL/SDL_ttf.h>
 
+#define PSPLOG_MODULE PSPLOG_MODULE_MAIN
 #include "psplog.h"
+#include "capture.h"
 #include "drone.h"
+#include "flightrec.h"
+#include "memtrack.h"
+#include "metrics.h"
+#include "platform.h"
 #include "ui.h"
 
-#define DRONE_IP "192.168.42.1"
 #define DRONE_DISCOVERY_PORT 44444
 #define DRONE_C2D_PORT 54321
 #define DRONE_D2C_PORT 43210
 
-PSP_MODULE_INFO ("PSP Drone Control", PSP_MODULE_USER, 0, 1);
-PSP_MAIN_THREAD_ATTR (PSP_THREAD_ATTR_USER);
-PSP_HEAP_SIZE_MAX ();
+/* binary log is expanded on host with tools/psplog-decode.py */
+#ifndef PSPLOG_BINARY
+#define PSPLOG_BINARY 0
+#endif
 
-int running = 1;
-
-static int
-on_app_exit (int arg1, int arg2, void *common)
-{
-	running = 0;
-	return 0;
-}
-
-static int
-callback_thread (SceSize args, void *argp)
-{
-	int callback_id;
-
-	callback_id = sceKernelCreateCallback ("Exit Callback", on_app_exit,
-			NULL);
-	sceKernelRegisterExitCallback (callback_id);
-
-	sceKernelSleepThreadCB ();
-
-	return 0;
-}
-
-static int
-setup_callback (void)
-{
-	int thread_id;
-
-	thread_id = sceKernelCreateThread ("Callback update thread",
-			callback_thread, 0x11, 0xFA0, THREAD_ATTR_USER, 0);
-
-	if (thread_id >= 0)
-		sceKernelStartThread (thread_id, 0, 0);
+#if PSPLOG_BINARY
+#define LOG_PATH PLATFORM_DATA_DIR "log.bin"
+#else
+#define LOG_PATH PLATFORM_DATA_DIR "log"
+#endif
 
-	return thread_id;
-}
-
-
-static int
-network_init (void)
-{
-	if (sceNetInit (128 * 4096, 42, 4096, 42, 4096) < 0) {
-		PSPLOG_ERROR ("failed to initialize net component");
-		return -1;
-	}
-
-	if (sceNetInetInit () < 0)
-		goto inet_init_failed;
-
-	if (sceNetApctlInit (0x8000, 48) < 0)
-		goto apctl_init_failed;
-
-	return 0;
+#define METRICS_PATH PLATFORM_DATA_DIR "metrics.txt"
 
-inet_init_failed:
-	PSPLOG_ERROR ("failed to initialize inet");
-	sceNetTerm ();
-	return -1;
-
-apctl_init_failed:
-	PSPLOG_ERROR ("failed to initialize apctl");
-	sceNetInetTerm ();
-	sceNetTerm ();
-	return -1;
-}
+int running = 1;
 
 static void
-network_deinit (void)
+on_app_exit (void)
 {
-	sceNetApctlTerm();
-	sceNetInetTerm();
-	sceNetTerm();
+	running = 0;
 }
 
 static int
 init_subsystem (void)
 {
-	PSPLOG_DEBUG ("loading net module");
-	sceUtilityLoadNetModule (PSP_NET_MODULE_COMMON);
-	sceUtilityLoadNetModule (PSP_NET_MODULE_INET);
-
 	PSPLOG_DEBUG ("initializing network stack");
-	if (network_init () < 0)
+	if (platform_network_init () < 0)
 		goto network_init_failed;
 
 	PSPLOG_DEBUG ("initializing SDL");
@@ -154,13 +87,13 @@ network_init_failed:
 
 sdl_init_failed:
 	PSPLOG_ERROR ("failed to initialize SDL");
-	network_deinit ();
+	platform_network_deinit ();
 	return -1;
 
 ttf_init_failed:
 	PSPLOG_ERROR ("failed to initialize SDL_ttf");
 	SDL_Quit ();
-	network_deinit ();
+	platform_network_deinit ();
 	return -1;
 }
 
@@ -169,7 +102,7 @@ deinit_subsystem (void)
 {
 	TTF_Quit ();
 	SDL_Quit ();
-	network_deinit ();
+	platform_network_deinit ();
 }
 
 int
@@ -177,15 +110,16 @@ main(int argc, char *argv[])
 {
 	Drone drone;
 	int ret;
-	union SceNetApctlInfo ssid;
-	union SceNetApctlInfo gateway;
-	union SceNetApctlInfo ip;
+	PlatformNetworkInfo info;
 	UI ui;
 
-	setup_callback ();
+	platform_init (on_app_exit);
+
+	if (psplog_init (PSPLOG_CAT_INFO, LOG_PATH, PSPLOG_BINARY) < 0)
+		platform_exit ();
 
-	if (psplog_init (PSPLOG_CAT_INFO, "ms0:/PSP/GAME/pspdc/log") < 0)
-		sceKernelExitGame ();
+	/* statistics are optional, keep going without snapshots */
+	metrics_init (METRICS_PATH);
 
 	if (init_subsystem () < 0)
 		goto end;
@@ -209,20 +143,22 @@ main_menu:
 	if (ui_network_dialog_run (&ui))
 		goto main_menu;
 
-	sceNetApctlGetInfo (PSP_NET_APCTL_INFO_SSID, &ssid);
-	sceNetApctlGetInfo (PSP_NET_APCTL_INFO_GATEWAY, &gateway);
-	sceNetApctlGetInfo (PSP_NET_APCTL_INFO_IP, &ip);
+	if (platform_network_get_info (&info) < 0) {
+		PSPLOG_ERROR ("failed to get network info");
+		platform_network_disconnect ();
+		goto main_menu;
+	}
 
-	PSPLOG_INFO ("connected to %s (%s)", ssid.ssid, gateway.gateway);
-	PSPLOG_INFO ("get ip: %s", ip.ip);
+	PSPLOG_INFO ("connected to %s (%s)", info.ssid, info.gateway);
+	PSPLOG_INFO ("get ip: %s", info.ip);
 
-	if (drone_connect (&drone, gateway.gateway, DRONE_DISCOVERY_PORT,
+	if (drone_connect (&drone, info.gateway, DRONE_DISCOVERY_PORT,
 			DRONE_C2D_PORT, DRONE_D2C_PORT) < 0) {
 		ui_msg_dialog (&ui, "Failed to connect to drone.\n"
 				"Make sure the access point you selected is "
 				"the right one.\n"
 				"More info could be found in the log file.");
-		sceNetApctlDisconnect ();
+		platform_network_disconnect ();
 		goto main_menu;
 	}
 
@@ -238,16 +174,23 @@ main_menu:
 	ret = ui_flight_run (&ui, &drone);
 
 	drone_disconnect (&drone);
-	sceNetApctlDisconnect ();
+	platform_network_disconnect ();
 
 	if (ret == FLIGHT_UI_MAIN_MENU)
 		goto main_menu;
 
 end:
+	capture_stop ();
+	flightrec_stop ();
+	capture_finish (1);
+	flightrec_finish (1);
 	drone_deinit (&drone);
 	ui_deinit (&ui);
 	deinit_subsystem ();
+	metrics_deinit ();
+	/* anything left in use now is a leak */
+	memtrack_log ();
 	psplog_deinit ();
-	sceKernelExitGame ();
+	platform_exit ();
 	return 0;
 }
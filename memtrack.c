@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "memtrack.h"
+#include "metrics.h"
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_MEMTRACK
+#include "psplog.h"
+
+typedef struct _MemtrackHeader MemtrackHeader;
+
+/* put in front of each block, sized to keep malloc () alignment */
+struct _MemtrackHeader
+{
+	size_t size;
+	unsigned int tag;
+} __attribute__((aligned (16)));
+
+static const char * const memtrack_tag_names[MEMTRACK_N_TAGS] = {
+	"other",
+	"arena"
+};
+
+/* per tag then totals, updated in critical sections */
+static MemtrackStats memtrack_stats[MEMTRACK_N_TAGS + 1];
+
+static void
+memtrack_stats_add (MemtrackStats * stats, size_t size)
+{
+	stats->bytes += size;
+	stats->allocs++;
+	if (stats->bytes > stats->peak)
+		stats->peak = stats->bytes;
+}
+
+static void
+memtrack_stats_remove (MemtrackStats * stats, size_t size)
+{
+	stats->bytes -= size;
+	stats->frees++;
+}
+
+void *
+memtrack_malloc_tagged (MemtrackTag tag, size_t size)
+{
+#if MEMTRACK
+	MemtrackStats *total = &memtrack_stats[MEMTRACK_N_TAGS];
+	MemtrackHeader *header;
+	int intr;
+
+	header = malloc (sizeof (MemtrackHeader) + size);
+	if (header == NULL)
+		return NULL;
+
+	header->size = size;
+	header->tag = tag;
+
+	intr = platform_critical_enter ();
+	memtrack_stats_add (&memtrack_stats[tag], size);
+	memtrack_stats_add (total, size);
+	metrics_gauge_set (METRICS_MEM_BYTES, total->bytes);
+	metrics_gauge_set (METRICS_MEM_PEAK, total->peak);
+	platform_critical_leave (intr);
+
+	return header + 1;
+#else
+	return malloc (size);
+#endif
+}
+
+char *
+memtrack_strdup_tagged (MemtrackTag tag, const char * str)
+{
+	size_t len = strlen (str) + 1;
+	char *copy;
+
+	copy = memtrack_malloc_tagged (tag, len);
+	if (copy)
+		memcpy (copy, str, len);
+
+	return copy;
+}
+
+#if MEMTRACK
+void
+memtrack_free (void * ptr)
+{
+	MemtrackStats *total = &memtrack_stats[MEMTRACK_N_TAGS];
+	MemtrackHeader *header;
+	int intr;
+
+	if (ptr == NULL)
+		return;
+
+	header = (MemtrackHeader *) ptr - 1;
+
+	intr = platform_critical_enter ();
+	memtrack_stats_remove (&memtrack_stats[header->tag], header->size);
+	memtrack_stats_remove (total, header->size);
+	metrics_gauge_set (METRICS_MEM_BYTES, total->bytes);
+	platform_critical_leave (intr);
+
+	free (header);
+}
+#endif
+
+void
+memtrack_get (MemtrackTag tag, MemtrackStats * stats)
+{
+	int intr;
+
+	if (tag > MEMTRACK_N_TAGS) {
+		memset (stats, 0, sizeof (*stats));
+		return;
+	}
+
+	intr = platform_critical_enter ();
+	*stats = memtrack_stats[tag];
+	platform_critical_leave (intr);
+}
+
+const char *
+memtrack_tag_get_name (MemtrackTag tag)
+{
+	if (tag < MEMTRACK_N_TAGS)
+		return memtrack_tag_names[tag];
+	else
+		return "total";
+}
+
+void
+memtrack_reset_peak (void)
+{
+	int intr;
+	int i;
+
+	intr = platform_critical_enter ();
+	for (i = 0; i <= MEMTRACK_N_TAGS; i++)
+		memtrack_stats[i].peak = memtrack_stats[i].bytes;
+	metrics_gauge_set (METRICS_MEM_PEAK,
+			memtrack_stats[MEMTRACK_N_TAGS].peak);
+	platform_critical_leave (intr);
+}
+
+void
+memtrack_log (void)
+{
+	MemtrackStats stats;
+	int i;
+
+	for (i = 0; i <= MEMTRACK_N_TAGS; i++) {
+		memtrack_get (i, &stats);
+		PSPLOG_INFO ("memory %s: %u bytes in use, peak %u, "
+				"%u allocations, %u frees",
+				memtrack_tag_get_name (i),
+				(unsigned int) stats.bytes,
+				(unsigned int) stats.peak, stats.allocs,
+				stats.frees);
+	}
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Heap allocation tracking
+ *
+ * Sources define MEMTRACK_TAG before including this header and allocate
+ * with memtrack_malloc () and friends, so that bytes in use and their peak
+ * are counted per subsystem. Each block gets a small header holding its
+ * size and tag. SDL and ARSDK allocations are not seen here.
+ *
+ * Build with -DMEMTRACK=0 to get plain malloc () and free () instead.
+ */
+#ifndef MEMTRACK
+#define MEMTRACK 1
+#endif
+
+typedef enum
+{
+	MEMTRACK_TAG_OTHER = 0,
+	MEMTRACK_TAG_ARENA,
+	MEMTRACK_N_TAGS
+} MemtrackTag;
+
+#ifndef MEMTRACK_TAG
+#define MEMTRACK_TAG MEMTRACK_TAG_OTHER
+#endif
+
+typedef struct _MemtrackStats MemtrackStats;
+
+struct _MemtrackStats
+{
+	/* bytes asked by callers, headers excluded */
+	size_t bytes;
+	size_t peak;
+	unsigned int allocs;
+	unsigned int frees;
+};
+
+#if MEMTRACK
+#define memtrack_malloc(size) memtrack_malloc_tagged (MEMTRACK_TAG, (size))
+#define memtrack_strdup(str) memtrack_strdup_tagged (MEMTRACK_TAG, (str))
+#else
+#define memtrack_malloc(size) malloc (size)
+#define memtrack_strdup(str) strdup (str)
+#define memtrack_free(ptr) free (ptr)
+#endif
+
+void *memtrack_malloc_tagged (MemtrackTag tag, size_t size);
+char *memtrack_strdup_tagged (MemtrackTag tag, const char * str);
+#if MEMTRACK
+void memtrack_free (void * ptr);
+#endif
+
+/* @tag MEMTRACK_N_TAGS gives totals, peak is then the peak of the sum */
+void memtrack_get (MemtrackTag tag, MemtrackStats * stats);
+const char *memtrack_tag_get_name (MemtrackTag tag);
+
+/* peaks restart from bytes currently in use */
+void memtrack_reset_peak (void);
+
+/* log bytes still in use and peak of each tag */
+void memtrack_log (void);
+
+#endif
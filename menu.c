@@ -25,36 +25,79 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <pspctrl.h>
 #include <string.h>
 
+#include "arena.h"
 #include "color.h"
+#include "input.h"
 #include "menu.h"
+#include "metrics.h"
+#include "platform.h"
+#include "trace.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_MENU
 #include "psplog.h"
 
 #define MENU_CHOICE_CLOSE 0
 
-#define EVENT_BUTTON_DOWN(latch, button) \
-	(((latch)->uiPress & (button)) && ((latch)->uiMake & (button)))
+/* a small menu (entries, titles and items) fits in one chunk */
+#define MENU_ARENA_CHUNK_SIZE 2048
+
+/* text rendering variants, each entry is pre-rendered in both of them so
+ * that selection changes only switch the blitted surface */
+enum
+{
+	MENU_VARIANT_DEFAULT = 0,
+	MENU_VARIANT_SELECTED,
+	MENU_N_VARIANTS
+};
+
+/* glyphs shared by all entries of a menu, 0 to 9 are the digits */
+enum
+{
+	MENU_GLYPH_MINUS = 10,
+	MENU_GLYPH_SUFFIX,
+	MENU_N_GLYPHS
+};
+
+#define MENU_VALUE_SUFFIX " ->"
+#define MENU_VALUE_PREFIX_FMT "%s : <- "
 
 typedef void (*MenuEntryFreeFunction) (MenuEntry * entry);
-typedef void (*MenuEntryRenderFunction) (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color);
+typedef int (*MenuEntryRenderFunction) (MenuEntry * entry, Menu * menu);
+typedef void (*MenuEntryDrawFunction) (MenuEntry * entry, Menu * menu,
+		SDL_Surface * dest, const SDL_Rect * position, int variant);
 
 struct _MenuEntry
 {
 	MenuEntryType type;
 	Menu *owner;
 
+	/* arena of the menu entry was created for, owns entry memory */
+	Arena *arena;
+
 	int id;
 	char *title;
-	SDL_Surface *surface;
+
+	/* pre-rendered title (or value prefix), one per variant */
+	SDL_Surface *surface[MENU_N_VARIANTS];
+
+	/* size taken by entry in menu and vertical offset from menu top */
+	int width;
+	int height;
+	int y;
 
 	MenuEntry *prev;
 	MenuEntry *next;
 
+	/* free entry private data */
 	void (*free) (MenuEntry * entry);
-	int (*render) (MenuEntry * entry, TTF_Font * font, const SDL_Color * color);
+
+	/* pre-render all surfaces and compute entry size */
+	int (*render) (MenuEntry * entry, Menu * menu);
+
+	/* blit pre-rendered surfaces according to entry state */
+	void (*draw) (MenuEntry * entry, Menu * menu, SDL_Surface * dest,
+			const SDL_Rect * position, int variant);
 };
 
 struct _MenuLabelEntry
@@ -71,11 +114,11 @@ struct _MenuSwitchEntry
 {
 	MenuEntry parent;
 
-	char *on_label;
-	char *off_label;
+	const char *on_label;
+	const char *off_label;
 
-	SDL_Surface *surface_on;
-	SDL_Surface *surface_off;
+	SDL_Surface *surface_on[MENU_N_VARIANTS];
+	SDL_Surface *surface_off[MENU_N_VARIANTS];
 
 	int active;
 
@@ -102,6 +145,7 @@ struct _ComboBoxItem
 {
 	int id;
 	char *label;
+	SDL_Surface *surface[MENU_N_VARIANTS];
 	ComboBoxItem *prev;
 	ComboBoxItem *next;
 };
@@ -116,6 +160,9 @@ struct _MenuComboBoxEntry
 
 struct _Menu
 {
+	/* owns menu, entries, strings and combobox items memory */
+	Arena *arena;
+
 	TTF_Font *font;
 
 	int options;
@@ -131,6 +178,9 @@ struct _Menu
 	/* must update all texture */
 	int updated;
 
+	/* digits, minus sign and value suffix for each variant */
+	SDL_Surface *glyphs[MENU_N_VARIANTS][MENU_N_GLYPHS];
+
 	MenuEntry *head;
 	MenuEntry *tail;
 	MenuEntry *selected;
@@ -138,13 +188,22 @@ struct _Menu
 	unsigned int width;
 	unsigned int height;
 
+	/* visible window height, 0 means no limit */
+	unsigned int viewport_height;
+
+	/* current and wanted vertical scroll offset in pixels */
+	int scroll;
+	int scroll_target;
+
+	/* first entry intersecting viewport at current scroll offset */
+	MenuEntry *first_visible;
+
 	/* used to filter controller */
 	unsigned int last_ts;
 	unsigned int threshold;
 };
 
-static int menu_entry_render (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color);
+static int menu_entry_render (MenuEntry * entry, Menu * menu);
 
 static void
 menu_surface_replace_helper (SDL_Surface ** old, SDL_Surface * new)
@@ -155,54 +214,219 @@ menu_surface_replace_helper (SDL_Surface ** old, SDL_Surface * new)
 	*old = new;
 }
 
+static void
+menu_surfaces_clear_helper (SDL_Surface ** surfaces, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		menu_surface_replace_helper (&surfaces[i], NULL);
+}
+
+/* render text in all variants colors */
+static int
+menu_render_variants_helper (Menu * menu, const char * text,
+		SDL_Surface ** surfaces)
+{
+	SDL_Surface *surface;
+
+	metrics_counter_add (METRICS_MENU_TEXT_RENDERS, MENU_N_VARIANTS);
+
+	surface = TTF_RenderText_Blended (menu->font, text,
+			menu->default_color);
+	if (!surface)
+		goto failed;
+
+	menu_surface_replace_helper (&surfaces[MENU_VARIANT_DEFAULT], surface);
+
+	surface = TTF_RenderText_Blended (menu->font, text,
+			menu->selected_color);
+	if (!surface)
+		goto failed;
+
+	menu_surface_replace_helper (&surfaces[MENU_VARIANT_SELECTED], surface);
+	return 0;
+
+failed:
+	PSPLOG_ERROR ("failed to render '%s', reason: %s", text,
+			TTF_GetError ());
+	return -1;
+}
+
+/* blit surface at position and advance position after it */
+static void
+menu_blit_helper (SDL_Surface * surface, SDL_Surface * dest,
+		SDL_Rect * position)
+{
+	SDL_Rect pos = *position;
+
+	if (surface == NULL)
+		return;
+
+	SDL_BlitSurface (surface, NULL, dest, &pos);
+	position->x += surface->w;
+}
+
 /*
  * Menu helpers
  */
+static int
+menu_render_glyphs (Menu * menu)
+{
+	char text[2] = { 0, };
+	int v, i;
+
+	for (v = 0; v < MENU_N_VARIANTS; v++) {
+		const SDL_Color *color = (v == MENU_VARIANT_SELECTED) ?
+			&menu->selected_color : &menu->default_color;
+
+		for (i = 0; i < MENU_N_GLYPHS; i++) {
+			SDL_Surface *surface;
+			const char *str;
+
+			if (i < MENU_GLYPH_MINUS) {
+				text[0] = '0' + i;
+				str = text;
+			} else if (i == MENU_GLYPH_MINUS) {
+				str = "-";
+			} else {
+				str = MENU_VALUE_SUFFIX;
+			}
+
+			metrics_counter_inc (METRICS_MENU_TEXT_RENDERS);
+			surface = TTF_RenderText_Blended (menu->font, str,
+					*color);
+			if (!surface) {
+				PSPLOG_ERROR ("failed to render glyph '%s', "
+						"reason: %s", str,
+						TTF_GetError ());
+				return -1;
+			}
+
+			menu_surface_replace_helper (&menu->glyphs[v][i],
+					surface);
+		}
+	}
+
+	return 0;
+}
+
+static int
+menu_glyph_get_width (Menu * menu, int glyph)
+{
+	SDL_Surface *surface = menu->glyphs[MENU_VARIANT_DEFAULT][glyph];
+
+	return surface ? surface->w : 0;
+}
+
 static void
 menu_refresh_all_entries (Menu * menu)
 {
 	MenuEntry *e;
 
+	menu_render_glyphs (menu);
+
+	menu->width = 0;
+	menu->height = 0;
+
 	for (e = menu->head; e != NULL; e = e->next) {
-		menu_entry_render (e, menu->font, &menu->default_color);
+		menu_entry_render (e, menu);
+
+		if (((unsigned int) e->width) > menu->width)
+			menu->width = e->width;
+
+		e->y = menu->height;
+		menu->height += e->height;
 	}
 }
 
 static int
-menu_select_entry_helper (Menu * menu, MenuEntry * entry)
+menu_get_visible_height (Menu * menu)
 {
-	int ret;
+	if (menu->viewport_height && menu->height > menu->viewport_height)
+		return menu->viewport_height;
+
+	return menu->height;
+}
+
+/* update scroll target so that selected entry is fully visible */
+static void
+menu_scroll_to_selected (Menu * menu)
+{
+	MenuEntry *sel = menu->selected;
+	int visible = menu_get_visible_height (menu);
+	int max_scroll = menu->height - visible;
+
+	if (sel == NULL)
+		return;
+
+	if (sel->y < menu->scroll_target)
+		menu->scroll_target = sel->y;
+	else if (sel->y + sel->height > menu->scroll_target + visible)
+		menu->scroll_target = sel->y + sel->height - visible;
+
+	if (menu->scroll_target > max_scroll)
+		menu->scroll_target = max_scroll;
+
+	if (menu->scroll_target < 0)
+		menu->scroll_target = 0;
+}
+
+/* move scroll offset toward target and keep first visible entry in sync,
+ * the walk only goes over entries which entered or left the viewport */
+static void
+menu_scroll_step (Menu * menu)
+{
+	int delta = menu->scroll_target - menu->scroll;
+	MenuEntry *e;
 
-	/* unselect currently selected entry */
-	if (menu->selected) {
-		ret = menu_entry_render (menu->selected, menu->font,
-				&menu->default_color);
+	if (delta) {
+		/* ease out: move by a third of remaining distance */
+		int step = delta / 3;
 
-		if (ret < 0)
-			goto done;
+		if (step == 0)
+			step = delta > 0 ? 1 : -1;
+
+		menu->scroll += step;
 	}
 
-	ret = menu_entry_render (entry, menu->font, &menu->selected_color);
+	e = menu->first_visible ? menu->first_visible : menu->head;
+	if (e == NULL)
+		return;
+
+	while (e->prev && e->y > menu->scroll)
+		e = e->prev;
+
+	while (e->next && e->y + e->height <= menu->scroll)
+		e = e->next;
+
+	menu->first_visible = e;
+}
+
+static int
+menu_select_entry_helper (Menu * menu, MenuEntry * entry)
+{
+	/* all variants are pre-rendered, nothing to redraw */
 	menu->selected = entry;
+	menu_scroll_to_selected (menu);
 
-done:
-	return ret;
+	return 0;
 }
 
 static void
-menu_repeat_button_reset (Menu * menu, const SceCtrlData * pad)
+menu_repeat_button_reset (Menu * menu, unsigned int timestamp)
 {
-	menu->last_ts = pad->TimeStamp;
+	menu->last_ts = timestamp;
 	menu->threshold = 500 * 1000; /* 500 ms */
 }
 
 static int
-menu_is_button_repeated (Menu * menu, const SceCtrlData * pad, int ctrl)
+menu_is_button_repeated (Menu * menu, const PlatformPad * pad, int ctrl)
 {
-	unsigned int diff = (pad->TimeStamp - menu->last_ts);
+	unsigned int diff = (pad->timestamp - menu->last_ts);
 
-	if ((pad->Buttons & ctrl) && (diff > menu->threshold)) {
-		menu->last_ts = pad->TimeStamp;
+	if ((pad->buttons & ctrl) && (diff > menu->threshold)) {
+		menu->last_ts = pad->timestamp;
 
 		if (menu->threshold > 200 * 1000)
 			menu->threshold -= 200 * 1000; /* 200 ms */
@@ -219,12 +443,20 @@ menu_is_button_repeated (Menu * menu, const SceCtrlData * pad, int ctrl)
 Menu *
 menu_new (TTF_Font * font, int options)
 {
+	Arena *arena;
 	Menu *menu;
 
-	menu = malloc (sizeof(Menu));
-	if (!menu)
+	arena = arena_new (MENU_ARENA_CHUNK_SIZE);
+	if (!arena)
+		return NULL;
+
+	menu = arena_alloc (arena, sizeof(Menu));
+	if (!menu) {
+		arena_free (arena);
 		return NULL;
+	}
 
+	menu->arena = arena;
 	menu->options = options;
 	menu->close_result = MENU_CLOSE_RESULT_NONE;
 	menu->font = font;
@@ -236,8 +468,18 @@ menu_new (TTF_Font * font, int options)
 	menu->selected_color = color_red;
 	menu->width = 0;
 	menu->height = 0;
+	menu->viewport_height = 0;
+	menu->scroll = 0;
+	menu->scroll_target = 0;
+	menu->first_visible = NULL;
 	menu->last_ts = 0;
 	menu->threshold = 500 * 1000; /* 500 ms */
+	memset (menu->glyphs, 0, sizeof (menu->glyphs));
+
+	if (menu_render_glyphs (menu) < 0) {
+		menu_free (menu);
+		return NULL;
+	}
 
 	return menu;
 }
@@ -246,9 +488,16 @@ void
 menu_free (Menu * menu)
 {
 	MenuEntry *e;
+	int v;
 
 	for (e = menu->head; e != NULL; e = e->next)
 		menu_entry_free (e);
+
+	for (v = 0; v < MENU_N_VARIANTS; v++)
+		menu_surfaces_clear_helper (menu->glyphs[v], MENU_N_GLYPHS);
+
+	/* release menu itself together with entries, strings and items */
+	arena_free (menu->arena);
 }
 
 void
@@ -274,7 +523,14 @@ menu_get_width (Menu * menu)
 int
 menu_get_height (Menu * menu)
 {
-	return menu->height;
+	return menu_get_visible_height (menu);
+}
+
+void
+menu_set_viewport_height (Menu * menu, int height)
+{
+	menu->viewport_height = height > 0 ? height : 0;
+	menu_scroll_to_selected (menu);
 }
 
 int
@@ -293,43 +549,32 @@ menu_get_close_result (Menu * menu)
 }
 
 MenuState
-menu_update (Menu * menu)
+menu_handle_press (Menu * menu, unsigned int button, unsigned int timestamp)
 {
-	MenuState state = MENU_STATE_VISIBLE;
 	MenuEntry *entry;
-	SceCtrlData pad;
-	SceCtrlLatch latch;
 
 	menu->close_result = MENU_CLOSE_RESULT_NONE;
 
-	sceCtrlReadBufferPositive (&pad, 1);
-	sceCtrlReadLatch (&latch);
-
-	if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_UP))
+	if (button == PLATFORM_BUTTON_UP)
 		menu_select_prev_entry (menu);
 
-	if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_DOWN))
+	if (button == PLATFORM_BUTTON_DOWN)
 		menu_select_next_entry (menu);
 
 	entry = menu->selected;
 
-	switch (entry->type) {
+	switch (entry ? entry->type : MENU_ENTRY_TYPE_BASE) {
 		case MENU_ENTRY_TYPE_BUTTON:
-			if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_CROSS)) {
-				state = MENU_STATE_CLOSE;
+			if (button == PLATFORM_BUTTON_CROSS) {
 				menu->close_result = MENU_CLOSE_RESULT_BUTTON;
+				return MENU_STATE_CLOSE;
 			}
 			break;
 
 		case MENU_ENTRY_TYPE_SWITCH:
-			if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_LEFT) ||
-					EVENT_BUTTON_DOWN (&latch, PSP_CTRL_RIGHT)) {
+			if (button == PLATFORM_BUTTON_LEFT ||
+					button == PLATFORM_BUTTON_RIGHT)
 				menu_switch_entry_toggle ((MenuSwitchEntry *) entry);
-
-				/* re-render to reflect change */
-				menu_entry_render (entry, menu->font,
-						&menu->selected_color);
-			}
 			break;
 
 		case MENU_ENTRY_TYPE_SCALE:
@@ -337,34 +582,21 @@ menu_update (Menu * menu)
 			MenuScaleEntry *scale = (MenuScaleEntry *) entry;
 			int val = menu_scale_entry_get_value (scale);
 
-			if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_LEFT)) {
-				menu_scale_entry_set_value (scale, val - 1);
-				menu_repeat_button_reset (menu, &pad);
-			} else if (menu_is_button_repeated (menu, &pad,
-						PSP_CTRL_LEFT)) {
+			if (button == PLATFORM_BUTTON_LEFT) {
 				menu_scale_entry_set_value (scale, val - 1);
-			} else if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_RIGHT)) {
-				menu_scale_entry_set_value (scale, val + 1);
-				menu_repeat_button_reset (menu, &pad);
-			} else if (menu_is_button_repeated (menu, &pad,
-						PSP_CTRL_RIGHT)) {
+				menu_repeat_button_reset (menu, timestamp);
+			} else if (button == PLATFORM_BUTTON_RIGHT) {
 				menu_scale_entry_set_value (scale, val + 1);
+				menu_repeat_button_reset (menu, timestamp);
 			}
-
-			menu_entry_render (entry, menu->font,
-					&menu->selected_color);
-
 			break;
 		}
 
 		case MENU_ENTRY_TYPE_COMBOBOX:
-			if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_LEFT))
+			if (button == PLATFORM_BUTTON_LEFT)
 				menu_combo_box_entry_prev ((MenuComboBoxEntry *) entry);
-			else if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_RIGHT))
+			else if (button == PLATFORM_BUTTON_RIGHT)
 				menu_combo_box_entry_next ((MenuComboBoxEntry *) entry);
-
-			menu_entry_render (entry, menu->font,
-					&menu->selected_color);
 			break;
 
 
@@ -375,43 +607,120 @@ menu_update (Menu * menu)
 	}
 
 	if ((menu->options & MENU_CANCEL_ON_START) &&
-			EVENT_BUTTON_DOWN (&latch, PSP_CTRL_START))
-		state = MENU_STATE_CANCELLED;
+			button == PLATFORM_BUTTON_START)
+		return MENU_STATE_CANCELLED;
+
 	if ((menu->options & MENU_BACK_ON_CIRCLE) &&
-			EVENT_BUTTON_DOWN (&latch, PSP_CTRL_CIRCLE)) {
-		state = MENU_STATE_CLOSE;
+			button == PLATFORM_BUTTON_CIRCLE) {
+		menu->close_result = MENU_CLOSE_RESULT_BACK;
+		return MENU_STATE_CLOSE;
+	}
+
+	if ((menu->options & MENU_BACK_ON_SQUARE) &&
+			button == PLATFORM_BUTTON_SQUARE) {
 		menu->close_result = MENU_CLOSE_RESULT_BACK;
+		return MENU_STATE_CLOSE;
+	}
+
+	return MENU_STATE_VISIBLE;
+}
+
+MenuState
+menu_update (Menu * menu)
+{
+	MenuState state = MENU_STATE_VISIBLE;
+	InputEvent event;
+	PlatformPad pad;
+
+	menu->close_result = MENU_CLOSE_RESULT_NONE;
+
+	/* stop consuming events once closed, following ones belong to
+	 * whatever is shown next */
+	while (state == MENU_STATE_VISIBLE && input_poll_event (&event)) {
+		if (event.type == INPUT_EVENT_PRESS)
+			state = menu_handle_press (menu, event.button,
+					event.timestamp);
 	}
 
+	if (state != MENU_STATE_VISIBLE)
+		return state;
+
+	input_get_state (&pad);
+	menu_handle_held (menu, &pad);
+
 	return state;
 }
 
+void
+menu_handle_held (Menu * menu, const PlatformPad * pad)
+{
+	/* auto repeat on held buttons */
+	if (menu->selected && menu->selected->type == MENU_ENTRY_TYPE_SCALE) {
+		MenuScaleEntry *scale = (MenuScaleEntry *) menu->selected;
+		int val = menu_scale_entry_get_value (scale);
+
+		if (menu_is_button_repeated (menu, pad, PLATFORM_BUTTON_LEFT))
+			menu_scale_entry_set_value (scale, val - 1);
+		else if (menu_is_button_repeated (menu, pad,
+					PLATFORM_BUTTON_RIGHT))
+			menu_scale_entry_set_value (scale, val + 1);
+	}
+}
+
 void
 menu_render_to (Menu * menu, SDL_Surface * dest, const SDL_Rect * position)
 {
 	MenuEntry *e;
 	SDL_Rect dest_pos = { 0, 0, 0, 0 };
+	SDL_Rect clip;
+	SDL_Rect old_clip;
+	unsigned int start = platform_get_time ();
+	int visible;
 
-	dest_pos.x = position->x;
-	dest_pos.y = position->y;
+	trace_begin ("menu_render");
 
 	if (menu->updated) {
 		menu_refresh_all_entries (menu);
+		menu_scroll_to_selected (menu);
 		menu->updated = 0;
 	}
 
-	for (e = menu->head; e != NULL; e = e->next) {
-		if (e->surface == NULL)
-			continue;
+	menu_scroll_step (menu);
+	visible = menu_get_visible_height (menu);
 
-		PSPLOG_DEBUG ("menu: blitting entry %p surface (%s) @ (%d,%d)",
-				e, e->title, dest_pos.x, dest_pos.y);
+	/* partially visible entries are cut at viewport edges */
+	clip.x = position->x;
+	clip.y = position->y;
+	clip.w = menu->width;
+	clip.h = visible;
+	SDL_GetClipRect (dest, &old_clip);
+	SDL_SetClipRect (dest, &clip);
 
-		SDL_BlitSurface (e->surface, NULL, dest, &dest_pos);
+	dest_pos.x = position->x;
+
+	/* only walk entries inside the viewport */
+	for (e = menu->first_visible; e != NULL; e = e->next) {
+		int variant = (e == menu->selected) ?
+			MENU_VARIANT_SELECTED : MENU_VARIANT_DEFAULT;
+
+		if (e->y >= menu->scroll + visible)
+			break;
 
-		/* update position for next entry */
-		dest_pos.y += dest_pos.h;
+		dest_pos.y = position->y + e->y - menu->scroll;
+
+		PSPLOG_TRACE ("menu: blitting entry %p surface (%s) @ (%d,%d)",
+				e, e->title, dest_pos.x, dest_pos.y);
+
+		if (e->draw)
+			e->draw (e, menu, dest, &dest_pos, variant);
 	}
+
+	SDL_SetClipRect (dest, &old_clip);
+
+	/* menus are rendered from ui thread only */
+	metrics_histogram_record (METRICS_MENU_RENDER_TIME,
+			platform_get_time () - start);
+	trace_end ("menu_render");
 }
 
 int
@@ -450,21 +759,14 @@ menu_select_next_entry (Menu * menu)
 int
 menu_add_entry (Menu * menu, MenuEntry * entry)
 {
-	SDL_Color *color;
-
-	/* first entry will be selected by default */
-	if (menu->head == NULL)
-		color = &menu->selected_color;
-	else
-		color = &menu->default_color;
-
-	if (menu_entry_render (entry, menu->font, color) < 0)
+	if (menu_entry_render (entry, menu) < 0)
 		goto render_failed;
 
-	if (((unsigned int) entry->surface->w) > menu->width)
-		menu->width = entry->surface->w;
+	if (((unsigned int) entry->width) > menu->width)
+		menu->width = entry->width;
 
-	menu->height += entry->surface->h;
+	entry->y = menu->height;
+	menu->height += entry->height;
 
 	/* add it to menu */
 	if (menu->tail) {
@@ -476,6 +778,7 @@ menu_add_entry (Menu * menu, MenuEntry * entry)
 		/* first entry, also make it selected */
 		menu->head = menu->tail = entry;
 		menu->selected = entry;
+		menu->first_visible = entry;
 	}
 
 	entry->owner = menu;
@@ -490,9 +793,18 @@ render_failed:
 void
 menu_remove_entry (Menu * menu, MenuEntry * entry)
 {
+	MenuEntry *e;
+
 	if (entry->owner != menu)
 		return;
 
+	/* following entries move up */
+	for (e = entry->next; e != NULL; e = e->next)
+		e->y -= entry->height;
+
+	if (menu->first_visible == entry)
+		menu->first_visible = entry->next ? entry->next : entry->prev;
+
 	if (entry->prev)
 		entry->prev->next = entry->next;
 
@@ -508,6 +820,9 @@ menu_remove_entry (Menu * menu, MenuEntry * entry)
 	if (menu->selected == entry)
 		menu->selected = menu->head;
 
+	menu->height -= entry->height;
+	menu_scroll_to_selected (menu);
+
 	menu_entry_free(entry);
 }
 
@@ -515,40 +830,100 @@ menu_remove_entry (Menu * menu, MenuEntry * entry)
  * MenuEntry implementation
  */
 static int
-menu_entry_render_default (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color)
+menu_entry_render_default (MenuEntry * entry, Menu * menu)
 {
-	SDL_Surface *surface;
+	if (menu_render_variants_helper (menu, entry->title,
+				entry->surface) < 0)
+		return -1;
 
-	surface = TTF_RenderText_Blended (font, entry->title, *color);
-	if (!surface)
+	entry->width = entry->surface[MENU_VARIANT_DEFAULT]->w;
+	entry->height = entry->surface[MENU_VARIANT_DEFAULT]->h;
+	return 0;
+}
+
+static void
+menu_entry_draw_default (MenuEntry * entry, Menu * menu, SDL_Surface * dest,
+		const SDL_Rect * position, int variant)
+{
+	SDL_Rect pos = *position;
+
+	menu_blit_helper (entry->surface[variant], dest, &pos);
+}
+
+/* render the "title : <- " prefix shared by all value entries */
+static int
+menu_entry_render_value_prefix (MenuEntry * entry, Menu * menu)
+{
+	char text[256];
+
+	snprintf (text, sizeof (text), MENU_VALUE_PREFIX_FMT, entry->title);
+
+	if (menu_render_variants_helper (menu, text, entry->surface) < 0)
 		return -1;
 
-	menu_surface_replace_helper (&entry->surface, surface);
+	entry->height = entry->surface[MENU_VARIANT_DEFAULT]->h;
 	return 0;
 }
 
+/* compute value entry width from its widest value */
 static void
-menu_entry_init (MenuEntry * entry, MenuEntryType type, int id,
+menu_entry_set_value_width (MenuEntry * entry, Menu * menu,
+		int value_width)
+{
+	entry->width = entry->surface[MENU_VARIANT_DEFAULT]->w + value_width +
+		menu_glyph_get_width (menu, MENU_GLYPH_SUFFIX);
+}
+
+/* blit "title : <- value ->" from prefix, value and suffix surfaces */
+static void
+menu_entry_draw_value (MenuEntry * entry, Menu * menu, SDL_Surface * dest,
+		const SDL_Rect * position, int variant, SDL_Surface * value)
+{
+	SDL_Rect pos = *position;
+
+	menu_blit_helper (entry->surface[variant], dest, &pos);
+	menu_blit_helper (value, dest, &pos);
+	menu_blit_helper (menu->glyphs[variant][MENU_GLYPH_SUFFIX], dest, &pos);
+}
+
+static MenuEntry *
+menu_entry_new (Menu * menu, size_t size, MenuEntryType type, int id,
 		const char * title, MenuEntryFreeFunction free)
 {
+	MenuEntry *entry;
+
+	entry = arena_alloc (menu->arena, size);
+	if (!entry)
+		return NULL;
+
+	entry->title = arena_strdup (menu->arena, title);
+	if (!entry->title)
+		return NULL;
+
 	entry->type = type;
 	entry->owner = NULL;
+	entry->arena = menu->arena;
 	entry->id = id;
-	entry->title = strdup(title);
-	entry->surface = NULL;
+	entry->surface[MENU_VARIANT_DEFAULT] = NULL;
+	entry->surface[MENU_VARIANT_SELECTED] = NULL;
+	entry->width = 0;
+	entry->height = 0;
+	entry->y = 0;
 	entry->prev = entry->next = NULL;
 	entry->free = free;
 	entry->render = menu_entry_render_default;
+	entry->draw = menu_entry_draw_default;
+
+	return entry;
 }
 
 static int
-menu_entry_render(MenuEntry * entry, TTF_Font * font, const SDL_Color * color)
+menu_entry_render(MenuEntry * entry, Menu * menu)
 {
 	if (!entry->render)
 		return -1;
 
-	return entry->render (entry, font, color);
+	return entry->render (entry, menu);
 }
 
 void
@@ -557,13 +932,8 @@ menu_entry_free (MenuEntry * entry)
 	if (entry->free)
 		entry->free (entry);
 
-	if (entry->surface)
-		SDL_FreeSurface (entry->surface);
-
-	if (entry->title)
-		free (entry->title);
-
-	free (entry);
+	/* memory itself is owned by menu arena and released with it */
+	menu_surfaces_clear_helper (entry->surface, MENU_N_VARIANTS);
 }
 
 MenuEntryType
@@ -576,106 +946,92 @@ menu_entry_get_type (MenuEntry * entry)
  * MenuLabelEntry API implementation
  */
 MenuLabelEntry *
-menu_label_entry_new (int id, const char * label)
+menu_label_entry_new (Menu * menu, int id, const char * label)
 {
-	MenuLabelEntry *entry;
-
-	entry = malloc(sizeof(MenuButtonEntry));
-	if (!entry)
-		return NULL;
-
-	menu_entry_init (&entry->parent, MENU_ENTRY_TYPE_LABEL, id, label,
-			NULL);
-
-	return entry;
+	return (MenuLabelEntry *) menu_entry_new (menu,
+			sizeof (MenuLabelEntry), MENU_ENTRY_TYPE_LABEL, id,
+			label, NULL);
 }
 
 /**
  * MenuButtonEntry API implementation
  */
 MenuButtonEntry *
-menu_button_entry_new (int id, const char * title)
+menu_button_entry_new (Menu * menu, int id, const char * title)
 {
-	MenuButtonEntry *entry;
-
-	entry = malloc(sizeof(MenuButtonEntry));
-	if (!entry)
-		return NULL;
-
-	menu_entry_init (&entry->parent, MENU_ENTRY_TYPE_BUTTON, id, title,
-			NULL);
-
-	return entry;
+	return (MenuButtonEntry *) menu_entry_new (menu,
+			sizeof (MenuButtonEntry), MENU_ENTRY_TYPE_BUTTON, id,
+			title, NULL);
 }
 
 /**
  * MenuSwitchEntry API implementation
  */
 static int
-menu_switch_entry_render (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color)
+menu_switch_entry_render (MenuEntry * entry, Menu * menu)
 {
 	MenuSwitchEntry *sw_entry = (MenuSwitchEntry *) entry;
-	SDL_Surface *surface;
-	const char *value_str;
-	char *text;
-	int len;
-	int ret = -1;
+	int on_w, off_w;
 
-	if (sw_entry->active)
-		value_str = sw_entry->on_label;
-	else
-		value_str = sw_entry->off_label;
+	if (menu_entry_render_value_prefix (entry, menu) < 0)
+		return -1;
 
-	len = 10 + strlen (entry->title) + strlen (value_str);
-	text = malloc (len * sizeof(char));
-	snprintf (text, len, "%s : <- %s ->", entry->title, value_str);
+	if (menu_render_variants_helper (menu, sw_entry->on_label,
+				sw_entry->surface_on) < 0)
+		return -1;
 
-	surface = TTF_RenderText_Blended (font, text, *color);
-	if (!surface) {
-		PSPLOG_ERROR ("failed to render switch text, reason: %s",
-				TTF_GetError ());
-		goto done;
-	}
+	if (menu_render_variants_helper (menu, sw_entry->off_label,
+				sw_entry->surface_off) < 0)
+		return -1;
 
-	menu_surface_replace_helper (&entry->surface, surface);
-	ret = 0;
+	on_w = sw_entry->surface_on[MENU_VARIANT_DEFAULT]->w;
+	off_w = sw_entry->surface_off[MENU_VARIANT_DEFAULT]->w;
+	menu_entry_set_value_width (entry, menu, on_w > off_w ? on_w : off_w);
 
-done:
-	free (text);
-	return ret;
+	return 0;
 }
 
 static void
-menu_switch_entry_free (MenuSwitchEntry * entry)
+menu_switch_entry_draw (MenuEntry * entry, Menu * menu, SDL_Surface * dest,
+		const SDL_Rect * position, int variant)
 {
-	if (entry->surface_off)
-		SDL_FreeSurface (entry->surface_off);
+	MenuSwitchEntry *sw_entry = (MenuSwitchEntry *) entry;
 
-	if (entry->surface_on)
-		SDL_FreeSurface (entry->surface_on);
+	menu_entry_draw_value (entry, menu, dest, position, variant,
+			sw_entry->active ? sw_entry->surface_on[variant] :
+			sw_entry->surface_off[variant]);
+}
 
-	free (entry->on_label);
-	free (entry->off_label);
+static void
+menu_switch_entry_free (MenuSwitchEntry * entry)
+{
+	menu_surfaces_clear_helper (entry->surface_off, MENU_N_VARIANTS);
+	menu_surfaces_clear_helper (entry->surface_on, MENU_N_VARIANTS);
 }
 
 MenuSwitchEntry *
-menu_switch_entry_new (int id, const char *title)
+menu_switch_entry_new (Menu * menu, int id, const char *title)
 {
 	MenuSwitchEntry *entry;
 
-	entry = malloc (sizeof(MenuSwitchEntry));
+	entry = (MenuSwitchEntry *) menu_entry_new (menu,
+			sizeof (MenuSwitchEntry), MENU_ENTRY_TYPE_SWITCH, id,
+			title, (MenuEntryFreeFunction) menu_switch_entry_free);
+	if (!entry)
+		return NULL;
 
-	menu_entry_init (&entry->parent, MENU_ENTRY_TYPE_SWITCH, id, title,
-			(MenuEntryFreeFunction) menu_switch_entry_free);
-	entry->on_label = strdup("on");
-	entry->off_label = strdup("off");
-	entry->surface_on = NULL;
-	entry->surface_off = NULL;
+	/* default labels are static, custom ones are copied in arena */
+	entry->on_label = "on";
+	entry->off_label = "off";
+	entry->surface_on[MENU_VARIANT_DEFAULT] = NULL;
+	entry->surface_on[MENU_VARIANT_SELECTED] = NULL;
+	entry->surface_off[MENU_VARIANT_DEFAULT] = NULL;
+	entry->surface_off[MENU_VARIANT_SELECTED] = NULL;
 	entry->active = 0;
 	entry->toggled = NULL;
 
 	entry->parent.render = menu_switch_entry_render;
+	entry->parent.draw = menu_switch_entry_draw;
 
 	return entry;
 }
@@ -707,15 +1063,25 @@ void
 menu_switch_entry_set_values_labels (MenuSwitchEntry * entry,
 		const char * off_label, const char * on_label)
 {
+	Arena *arena = entry->parent.arena;
+	const char *label;
+
+	/* previous labels are released with the arena */
 	if (off_label) {
-		free (entry->off_label);
-		entry->off_label = strdup (off_label);
+		label = arena_strdup (arena, off_label);
+		if (label)
+			entry->off_label = label;
 	}
 
 	if (on_label) {
-		free (entry->on_label);
-		entry->on_label = strdup (on_label);
+		label = arena_strdup (arena, on_label);
+		if (label)
+			entry->on_label = label;
 	}
+
+	/* labels surfaces must be rendered again */
+	if (entry->parent.owner)
+		entry->parent.owner->updated = 1;
 }
 
 void
@@ -730,45 +1096,86 @@ menu_switch_entry_set_toggled_callback (MenuSwitchEntry * entry,
  * MenuScaleEntry API implementation
  */
 static int
-menu_scale_entry_render (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color)
+menu_scale_entry_render (MenuEntry * entry, Menu * menu)
 {
 	MenuScaleEntry *scale_entry = (MenuScaleEntry *) entry;
-	SDL_Surface *surface;
-	char *text;
-	int len = 255;
-	int ret = -1;
-
-	text = malloc (len * sizeof(char));
-	snprintf (text, len, "%s : <- %d ->", entry->title,
-			scale_entry->current);
-
-	surface = TTF_RenderText_Blended (font, text, *color);
-	if (!surface) {
-		PSPLOG_ERROR ("failed to render scale button, reason: %s",
-				TTF_GetError ());
-		goto done;
+	int digit_w = 0;
+	int value_w = 0;
+	int max_abs;
+	int i;
+
+	if (menu_entry_render_value_prefix (entry, menu) < 0)
+		return -1;
+
+	/* reserve room for the widest possible value */
+	for (i = 0; i < MENU_GLYPH_MINUS; i++) {
+		if (menu_glyph_get_width (menu, i) > digit_w)
+			digit_w = menu_glyph_get_width (menu, i);
 	}
 
-	menu_surface_replace_helper (&entry->surface, surface);
-	ret = 0;
+	max_abs = abs (scale_entry->min) > abs (scale_entry->max) ?
+		abs (scale_entry->min) : abs (scale_entry->max);
 
-done:
-	free (text);
-	return ret;
+	do {
+		value_w += digit_w;
+		max_abs /= 10;
+	} while (max_abs);
+
+	if (scale_entry->min < 0)
+		value_w += menu_glyph_get_width (menu, MENU_GLYPH_MINUS);
+
+	menu_entry_set_value_width (entry, menu, value_w);
+
+	return 0;
+}
+
+/* composite value from cached digits glyphs */
+static void
+menu_scale_entry_draw (MenuEntry * entry, Menu * menu, SDL_Surface * dest,
+		const SDL_Rect * position, int variant)
+{
+	MenuScaleEntry *scale_entry = (MenuScaleEntry *) entry;
+	SDL_Surface **glyphs = menu->glyphs[variant];
+	SDL_Rect pos = *position;
+	int digits[12];
+	int n_digits = 0;
+	unsigned int value;
+
+	if (scale_entry->current < 0)
+		value = -(unsigned int) scale_entry->current;
+	else
+		value = scale_entry->current;
+
+	do {
+		digits[n_digits++] = value % 10;
+		value /= 10;
+	} while (value);
+
+	menu_blit_helper (entry->surface[variant], dest, &pos);
+
+	if (scale_entry->current < 0)
+		menu_blit_helper (glyphs[MENU_GLYPH_MINUS], dest, &pos);
+
+	while (n_digits--)
+		menu_blit_helper (glyphs[digits[n_digits]], dest, &pos);
+
+	menu_blit_helper (glyphs[MENU_GLYPH_SUFFIX], dest, &pos);
 }
 
 MenuScaleEntry *
-menu_scale_entry_new (int id, const char *title, int min, int max)
+menu_scale_entry_new (Menu * menu, int id, const char *title, int min,
+		int max)
 {
 	MenuScaleEntry *entry;
 
 	if (max < min)
 		return NULL;
 
-	entry = malloc (sizeof (MenuScaleEntry));
-
-	menu_entry_init (&entry->parent, MENU_ENTRY_TYPE_SCALE, id, title, NULL);
+	entry = (MenuScaleEntry *) menu_entry_new (menu,
+			sizeof (MenuScaleEntry), MENU_ENTRY_TYPE_SCALE, id,
+			title, NULL);
+	if (!entry)
+		return NULL;
 
 	entry->min = min;
 	entry->max = max;
@@ -778,6 +1185,7 @@ menu_scale_entry_new (int id, const char *title, int min, int max)
 	entry->value_changed = NULL;
 
 	entry->parent.render = menu_scale_entry_render;
+	entry->parent.draw = menu_scale_entry_draw;
 
 	return entry;
 }
@@ -817,8 +1225,7 @@ menu_scale_entry_set_value_changed_callback (MenuScaleEntry * entry,
 static void
 combo_box_item_free (ComboBoxItem * item)
 {
-	free (item->label);
-	free (item);
+	menu_surfaces_clear_helper (item->surface, MENU_N_VARIANTS);
 }
 
 static void
@@ -836,49 +1243,56 @@ menu_combo_box_entry_free (MenuEntry * entry)
 }
 
 static int
-menu_combo_box_entry_render (MenuEntry * entry, TTF_Font * font,
-		const SDL_Color * color)
+menu_combo_box_entry_render (MenuEntry * entry, Menu * menu)
 {
 	MenuComboBoxEntry *combo_entry = (MenuComboBoxEntry *) entry;
-	ComboBoxItem *item = combo_entry->current;
-	SDL_Surface *surface;
-	char *text;
-	int len = 255;
-	int ret = -1;
-
-	text = malloc (len * sizeof(char));
-	snprintf (text, len, "%s : <- %s ->", entry->title,
-			item != NULL ? item->label : "(null)");
-
-	surface = TTF_RenderText_Blended (font, text, *color);
-	if (!surface) {
-		PSPLOG_ERROR ("failed to render combo box, reason: %s",
-				TTF_GetError ());
-		goto done;
+	ComboBoxItem *item;
+	int value_w = 0;
+
+	if (menu_entry_render_value_prefix (entry, menu) < 0)
+		return -1;
+
+	for (item = combo_entry->items; item != NULL; item = item->next) {
+		if (menu_render_variants_helper (menu, item->label,
+					item->surface) < 0)
+			return -1;
+
+		if (item->surface[MENU_VARIANT_DEFAULT]->w > value_w)
+			value_w = item->surface[MENU_VARIANT_DEFAULT]->w;
 	}
 
-	menu_surface_replace_helper (&entry->surface, surface);
-	ret = 0;
+	menu_entry_set_value_width (entry, menu, value_w);
 
-done:
-	free (text);
-	return ret;
+	return 0;
+}
+
+static void
+menu_combo_box_entry_draw (MenuEntry * entry, Menu * menu,
+		SDL_Surface * dest, const SDL_Rect * position, int variant)
+{
+	MenuComboBoxEntry *combo_entry = (MenuComboBoxEntry *) entry;
+	ComboBoxItem *item = combo_entry->current;
+
+	menu_entry_draw_value (entry, menu, dest, position, variant,
+			item != NULL ? item->surface[variant] : NULL);
 }
 
 MenuComboBoxEntry *
-menu_combo_box_entry_new (int id, const char *title)
+menu_combo_box_entry_new (Menu * menu, int id, const char *title)
 {
 	MenuComboBoxEntry *entry;
 
-	entry = malloc (sizeof (MenuComboBoxEntry));
-
-	menu_entry_init (&entry->parent, MENU_ENTRY_TYPE_COMBOBOX, id, title,
-			menu_combo_box_entry_free);
+	entry = (MenuComboBoxEntry *) menu_entry_new (menu,
+			sizeof (MenuComboBoxEntry), MENU_ENTRY_TYPE_COMBOBOX, id,
+			title, menu_combo_box_entry_free);
+	if (!entry)
+		return NULL;
 
 	entry->items = NULL;
 	entry->current = NULL;
 
 	entry->parent.render = menu_combo_box_entry_render;
+	entry->parent.draw = menu_combo_box_entry_draw;
 
 	return entry;
 }
@@ -915,11 +1329,23 @@ menu_combo_box_entry_append (MenuComboBoxEntry * entry, int id,
 	ComboBoxItem *item;
 	ComboBoxItem *cur = entry->items;
 
-	item = malloc (sizeof (*item));
+	item = arena_alloc (entry->parent.arena, sizeof (*item));
+	if (!item)
+		return -1;
+
+	item->label = arena_strdup (entry->parent.arena, label);
+	if (!item->label)
+		return -1;
+
 	item->id = id;
-	item->label = strdup (label);
+	item->surface[MENU_VARIANT_DEFAULT] = NULL;
+	item->surface[MENU_VARIANT_SELECTED] = NULL;
 	item->prev = item->next = NULL;
 
+	/* new item surfaces must be rendered */
+	if (entry->parent.owner)
+		entry->parent.owner->updated = 1;
+
 	if (cur == NULL) {
 		/* no item in combo yet */
 		entry->items = item;
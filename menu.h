@@ -31,8 +31,11 @@
 #include <SDL/SDL.h>
 #include <SDL/SDL_ttf.h>
 
+#include "platform.h"
+
 #define MENU_CANCEL_ON_START 1
 #define MENU_BACK_ON_CIRCLE  1 << 1
+#define MENU_BACK_ON_SQUARE  1 << 2
 
 typedef enum
 {
@@ -69,6 +72,8 @@ typedef struct _MenuComboBoxEntry MenuComboBoxEntry;
 typedef void (*MenuSwitchEntryToggledCallback)(MenuSwitchEntry * entry, void * userdata);
 typedef void (*MenuScaleEntryValueChangedCallback)(MenuScaleEntry * entry, void * userdata);
 
+/* entries are allocated from the menu they are created for and released
+ * all at once by menu_free () */
 Menu *menu_new (TTF_Font * font, int options);
 void menu_free (Menu * menu);
 
@@ -77,6 +82,10 @@ void menu_set_selected_color (Menu * menu, const SDL_Color * color);
 
 int menu_get_width (Menu * menu);
 int menu_get_height (Menu * menu);
+
+/* limit visible height, entries outside are scrolled into view when
+ * selected. 0 disables the limit */
+void menu_set_viewport_height (Menu * menu, int height);
 int menu_get_selected_id (Menu * menu);
 int menu_get_close_result (Menu * menu);
 
@@ -87,7 +96,16 @@ int menu_select_entry (Menu * menu, MenuEntry * entry);
 int menu_select_prev_entry (Menu * menu);
 int menu_select_next_entry (Menu * menu);
 
+/* consume pending input events and handle held buttons */
 MenuState menu_update (Menu * menu);
+
+/* for callers owning the input loop: feed a button press event, return
+ * new menu state */
+MenuState menu_handle_press (Menu * menu, unsigned int button,
+		unsigned int timestamp);
+
+/* for callers owning the input loop: handle held buttons auto repeat */
+void menu_handle_held (Menu * menu, const PlatformPad * pad);
 void menu_render_to (Menu * menu, SDL_Surface * dest, const SDL_Rect * position);
 
 /* MenuEntry API */
@@ -95,13 +113,16 @@ void menu_entry_free (MenuEntry * entry);
 MenuEntryType menu_entry_get_type (MenuEntry * entry);
 
 /* MenuLabelEntry API */
-MenuLabelEntry *menu_label_entry_new (int id, const char * label);
+MenuLabelEntry *menu_label_entry_new (Menu * menu, int id,
+		const char * label);
 
 /* MenuButtonEntry API */
-MenuButtonEntry *menu_button_entry_new (int id, const char * title);
+MenuButtonEntry *menu_button_entry_new (Menu * menu, int id,
+		const char * title);
 
 /* MenuSwitchEntry API */
-MenuSwitchEntry *menu_switch_entry_new (int id, const char * title);
+MenuSwitchEntry *menu_switch_entry_new (Menu * menu, int id,
+		const char * title);
 int menu_switch_entry_get_active (MenuSwitchEntry * entry);
 void menu_switch_entry_set_active (MenuSwitchEntry * entry, int is_active);
 void menu_switch_entry_toggle (MenuSwitchEntry * entry);
@@ -111,15 +132,16 @@ void menu_switch_entry_set_toggled_callback (MenuSwitchEntry * entry,
 		MenuSwitchEntryToggledCallback callback, void * userdata);
 
 /* MenuScaleEntry API */
-MenuScaleEntry *menu_scale_entry_new (int id, const char * title, int min,
-		int max);
+MenuScaleEntry *menu_scale_entry_new (Menu * menu, int id,
+		const char * title, int min, int max);
 int menu_scale_entry_get_value (MenuScaleEntry * entry);
 void menu_scale_entry_set_value (MenuScaleEntry * entry, int value);
 void menu_scale_entry_set_value_changed_callback (MenuScaleEntry * entry,
 		MenuScaleEntryValueChangedCallback callback, void * userdata);
 
 /* MenuComboBoxEntry API */
-MenuComboBoxEntry *menu_combo_box_entry_new (int id, const char * title);
+MenuComboBoxEntry *menu_combo_box_entry_new (Menu * menu, int id,
+		const char * title);
 int menu_combo_box_entry_append (MenuComboBoxEntry * entry, int id,
 		const char * label);
 int menu_combo_box_entry_get_value (MenuComboBoxEntry * entry);
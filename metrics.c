@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_METRICS
+#include "psplog.h"
+
+/* snapshot thread runs rarely and writes one line per period */
+#define METRICS_SNAPSHOT_PERIOD 5000000 /* us */
+#define METRICS_SNAPSHOT_PRIORITY 0x30
+#define METRICS_SNAPSHOT_STACK_SIZE 0x1000
+#define METRICS_SNAPSHOT_LINE_LEN 1024
+#define METRICS_FORMAT_LEN 64
+
+typedef struct _MetricsDesc MetricsDesc;
+
+struct _MetricsDesc
+{
+	const char *name;
+	MetricsType type;
+};
+
+/* indexed by MetricsId, names are kept short for snapshot and stats page */
+static const MetricsDesc metrics_desc[METRICS_N] = {
+	{ "evt_pkts", METRICS_TYPE_COUNTER },
+	{ "nav_pkts", METRICS_TYPE_COUNTER },
+	{ "read_err", METRICS_TYPE_COUNTER },
+	{ "decode_err", METRICS_TYPE_COUNTER },
+	{ "cmd_sent", METRICS_TYPE_COUNTER },
+	{ "cmd_timeout", METRICS_TYPE_COUNTER },
+	{ "pcmd", METRICS_TYPE_COUNTER },
+	{ "frames", METRICS_TYPE_COUNTER },
+	{ "frame_us", METRICS_TYPE_HISTOGRAM },
+	{ "input_evts", METRICS_TYPE_COUNTER },
+	{ "notifs", METRICS_TYPE_GAUGE },
+	{ "menu_renders", METRICS_TYPE_COUNTER },
+	{ "menu_us", METRICS_TYPE_HISTOGRAM },
+	{ "log_records", METRICS_TYPE_COUNTER },
+	{ "log_dropped", METRICS_TYPE_COUNTER },
+	{ "log_suppr", METRICS_TYPE_COUNTER },
+	{ "log_ring", METRICS_TYPE_GAUGE },
+	{ "cap_records", METRICS_TYPE_COUNTER },
+	{ "cap_dropped", METRICS_TYPE_COUNTER },
+	{ "rec_rows", METRICS_TYPE_COUNTER },
+	{ "rec_dropped", METRICS_TYPE_COUNTER },
+	{ "mem_bytes", METRICS_TYPE_GAUGE },
+	{ "mem_peak", METRICS_TYPE_GAUGE },
+	{ "lat_input_us", METRICS_TYPE_HISTOGRAM },
+	{ "lat_queue_us", METRICS_TYPE_HISTOGRAM },
+	{ "lat_send_us", METRICS_TYPE_HISTOGRAM },
+	{ "lat_total_us", METRICS_TYPE_HISTOGRAM }
+};
+
+static MetricsValue metrics_values[METRICS_N];
+
+static int metrics_fd = -1;
+static int metrics_thread = -1;
+static int metrics_semaphore = -1;
+static volatile int metrics_running = 0;
+
+static char metrics_line[METRICS_SNAPSHOT_LINE_LEN];
+
+static void
+metrics_snapshot_write (void)
+{
+	int len;
+	int id;
+
+	len = snprintf (metrics_line, METRICS_SNAPSHOT_LINE_LEN, "t=%u",
+			platform_get_time () / 1000);
+
+	for (id = 0; id < METRICS_N; id++) {
+		MetricsValue value;
+
+		metrics_get (id, &value);
+
+		if (len < METRICS_SNAPSHOT_LINE_LEN - 1)
+			metrics_line[len++] = ' ';
+
+		len += metrics_format (id, &value, metrics_line + len,
+				METRICS_SNAPSHOT_LINE_LEN - len - 1);
+	}
+
+	metrics_line[len++] = '\n';
+	platform_file_write (metrics_fd, metrics_line, len);
+}
+
+static int
+metrics_snapshot_run (void *data)
+{
+	/* deinit wakes thread up for a last snapshot */
+	do {
+		platform_sema_wait (metrics_semaphore,
+				METRICS_SNAPSHOT_PERIOD);
+		metrics_snapshot_write ();
+	} while (metrics_running);
+
+	return 0;
+}
+
+int
+metrics_init (const char * path)
+{
+	metrics_reset ();
+
+	if (path == NULL)
+		return 0;
+
+	metrics_fd = platform_file_create (path);
+	if (metrics_fd < 0)
+		goto no_file;
+
+	metrics_semaphore = platform_sema_create ("metrics_semaphore", 0, 1);
+	if (metrics_semaphore < 0)
+		goto no_thread;
+
+	metrics_running = 1;
+	metrics_thread = platform_thread_create ("metrics_snapshot",
+			metrics_snapshot_run, NULL, METRICS_SNAPSHOT_PRIORITY,
+			METRICS_SNAPSHOT_STACK_SIZE);
+	if (metrics_thread < 0)
+		goto no_thread;
+
+	return 0;
+
+no_file:
+	PSPLOG_ERROR ("failed to open %s", path);
+	return -1;
+
+no_thread:
+	PSPLOG_ERROR ("failed to start metrics snapshot thread");
+	if (metrics_semaphore >= 0)
+		platform_sema_delete (metrics_semaphore);
+	metrics_semaphore = -1;
+	metrics_thread = -1;
+	metrics_running = 0;
+	platform_file_close (metrics_fd);
+	metrics_fd = -1;
+	return -1;
+}
+
+void
+metrics_deinit (void)
+{
+	if (metrics_thread < 0)
+		return;
+
+	metrics_running = 0;
+	platform_sema_signal (metrics_semaphore);
+	platform_thread_join (metrics_thread);
+	platform_sema_delete (metrics_semaphore);
+	platform_file_close (metrics_fd);
+
+	metrics_thread = -1;
+	metrics_semaphore = -1;
+	metrics_fd = -1;
+}
+
+void
+metrics_reset (void)
+{
+	memset (metrics_values, 0, sizeof (metrics_values));
+}
+
+void
+metrics_histogram_clear (MetricsId id)
+{
+	if (id >= METRICS_N)
+		return;
+
+	memset (&metrics_values[id], 0, sizeof (MetricsValue));
+}
+
+void
+metrics_counter_add (MetricsId id, unsigned int n)
+{
+	int intr;
+
+	if (id >= METRICS_N)
+		return;
+
+	/* Allegrex has no atomic instructions, read modify write is done in
+	 * a critical section */
+	intr = platform_critical_enter ();
+	metrics_values[id].value += n;
+	platform_critical_leave (intr);
+}
+
+void
+metrics_gauge_set (MetricsId id, unsigned int value)
+{
+	if (id >= METRICS_N)
+		return;
+
+	metrics_values[id].value = value;
+}
+
+static unsigned int
+metrics_get_bucket (unsigned int value)
+{
+	unsigned int bucket;
+
+	if (value == 0)
+		return 0;
+
+	bucket = 32 - __builtin_clz (value);
+	if (bucket >= METRICS_N_BUCKETS)
+		bucket = METRICS_N_BUCKETS - 1;
+
+	return bucket;
+}
+
+void
+metrics_histogram_record (MetricsId id, unsigned int value)
+{
+	MetricsValue *hist;
+
+	if (id >= METRICS_N)
+		return;
+
+	hist = &metrics_values[id];
+
+	if (hist->value == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+
+	hist->sum += value;
+	hist->buckets[metrics_get_bucket (value)]++;
+	hist->value++;
+}
+
+void
+metrics_get (MetricsId id, MetricsValue * value)
+{
+	if (id >= METRICS_N) {
+		memset (value, 0, sizeof (MetricsValue));
+		return;
+	}
+
+	*value = metrics_values[id];
+}
+
+MetricsType
+metrics_get_type (MetricsId id)
+{
+	if (id >= METRICS_N)
+		return METRICS_TYPE_COUNTER;
+
+	return metrics_desc[id].type;
+}
+
+const char *
+metrics_get_name (MetricsId id)
+{
+	if (id < METRICS_N)
+		return metrics_desc[id].name;
+	else
+		return "?????";
+}
+
+unsigned int
+metrics_histogram_get_percentile (const MetricsValue * value,
+		unsigned int percent)
+{
+	unsigned long long target;
+	unsigned long long seen = 0;
+	unsigned int i;
+
+	if (value->value == 0)
+		return 0;
+
+	target = ((unsigned long long) value->value * percent + 99) / 100;
+
+	for (i = 0; i < METRICS_N_BUCKETS - 1; i++) {
+		seen += value->buckets[i];
+		if (seen >= target)
+			return 1U << i;
+	}
+
+	return value->max;
+}
+
+int
+metrics_format (MetricsId id, const MetricsValue * value, char * buf,
+		size_t size)
+{
+	int len;
+
+	if (size == 0)
+		return 0;
+
+	if (metrics_get_type (id) == METRICS_TYPE_HISTOGRAM)
+		len = snprintf (buf, size, "%s=%u/%u/%u/%u",
+				metrics_get_name (id), value->value,
+				metrics_histogram_get_percentile (value, 50),
+				metrics_histogram_get_percentile (value, 99),
+				value->max);
+	else
+		len = snprintf (buf, size, "%s=%u", metrics_get_name (id),
+				value->value);
+
+	/* snprintf returns length before truncation */
+	if (len > (int) size - 1)
+		len = size - 1;
+
+	return len;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+typedef enum
+{
+	METRICS_TYPE_COUNTER = 0,
+	METRICS_TYPE_GAUGE,
+	METRICS_TYPE_HISTOGRAM
+} MetricsType;
+
+/* metrics are fixed at build time, see metrics_desc in metrics.c */
+typedef enum
+{
+	/* drone */
+	METRICS_DRONE_EVENT_PACKETS = 0,
+	METRICS_DRONE_NAVDATA_PACKETS,
+	METRICS_DRONE_READ_ERRORS,
+	METRICS_DRONE_DECODE_ERRORS,
+	METRICS_DRONE_COMMANDS_SENT,
+	METRICS_DRONE_COMMANDS_TIMEOUT,
+	METRICS_DRONE_PCMD,
+	/* ui */
+	METRICS_UI_FRAMES,
+	METRICS_UI_FRAME_TIME,
+	METRICS_UI_INPUT_EVENTS,
+	METRICS_UI_NOTIFICATIONS,
+	/* menu */
+	METRICS_MENU_TEXT_RENDERS,
+	METRICS_MENU_RENDER_TIME,
+	/* psplog */
+	METRICS_PSPLOG_RECORDS,
+	METRICS_PSPLOG_DROPPED,
+	METRICS_PSPLOG_SUPPRESSED,
+	METRICS_PSPLOG_RING_DEPTH,
+
+	METRICS_CAPTURE_RECORDS,
+	METRICS_CAPTURE_DROPPED,
+
+	METRICS_FLIGHTREC_ROWS,
+	METRICS_FLIGHTREC_DROPPED,
+
+	METRICS_MEM_BYTES,
+	METRICS_MEM_PEAK,
+
+	/* piloting command latency, one per LatencyStage in same order, see
+	 * latency.h. Kept last, statistics page leaves them to latency
+	 * overlay */
+	METRICS_LATENCY_INPUT,
+	METRICS_LATENCY_QUEUE,
+	METRICS_LATENCY_SEND,
+	METRICS_LATENCY_TOTAL,
+	METRICS_N
+} MetricsId;
+
+/* bucket n counts values in [2^(n-1), 2^n), last bucket is overflow */
+#define METRICS_N_BUCKETS 18
+
+typedef struct _MetricsValue MetricsValue;
+
+struct _MetricsValue
+{
+	/* counter total, gauge value or histogram samples count */
+	unsigned int value;
+
+	/* histograms only */
+	unsigned int min;
+	unsigned int max;
+	unsigned long long sum;
+	unsigned int buckets[METRICS_N_BUCKETS];
+};
+
+/**
+ * Init metrics registry
+ *
+ * @path : file to which a snapshot line is appended periodically by a
+ * background thread, or NULL for no snapshot
+ */
+int metrics_init (const char * path);
+void metrics_deinit (void);
+
+void metrics_reset (void);
+
+/* forget samples of a single histogram */
+void metrics_histogram_clear (MetricsId id);
+
+/*
+ * Updates are short and never wait for I/O. Counters can be updated from
+ * any thread, they take platform_critical_enter () for the read modify
+ * write. A gauge is a single store. A histogram must be recorded from a
+ * single thread and takes no lock, readers may see it partially updated
+ * which is fine for statistics.
+ */
+void metrics_counter_add (MetricsId id, unsigned int n);
+void metrics_gauge_set (MetricsId id, unsigned int value);
+void metrics_histogram_record (MetricsId id, unsigned int value);
+
+#define metrics_counter_inc(id) metrics_counter_add ((id), 1)
+
+void metrics_get (MetricsId id, MetricsValue * value);
+
+MetricsType metrics_get_type (MetricsId id);
+const char *metrics_get_name (MetricsId id);
+
+/* upper bound of the bucket holding given percentile */
+unsigned int metrics_histogram_get_percentile (const MetricsValue * value,
+		unsigned int percent);
+
+/* compact text form of a value, e.g. "frame_us=n/p50/p99/max" */
+int metrics_format (MetricsId id, const MetricsValue * value, char * buf,
+		size_t size);
+
+#endif
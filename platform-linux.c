@@ -0,0 +1,617 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <SDL/SDL.h>
+
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_PLATFORM
+#include "psplog.h"
+
+/* desktop implementation, threads and semaphores are kept in fixed tables
+ * so that they are identified by small ids as on PSP */
+#define PLATFORM_MAX_THREADS 16
+#define PLATFORM_MAX_SEMAS 16
+
+/* PSP display refresh rate */
+#define PLATFORM_FRAME_PERIOD 16683 /* us */
+
+/* controller is emulated with keyboard, sampled once per frame */
+#define PLATFORM_CTRL_TIMEOUT 100000 /* us */
+
+/* virtual clock start, ui takes a zero time as unset */
+#define PLATFORM_VIRTUAL_START 1000000 /* us */
+
+/* access point reported by network dialog, drone runs a DHCP server and
+ * is the gateway. Set PSPDC_GATEWAY to reach e.g. a simulator */
+#define PLATFORM_DEFAULT_GATEWAY "192.168.42.1"
+
+typedef struct _PlatformThread PlatformThread;
+typedef struct _PlatformSema PlatformSema;
+typedef struct _PlatformKey PlatformKey;
+
+struct _PlatformThread
+{
+	int used;
+	pthread_t thread;
+	char name[16];
+	PlatformThreadFunc func;
+	void *data;
+};
+
+struct _PlatformSema
+{
+	int used;
+	int count;
+	int max;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+struct _PlatformKey
+{
+	SDLKey key;
+	unsigned int button;
+};
+
+static const PlatformKey platform_keys[] = {
+	{ SDLK_BACKSPACE, PLATFORM_BUTTON_SELECT },
+	{ SDLK_RETURN, PLATFORM_BUTTON_START },
+	{ SDLK_UP, PLATFORM_BUTTON_UP },
+	{ SDLK_RIGHT, PLATFORM_BUTTON_RIGHT },
+	{ SDLK_DOWN, PLATFORM_BUTTON_DOWN },
+	{ SDLK_LEFT, PLATFORM_BUTTON_LEFT },
+	{ SDLK_q, PLATFORM_BUTTON_LTRIGGER },
+	{ SDLK_e, PLATFORM_BUTTON_RTRIGGER },
+	{ SDLK_w, PLATFORM_BUTTON_TRIANGLE },
+	{ SDLK_d, PLATFORM_BUTTON_CIRCLE },
+	{ SDLK_s, PLATFORM_BUTTON_CROSS },
+	{ SDLK_a, PLATFORM_BUTTON_SQUARE },
+};
+static const size_t n_platform_keys =
+	sizeof (platform_keys) / sizeof (platform_keys[0]);
+
+static void (*platform_on_exit) (void) = NULL;
+
+static PlatformThread platform_threads[PLATFORM_MAX_THREADS];
+static PlatformSema platform_semas[PLATFORM_MAX_SEMAS];
+static pthread_mutex_t platform_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t platform_critical_mutex =
+	PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* last keyboard sample, published by platform_wait_vblank () which runs in
+ * main thread as SDL requires */
+static PlatformPad platform_pad;
+static unsigned int platform_pad_seq = 0;
+static pthread_mutex_t platform_pad_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t platform_pad_cond;
+
+/* last sample seen by reader when it came back waiting for the next one */
+static unsigned int platform_pad_read_seq = 0;
+static pthread_cond_t platform_pad_read_cond;
+
+static long long platform_next_frame = 0;
+
+/* virtual clock, see platform_virtual_start () */
+static int platform_virtual = 0;
+static long long platform_virtual_time = 0;
+static PlatformVblankFunc platform_virtual_on_vblank = NULL;
+static void *platform_virtual_data = NULL;
+
+static void
+platform_timespec_after (struct timespec * ts, unsigned int us)
+{
+	clock_gettime (CLOCK_MONOTONIC, ts);
+	ts->tv_sec += us / 1000000;
+	ts->tv_nsec += (us % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static void
+platform_cond_init (pthread_cond_t * cond)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init (&attr);
+	pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+	pthread_cond_init (cond, &attr);
+	pthread_condattr_destroy (&attr);
+}
+
+static void
+platform_signal_handler (int signum)
+{
+	if (platform_on_exit)
+		platform_on_exit ();
+}
+
+int
+platform_init (void (*on_exit) (void))
+{
+	struct sigaction action;
+
+	platform_on_exit = on_exit;
+	platform_cond_init (&platform_pad_cond);
+	platform_cond_init (&platform_pad_read_cond);
+
+	memset (&platform_pad, 0, sizeof (platform_pad));
+	platform_pad.lx = platform_pad.ly = 128;
+
+	memset (&action, 0, sizeof (action));
+	action.sa_handler = platform_signal_handler;
+	sigaction (SIGINT, &action, NULL);
+	sigaction (SIGTERM, &action, NULL);
+
+	return 0;
+}
+
+void
+platform_exit (void)
+{
+	exit (0);
+}
+
+long long
+platform_get_time_wide (void)
+{
+	struct timespec ts;
+
+	if (platform_virtual)
+		return __sync_add_and_fetch (&platform_virtual_time, 0);
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned int
+platform_get_time (void)
+{
+	return platform_get_time_wide ();
+}
+
+void
+platform_delay (unsigned int us)
+{
+	if (platform_virtual)
+		__sync_add_and_fetch (&platform_virtual_time, us);
+	else
+		usleep (us);
+}
+
+static void
+platform_pad_sample (void)
+{
+	SDL_Event event;
+	Uint8 *keys;
+	PlatformPad pad;
+	size_t i;
+
+	while (SDL_PollEvent (&event)) {
+		if (event.type == SDL_QUIT && platform_on_exit)
+			platform_on_exit ();
+	}
+
+	keys = SDL_GetKeyState (NULL);
+
+	pad.timestamp = platform_get_time ();
+	pad.buttons = 0;
+	for (i = 0; i < n_platform_keys; i++) {
+		if (keys[platform_keys[i].key])
+			pad.buttons |= platform_keys[i].button;
+	}
+
+	/* analog stick at full deflection with i, j, k and l */
+	pad.lx = keys[SDLK_j] ? 0 : keys[SDLK_l] ? 255 : 128;
+	pad.ly = keys[SDLK_i] ? 0 : keys[SDLK_k] ? 255 : 128;
+
+	pthread_mutex_lock (&platform_pad_mutex);
+	platform_pad = pad;
+	platform_pad_seq++;
+	pthread_cond_broadcast (&platform_pad_cond);
+	pthread_mutex_unlock (&platform_pad_mutex);
+}
+
+static void
+platform_virtual_vblank (void)
+{
+	struct timespec deadline;
+	int ret = 0;
+
+	__sync_add_and_fetch (&platform_virtual_time, PLATFORM_FRAME_PERIOD);
+	platform_virtual_on_vblank (platform_virtual_data);
+
+	pthread_mutex_lock (&platform_pad_mutex);
+	platform_pad.timestamp = platform_get_time ();
+	platform_pad_seq++;
+	pthread_cond_broadcast (&platform_pad_cond);
+
+	/* events of this sample must be queued before next frame polls them */
+	platform_timespec_after (&deadline, PLATFORM_CTRL_TIMEOUT);
+	while (ret == 0 && platform_pad_read_seq != platform_pad_seq)
+		ret = pthread_cond_timedwait (&platform_pad_read_cond,
+				&platform_pad_mutex, &deadline);
+	pthread_mutex_unlock (&platform_pad_mutex);
+
+	if (ret != 0)
+		PSPLOG_WARNING ("input thread missed virtual frame");
+}
+
+void
+platform_wait_vblank (void)
+{
+	long long now;
+
+	if (platform_virtual) {
+		platform_virtual_vblank ();
+		return;
+	}
+
+	now = platform_get_time_wide ();
+
+	/* fixed frame rate, restarted after a long stall */
+	if (platform_next_frame <= now ||
+			platform_next_frame - now > PLATFORM_FRAME_PERIOD)
+		platform_next_frame = now;
+	else
+		usleep (platform_next_frame - now);
+
+	platform_next_frame += PLATFORM_FRAME_PERIOD;
+
+	if (SDL_WasInit (SDL_INIT_VIDEO))
+		platform_pad_sample ();
+}
+
+int
+platform_ctrl_init (unsigned int sampling_cycle)
+{
+	return 0;
+}
+
+int
+platform_ctrl_read (PlatformPad * pad)
+{
+	struct timespec deadline;
+	unsigned int seq;
+	int ret = 0;
+
+	platform_timespec_after (&deadline, PLATFORM_CTRL_TIMEOUT);
+
+	pthread_mutex_lock (&platform_pad_mutex);
+	seq = platform_pad_seq;
+	if (platform_virtual) {
+		platform_pad_read_seq = seq;
+		pthread_cond_broadcast (&platform_pad_read_cond);
+	}
+	while (ret == 0 && seq == platform_pad_seq)
+		ret = pthread_cond_timedwait (&platform_pad_cond,
+				&platform_pad_mutex, &deadline);
+	*pad = platform_pad;
+	pthread_mutex_unlock (&platform_pad_mutex);
+
+	return ret == 0 ? 0 : -1;
+}
+
+void
+platform_virtual_start (PlatformVblankFunc on_vblank, void * data)
+{
+	platform_virtual_on_vblank = on_vblank;
+	platform_virtual_data = data;
+	platform_virtual_time = PLATFORM_VIRTUAL_START;
+	PLATFORM_BARRIER ();
+	platform_virtual = 1;
+}
+
+void
+platform_virtual_set_pad (unsigned int buttons, unsigned char lx,
+		unsigned char ly)
+{
+	pthread_mutex_lock (&platform_pad_mutex);
+	platform_pad.buttons = buttons;
+	platform_pad.lx = lx;
+	platform_pad.ly = ly;
+	pthread_mutex_unlock (&platform_pad_mutex);
+}
+
+static void *
+platform_thread_run (void *data)
+{
+	PlatformThread *thread = data;
+
+	pthread_setname_np (pthread_self (), thread->name);
+	thread->func (thread->data);
+	return NULL;
+}
+
+int
+platform_thread_create (const char * name, PlatformThreadFunc func,
+		void * data, int priority, int stack_size)
+{
+	PlatformThread *thread = NULL;
+	int i;
+
+	pthread_mutex_lock (&platform_table_mutex);
+	for (i = 0; i < PLATFORM_MAX_THREADS; i++) {
+		if (!platform_threads[i].used) {
+			thread = &platform_threads[i];
+			thread->used = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&platform_table_mutex);
+
+	if (thread == NULL) {
+		PSPLOG_ERROR ("no free thread slot for %s", name);
+		return -1;
+	}
+
+	/* priority and stack size are tuned for PSP, keep system defaults */
+	snprintf (thread->name, sizeof (thread->name), "%s", name);
+	thread->func = func;
+	thread->data = data;
+
+	if (pthread_create (&thread->thread, NULL, platform_thread_run,
+			thread) != 0) {
+		thread->used = 0;
+		return -1;
+	}
+
+	return i + 1;
+}
+
+void
+platform_thread_join (int thread)
+{
+	if (thread < 1 || thread > PLATFORM_MAX_THREADS)
+		return;
+
+	pthread_join (platform_threads[thread - 1].thread, NULL);
+	platform_threads[thread - 1].used = 0;
+}
+
+unsigned int
+platform_thread_get_id (void)
+{
+	return syscall (SYS_gettid);
+}
+
+int
+platform_thread_get_name (unsigned int id, char * name, size_t size)
+{
+	char path[64];
+	FILE *file;
+	size_t len;
+
+	snprintf (path, sizeof (path), "/proc/self/task/%u/comm", id);
+	file = fopen (path, "r");
+	if (file == NULL)
+		return -1;
+
+	if (fgets (name, size, file) == NULL) {
+		fclose (file);
+		return -1;
+	}
+	fclose (file);
+
+	len = strlen (name);
+	if (len > 0 && name[len - 1] == '\n')
+		name[len - 1] = '\0';
+
+	return 0;
+}
+
+int
+platform_sema_create (const char * name, int initial, int max)
+{
+	PlatformSema *sema = NULL;
+	int i;
+
+	pthread_mutex_lock (&platform_table_mutex);
+	for (i = 0; i < PLATFORM_MAX_SEMAS; i++) {
+		if (!platform_semas[i].used) {
+			sema = &platform_semas[i];
+			sema->used = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&platform_table_mutex);
+
+	if (sema == NULL) {
+		PSPLOG_ERROR ("no free semaphore slot for %s", name);
+		return -1;
+	}
+
+	sema->count = initial;
+	sema->max = max;
+	pthread_mutex_init (&sema->mutex, NULL);
+	platform_cond_init (&sema->cond);
+
+	return i + 1;
+}
+
+static PlatformSema *
+platform_sema_get (int id)
+{
+	if (id < 1 || id > PLATFORM_MAX_SEMAS || !platform_semas[id - 1].used)
+		return NULL;
+
+	return &platform_semas[id - 1];
+}
+
+void
+platform_sema_delete (int id)
+{
+	PlatformSema *sema = platform_sema_get (id);
+
+	if (sema == NULL)
+		return;
+
+	pthread_cond_destroy (&sema->cond);
+	pthread_mutex_destroy (&sema->mutex);
+	sema->used = 0;
+}
+
+int
+platform_sema_wait (int id, unsigned int timeout)
+{
+	PlatformSema *sema = platform_sema_get (id);
+	struct timespec deadline;
+	int ret = 0;
+
+	if (sema == NULL)
+		return -1;
+
+	if (timeout != PLATFORM_WAIT_FOREVER)
+		platform_timespec_after (&deadline, timeout);
+
+	pthread_mutex_lock (&sema->mutex);
+	while (ret == 0 && sema->count == 0) {
+		if (timeout == PLATFORM_WAIT_FOREVER)
+			ret = pthread_cond_wait (&sema->cond, &sema->mutex);
+		else
+			ret = pthread_cond_timedwait (&sema->cond,
+					&sema->mutex, &deadline);
+	}
+	if (ret == 0)
+		sema->count--;
+	pthread_mutex_unlock (&sema->mutex);
+
+	return ret == 0 ? 0 : -1;
+}
+
+void
+platform_sema_signal (int id)
+{
+	PlatformSema *sema = platform_sema_get (id);
+
+	if (sema == NULL)
+		return;
+
+	pthread_mutex_lock (&sema->mutex);
+	if (sema->count < sema->max)
+		sema->count++;
+	pthread_cond_signal (&sema->cond);
+	pthread_mutex_unlock (&sema->mutex);
+}
+
+int
+platform_critical_enter (void)
+{
+	pthread_mutex_lock (&platform_critical_mutex);
+	return 0;
+}
+
+void
+platform_critical_leave (int state)
+{
+	pthread_mutex_unlock (&platform_critical_mutex);
+}
+
+int
+platform_file_create (const char * path)
+{
+	int fd;
+
+	fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	return fd < 0 ? -1 : fd;
+}
+
+int
+platform_file_write (int fd, const void * buf, size_t size)
+{
+	return write (fd, buf, size);
+}
+
+void
+platform_file_close (int fd)
+{
+	close (fd);
+}
+
+void
+platform_screen_init (void)
+{
+}
+
+void
+platform_screen_print (unsigned int color, const char * buf, size_t size)
+{
+	fwrite (buf, 1, size, stderr);
+}
+
+int
+platform_network_init (void)
+{
+	return 0;
+}
+
+void
+platform_network_deinit (void)
+{
+}
+
+int
+platform_network_dialog_run (void)
+{
+	return 0;
+}
+
+int
+platform_network_get_info (PlatformNetworkInfo * info)
+{
+	const char *gateway = getenv ("PSPDC_GATEWAY");
+
+	if (gateway == NULL)
+		gateway = PLATFORM_DEFAULT_GATEWAY;
+
+	snprintf (info->ssid, sizeof (info->ssid), "host");
+	snprintf (info->gateway, sizeof (info->gateway), "%s", gateway);
+	snprintf (info->ip, sizeof (info->ip), "0.0.0.0");
+	return 0;
+}
+
+void
+platform_network_disconnect (void)
+{
+}
+
+void
+platform_msg_dialog (const char * msg)
+{
+	fprintf (stderr, "%s\n", msg);
+}
@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pspkernel.h>
+#include <pspdebug.h>
+#include <pspdisplay.h>
+#include <pspctrl.h>
+#include <pspintrman.h>
+#include <pspthreadman.h>
+#include <pspiofilemgr.h>
+#include <pspnet.h>
+#include <pspnet_inet.h>
+#include <pspnet_apctl.h>
+#include <psputility.h>
+#include <psputility_netmodules.h>
+#include <psputility_netconf.h>
+#include <pspgu.h>
+
+#include "platform.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_PLATFORM
+#include "psplog.h"
+
+PSP_MODULE_INFO ("PSP Drone Control", PSP_MODULE_USER, 0, 1);
+PSP_MAIN_THREAD_ATTR (PSP_THREAD_ATTR_USER);
+PSP_HEAP_SIZE_MAX ();
+
+typedef struct _PlatformThreadStart PlatformThreadStart;
+
+/* copied on new thread stack by sceKernelStartThread () */
+struct _PlatformThreadStart
+{
+	PlatformThreadFunc func;
+	void *data;
+};
+
+static void (*platform_on_exit) (void) = NULL;
+static volatile int platform_exiting = 0;
+
+/* display list used by system dialogs */
+static unsigned int __attribute__((aligned(16))) platform_gu_list[4096];
+
+static int
+platform_exit_callback (int arg1, int arg2, void *common)
+{
+	platform_exiting = 1;
+	if (platform_on_exit)
+		platform_on_exit ();
+	return 0;
+}
+
+static int
+platform_callback_thread (SceSize args, void *argp)
+{
+	int callback_id;
+
+	callback_id = sceKernelCreateCallback ("Exit Callback",
+			platform_exit_callback, NULL);
+	sceKernelRegisterExitCallback (callback_id);
+
+	sceKernelSleepThreadCB ();
+
+	return 0;
+}
+
+int
+platform_init (void (*on_exit) (void))
+{
+	int thread_id;
+
+	platform_on_exit = on_exit;
+
+	thread_id = sceKernelCreateThread ("Callback update thread",
+			platform_callback_thread, 0x11, 0xFA0, THREAD_ATTR_USER,
+			0);
+
+	if (thread_id >= 0)
+		sceKernelStartThread (thread_id, 0, 0);
+
+	return thread_id < 0 ? -1 : 0;
+}
+
+void
+platform_exit (void)
+{
+	sceKernelExitGame ();
+}
+
+unsigned int
+platform_get_time (void)
+{
+	return sceKernelGetSystemTimeLow ();
+}
+
+long long
+platform_get_time_wide (void)
+{
+	return sceKernelGetSystemTimeWide ();
+}
+
+void
+platform_delay (unsigned int us)
+{
+	sceKernelDelayThread (us);
+}
+
+void
+platform_wait_vblank (void)
+{
+	sceDisplayWaitVblankStart ();
+}
+
+int
+platform_ctrl_init (unsigned int sampling_cycle)
+{
+	sceCtrlSetSamplingCycle (sampling_cycle);
+	sceCtrlSetSamplingMode (PSP_CTRL_MODE_ANALOG);
+	return 0;
+}
+
+int
+platform_ctrl_read (PlatformPad * pad)
+{
+	SceCtrlData data;
+
+	if (sceCtrlReadBufferPositive (&data, 1) < 0)
+		return -1;
+
+	pad->timestamp = data.TimeStamp;
+	pad->buttons = data.Buttons;
+	pad->lx = data.Lx;
+	pad->ly = data.Ly;
+	return 0;
+}
+
+static int
+platform_thread_run (SceSize args, void *argp)
+{
+	PlatformThreadStart *start = argp;
+
+	return start->func (start->data);
+}
+
+int
+platform_thread_create (const char * name, PlatformThreadFunc func,
+		void * data, int priority, int stack_size)
+{
+	PlatformThreadStart start;
+	SceUID thid;
+
+	thid = sceKernelCreateThread (name, platform_thread_run, priority,
+			stack_size, PSP_THREAD_ATTR_USER, NULL);
+	if (thid < 0)
+		return -1;
+
+	start.func = func;
+	start.data = data;
+	if (sceKernelStartThread (thid, sizeof (start), &start) < 0) {
+		sceKernelDeleteThread (thid);
+		return -1;
+	}
+
+	return thid;
+}
+
+void
+platform_thread_join (int thread)
+{
+	sceKernelWaitThreadEnd (thread, NULL);
+	sceKernelDeleteThread (thread);
+}
+
+unsigned int
+platform_thread_get_id (void)
+{
+	return sceKernelGetThreadId ();
+}
+
+int
+platform_thread_get_name (unsigned int id, char * name, size_t size)
+{
+	SceKernelThreadInfo info;
+
+	memset (&info, 0, sizeof (info));
+	info.size = sizeof (info);
+	if (sceKernelReferThreadStatus (id, &info) < 0)
+		return -1;
+
+	snprintf (name, size, "%s", info.name);
+	return 0;
+}
+
+int
+platform_sema_create (const char * name, int initial, int max)
+{
+	SceUID sema = sceKernelCreateSema (name, 0, initial, max, NULL);
+
+	return sema < 0 ? -1 : sema;
+}
+
+void
+platform_sema_delete (int sema)
+{
+	sceKernelDeleteSema (sema);
+}
+
+int
+platform_sema_wait (int sema, unsigned int timeout)
+{
+	SceUInt t = timeout;
+
+	if (sceKernelWaitSema (sema, 1,
+			timeout == PLATFORM_WAIT_FOREVER ? NULL : &t) < 0)
+		return -1;
+
+	return 0;
+}
+
+void
+platform_sema_signal (int sema)
+{
+	sceKernelSignalSema (sema, 1);
+}
+
+int
+platform_critical_enter (void)
+{
+	return sceKernelCpuSuspendIntr ();
+}
+
+void
+platform_critical_leave (int state)
+{
+	sceKernelCpuResumeIntr (state);
+}
+
+int
+platform_file_create (const char * path)
+{
+	SceUID fd;
+
+	fd = sceIoOpen (path, PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+	return fd < 0 ? -1 : fd;
+}
+
+int
+platform_file_write (int fd, const void * buf, size_t size)
+{
+	return sceIoWrite (fd, buf, size);
+}
+
+void
+platform_file_close (int fd)
+{
+	sceIoClose (fd);
+}
+
+void
+platform_screen_init (void)
+{
+	pspDebugScreenInit ();
+	pspDebugScreenSetXY (0, 0);
+}
+
+void
+platform_screen_print (unsigned int color, const char * buf, size_t size)
+{
+	pspDebugScreenSetTextColor (color);
+	pspDebugScreenPrintData (buf, size);
+	pspDebugScreenSetTextColor (0xffffff);
+}
+
+int
+platform_network_init (void)
+{
+	PSPLOG_DEBUG ("loading net module");
+	sceUtilityLoadNetModule (PSP_NET_MODULE_COMMON);
+	sceUtilityLoadNetModule (PSP_NET_MODULE_INET);
+
+	if (sceNetInit (128 * 4096, 42, 4096, 42, 4096) < 0) {
+		PSPLOG_ERROR ("failed to initialize net component");
+		return -1;
+	}
+
+	if (sceNetInetInit () < 0)
+		goto inet_init_failed;
+
+	if (sceNetApctlInit (0x8000, 48) < 0)
+		goto apctl_init_failed;
+
+	return 0;
+
+inet_init_failed:
+	PSPLOG_ERROR ("failed to initialize inet");
+	sceNetTerm ();
+	return -1;
+
+apctl_init_failed:
+	PSPLOG_ERROR ("failed to initialize apctl");
+	sceNetInetTerm ();
+	sceNetTerm ();
+	return -1;
+}
+
+void
+platform_network_deinit (void)
+{
+	sceNetApctlTerm();
+	sceNetInetTerm();
+	sceNetTerm();
+}
+
+/* draw a blank frame under system dialog, directly use GU to avoid
+ * flickering with SDL */
+static void
+platform_dialog_clear (void)
+{
+	sceGuStart (GU_DIRECT, platform_gu_list);
+	sceGuClearColor (0xff554433);
+	sceGuClearDepth (0);
+	sceGuClear (GU_COLOR_BUFFER_BIT|GU_DEPTH_BUFFER_BIT);
+	sceGuFinish ();
+	sceGuSync (0,0);
+}
+
+/* hack for SDL compatibility.
+ * if it end up on an odd buffer, SDL won't be displayed.
+ * ie SDL will display in an hidden buffer
+ */
+static void
+platform_dialog_restore (unsigned int swap_count)
+{
+	if (swap_count & 1)
+		sceGuSwapBuffers ();
+}
+
+/* configuration dialog return 0 when connected
+ * 1 when cancelled (ie back)
+ */
+int
+platform_network_dialog_run (void)
+{
+	pspUtilityNetconfData conf;
+	struct pspUtilityNetconfAdhoc adhoc_params;
+	unsigned int swap_count = 0;
+
+	memset(&conf, 0, sizeof (conf));
+	memset(&adhoc_params, 0, sizeof (adhoc_params));
+
+	conf.base.size = sizeof (conf);
+	conf.base.language = PSP_SYSTEMPARAM_LANGUAGE_ENGLISH;
+	conf.base.buttonSwap = PSP_UTILITY_ACCEPT_CROSS;
+
+	/* Thread priorities */
+	conf.base.graphicsThread = 17;
+	conf.base.accessThread = 19;
+	conf.base.fontThread = 18;
+	conf.base.soundThread = 16;
+
+	conf.action = PSP_NETCONF_ACTION_CONNECTAP;
+	conf.adhocparam = &adhoc_params;
+
+	sceUtilityNetconfInitStart (&conf);
+
+	while (!platform_exiting) {
+		int done = 0;
+
+		platform_dialog_clear ();
+
+		switch (sceUtilityNetconfGetStatus ()) {
+			case PSP_UTILITY_DIALOG_NONE:
+				break;
+
+			case PSP_UTILITY_DIALOG_VISIBLE:
+				sceUtilityNetconfUpdate (1);
+				break;
+
+			case PSP_UTILITY_DIALOG_QUIT:
+				sceUtilityNetconfShutdownStart ();
+				break;
+
+			case PSP_UTILITY_DIALOG_FINISHED:
+				done = 1;
+				break;
+
+			default:
+				break;
+		}
+
+		sceDisplayWaitVblankStart ();
+		sceGuSwapBuffers ();
+		swap_count++;
+
+		if (done)
+			break;
+	}
+
+	platform_dialog_restore (swap_count);
+
+	return conf.base.result;
+}
+
+int
+platform_network_get_info (PlatformNetworkInfo * info)
+{
+	union SceNetApctlInfo ssid;
+	union SceNetApctlInfo gateway;
+	union SceNetApctlInfo ip;
+
+	if (sceNetApctlGetInfo (PSP_NET_APCTL_INFO_SSID, &ssid) < 0 ||
+			sceNetApctlGetInfo (PSP_NET_APCTL_INFO_GATEWAY,
+				&gateway) < 0 ||
+			sceNetApctlGetInfo (PSP_NET_APCTL_INFO_IP, &ip) < 0)
+		return -1;
+
+	snprintf (info->ssid, sizeof (info->ssid), "%s", ssid.ssid);
+	snprintf (info->gateway, sizeof (info->gateway), "%s",
+			gateway.gateway);
+	snprintf (info->ip, sizeof (info->ip), "%s", ip.ip);
+	return 0;
+}
+
+void
+platform_network_disconnect (void)
+{
+	sceNetApctlDisconnect ();
+}
+
+void
+platform_msg_dialog (const char * msg)
+{
+	pspUtilityMsgDialogParams params;
+	unsigned int swap_count = 0;
+
+	memset (&params, 0, sizeof (params));
+
+	params.base.size = sizeof (params);
+	params.base.language = PSP_SYSTEMPARAM_LANGUAGE_ENGLISH;
+	params.base.buttonSwap = PSP_UTILITY_ACCEPT_CROSS;
+
+	/* Thread priorities */
+	params.base.graphicsThread = 17;
+	params.base.accessThread = 19;
+	params.base.fontThread = 18;
+	params.base.soundThread = 16;
+
+	params.mode = PSP_UTILITY_MSGDIALOG_MODE_TEXT;
+	params.options = PSP_UTILITY_MSGDIALOG_OPTION_TEXT;
+	snprintf (params.message, 512, "%s", msg);
+
+	sceUtilityMsgDialogInitStart (&params);
+
+	while (!platform_exiting) {
+		int done = 0;
+
+		platform_dialog_clear ();
+
+		switch (sceUtilityMsgDialogGetStatus ()) {
+			case PSP_UTILITY_DIALOG_NONE:
+				break;
+			case PSP_UTILITY_DIALOG_VISIBLE:
+				sceUtilityMsgDialogUpdate (1);
+				break;
+			case PSP_UTILITY_DIALOG_QUIT:
+				sceUtilityMsgDialogShutdownStart ();
+				break;
+			case PSP_UTILITY_DIALOG_FINISHED:
+				done = 1;
+				break;
+			default:
+				break;
+		}
+
+		sceDisplayWaitVblankStart ();
+		sceGuSwapBuffers ();
+		swap_count++;
+
+		if (done)
+			break;
+	}
+
+	platform_dialog_restore (swap_count);
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+
+/* system services used by the application, implemented on PSP by
+ * platform-psp.c and on a desktop by platform-linux.c with SDL, so that
+ * flight loop and menus can be profiled off device */
+
+/* files written by application, e.g. log, metrics and traces */
+#ifndef PLATFORM_DATA_DIR
+#define PLATFORM_DATA_DIR "ms0:/PSP/GAME/pspdc/"
+#endif
+
+/* controller buttons, same values as PSP_CTRL_* */
+#define PLATFORM_BUTTON_SELECT   0x000001
+#define PLATFORM_BUTTON_START    0x000008
+#define PLATFORM_BUTTON_UP       0x000010
+#define PLATFORM_BUTTON_RIGHT    0x000020
+#define PLATFORM_BUTTON_DOWN     0x000040
+#define PLATFORM_BUTTON_LEFT     0x000080
+#define PLATFORM_BUTTON_LTRIGGER 0x000100
+#define PLATFORM_BUTTON_RTRIGGER 0x000200
+#define PLATFORM_BUTTON_TRIANGLE 0x001000
+#define PLATFORM_BUTTON_CIRCLE   0x002000
+#define PLATFORM_BUTTON_CROSS    0x004000
+#define PLATFORM_BUTTON_SQUARE   0x008000
+
+/* timeout of platform_sema_wait () */
+#define PLATFORM_WAIT_FOREVER 0xffffffffU
+
+/* order memory accesses between threads. PSP has a single core so
+ * preventing compiler reordering is enough */
+#ifdef __psp__
+#define PLATFORM_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+#define PLATFORM_BARRIER() __sync_synchronize ()
+#endif
+
+typedef struct _PlatformPad PlatformPad;
+typedef struct _PlatformNetworkInfo PlatformNetworkInfo;
+
+typedef int (*PlatformThreadFunc) (void * data);
+typedef void (*PlatformVblankFunc) (void * data);
+
+/* controller sample */
+struct _PlatformPad
+{
+	/* sample time in us, same clock as platform_get_time () */
+	unsigned int timestamp;
+	/* PLATFORM_BUTTON_* held */
+	unsigned int buttons;
+	/* analog stick position, 128 is centered */
+	unsigned char lx;
+	unsigned char ly;
+};
+
+struct _PlatformNetworkInfo
+{
+	char ssid[33];
+	char gateway[16];
+	char ip[16];
+};
+
+/* @on_exit is called from any thread when user asks to quit */
+int platform_init (void (*on_exit) (void));
+void platform_exit (void);
+
+/* time in us, low part wraps after about 71 minutes */
+unsigned int platform_get_time (void);
+long long platform_get_time_wide (void);
+void platform_delay (unsigned int us);
+
+/* wait for start of next frame */
+void platform_wait_vblank (void);
+
+/* controller is sampled every @sampling_cycle us when supported, reading
+ * blocks until next sample and returns -1 if none came */
+int platform_ctrl_init (unsigned int sampling_cycle);
+int platform_ctrl_read (PlatformPad * pad);
+
+/* threads and semaphores are identified by a positive id, lower
+ * @priority value means higher priority */
+int platform_thread_create (const char * name, PlatformThreadFunc func,
+		void * data, int priority, int stack_size);
+void platform_thread_join (int thread);
+unsigned int platform_thread_get_id (void);
+int platform_thread_get_name (unsigned int id, char * name, size_t size);
+
+int platform_sema_create (const char * name, int initial, int max);
+void platform_sema_delete (int sema);
+/* return 0 when signaled, -1 on timeout or error */
+int platform_sema_wait (int sema, unsigned int timeout);
+void platform_sema_signal (int sema);
+
+/* short critical sections which never block, may be nested */
+int platform_critical_enter (void);
+void platform_critical_leave (int state);
+
+/* file is truncated, return a positive descriptor or -1 */
+int platform_file_create (const char * path);
+int platform_file_write (int fd, const void * buf, size_t size);
+void platform_file_close (int fd);
+
+/* debug text output used before and instead of SDL ui, @color is 0xBBGGRR */
+void platform_screen_init (void);
+void platform_screen_print (unsigned int color, const char * buf,
+		size_t size);
+
+int platform_network_init (void);
+void platform_network_deinit (void);
+/* let user pick an access point, return 0 when connected */
+int platform_network_dialog_run (void);
+int platform_network_get_info (PlatformNetworkInfo * info);
+void platform_network_disconnect (void);
+
+/* modal system message dialog */
+void platform_msg_dialog (const char * msg);
+
+#ifndef __psp__
+/* desktop only, for tools/flight-harness.c: clock stops following real
+ * time and only moves by a frame period on each platform_wait_vblank (),
+ * which calls @on_vblank instead of waiting. Controller reports the pad
+ * given to platform_virtual_set_pad () once per frame, and vblank returns
+ * once input thread handled it. Semaphore timeouts still count real time.
+ * Call it before input_init () */
+void platform_virtual_start (PlatformVblankFunc on_vblank, void * data);
+void platform_virtual_set_pad (unsigned int buttons, unsigned char lx,
+		unsigned char ly);
+#endif
+
+#endif
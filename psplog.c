@@ -27,14 +27,43 @@
 
 #include <stdio.h>
 #include <stdarg.h>
-#include <pspdebug.h>
-#include <pspthreadman.h>
-#include <pspiofilemgr.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "metrics.h"
+#include "platform.h"
+#include "trace.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_PSPLOG
 #include "psplog.h"
 
 #define BUFFER_LEN 512
 
+/* binary log layout, see tools/psplog-decode.py.
+ * File starts with magic, then each record has a header:
+ *   u16 size, u8 category, u8 flags, u32 site, u32 timestamp (us)
+ * followed by raw arguments in format order: 4 bytes integers and pointers,
+ * 8 bytes long long and double, strings as u8 length and characters. */
+#define PSPLOG_BINARY_MAGIC "PSPLOGB1"
+#define PSPLOG_BINARY_HEADER_LEN 12
+#define PSPLOG_BINARY_FLAG_TRUNCATED 1
+#define PSPLOG_BINARY_STRING_MAX 255
+
+/* reserved sites, no format string in table:
+ * dropped records count is followed by u32 count,
+ * suppressed records summary by u32 site of limited statement and u32 count */
+#define PSPLOG_BINARY_SITE_DROPPED 0
+#define PSPLOG_BINARY_SITE_SUPPRESSED 1
+
+/* records waiting for writer thread, must be a power of 2 */
+#define PSPLOG_RING_SIZE 64
+
+/* writer thread wakes up periodically, or when ring is half full, and
+ * writes all pending records in as few large writes as possible */
+#define PSPLOG_WRITER_PERIOD 100000 /* us */
+#define PSPLOG_WRITER_PRIORITY 0x30
+#define PSPLOG_WRITER_STACK_SIZE 0x1000
+#define PSPLOG_WRITE_BUFFER_LEN 8192
+
 #define COLOR_RED    0x0000ffU
 #define COLOR_GREEN  0x00ff00U
 #define COLOR_BLUE   0xff0000U
@@ -49,55 +78,848 @@ enum psplog_output
 
 static enum psplog_category level_threshold;
 static enum psplog_output output;
-static SceUID psplog_semaphore = 0;
-static SceUID psplog_fd = -1;
+static int binary = 0;
+static int psplog_semaphore = -1;
+static int psplog_fd = -1;
+
+typedef struct _PspLogRecord PspLogRecord;
+
+struct _PspLogRecord
+{
+	volatile int ready;
+	int size;
+	char data[BUFFER_LEN];
+};
+
+/* multiple producers reserve slots with interrupts disabled for a few
+ * instructions, which never blocks, a single writer thread consumes them */
+static PspLogRecord psplog_ring[PSPLOG_RING_SIZE];
+static volatile unsigned int psplog_ring_head = 0;
+static volatile unsigned int psplog_ring_tail = 0;
+static volatile unsigned int psplog_dropped = 0;
+
+static int psplog_writer = -1;
+static int psplog_writer_semaphore = -1;
+static volatile int psplog_writer_running = 0;
+
+typedef struct _PspLogHistoryEntry PspLogHistoryEntry;
+
+/* records are kept as produced for output, text without category or raw
+ * arguments in binary mode, and only expanded when read */
+struct _PspLogHistoryEntry
+{
+	/* record number once written, PSPLOG_HISTORY_INVALID while written */
+	volatile unsigned int seq;
+	enum psplog_category cat;
+	/* format of call site in binary mode, NULL for text */
+	const char *fmt;
+	unsigned int size;
+	char data[PSPLOG_HISTORY_LINE_LEN];
+};
+
+#define PSPLOG_HISTORY_INVALID 0xffffffffU
+
+/* overwritten in place, readers check record number before and after copy */
+static PspLogHistoryEntry psplog_history[PSPLOG_HISTORY_SIZE];
+static volatile unsigned int psplog_history_head = 0;
+
+/* limiters which suppressed records, so that writer can report them even
+ * if their statement is not reached anymore */
+static PspLogLimit *psplog_limits = NULL;
+
+/* memory stick prefers 64 bytes aligned buffers */
+static char psplog_write_buffer[PSPLOG_WRITE_BUFFER_LEN]
+	__attribute__((aligned(64)));
+
+#define PSPLOG_BARRIER() PLATFORM_BARRIER ()
 
 static const char * const psplog_category_str[] = {
 	"ERROR",
 	"WARN",
 	"INFO",
-	"DEBUG"
+	"DEBUG",
+	"TRACE"
+};
+
+/* indexed by PSPLOG_MODULE_* */
+static const char * const psplog_module_str[] = {
+	"default",
+	"main",
+	"drone",
+	"ui",
+	"menu",
+	"input",
+	"latency",
+	"psplog",
+	"metrics",
+	"trace",
+	"platform",
+	"capture",
+	"flightrec",
+	"memtrack"
 };
 
 static const char *
 psplog_category_get_name (enum psplog_category cat)
 {
-	if (cat >= PSPLOG_CAT_ERROR || cat <= PSPLOG_CAT_DEBUG)
+	if (cat >= PSPLOG_CAT_ERROR && cat <= PSPLOG_CAT_TRACE)
 		return psplog_category_str[cat];
 	else
 		return "?????";
 }
 
+static const char *
+psplog_module_get_name (unsigned int module)
+{
+	if (module < sizeof (psplog_module_str) / sizeof (psplog_module_str[0]))
+		return psplog_module_str[module];
+	else
+		return "?????";
+}
+
+static int
+psplog_encode_header (char *buf, size_t size, enum psplog_category cat,
+		int flags, unsigned int site)
+{
+	uint16_t size16 = size;
+	uint32_t site32 = site;
+	uint32_t timestamp = platform_get_time ();
+
+	memcpy (buf, &size16, 2);
+	buf[2] = cat;
+	buf[3] = flags;
+	memcpy (buf + 4, &site32, 4);
+	memcpy (buf + 8, &timestamp, 4);
+
+	return PSPLOG_BINARY_HEADER_LEN;
+}
+
+/* copy a raw argument, return -1 if it doesn't fit */
+#define PSPLOG_ENCODE(type, value) \
+	do { \
+		type v = (value); \
+		if (len + sizeof (type) > size) \
+			goto truncated; \
+		memcpy (buf + len, &v, sizeof (type)); \
+		len += sizeof (type); \
+	} while (0)
+
+/*
+ * Encode a binary record: walk format string like printf would, to know
+ * arguments types, but copy raw values instead of converting them.
+ */
+int
+psplog_encode (char *buf, size_t size, enum psplog_category cat,
+		unsigned int site, const char * fmt, va_list ap)
+{
+	size_t len = PSPLOG_BINARY_HEADER_LEN;
+	int flags = 0;
+	const char *p;
+
+	if (size < PSPLOG_BINARY_HEADER_LEN)
+		return -1;
+
+	for (p = fmt; *p; p++) {
+		int lng = 0;
+
+		if (*p != '%')
+			continue;
+
+		p++;
+		if (*p == '%')
+			continue;
+
+		/* flags */
+		while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' ||
+				*p == '0')
+			p++;
+
+		/* width */
+		if (*p == '*') {
+			PSPLOG_ENCODE (int32_t, va_arg (ap, int));
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+
+		/* precision */
+		if (*p == '.') {
+			p++;
+			if (*p == '*') {
+				PSPLOG_ENCODE (int32_t, va_arg (ap, int));
+				p++;
+			}
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+
+		/* length */
+		while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' ||
+				*p == 'j' || *p == 'z' || *p == 't') {
+			if (*p == 'l' || *p == 'L' || *p == 'q' || *p == 'j')
+				lng++;
+			p++;
+		}
+
+		switch (*p) {
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'c':
+				if (lng >= 2)
+					PSPLOG_ENCODE (int64_t,
+							va_arg (ap, long long));
+				else if (lng == 1)
+					PSPLOG_ENCODE (int32_t, va_arg (ap, long));
+				else
+					PSPLOG_ENCODE (int32_t, va_arg (ap, int));
+				break;
+
+			case 'p':
+			case 'n':
+				PSPLOG_ENCODE (uint32_t,
+						(uintptr_t) va_arg (ap, void *));
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				PSPLOG_ENCODE (double, va_arg (ap, double));
+				break;
+
+			case 's':
+			{
+				const char *str = va_arg (ap, const char *);
+				size_t slen;
+
+				if (str == NULL)
+					str = "(null)";
+
+				slen = strlen (str);
+				if (slen > PSPLOG_BINARY_STRING_MAX)
+					slen = PSPLOG_BINARY_STRING_MAX;
+
+				if (len + 1 + slen > size)
+					goto truncated;
+
+				buf[len++] = slen;
+				memcpy (buf + len, str, slen);
+				len += slen;
+				break;
+			}
+
+			case '\0':
+				p--;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	goto done;
+
+truncated:
+	flags |= PSPLOG_BINARY_FLAG_TRUNCATED;
+
+done:
+	psplog_encode_header (buf, len, cat, flags, site);
+	return len;
+}
+
+/* read a raw argument, stop expanding if record was truncated */
+#define PSPLOG_DECODE(type, var) \
+	do { \
+		if (pos + sizeof (type) > size) \
+			goto done; \
+		memcpy (&(var), args + pos, sizeof (type)); \
+		pos += sizeof (type); \
+	} while (0)
+
+/*
+ * Expand raw arguments of a binary record, as encoded by psplog_encode (),
+ * to text. Each conversion is rebuilt with its width and precision values
+ * and our own length modifier, then formatted alone.
+ */
+static int
+psplog_expand (char *buf, size_t len_max, const char * fmt, const char * args,
+		size_t size)
+{
+	size_t len = 0;
+	size_t pos = 0;
+	const char *p = fmt;
+
+	if (len_max == 0)
+		return -1;
+
+	while (*p && len < len_max - 1) {
+		char spec[32];
+		size_t spec_len = 0;
+		int lng = 0;
+		int n = 0;
+
+		if (*p != '%') {
+			buf[len++] = *p++;
+			continue;
+		}
+
+		if (p[1] == '%') {
+			buf[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		spec[spec_len++] = *p++;
+
+		/* flags */
+		while ((*p == '-' || *p == '+' || *p == ' ' || *p == '#' ||
+				*p == '0') && spec_len < 8)
+			spec[spec_len++] = *p++;
+
+		/* width */
+		if (*p == '*') {
+			int32_t width;
+
+			PSPLOG_DECODE (int32_t, width);
+			spec_len += snprintf (spec + spec_len, 12, "%d",
+					(int) width);
+			p++;
+		}
+		while (*p >= '0' && *p <= '9') {
+			if (spec_len < 20)
+				spec[spec_len++] = *p;
+			p++;
+		}
+
+		/* precision */
+		if (*p == '.') {
+			spec[spec_len++] = *p++;
+			if (*p == '*') {
+				int32_t precision;
+
+				PSPLOG_DECODE (int32_t, precision);
+				spec_len += snprintf (spec + spec_len, 12, "%d",
+						(int) precision);
+				p++;
+			}
+			while (*p >= '0' && *p <= '9') {
+				if (spec_len < 26)
+					spec[spec_len++] = *p;
+				p++;
+			}
+		}
+
+		/* length, replaced by the one matching decoded type */
+		while (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'q' ||
+				*p == 'j' || *p == 'z' || *p == 't') {
+			if (*p == 'l' || *p == 'L' || *p == 'q' || *p == 'j')
+				lng++;
+			p++;
+		}
+
+		if (*p == '\0')
+			break;
+
+		switch (*p) {
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'c':
+			{
+				int signed_conv = (*p == 'd' || *p == 'i');
+
+				if (lng >= 2) {
+					int64_t v;
+
+					PSPLOG_DECODE (int64_t, v);
+					spec[spec_len++] = 'l';
+					spec[spec_len++] = 'l';
+					spec[spec_len++] = *p;
+					spec[spec_len] = '\0';
+					n = snprintf (buf + len, len_max - len,
+							spec, (long long) v);
+				} else {
+					int32_t v;
+
+					PSPLOG_DECODE (int32_t, v);
+					spec[spec_len++] = *p;
+					spec[spec_len] = '\0';
+					if (signed_conv || *p == 'c')
+						n = snprintf (buf + len,
+								len_max - len,
+								spec, (int) v);
+					else
+						n = snprintf (buf + len,
+								len_max - len,
+								spec,
+								(unsigned int) v);
+				}
+				break;
+			}
+
+			case 'p':
+			{
+				uint32_t v;
+
+				PSPLOG_DECODE (uint32_t, v);
+				spec[spec_len++] = 'p';
+				spec[spec_len] = '\0';
+				n = snprintf (buf + len, len_max - len, spec,
+						(void *) (uintptr_t) v);
+				break;
+			}
+
+			case 'n':
+			{
+				uint32_t v;
+
+				PSPLOG_DECODE (uint32_t, v);
+				break;
+			}
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+			{
+				double v;
+
+				PSPLOG_DECODE (double, v);
+				spec[spec_len++] = *p;
+				spec[spec_len] = '\0';
+				n = snprintf (buf + len, len_max - len, spec, v);
+				break;
+			}
+
+			case 's':
+			{
+				char str[PSPLOG_BINARY_STRING_MAX + 1];
+				uint8_t slen;
+
+				/* history keeps only start of long records */
+				PSPLOG_DECODE (uint8_t, slen);
+				if (pos + slen > size)
+					slen = size - pos;
+
+				memcpy (str, args + pos, slen);
+				str[slen] = '\0';
+				pos += slen;
+
+				spec[spec_len++] = 's';
+				spec[spec_len] = '\0';
+				n = snprintf (buf + len, len_max - len, spec, str);
+				break;
+			}
+
+			default:
+				break;
+		}
+
+		p++;
+
+		/* snprintf returns length before truncation */
+		if (n > 0)
+			len += n;
+		if (len > len_max - 1)
+			len = len_max - 1;
+	}
+
+done:
+	buf[len] = '\0';
+	return len;
+}
+
+/* keep a record produced for output: text without category and newline,
+ * or raw arguments of a binary record when fmt is set */
+static void
+psplog_history_add (enum psplog_category cat, const char * fmt,
+		const char * data, size_t size)
+{
+	PspLogHistoryEntry *entry;
+	unsigned int seq;
+	int intr;
+
+	if (size > PSPLOG_HISTORY_LINE_LEN)
+		size = PSPLOG_HISTORY_LINE_LEN;
+
+	intr = platform_critical_enter ();
+	seq = psplog_history_head++;
+	entry = &psplog_history[seq & (PSPLOG_HISTORY_SIZE - 1)];
+	entry->seq = PSPLOG_HISTORY_INVALID;
+	platform_critical_leave (intr);
+
+	PSPLOG_BARRIER ();
+	entry->cat = cat;
+	entry->fmt = fmt;
+	entry->size = size;
+	memcpy (entry->data, data, size);
+
+	PSPLOG_BARRIER ();
+	entry->seq = seq;
+}
+
+static void
+psplog_history_printf (enum psplog_category cat, const char * fmt, ...)
+{
+	va_list ap;
+	char buf[128];
+	int size;
+
+	va_start (ap, fmt);
+	if (binary)
+		size = psplog_encode (buf, sizeof (buf), cat, 0, fmt, ap);
+	else
+		size = vsnprintf (buf, sizeof (buf), fmt, ap);
+	va_end (ap);
+
+	if (size < 0)
+		return;
+
+	if (binary) {
+		psplog_history_add (cat, fmt, buf + PSPLOG_BINARY_HEADER_LEN,
+				size - PSPLOG_BINARY_HEADER_LEN);
+	} else {
+		/* vsnprintf returns length before truncation */
+		if (size > (int) sizeof (buf) - 1)
+			size = sizeof (buf) - 1;
+		psplog_history_add (cat, NULL, buf, size);
+	}
+}
+
+unsigned int
+psplog_history_get_count (void)
+{
+	return psplog_history_head;
+}
+
 int
-psplog_init (enum psplog_category level, const char *path)
+psplog_history_get (unsigned int seq, char *buf, size_t size,
+		enum psplog_category *cat)
+{
+	PspLogHistoryEntry *entry =
+		&psplog_history[seq & (PSPLOG_HISTORY_SIZE - 1)];
+	char data[PSPLOG_HISTORY_LINE_LEN];
+	const char *fmt;
+	unsigned int data_size;
+
+	if (size == 0 || entry->seq != seq)
+		return -1;
+
+	PSPLOG_BARRIER ();
+	fmt = entry->fmt;
+	data_size = entry->size;
+	if (data_size > PSPLOG_HISTORY_LINE_LEN)
+		data_size = PSPLOG_HISTORY_LINE_LEN;
+	memcpy (data, entry->data, data_size);
+	if (cat)
+		*cat = entry->cat;
+	PSPLOG_BARRIER ();
+
+	/* overwritten while copying */
+	if (entry->seq != seq)
+		return -1;
+
+	if (fmt)
+		return psplog_expand (buf, size, fmt, data, data_size) < 0 ?
+			-1 : 0;
+
+	if (data_size > size - 1)
+		data_size = size - 1;
+	memcpy (buf, data, data_size);
+	buf[data_size] = '\0';
+
+	return 0;
+}
+
+static void
+psplog_history_suppressed (enum psplog_category cat, unsigned int site,
+		unsigned int count)
+{
+	psplog_history_printf (cat, "%s:%u: %u similar records suppressed",
+			psplog_module_get_name (site >> 16), site & 0xffff,
+			count);
+}
+
+/* summary record for a rate limited call site */
+static int
+psplog_format_suppressed (char *buf, size_t size, enum psplog_category cat,
+		unsigned int site, unsigned int count)
+{
+	int len;
+
+	if (binary) {
+		uint32_t site32 = site;
+		uint32_t count32 = count;
+
+		if (size < PSPLOG_BINARY_HEADER_LEN + 8)
+			return -1;
+
+		len = psplog_encode_header (buf, PSPLOG_BINARY_HEADER_LEN + 8,
+				cat, 0, PSPLOG_BINARY_SITE_SUPPRESSED);
+		memcpy (buf + len, &site32, 4);
+		memcpy (buf + len + 4, &count32, 4);
+		return len + 8;
+	}
+
+	len = snprintf (buf, size, "%s %s:%u: %u similar records suppressed\n",
+			psplog_category_get_name (cat),
+			psplog_module_get_name (site >> 16), site & 0xffff,
+			count);
+	if (len > (int) size - 1)
+		len = size - 1;
+
+	return len;
+}
+
+/* queue a formatted record for writer thread, never blocks */
+static int
+psplog_ring_push (const char *buf, size_t size)
+{
+	PspLogRecord *record;
+	unsigned int index;
+	int intr;
+
+	intr = platform_critical_enter ();
+
+	if (psplog_ring_head - psplog_ring_tail >= PSPLOG_RING_SIZE) {
+		psplog_dropped++;
+		platform_critical_leave (intr);
+		metrics_counter_inc (METRICS_PSPLOG_DROPPED);
+		return -1;
+	}
+
+	index = psplog_ring_head++;
+	platform_critical_leave (intr);
+
+	if (index - psplog_ring_tail == PSPLOG_RING_SIZE / 2)
+		platform_sema_signal (psplog_writer_semaphore);
+
+	record = &psplog_ring[index & (PSPLOG_RING_SIZE - 1)];
+	memcpy (record->data, buf, size);
+	record->size = size;
+
+	PSPLOG_BARRIER ();
+	record->ready = 1;
+
+	return 0;
+}
+
+/* append to write buffer, writing it when full */
+static void
+psplog_write_buffer_append (size_t * len, const char *data, size_t size)
+{
+	if (*len + size > PSPLOG_WRITE_BUFFER_LEN) {
+		platform_file_write (psplog_fd, psplog_write_buffer, *len);
+		*len = 0;
+	}
+
+	memcpy (psplog_write_buffer + *len, data, size);
+	*len += size;
+}
+
+/* report records suppressed during a period which is now over */
+static void
+psplog_limits_flush (size_t * len)
+{
+	PspLogLimit *limit;
+
+	for (limit = psplog_limits; limit != NULL; limit = limit->next) {
+		unsigned int suppressed = 0;
+		int intr;
+
+		intr = platform_critical_enter ();
+		if (limit->suppressed > 0 && platform_get_time () -
+				limit->window_start >= PSPLOG_LIMIT_PERIOD) {
+			suppressed = limit->suppressed;
+			limit->suppressed = 0;
+		}
+		platform_critical_leave (intr);
+
+		if (suppressed > 0) {
+			char buf[128];
+			int size;
+
+			psplog_history_suppressed (limit->cat, limit->site,
+					suppressed);
+			size = psplog_format_suppressed (buf, sizeof (buf),
+					limit->cat, limit->site, suppressed);
+			if (size > 0)
+				psplog_write_buffer_append (len, buf, size);
+		}
+	}
+}
+
+/* write all published records, in order */
+static void
+psplog_ring_flush (void)
+{
+	static unsigned int reported_dropped = 0;
+	unsigned int dropped;
+	size_t len = 0;
+
+	metrics_gauge_set (METRICS_PSPLOG_RING_DEPTH,
+			psplog_ring_head - psplog_ring_tail);
+	trace_begin ("log_write");
+
+	for (;;) {
+		PspLogRecord *record =
+			&psplog_ring[psplog_ring_tail & (PSPLOG_RING_SIZE - 1)];
+
+		if (psplog_ring_tail == psplog_ring_head || !record->ready)
+			break;
+
+		PSPLOG_BARRIER ();
+		psplog_write_buffer_append (&len, record->data, record->size);
+
+		record->ready = 0;
+		PSPLOG_BARRIER ();
+		psplog_ring_tail++;
+	}
+
+	dropped = psplog_dropped;
+	if (dropped != reported_dropped) {
+		char buf[64];
+		int size;
+
+		if (binary) {
+			uint32_t count = dropped - reported_dropped;
+
+			size = psplog_encode_header (buf,
+					PSPLOG_BINARY_HEADER_LEN + 4,
+					PSPLOG_CAT_WARNING, 0,
+					PSPLOG_BINARY_SITE_DROPPED);
+			memcpy (buf + size, &count, 4);
+			size += 4;
+		} else {
+			size = snprintf (buf, sizeof (buf),
+					"%s %u records dropped\n",
+					psplog_category_get_name (
+						PSPLOG_CAT_WARNING),
+					dropped - reported_dropped);
+		}
+
+		psplog_write_buffer_append (&len, buf, size);
+		reported_dropped = dropped;
+	}
+
+	psplog_limits_flush (&len);
+
+	if (len > 0)
+		platform_file_write (psplog_fd, psplog_write_buffer, len);
+
+	trace_end ("log_write");
+}
+
+static int
+psplog_writer_run (void *data)
+{
+	while (psplog_writer_running) {
+		platform_sema_wait (psplog_writer_semaphore,
+				PSPLOG_WRITER_PERIOD);
+		psplog_ring_flush ();
+	}
+
+	return 0;
+}
+
+int
+psplog_init (enum psplog_category level, const char *path, int binary_mode)
 {
 	output = path ? PSPLOG_OUTPUT_FILE : PSPLOG_OUTPUT_SCREEN;
+	binary = path ? binary_mode : 0;
 
 	if (output == PSPLOG_OUTPUT_FILE) {
-		psplog_fd = sceIoOpen (path,
-				PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+		psplog_fd = platform_file_create (path);
 		if (psplog_fd < 0)
 			return -1;
+
+		if (binary)
+			platform_file_write (psplog_fd, PSPLOG_BINARY_MAGIC,
+					strlen (PSPLOG_BINARY_MAGIC));
+
+		psplog_ring_head = psplog_ring_tail = 0;
+		psplog_dropped = 0;
+		psplog_writer_running = 1;
+
+		psplog_writer_semaphore = platform_sema_create (
+				"psplog_writer_semaphore", 0, 1);
+		if (psplog_writer_semaphore < 0)
+			goto no_writer;
+
+		psplog_writer = platform_thread_create ("psplog_writer",
+				psplog_writer_run, NULL, PSPLOG_WRITER_PRIORITY,
+				PSPLOG_WRITER_STACK_SIZE);
+		if (psplog_writer < 0)
+			goto no_writer;
 	} else {
-		pspDebugScreenInit ();
-		pspDebugScreenSetXY (0, 0);
+		platform_screen_init ();
 	}
 
-	psplog_semaphore = sceKernelCreateSema ("psplog_semaphore", 0, 1, 1,
-			NULL);
+	psplog_semaphore = platform_sema_create ("psplog_semaphore", 1, 1);
 
 	level_threshold = level;
 
 	return 0;
+
+no_writer:
+	if (psplog_writer_semaphore >= 0)
+		platform_sema_delete (psplog_writer_semaphore);
+	psplog_writer_semaphore = -1;
+	psplog_writer = -1;
+	psplog_writer_running = 0;
+	platform_file_close (psplog_fd);
+	psplog_fd = -1;
+	return -1;
 }
 
 void
 psplog_deinit()
 {
+	if (psplog_writer >= 0) {
+		psplog_writer_running = 0;
+		platform_sema_signal (psplog_writer_semaphore);
+		platform_thread_join (psplog_writer);
+		platform_sema_delete (psplog_writer_semaphore);
+		psplog_writer = -1;
+		psplog_writer_semaphore = -1;
+
+		/* records queued after writer last wake up */
+		psplog_ring_flush ();
+	}
+
+	while (psplog_limits != NULL) {
+		PspLogLimit *limit = psplog_limits;
+
+		psplog_limits = limit->next;
+		limit->next = NULL;
+		limit->registered = 0;
+	}
+
 	if (psplog_fd > 0)
-		sceIoClose (psplog_fd);
+		platform_file_close (psplog_fd);
 
-	sceKernelDeleteSema (psplog_semaphore);
+	platform_sema_delete (psplog_semaphore);
+}
+
+unsigned int
+psplog_get_dropped_count (void)
+{
+	return psplog_dropped;
 }
 
 int
@@ -115,6 +937,11 @@ psplog_format (char *buf, size_t size, enum psplog_category cat,
 
 	/* keep 1 byte of buf for \n */
 	wbytes += vsnprintf (buf + wbytes, size - wbytes - 1, fmt, ap);
+
+	/* vsnprintf returns length before truncation */
+	if (wbytes > (int) size - 1)
+		wbytes = size - 1;
+
 	buf[wbytes++] = '\n';
 	return wbytes;
 }
@@ -125,8 +952,7 @@ psplog_print_file (enum psplog_category cat, const char *buf, size_t size)
 	int wbytes;
 
 	if (psplog_fd > 0) {
-		wbytes = sceIoWrite (psplog_fd, buf, size);
-		/* sceIoSync("ms0:", 0); */
+		wbytes = platform_file_write (psplog_fd, buf, size);
 		return wbytes;
 	}
 
@@ -136,7 +962,7 @@ psplog_print_file (enum psplog_category cat, const char *buf, size_t size)
 int
 psplog_print_screen (enum psplog_category cat, const char *buf, size_t size)
 {
-	u32 color;
+	unsigned int color;
 
 	switch (cat) {
 		case PSPLOG_CAT_ERROR:
@@ -156,38 +982,119 @@ psplog_print_screen (enum psplog_category cat, const char *buf, size_t size)
 			break;
 	}
 
-	pspDebugScreenSetTextColor (color);
-	pspDebugScreenPrintData (buf, size);
-	pspDebugScreenSetTextColor (COLOR_WHITE);
+	platform_screen_print (color, buf, size);
 
 	return 0;
 }
 
+static void
+psplog_output_record (enum psplog_category cat, const char *buf, size_t size)
+{
+	/* file output is done by writer thread, so that caller never waits
+	 * for memory stick */
+	if (output == PSPLOG_OUTPUT_FILE) {
+		psplog_ring_push (buf, size);
+		return;
+	}
+
+	if (platform_sema_wait (psplog_semaphore, PLATFORM_WAIT_FOREVER) < 0)
+		return;
+
+	psplog_print_screen (cat, buf, size);
+
+	platform_sema_signal (psplog_semaphore);
+}
+
 void
-psplog_print (enum psplog_category cat, const char * fmt, ...)
+psplog_print (enum psplog_category cat, unsigned int site,
+		const char * fmt, ...)
 {
 	va_list ap;
-	char buf[BUFFER_LEN] = { 0, };
+	char buf[BUFFER_LEN];
 	int size;
 
 	if (cat > level_threshold)
 		return;
 
-	if (sceKernelWaitSema (psplog_semaphore, 1, NULL) < 0)
-		goto done;
+	metrics_counter_inc (METRICS_PSPLOG_RECORDS);
 
 	va_start (ap, fmt);
-	size = psplog_format (buf, BUFFER_LEN, cat, fmt, ap);
+	if (binary)
+		size = psplog_encode (buf, BUFFER_LEN, cat, site, fmt, ap);
+	else
+		size = psplog_format (buf, BUFFER_LEN, cat, fmt, ap);
 	va_end (ap);
 
-	if (output == PSPLOG_OUTPUT_FILE) {
-		psplog_print_file (cat, buf, size);
+	if (size < 0)
+		return;
+
+	/* history copies what was produced, it never formats again */
+	if (binary) {
+		psplog_history_add (cat, fmt, buf + PSPLOG_BINARY_HEADER_LEN,
+				size - PSPLOG_BINARY_HEADER_LEN);
 	} else {
-		psplog_print_screen (cat, buf, size);
+		size_t prefix = strlen (psplog_category_get_name (cat)) + 1;
+
+		psplog_history_add (cat, NULL, buf + prefix,
+				size - prefix - 1);
 	}
 
-	sceKernelSignalSema (psplog_semaphore, 1);
+	psplog_output_record (cat, buf, size);
+}
 
-done:
-	return;
+int
+psplog_limit_check (PspLogLimit * limit, enum psplog_category cat,
+		unsigned int site)
+{
+	unsigned int suppressed = 0;
+	int allowed;
+	int intr;
+
+	if (cat > level_threshold)
+		return 0;
+
+	/* a limiter may be shared by threads, and is also read by writer */
+	intr = platform_critical_enter ();
+
+	if (platform_get_time () - limit->window_start >=
+			PSPLOG_LIMIT_PERIOD) {
+		suppressed = limit->suppressed;
+		limit->window_start = platform_get_time ();
+		limit->count = 0;
+		limit->suppressed = 0;
+	}
+
+	allowed = limit->count < PSPLOG_LIMIT_BURST;
+	if (allowed) {
+		limit->count++;
+	} else {
+		limit->suppressed++;
+		limit->site = site;
+		limit->cat = cat;
+
+		if (!limit->registered && output == PSPLOG_OUTPUT_FILE) {
+			limit->next = psplog_limits;
+			psplog_limits = limit;
+			limit->registered = 1;
+		}
+	}
+
+	platform_critical_leave (intr);
+
+	if (!allowed)
+		metrics_counter_inc (METRICS_PSPLOG_SUPPRESSED);
+
+	/* previous period wasn't reported by writer yet */
+	if (suppressed > 0) {
+		char buf[128];
+		int size;
+
+		psplog_history_suppressed (cat, site, suppressed);
+		size = psplog_format_suppressed (buf, sizeof (buf), cat, site,
+				suppressed);
+		if (size > 0)
+			psplog_output_record (cat, buf, size);
+	}
+
+	return allowed;
 }
@@ -28,34 +28,222 @@
 #ifndef PSPLOG_H_
 #define PSPLOG_H_
 
+#include <stddef.h>
+
+/* numeric levels, usable in preprocessor conditions */
+#define PSPLOG_LEVEL_ERROR   0
+#define PSPLOG_LEVEL_WARNING 1
+#define PSPLOG_LEVEL_INFO    2
+#define PSPLOG_LEVEL_DEBUG   3
+#define PSPLOG_LEVEL_TRACE   4 /* per frame or per packet */
+
 enum psplog_category
 {
-	PSPLOG_CAT_ERROR = 0,
-	PSPLOG_CAT_WARNING,
-	PSPLOG_CAT_INFO,
-	PSPLOG_CAT_DEBUG
+	PSPLOG_CAT_ERROR = PSPLOG_LEVEL_ERROR,
+	PSPLOG_CAT_WARNING = PSPLOG_LEVEL_WARNING,
+	PSPLOG_CAT_INFO = PSPLOG_LEVEL_INFO,
+	PSPLOG_CAT_DEBUG = PSPLOG_LEVEL_DEBUG,
+	PSPLOG_CAT_TRACE = PSPLOG_LEVEL_TRACE
 };
 
+/* log call sites are identified by module and line, so that binary logs
+ * can be expanded offline. Sources define PSPLOG_MODULE before including
+ * this file, tools/psplog-fmtgen.py reads these values. */
+#define PSPLOG_MODULE_DEFAULT 0
+#define PSPLOG_MODULE_MAIN    1
+#define PSPLOG_MODULE_DRONE   2
+#define PSPLOG_MODULE_UI      3
+#define PSPLOG_MODULE_MENU    4
+#define PSPLOG_MODULE_INPUT   5
+#define PSPLOG_MODULE_LATENCY 6
+#define PSPLOG_MODULE_PSPLOG  7
+#define PSPLOG_MODULE_METRICS 8
+#define PSPLOG_MODULE_TRACE   9
+#define PSPLOG_MODULE_PLATFORM 10
+#define PSPLOG_MODULE_CAPTURE  11
+#define PSPLOG_MODULE_FLIGHTREC 12
+#define PSPLOG_MODULE_MEMTRACK 13
+
+#ifndef PSPLOG_MODULE
+#define PSPLOG_MODULE PSPLOG_MODULE_DEFAULT
+#endif
+
+#define PSPLOG_SITE ((PSPLOG_MODULE << 16) | __LINE__)
+
+/* statements above this level are compiled out, arguments included, so that
+ * they cost nothing whatever the runtime level */
+#ifndef PSPLOG_MAX_LEVEL
+#define PSPLOG_MAX_LEVEL PSPLOG_LEVEL_INFO
+#endif
+
+/* per module maximum level, e.g. -DPSPLOG_MAX_LEVEL_DRONE=PSPLOG_LEVEL_TRACE
+ * to debug drone without paying for the others */
+#ifndef PSPLOG_MAX_LEVEL_MAIN
+#define PSPLOG_MAX_LEVEL_MAIN PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_DRONE
+#define PSPLOG_MAX_LEVEL_DRONE PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_UI
+#define PSPLOG_MAX_LEVEL_UI PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_MENU
+#define PSPLOG_MAX_LEVEL_MENU PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_INPUT
+#define PSPLOG_MAX_LEVEL_INPUT PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_LATENCY
+#define PSPLOG_MAX_LEVEL_LATENCY PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_PSPLOG
+#define PSPLOG_MAX_LEVEL_PSPLOG PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_METRICS
+#define PSPLOG_MAX_LEVEL_METRICS PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_TRACE
+#define PSPLOG_MAX_LEVEL_TRACE PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_PLATFORM
+#define PSPLOG_MAX_LEVEL_PLATFORM PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_CAPTURE
+#define PSPLOG_MAX_LEVEL_CAPTURE PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_FLIGHTREC
+#define PSPLOG_MAX_LEVEL_FLIGHTREC PSPLOG_MAX_LEVEL
+#endif
+#ifndef PSPLOG_MAX_LEVEL_MEMTRACK
+#define PSPLOG_MAX_LEVEL_MEMTRACK PSPLOG_MAX_LEVEL
+#endif
+
+#define PSPLOG_MODULE_MAX_LEVEL(module) \
+	((module) == PSPLOG_MODULE_MAIN ? PSPLOG_MAX_LEVEL_MAIN : \
+	 (module) == PSPLOG_MODULE_DRONE ? PSPLOG_MAX_LEVEL_DRONE : \
+	 (module) == PSPLOG_MODULE_UI ? PSPLOG_MAX_LEVEL_UI : \
+	 (module) == PSPLOG_MODULE_MENU ? PSPLOG_MAX_LEVEL_MENU : \
+	 (module) == PSPLOG_MODULE_INPUT ? PSPLOG_MAX_LEVEL_INPUT : \
+	 (module) == PSPLOG_MODULE_LATENCY ? PSPLOG_MAX_LEVEL_LATENCY : \
+	 (module) == PSPLOG_MODULE_PSPLOG ? PSPLOG_MAX_LEVEL_PSPLOG : \
+	 (module) == PSPLOG_MODULE_METRICS ? PSPLOG_MAX_LEVEL_METRICS : \
+	 (module) == PSPLOG_MODULE_TRACE ? PSPLOG_MAX_LEVEL_TRACE : \
+	 (module) == PSPLOG_MODULE_PLATFORM ? PSPLOG_MAX_LEVEL_PLATFORM : \
+	 (module) == PSPLOG_MODULE_CAPTURE ? PSPLOG_MAX_LEVEL_CAPTURE : \
+	 (module) == PSPLOG_MODULE_FLIGHTREC ? PSPLOG_MAX_LEVEL_FLIGHTREC : \
+	 (module) == PSPLOG_MODULE_MEMTRACK ? PSPLOG_MAX_LEVEL_MEMTRACK : \
+	 PSPLOG_MAX_LEVEL)
+
+/* constant expression, also usable in #if to guard code only needed to
+ * build a log message */
+#define PSPLOG_ENABLED(level) \
+	((level) <= PSPLOG_MODULE_MAX_LEVEL (PSPLOG_MODULE))
+
+#define PSPLOG_PRINT(level, fmt, ...) \
+	do { \
+		if (PSPLOG_ENABLED (level)) \
+			psplog_print ((enum psplog_category) (level), \
+					PSPLOG_SITE, (fmt), ##__VA_ARGS__); \
+	} while (0)
+
 #define PSPLOG_ERROR(fmt, ...) \
-	psplog_print (PSPLOG_CAT_ERROR, (fmt), ##__VA_ARGS__)
+	PSPLOG_PRINT (PSPLOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
 #define PSPLOG_WARNING(fmt, ...) \
-	psplog_print (PSPLOG_CAT_WARNING, (fmt), ##__VA_ARGS__)
+	PSPLOG_PRINT (PSPLOG_LEVEL_WARNING, fmt, ##__VA_ARGS__)
 #define PSPLOG_INFO(fmt, ...) \
-	psplog_print (PSPLOG_CAT_INFO, (fmt), ##__VA_ARGS__)
+	PSPLOG_PRINT (PSPLOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
 #define PSPLOG_DEBUG(fmt, ...) \
-	psplog_print (PSPLOG_CAT_DEBUG, (fmt), ##__VA_ARGS__)
+	PSPLOG_PRINT (PSPLOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define PSPLOG_TRACE(fmt, ...) \
+	PSPLOG_PRINT (PSPLOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+
+/* rate limiting: a call site logs at most PSPLOG_LIMIT_BURST records per
+ * PSPLOG_LIMIT_PERIOD, following ones are counted and reported as a single
+ * "suppressed" record once period is over, so that an error repeating in a
+ * loop can't flood the log */
+#define PSPLOG_LIMIT_BURST 5
+#define PSPLOG_LIMIT_PERIOD 5000000 /* us */
+
+typedef struct _PspLogLimit PspLogLimit;
+
+struct _PspLogLimit
+{
+	unsigned int window_start;
+	unsigned int count;
+	unsigned int suppressed;
+	unsigned int site;
+	enum psplog_category cat;
+
+	/* limiters with pending suppressed records, reported by writer */
+	PspLogLimit *next;
+	int registered;
+};
+
+/* return non zero if a record of this category may be logged now */
+int psplog_limit_check (PspLogLimit * limit, enum psplog_category cat,
+		unsigned int site);
+
+/* condition guarding a block which builds and logs a message, so that the
+ * cost of building it is also bounded, e.g.
+ *   if (PSPLOG_LIMITED (PSPLOG_LEVEL_INFO)) {
+ *     describe (buf, msg);
+ *     PSPLOG_INFO ("%s", msg);
+ *   } */
+#define PSPLOG_LIMITED(level) \
+	({ \
+		static PspLogLimit _psplog_limit; \
+		PSPLOG_ENABLED (level) && \
+			psplog_limit_check (&_psplog_limit, \
+					(enum psplog_category) (level), \
+					PSPLOG_SITE); \
+	})
+
+#define PSPLOG_PRINT_LIMITED(level, fmt, ...) \
+	do { \
+		if (PSPLOG_LIMITED (level)) \
+			psplog_print ((enum psplog_category) (level), \
+					PSPLOG_SITE, (fmt), ##__VA_ARGS__); \
+	} while (0)
+
+#define PSPLOG_ERROR_LIMITED(fmt, ...) \
+	PSPLOG_PRINT_LIMITED (PSPLOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define PSPLOG_WARNING_LIMITED(fmt, ...) \
+	PSPLOG_PRINT_LIMITED (PSPLOG_LEVEL_WARNING, fmt, ##__VA_ARGS__)
+#define PSPLOG_INFO_LIMITED(fmt, ...) \
+	PSPLOG_PRINT_LIMITED (PSPLOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
 
 /**
  * Init psplog context
  *
  * @level : max level to log
  * @path : path to log file. It could be NULL, in this case log output on screen
+ * @binary : write raw arguments instead of formatted text to file, to be
+ * expanded on host with tools/psplog-decode.py
  */
-int psplog_init (enum psplog_category level, const char *path);
+int psplog_init (enum psplog_category level, const char *path, int binary);
 
 void psplog_deinit ();
 
-void psplog_print (enum psplog_category cat, const char * fmt, ...);
+void psplog_print (enum psplog_category cat, unsigned int site,
+		const char * fmt, ...);
+
+/* number of records lost because writer thread could not keep up */
+unsigned int psplog_get_dropped_count (void);
+
+/* last records are also kept in memory, whatever the output, so that they
+ * can be shown during flight. They are kept as written to output, raw
+ * arguments in binary mode, and only turned to text when read. Records are
+ * numbered from 0 in logging order. */
+#define PSPLOG_HISTORY_SIZE 64 /* must be a power of 2 */
+#define PSPLOG_HISTORY_LINE_LEN 96
+
+/* number of records logged so far, i.e. number of next record */
+unsigned int psplog_history_get_count (void);
+
+/* copy text of a record, without category, return -1 if record is not
+ * in history anymore or not written yet */
+int psplog_history_get (unsigned int seq, char *buf, size_t size,
+		enum psplog_category *cat);
 
 
 #endif
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Capture replay: feed d2c buffers recorded by capture.c to
+ * ARCOMMANDS_Decoder_DecodeBuffer () and drone.c callbacks, to reproduce
+ * field bugs or measure decoding cost on host.
+ *
+ * usage: capture-replay [-r] [-v] [-n loops] capture_file
+ *
+ * By default records are decoded as fast as possible and decoding
+ * throughput is reported, -n repeats the whole capture to get stable
+ * figures. -r replays records at their captured pace instead, -v describes
+ * each record. Drone state reached at end of capture is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <libARCommands/ARCommands.h>
+
+#include "capture.h"
+#include "drone.h"
+#include "platform.h"
+#include "psplog.h"
+
+#define REPLAY_DESCRIPTION_LEN 256
+
+typedef struct _ReplayRecord ReplayRecord;
+
+/* record header fields, decoded from little endian */
+struct _ReplayRecord
+{
+	uint32_t timestamp;
+	int buffer_id;
+	int size;
+	uint8_t *payload;
+};
+
+static int replay_realtime = 0;
+static int replay_verbose = 0;
+static int replay_loops = 1;
+
+static uint8_t *replay_data;
+static size_t replay_data_size;
+
+static int
+replay_load (const char * path)
+{
+	FILE *file;
+	long size;
+
+	file = fopen (path, "rb");
+	if (file == NULL)
+		goto no_file;
+
+	if (fseek (file, 0, SEEK_END) < 0 || (size = ftell (file)) < 0)
+		goto read_failed;
+	rewind (file);
+
+	replay_data = malloc (size > 0 ? size : 1);
+	if (replay_data == NULL)
+		goto read_failed;
+
+	if (fread (replay_data, 1, size, file) != (size_t) size)
+		goto read_failed;
+
+	fclose (file);
+	replay_data_size = size;
+
+	if (replay_data_size < CAPTURE_MAGIC_LEN ||
+			memcmp (replay_data, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+		fprintf (stderr, "%s is not a capture file\n", path);
+		return -1;
+	}
+
+	return 0;
+
+no_file:
+	perror (path);
+	return -1;
+
+read_failed:
+	perror (path);
+	fclose (file);
+	return -1;
+}
+
+/* return offset of next record, 0 at end of capture */
+static size_t
+replay_next (size_t offset, ReplayRecord * record)
+{
+	const uint8_t *p = replay_data + offset;
+
+	if (offset + sizeof (CaptureRecordHeader) > replay_data_size)
+		return 0;
+
+	record->timestamp = p[0] | (p[1] << 8) | (p[2] << 16) |
+		((uint32_t) p[3] << 24);
+	record->buffer_id = p[4];
+	record->size = p[6] | (p[7] << 8);
+	record->payload = replay_data + offset + sizeof (CaptureRecordHeader);
+
+	offset += sizeof (CaptureRecordHeader) + record->size;
+	if (offset > replay_data_size) {
+		fprintf (stderr, "truncated record, capture ends\n");
+		return 0;
+	}
+
+	return offset;
+}
+
+static void
+replay_describe (const ReplayRecord * record)
+{
+	char msg[REPLAY_DESCRIPTION_LEN];
+
+	if (ARCOMMANDS_Decoder_DescribeBuffer (record->payload, record->size,
+				msg, sizeof (msg)) != ARCOMMANDS_DECODER_OK)
+		snprintf (msg, sizeof (msg), "undescribable, %d bytes",
+				record->size);
+
+	printf ("%10u %3d %s\n", record->timestamp, record->buffer_id, msg);
+}
+
+static void
+replay_print_state (const Drone * drone)
+{
+	const DroneTelemetry *telemetry = &drone->telemetry;
+	const DroneInfo *info = &drone->info;
+
+	printf ("state %d battery %u%% altitude %d hull %u outdoor %u\n",
+			telemetry->state, telemetry->battery, telemetry->altitude,
+			info->hull, info->outdoor);
+	printf ("gps fixed %u position %f %f %f\n", telemetry->gps_fixed,
+			telemetry->gps_latitude, telemetry->gps_longitude,
+			telemetry->gps_altitude);
+	printf ("software %s hardware %s arcommands %s\n",
+			info->software_version[0] ? info->software_version : "-",
+			info->hardware_version[0] ? info->hardware_version : "-",
+			info->arcommand_version[0] ? info->arcommand_version : "-");
+	printf ("limits altitude %d vertical speed %d rotation speed %d "
+			"tilt %d\n", info->altitude_limit.current,
+			info->vertical_speed_limit.current,
+			info->rotation_speed_limit.current,
+			info->tilt_limit.current);
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-r] [-v] [-n loops] capture_file\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	Drone drone;
+	ReplayRecord record;
+	unsigned long records = 0;
+	unsigned long bytes = 0;
+	unsigned long errors = 0;
+	long long start, elapsed;
+	int opt;
+	int i;
+
+	while ((opt = getopt (argc, argv, "rvn:")) != -1) {
+		switch (opt) {
+			case 'r':
+				replay_realtime = 1;
+				break;
+			case 'v':
+				replay_verbose = 1;
+				break;
+			case 'n':
+				replay_loops = atoi (optarg);
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1 || replay_loops < 1) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (replay_load (argv[optind]) < 0)
+		return 1;
+
+	psplog_init (PSPLOG_CAT_WARNING, NULL, 0);
+
+	/* registers drone.c decoder callbacks, nothing is connected */
+	if (drone_init (&drone) < 0)
+		return 1;
+
+	start = platform_get_time_wide ();
+
+	for (i = 0; i < replay_loops; i++) {
+		size_t offset = CAPTURE_MAGIC_LEN;
+		size_t next;
+		uint32_t first = 0;
+		long long loop_start = platform_get_time_wide ();
+
+		while ((next = replay_next (offset, &record)) != 0) {
+			eARCOMMANDS_DECODER_ERROR error;
+
+			if (replay_realtime) {
+				long long due;
+
+				/* unsigned difference handles wrap of capture
+				 * clock */
+				if (offset == CAPTURE_MAGIC_LEN)
+					first = record.timestamp;
+				due = loop_start + (uint32_t) (record.timestamp - first);
+				while (platform_get_time_wide () < due)
+					platform_delay (due - platform_get_time_wide ());
+			}
+
+			if (replay_verbose)
+				replay_describe (&record);
+
+			error = ARCOMMANDS_Decoder_DecodeBuffer (record.payload,
+					record.size);
+			if (error != ARCOMMANDS_DECODER_OK &&
+					error != ARCOMMANDS_DECODER_ERROR_NO_CALLBACK)
+				errors++;
+
+			records++;
+			bytes += record.size;
+			offset = next;
+		}
+	}
+
+	elapsed = platform_get_time_wide () - start;
+
+	replay_print_state (&drone);
+	printf ("%lu records %lu bytes %lu decode errors in %lld us", records,
+			bytes, errors, elapsed);
+	if (!replay_realtime && records > 0 && elapsed > 0)
+		printf (", %.0f records/s %.0f ns/record",
+				records * 1e6 / elapsed, elapsed * 1e3 / records);
+	printf ("\n");
+
+	drone_deinit (&drone);
+	psplog_deinit ();
+	free (replay_data);
+
+	return errors > 0 ? 2 : 0;
+}
@@ -0,0 +1,1221 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Simulated Bebop for desktop runs of drone_connect () and flight loop.
+ *
+ * It answers ARDiscovery TCP handshake then speaks ARNetworkAL over UDP:
+ * commands from controller are acknowledged and applied to a simple flight
+ * model, navdata is streamed on non acknowledged buffer and events are sent
+ * on acknowledged buffer with retries, as the drone does.
+ *
+ * usage: drone-sim [-v] [-T] [-p discovery_port] [-c c2d_port]
+ *                  [-n navdata_hz] [-b battery_s] [-s script]
+ *
+ * -n is the altitude and position stream rate, -b the time for battery to
+ * drain from 100% to 0%. -T is the probe mode for link benchmarks: streamed
+ * position holds roll of last piloting command, its receive time and send
+ * time of position, in us of CLOCK_MONOTONIC, so that a controller on same
+ * host measures command latency and navdata age. Script lines are "<time s> <key> [values]", with
+ * time counted from controller connection and keys:
+ *   battery <percent>
+ *   gps <0|1>
+ *   position <latitude> <longitude> <altitude>
+ *   state <landed|hovering|flying|emergency>
+ *   link <up|down>      stop answering and streaming while down
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <libARNetworkAL/ARNetworkAL.h>
+#include <libARCommands/ARCommands.h>
+
+#define SIM_DISCOVERY_PORT 44444
+#define SIM_C2D_PORT 54321
+
+/* ARNetworkAL frame header: u8 type, u8 buffer id, u8 sequence number and
+ * u32 frame size including header, little endian */
+#define SIM_FRAME_HEADER_LEN 7
+#define SIM_FRAME_MAX_LEN 1500
+
+/* ARNetwork internal buffers and offset of acknowledge buffers */
+#define SIM_PING_ID 0
+#define SIM_PONG_ID 1
+#define SIM_ACK_ID_OFFSET 128
+
+/* device to controller buffers, see d2c_buf_params in drone.c */
+#define SIM_EVENT_ID 126
+#define SIM_NAVDATA_ID 127
+
+/* controller gives up after 5 s without data, see
+ * ARNETWORKAL_Manager_InitWifiNetwork () call in drone.c */
+#define SIM_CONTROLLER_TIMEOUT 5000000 /* us */
+
+/* events waiting for acknowledge, must be a power of 2 */
+#define SIM_EVENT_QUEUE_SIZE 64
+#define SIM_EVENT_MAX_LEN 128
+#define SIM_EVENT_ACK_TIMEOUT 500000 /* us */
+#define SIM_EVENT_RETRIES 3
+
+#define SIM_DISCOVERY_TIMEOUT 2000 /* ms */
+#define SIM_JSON_MAX_LEN 512
+
+#define SIM_SCRIPT_MAX_STEPS 256
+
+/* flight model */
+#define SIM_TAKEOFF_DURATION 1500000 /* us */
+#define SIM_TAKEOFF_ALTITUDE 1.0 /* m */
+#define SIM_LANDING_SPEED 0.7 /* m/s */
+#define SIM_MAX_HORIZONTAL_SPEED 5.0 /* m/s */
+#define SIM_METERS_PER_DEGREE 111111.0
+#define SIM_UPDATE_PERIOD 10 /* ms */
+
+#define SIM_SOFTWARE_VERSION "3.3.0"
+#define SIM_HARDWARE_VERSION "HW_sim"
+#define SIM_ARCOMMANDS_VERSION "3.4.0"
+
+typedef eARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE SimState;
+
+typedef struct _DroneSim DroneSim;
+typedef struct _SimEvent SimEvent;
+typedef struct _SimScriptStep SimScriptStep;
+typedef struct _SimSetting SimSetting;
+
+struct _SimEvent
+{
+	uint8_t data[SIM_EVENT_MAX_LEN];
+	int32_t size;
+};
+
+struct _SimScriptStep
+{
+	long long time;
+	char key[16];
+	char arg[16];
+	double values[3];
+};
+
+struct _SimSetting
+{
+	float current;
+	float min;
+	float max;
+};
+
+struct _DroneSim
+{
+	int discovery_fd;
+	int udp_fd;
+	int c2d_port;
+	int verbose;
+
+	/* controller address, known after discovery */
+	struct sockaddr_in controller;
+	int connected;
+	int link_up;
+	long long connect_time;
+	long long last_rx_time;
+
+	/* next sequence number per sent buffer and last one per received
+	 * buffer, to drop commands sent again after a lost acknowledge */
+	uint8_t tx_seq[256];
+	uint8_t rx_seq[256];
+	uint8_t rx_seen[256];
+
+	/* events are sent one at a time, next one once acknowledged */
+	SimEvent events[SIM_EVENT_QUEUE_SIZE];
+	unsigned int event_head;
+	unsigned int event_tail;
+	int event_in_flight;
+	uint8_t event_seq;
+	long long event_sent_time;
+	int event_retries;
+
+	SimState state;
+	long long state_time;
+	long long update_time;
+	double altitude;
+	double heading;
+	double latitude;
+	double longitude;
+	double gps_altitude;
+	int gps_fixed;
+	int battery;
+	int hull;
+	int outdoor;
+	SimSetting max_altitude;
+	SimSetting max_vertical_speed;
+	SimSetting max_rotation_speed;
+	SimSetting max_tilt;
+
+	/* last piloting command */
+	int pcmd_flag;
+	int pcmd_roll;
+	int pcmd_pitch;
+	int pcmd_yaw;
+	int pcmd_gaz;
+
+	/* probe mode */
+	int probe;
+	long long pcmd_time;
+
+	long long navdata_period;
+	long long next_navdata;
+	long long battery_period;
+	long long battery_time;
+
+	SimScriptStep script[SIM_SCRIPT_MAX_STEPS];
+	int n_script_steps;
+	int script_index;
+
+	/* statistics */
+	unsigned int connections;
+	unsigned int rx_frames;
+	unsigned int tx_frames;
+	unsigned int rx_duplicates;
+	unsigned int commands;
+	unsigned int pcmds;
+	unsigned int event_retries_total;
+	unsigned int event_drops;
+};
+
+static volatile int sim_running = 1;
+
+#define SIM_LOG(sim, fmt, ...) \
+	do { \
+		if ((sim)->verbose) \
+			fprintf (stderr, "drone-sim: " fmt "\n", ##__VA_ARGS__); \
+	} while (0)
+
+static long long
+sim_get_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+sim_on_signal (int signum)
+{
+	sim_running = 0;
+}
+
+static void
+sim_send_frame (DroneSim * sim, eARNETWORKAL_FRAME_TYPE type, int id,
+		uint8_t seq, const uint8_t * data, int32_t size)
+{
+	uint8_t frame[SIM_FRAME_MAX_LEN];
+	uint32_t frame_size = SIM_FRAME_HEADER_LEN + size;
+
+	if (!sim->connected || !sim->link_up || frame_size > sizeof (frame))
+		return;
+
+	frame[0] = type;
+	frame[1] = id;
+	frame[2] = seq;
+	frame[3] = frame_size & 0xff;
+	frame[4] = (frame_size >> 8) & 0xff;
+	frame[5] = (frame_size >> 16) & 0xff;
+	frame[6] = (frame_size >> 24) & 0xff;
+	memcpy (frame + SIM_FRAME_HEADER_LEN, data, size);
+
+	if (sendto (sim->udp_fd, frame, frame_size, 0,
+				(struct sockaddr *) &sim->controller,
+				sizeof (sim->controller)) < 0) {
+		SIM_LOG (sim, "failed to send frame: %s", strerror (errno));
+		return;
+	}
+
+	sim->tx_frames++;
+}
+
+static void
+sim_send_navdata (DroneSim * sim, const uint8_t * data, int32_t size)
+{
+	sim_send_frame (sim, ARNETWORKAL_FRAME_TYPE_DATA, SIM_NAVDATA_ID,
+			sim->tx_seq[SIM_NAVDATA_ID]++, data, size);
+}
+
+static void
+sim_queue_event (DroneSim * sim, const uint8_t * data, int32_t size)
+{
+	SimEvent *event;
+
+	if (!sim->connected)
+		return;
+
+	if (sim->event_head - sim->event_tail >= SIM_EVENT_QUEUE_SIZE) {
+		SIM_LOG (sim, "event queue full, event dropped");
+		sim->event_drops++;
+		return;
+	}
+
+	event = &sim->events[sim->event_head & (SIM_EVENT_QUEUE_SIZE - 1)];
+	memcpy (event->data, data, size);
+	event->size = size;
+	sim->event_head++;
+}
+
+static void
+sim_send_events (DroneSim * sim, long long now)
+{
+	SimEvent *event;
+
+	if (sim->event_in_flight) {
+		if (now - sim->event_sent_time < SIM_EVENT_ACK_TIMEOUT)
+			return;
+
+		if (sim->event_retries < SIM_EVENT_RETRIES) {
+			/* sent again with same sequence number */
+			event = &sim->events[sim->event_tail &
+				(SIM_EVENT_QUEUE_SIZE - 1)];
+			sim_send_frame (sim,
+					ARNETWORKAL_FRAME_TYPE_DATA_WITH_ACK,
+					SIM_EVENT_ID, sim->event_seq,
+					event->data, event->size);
+			sim->event_sent_time = now;
+			sim->event_retries++;
+			sim->event_retries_total++;
+			return;
+		}
+
+		SIM_LOG (sim, "event %u not acknowledged, dropped",
+				sim->event_seq);
+		sim->event_drops++;
+		sim->event_in_flight = 0;
+		sim->event_tail++;
+	}
+
+	if (sim->event_tail == sim->event_head)
+		return;
+
+	event = &sim->events[sim->event_tail & (SIM_EVENT_QUEUE_SIZE - 1)];
+	sim->event_seq = sim->tx_seq[SIM_EVENT_ID]++;
+	sim_send_frame (sim, ARNETWORKAL_FRAME_TYPE_DATA_WITH_ACK,
+			SIM_EVENT_ID, sim->event_seq, event->data, event->size);
+	sim->event_in_flight = 1;
+	sim->event_sent_time = now;
+	sim->event_retries = 0;
+}
+
+/* build a command with ARCommands generator and send it as event or
+ * navdata, NAME is the generator name without Generate prefix */
+#define SIM_GENERATE(sim, send, name, ...) \
+	do { \
+		uint8_t cmd[SIM_EVENT_MAX_LEN]; \
+		int32_t cmd_size; \
+		if (ARCOMMANDS_Generator_Generate##name (cmd, sizeof (cmd), \
+					&cmd_size, ##__VA_ARGS__) == \
+				ARCOMMANDS_GENERATOR_OK) \
+			send (sim, cmd, cmd_size); \
+	} while (0)
+
+#define SIM_EVENT(sim, name, ...) \
+	SIM_GENERATE (sim, sim_queue_event, name, ##__VA_ARGS__)
+#define SIM_NAVDATA(sim, name, ...) \
+	SIM_GENERATE (sim, sim_send_navdata, name, ##__VA_ARGS__)
+
+static void
+sim_set_state (DroneSim * sim, SimState state, long long now)
+{
+	if (sim->state == state)
+		return;
+
+	SIM_LOG (sim, "flying state %d -> %d", sim->state, state);
+
+	sim->state = state;
+	sim->state_time = now;
+	SIM_EVENT (sim, ARDrone3PilotingStateFlyingStateChanged, state);
+}
+
+static void
+sim_set_battery (DroneSim * sim, int battery)
+{
+	if (battery < 0)
+		battery = 0;
+	if (battery > 100)
+		battery = 100;
+
+	if (sim->battery == battery)
+		return;
+
+	sim->battery = battery;
+	SIM_EVENT (sim, CommonCommonStateBatteryStateChanged, battery);
+}
+
+static void
+sim_send_position (DroneSim * sim, void (*send) (DroneSim *, const uint8_t *,
+			int32_t), long long now)
+{
+	if (sim->probe)
+		SIM_GENERATE (sim, send, ARDrone3PilotingStatePositionChanged,
+				sim->pcmd_roll, sim->pcmd_time, now);
+	else if (sim->gps_fixed)
+		SIM_GENERATE (sim, send, ARDrone3PilotingStatePositionChanged,
+				sim->latitude, sim->longitude,
+				sim->gps_altitude);
+	else
+		/* unknown position */
+		SIM_GENERATE (sim, send, ARDrone3PilotingStatePositionChanged,
+				500.0, 500.0, 500.0);
+}
+
+static void
+sim_send_all_states (DroneSim * sim, long long now)
+{
+	SIM_EVENT (sim, CommonSettingsStateProductVersionChanged,
+			SIM_SOFTWARE_VERSION, SIM_HARDWARE_VERSION);
+	SIM_EVENT (sim, CommonARLibsVersionsStateDeviceLibARCommandsVersion,
+			SIM_ARCOMMANDS_VERSION);
+	SIM_EVENT (sim, CommonCommonStateBatteryStateChanged, sim->battery);
+	SIM_EVENT (sim, ARDrone3PilotingStateFlyingStateChanged, sim->state);
+	SIM_EVENT (sim, ARDrone3PilotingStateAltitudeChanged, sim->altitude);
+	sim_send_position (sim, sim_queue_event, now);
+	SIM_EVENT (sim, ARDrone3GPSSettingsStateGPSFixStateChanged,
+			sim->gps_fixed);
+	SIM_EVENT (sim, ARDrone3MediaStreamingStateVideoEnableChanged,
+			ARCOMMANDS_ARDRONE3_MEDIASTREAMINGSTATE_VIDEOENABLECHANGED_ENABLED_DISABLED);
+	SIM_EVENT (sim, CommonCommonStateAllStatesChanged);
+}
+
+static void
+sim_send_all_settings (DroneSim * sim)
+{
+	SIM_EVENT (sim, ARDrone3SpeedSettingsStateHullProtectionChanged,
+			sim->hull);
+	SIM_EVENT (sim, ARDrone3SpeedSettingsStateOutdoorChanged,
+			sim->outdoor);
+	SIM_EVENT (sim, ARDrone3PilotingSettingsStateMaxAltitudeChanged,
+			sim->max_altitude.current, sim->max_altitude.min,
+			sim->max_altitude.max);
+	SIM_EVENT (sim, ARDrone3SpeedSettingsStateMaxVerticalSpeedChanged,
+			sim->max_vertical_speed.current,
+			sim->max_vertical_speed.min,
+			sim->max_vertical_speed.max);
+	SIM_EVENT (sim, ARDrone3SpeedSettingsStateMaxRotationSpeedChanged,
+			sim->max_rotation_speed.current,
+			sim->max_rotation_speed.min,
+			sim->max_rotation_speed.max);
+	SIM_EVENT (sim, ARDrone3PilotingSettingsStateMaxTiltChanged,
+			sim->max_tilt.current, sim->max_tilt.min,
+			sim->max_tilt.max);
+	SIM_EVENT (sim, CommonSettingsStateAllSettingsChanged);
+}
+
+static void
+sim_setting_set (SimSetting * setting, const uint8_t * args, int32_t size)
+{
+	float value;
+
+	if (size < (int32_t) sizeof (value))
+		return;
+
+	memcpy (&value, args, sizeof (value));
+
+	if (value < setting->min)
+		value = setting->min;
+	if (value > setting->max)
+		value = setting->max;
+
+	setting->current = value;
+}
+
+static void
+sim_handle_piloting (DroneSim * sim, int command, const uint8_t * args,
+		int32_t size, long long now)
+{
+	switch (command) {
+		case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_PCMD:
+			/* flag, roll, pitch, yaw, gaz, psi */
+			if (size < 5)
+				break;
+			sim->pcmds++;
+			sim->pcmd_flag = args[0];
+			sim->pcmd_roll = (int8_t) args[1];
+			sim->pcmd_pitch = (int8_t) args[2];
+			sim->pcmd_yaw = (int8_t) args[3];
+			sim->pcmd_gaz = (int8_t) args[4];
+			sim->pcmd_time = now;
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_TAKEOFF:
+			SIM_LOG (sim, "takeoff");
+			if (sim->state == ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED)
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_TAKINGOFF,
+						now);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_LANDING:
+			SIM_LOG (sim, "landing");
+			if (sim->state == ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_TAKINGOFF ||
+					sim->state == ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING ||
+					sim->state == ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_FLYING)
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDING,
+						now);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_PILOTING_CMD_EMERGENCY:
+			SIM_LOG (sim, "emergency");
+			sim_set_state (sim,
+					ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_EMERGENCY,
+					now);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void
+sim_handle_settings (DroneSim * sim, int klass, int command,
+		const uint8_t * args, int32_t size)
+{
+	if (klass == ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSETTINGS) {
+		switch (command) {
+			case ARCOMMANDS_ID_ARDRONE3_PILOTINGSETTINGS_CMD_MAXALTITUDE:
+				sim_setting_set (&sim->max_altitude, args, size);
+				SIM_EVENT (sim, ARDrone3PilotingSettingsStateMaxAltitudeChanged,
+						sim->max_altitude.current,
+						sim->max_altitude.min,
+						sim->max_altitude.max);
+				break;
+
+			case ARCOMMANDS_ID_ARDRONE3_PILOTINGSETTINGS_CMD_MAXTILT:
+				sim_setting_set (&sim->max_tilt, args, size);
+				SIM_EVENT (sim, ARDrone3PilotingSettingsStateMaxTiltChanged,
+						sim->max_tilt.current,
+						sim->max_tilt.min,
+						sim->max_tilt.max);
+				break;
+
+			default:
+				break;
+		}
+		return;
+	}
+
+	switch (command) {
+		case ARCOMMANDS_ID_ARDRONE3_SPEEDSETTINGS_CMD_MAXVERTICALSPEED:
+			sim_setting_set (&sim->max_vertical_speed, args, size);
+			SIM_EVENT (sim, ARDrone3SpeedSettingsStateMaxVerticalSpeedChanged,
+					sim->max_vertical_speed.current,
+					sim->max_vertical_speed.min,
+					sim->max_vertical_speed.max);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_SPEEDSETTINGS_CMD_MAXROTATIONSPEED:
+			sim_setting_set (&sim->max_rotation_speed, args, size);
+			SIM_EVENT (sim, ARDrone3SpeedSettingsStateMaxRotationSpeedChanged,
+					sim->max_rotation_speed.current,
+					sim->max_rotation_speed.min,
+					sim->max_rotation_speed.max);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_SPEEDSETTINGS_CMD_HULLPROTECTION:
+			if (size < 1)
+				break;
+			sim->hull = args[0];
+			SIM_EVENT (sim, ARDrone3SpeedSettingsStateHullProtectionChanged,
+					sim->hull);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_SPEEDSETTINGS_CMD_OUTDOOR:
+			if (size < 1)
+				break;
+			sim->outdoor = args[0];
+			SIM_EVENT (sim, ARDrone3SpeedSettingsStateOutdoorChanged,
+					sim->outdoor);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* ARCommands header is u8 project, u8 class and u16 command, followed by
+ * arguments in little endian */
+static void
+sim_handle_command (DroneSim * sim, const uint8_t * data, int32_t size,
+		long long now)
+{
+	int project;
+	int klass;
+	int command;
+
+	if (size < 4)
+		return;
+
+	project = data[0];
+	klass = data[1];
+	command = data[2] | (data[3] << 8);
+	data += 4;
+	size -= 4;
+
+	sim->commands++;
+
+	if (project == ARCOMMANDS_ID_PROJECT_COMMON) {
+		if (klass == ARCOMMANDS_ID_COMMON_CLASS_COMMON &&
+				command == ARCOMMANDS_ID_COMMON_COMMON_CMD_ALLSTATES) {
+			SIM_LOG (sim, "all states requested");
+			sim_send_all_states (sim, now);
+		} else if (klass == ARCOMMANDS_ID_COMMON_CLASS_SETTINGS &&
+				command == ARCOMMANDS_ID_COMMON_SETTINGS_CMD_ALLSETTINGS) {
+			SIM_LOG (sim, "all settings requested");
+			sim_send_all_settings (sim);
+		}
+		return;
+	}
+
+	if (project != ARCOMMANDS_ID_PROJECT_ARDRONE3)
+		return;
+
+	switch (klass) {
+		case ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTING:
+			sim_handle_piloting (sim, command, data, size, now);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_CLASS_PILOTINGSETTINGS:
+		case ARCOMMANDS_ID_ARDRONE3_CLASS_SPEEDSETTINGS:
+			sim_handle_settings (sim, klass, command, data, size);
+			break;
+
+		case ARCOMMANDS_ID_ARDRONE3_CLASS_MEDIASTREAMING:
+			if (command != ARCOMMANDS_ID_ARDRONE3_MEDIASTREAMING_CMD_VIDEOENABLE ||
+					size < 1)
+				break;
+			SIM_EVENT (sim, ARDrone3MediaStreamingStateVideoEnableChanged,
+					data[0] ?
+					ARCOMMANDS_ARDRONE3_MEDIASTREAMINGSTATE_VIDEOENABLECHANGED_ENABLED_ENABLED :
+					ARCOMMANDS_ARDRONE3_MEDIASTREAMINGSTATE_VIDEOENABLECHANGED_ENABLED_DISABLED);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void
+sim_handle_frame (DroneSim * sim, int type, int id, uint8_t seq,
+		const uint8_t * data, int32_t size, long long now)
+{
+	sim->rx_frames++;
+
+	switch (type) {
+		case ARNETWORKAL_FRAME_TYPE_ACK:
+			if (id == SIM_EVENT_ID + SIM_ACK_ID_OFFSET && size >= 1 &&
+					sim->event_in_flight &&
+					data[0] == sim->event_seq) {
+				sim->event_in_flight = 0;
+				sim->event_tail++;
+				sim_send_events (sim, now);
+			}
+			return;
+
+		case ARNETWORKAL_FRAME_TYPE_DATA_WITH_ACK:
+			sim_send_frame (sim, ARNETWORKAL_FRAME_TYPE_ACK,
+					id + SIM_ACK_ID_OFFSET,
+					sim->tx_seq[(id + SIM_ACK_ID_OFFSET) & 0xff]++,
+					&seq, 1);
+
+			if (sim->rx_seen[id] && sim->rx_seq[id] == seq) {
+				sim->rx_duplicates++;
+				return;
+			}
+			break;
+
+		case ARNETWORKAL_FRAME_TYPE_DATA:
+		case ARNETWORKAL_FRAME_TYPE_DATA_LOW_LATENCY:
+			if (id == SIM_PING_ID) {
+				sim_send_frame (sim, ARNETWORKAL_FRAME_TYPE_DATA,
+						SIM_PONG_ID,
+						sim->tx_seq[SIM_PONG_ID]++,
+						data, size);
+				return;
+			}
+			if (id == SIM_PONG_ID)
+				return;
+			break;
+
+		default:
+			return;
+	}
+
+	sim->rx_seen[id] = 1;
+	sim->rx_seq[id] = seq;
+	sim_handle_command (sim, data, size, now);
+}
+
+static void
+sim_receive (DroneSim * sim, long long now)
+{
+	uint8_t buf[SIM_FRAME_MAX_LEN * 4];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof (addr);
+	ssize_t offset = 0;
+	ssize_t len;
+
+	len = recvfrom (sim->udp_fd, buf, sizeof (buf), 0,
+			(struct sockaddr *) &addr, &addr_len);
+	if (len <= 0 || !sim->connected || !sim->link_up)
+		return;
+
+	/* only the controller which did discovery is served */
+	if (addr.sin_addr.s_addr != sim->controller.sin_addr.s_addr)
+		return;
+
+	sim->last_rx_time = now;
+
+	/* a datagram may hold several frames */
+	while (len - offset >= SIM_FRAME_HEADER_LEN) {
+		const uint8_t *frame = buf + offset;
+		uint32_t size = frame[3] | (frame[4] << 8) | (frame[5] << 16) |
+			((uint32_t) frame[6] << 24);
+
+		if (size < SIM_FRAME_HEADER_LEN || size > len - offset) {
+			SIM_LOG (sim, "malformed frame of %u bytes", size);
+			return;
+		}
+
+		sim_handle_frame (sim, frame[0], frame[1], frame[2],
+				frame + SIM_FRAME_HEADER_LEN,
+				size - SIM_FRAME_HEADER_LEN, now);
+		offset += size;
+	}
+}
+
+/* controller json is flat, only integer values are looked up */
+static int
+sim_json_get_int (const char * json, const char * key, int * value)
+{
+	char pattern[64];
+	const char *p;
+
+	snprintf (pattern, sizeof (pattern), "\"%s\"", key);
+
+	p = strstr (json, pattern);
+	if (p == NULL)
+		return -1;
+
+	p = strchr (p + strlen (pattern), ':');
+	if (p == NULL)
+		return -1;
+
+	*value = atoi (p + 1);
+	return 0;
+}
+
+static void
+sim_start_session (DroneSim * sim, long long now)
+{
+	memset (sim->tx_seq, 0, sizeof (sim->tx_seq));
+	memset (sim->rx_seq, 0, sizeof (sim->rx_seq));
+	memset (sim->rx_seen, 0, sizeof (sim->rx_seen));
+
+	sim->event_head = 0;
+	sim->event_tail = 0;
+	sim->event_in_flight = 0;
+
+	sim->pcmd_flag = 0;
+	sim->pcmd_roll = 0;
+	sim->pcmd_pitch = 0;
+	sim->pcmd_yaw = 0;
+	sim->pcmd_gaz = 0;
+
+	sim->connected = 1;
+	sim->link_up = 1;
+	sim->connect_time = now;
+	sim->last_rx_time = now;
+	sim->next_navdata = now;
+	sim->script_index = 0;
+	sim->connections++;
+}
+
+static void
+sim_accept (DroneSim * sim, long long now)
+{
+	char json[SIM_JSON_MAX_LEN];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof (addr);
+	struct pollfd pfd;
+	size_t len = 0;
+	int d2c_port;
+	int fd;
+
+	fd = accept (sim->discovery_fd, (struct sockaddr *) &addr, &addr_len);
+	if (fd < 0)
+		return;
+
+	/* controller json is nul terminated */
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (len < sizeof (json) - 1 &&
+			poll (&pfd, 1, SIM_DISCOVERY_TIMEOUT) > 0) {
+		ssize_t n = recv (fd, json + len, sizeof (json) - 1 - len, 0);
+
+		if (n <= 0)
+			break;
+
+		len += n;
+		if (memchr (json, '\0', len) != NULL)
+			break;
+	}
+	json[len] = '\0';
+
+	if (sim_json_get_int (json, "d2c_port", &d2c_port) < 0) {
+		SIM_LOG (sim, "discovery without d2c_port: %s", json);
+		goto done;
+	}
+
+	len = snprintf (json, sizeof (json), "{ \"status\": 0, "
+			"\"c2d_port\": %d, "
+			"\"arstream_fragment_size\": 65000, "
+			"\"arstream_fragment_maximum_number\": 4, "
+			"\"arstream_max_ack_interval\": 0 }",
+			sim->c2d_port);
+
+	/* reply is nul terminated too */
+	if (send (fd, json, len + 1, MSG_NOSIGNAL) < 0) {
+		SIM_LOG (sim, "failed to send discovery reply: %s",
+				strerror (errno));
+		goto done;
+	}
+
+	sim->controller = addr;
+	sim->controller.sin_port = htons (d2c_port);
+	sim_start_session (sim, now);
+
+	fprintf (stderr, "drone-sim: controller %s connected, d2c port %d\n",
+			inet_ntoa (addr.sin_addr), d2c_port);
+
+done:
+	close (fd);
+}
+
+static void
+sim_run_script (DroneSim * sim, long long now)
+{
+	SimScriptStep *step;
+
+	while (sim->script_index < sim->n_script_steps) {
+		step = &sim->script[sim->script_index];
+		if (now - sim->connect_time < step->time)
+			break;
+
+		sim->script_index++;
+		SIM_LOG (sim, "script: %s %s", step->key, step->arg);
+
+		if (strcmp (step->key, "battery") == 0) {
+			sim_set_battery (sim, (int) step->values[0]);
+			/* drain restarts from scripted level */
+			sim->battery_time = now;
+		} else if (strcmp (step->key, "gps") == 0) {
+			sim->gps_fixed = step->values[0] != 0;
+			SIM_EVENT (sim, ARDrone3GPSSettingsStateGPSFixStateChanged,
+					sim->gps_fixed);
+		} else if (strcmp (step->key, "position") == 0) {
+			sim->latitude = step->values[0];
+			sim->longitude = step->values[1];
+			sim->gps_altitude = step->values[2];
+		} else if (strcmp (step->key, "state") == 0) {
+			if (strcmp (step->arg, "landed") == 0) {
+				sim->altitude = 0.0;
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED,
+						now);
+			} else if (strcmp (step->arg, "hovering") == 0) {
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING,
+						now);
+			} else if (strcmp (step->arg, "flying") == 0) {
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_FLYING,
+						now);
+			} else if (strcmp (step->arg, "emergency") == 0) {
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_EMERGENCY,
+						now);
+			}
+		} else if (strcmp (step->key, "link") == 0) {
+			sim->link_up = strcmp (step->arg, "down") != 0;
+			/* controller pings stopped while link was down */
+			sim->last_rx_time = now;
+		}
+	}
+}
+
+static void
+sim_update_flight (DroneSim * sim, long long now)
+{
+	double dt = (now - sim->update_time) / 1000000.0;
+	double speed;
+
+	sim->update_time = now;
+
+	switch (sim->state) {
+		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_TAKINGOFF:
+			sim->altitude = SIM_TAKEOFF_ALTITUDE *
+				(now - sim->state_time) / SIM_TAKEOFF_DURATION;
+			if (now - sim->state_time >= SIM_TAKEOFF_DURATION) {
+				sim->altitude = SIM_TAKEOFF_ALTITUDE;
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING,
+						now);
+			}
+			break;
+
+		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING:
+		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_FLYING:
+			/* roll and pitch are only applied when flag is set */
+			if (sim->pcmd_flag || sim->pcmd_yaw || sim->pcmd_gaz)
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_FLYING,
+						now);
+			else
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING,
+						now);
+
+			sim->altitude += dt * sim->pcmd_gaz / 100.0 *
+				sim->max_vertical_speed.current;
+			if (sim->altitude < 0.0)
+				sim->altitude = 0.0;
+			if (sim->altitude > sim->max_altitude.current)
+				sim->altitude = sim->max_altitude.current;
+
+			sim->heading += dt * sim->pcmd_yaw / 100.0 *
+				sim->max_rotation_speed.current;
+
+			if (!sim->pcmd_flag)
+				break;
+
+			speed = dt * SIM_MAX_HORIZONTAL_SPEED / 100.0;
+			sim->latitude += speed / SIM_METERS_PER_DEGREE *
+				(sim->pcmd_pitch * cos (sim->heading * M_PI / 180.0) -
+				 sim->pcmd_roll * sin (sim->heading * M_PI / 180.0));
+			sim->longitude += speed / SIM_METERS_PER_DEGREE *
+				(sim->pcmd_pitch * sin (sim->heading * M_PI / 180.0) +
+				 sim->pcmd_roll * cos (sim->heading * M_PI / 180.0));
+			break;
+
+		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDING:
+			sim->altitude -= dt * SIM_LANDING_SPEED;
+			if (sim->altitude <= 0.0) {
+				sim->altitude = 0.0;
+				sim_set_state (sim,
+						ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED,
+						now);
+			}
+			break;
+
+		case ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_EMERGENCY:
+			/* motors are cut */
+			sim->altitude = 0.0;
+			sim_set_state (sim,
+					ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED,
+					now);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void
+sim_update (DroneSim * sim, long long now)
+{
+	if (sim->connected && sim->link_up &&
+			now - sim->last_rx_time > SIM_CONTROLLER_TIMEOUT) {
+		fprintf (stderr, "drone-sim: controller timed out\n");
+		sim->connected = 0;
+	}
+
+	if (sim->connected)
+		sim_run_script (sim, now);
+
+	sim_update_flight (sim, now);
+
+	if (sim->battery_period > 0 && sim->battery > 0 &&
+			now - sim->battery_time >= sim->battery_period / 100) {
+		sim->battery_time = now;
+		sim_set_battery (sim, sim->battery - 1);
+	}
+
+	if (!sim->connected)
+		return;
+
+	if (now >= sim->next_navdata) {
+		sim->next_navdata += sim->navdata_period;
+		if (sim->next_navdata < now)
+			sim->next_navdata = now + sim->navdata_period;
+
+		SIM_NAVDATA (sim, ARDrone3PilotingStateAltitudeChanged,
+				sim->altitude);
+		sim_send_position (sim, sim_send_navdata, now);
+	}
+
+	sim_send_events (sim, now);
+}
+
+static int
+sim_load_script (DroneSim * sim, const char * path)
+{
+	char line[256];
+	FILE *f;
+	int lineno = 0;
+
+	f = fopen (path, "r");
+	if (f == NULL) {
+		fprintf (stderr, "drone-sim: failed to open %s: %s\n", path,
+				strerror (errno));
+		return -1;
+	}
+
+	while (fgets (line, sizeof (line), f) != NULL) {
+		SimScriptStep *step;
+		double time;
+		int n;
+
+		lineno++;
+
+		if (line[0] == '#' || line[strspn (line, " \t\r\n")] == '\0')
+			continue;
+
+		if (sim->n_script_steps == SIM_SCRIPT_MAX_STEPS) {
+			fprintf (stderr, "drone-sim: too many script steps\n");
+			goto error;
+		}
+
+		step = &sim->script[sim->n_script_steps];
+		memset (step, 0, sizeof (*step));
+
+		n = sscanf (line, "%lf %15s %15s", &time, step->key, step->arg);
+		if (n < 2) {
+			fprintf (stderr, "drone-sim: %s:%d: syntax error\n",
+					path, lineno);
+			goto error;
+		}
+
+		sscanf (line, "%*f %*s %lf %lf %lf", &step->values[0],
+				&step->values[1], &step->values[2]);
+		step->time = (long long) (time * 1000000.0);
+
+		/* steps are run in order */
+		if (sim->n_script_steps > 0 &&
+				step->time < sim->script[sim->n_script_steps - 1].time) {
+			fprintf (stderr, "drone-sim: %s:%d: time goes backward\n",
+					path, lineno);
+			goto error;
+		}
+
+		sim->n_script_steps++;
+	}
+
+	fclose (f);
+	return 0;
+
+error:
+	fclose (f);
+	return -1;
+}
+
+static int
+sim_open_sockets (DroneSim * sim, int discovery_port, int c2d_port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_ANY);
+
+	sim->discovery_fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (sim->discovery_fd < 0)
+		goto error;
+
+	setsockopt (sim->discovery_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+			sizeof (one));
+
+	addr.sin_port = htons (discovery_port);
+	if (bind (sim->discovery_fd, (struct sockaddr *) &addr,
+				sizeof (addr)) < 0)
+		goto error;
+
+	if (listen (sim->discovery_fd, 1) < 0)
+		goto error;
+
+	sim->udp_fd = socket (AF_INET, SOCK_DGRAM, 0);
+	if (sim->udp_fd < 0)
+		goto error;
+
+	sim->c2d_port = c2d_port;
+	addr.sin_port = htons (c2d_port);
+	if (bind (sim->udp_fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+		goto error;
+
+	return 0;
+
+error:
+	fprintf (stderr, "drone-sim: failed to open sockets: %s\n",
+			strerror (errno));
+	return -1;
+}
+
+static void
+sim_init (DroneSim * sim)
+{
+	memset (sim, 0, sizeof (*sim));
+
+	sim->discovery_fd = -1;
+	sim->udp_fd = -1;
+	sim->state = ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_LANDED;
+	sim->battery = 100;
+	sim->gps_fixed = 1;
+	sim->latitude = 48.8789;
+	sim->longitude = 2.3677;
+	sim->gps_altitude = 35.0;
+	sim->outdoor = 1;
+
+	/* Bebop firmware defaults and limits */
+	sim->max_altitude = (SimSetting) { 20.0, 2.6, 150.0 };
+	sim->max_vertical_speed = (SimSetting) { 1.0, 0.5, 6.0 };
+	sim->max_rotation_speed = (SimSetting) { 100.0, 10.0, 200.0 };
+	sim->max_tilt = (SimSetting) { 15.0, 5.0, 35.0 };
+
+	sim->navdata_period = 1000000 / 5;
+	sim->battery_period = 20 * 60 * 1000000LL;
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-v] [-T] [-p discovery_port] "
+			"[-c c2d_port] [-n navdata_hz] [-b battery_s] "
+			"[-s script]\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	static DroneSim sim;
+	int discovery_port = SIM_DISCOVERY_PORT;
+	int c2d_port = SIM_C2D_PORT;
+	struct pollfd pfds[2];
+	int opt;
+
+	sim_init (&sim);
+
+	while ((opt = getopt (argc, argv, "vTp:c:n:b:s:")) != -1) {
+		switch (opt) {
+			case 'v':
+				sim.verbose = 1;
+				break;
+			case 'T':
+				sim.probe = 1;
+				break;
+			case 'p':
+				discovery_port = atoi (optarg);
+				break;
+			case 'c':
+				c2d_port = atoi (optarg);
+				break;
+			case 'n':
+				if (atoi (optarg) <= 0) {
+					usage (argv[0]);
+					return 1;
+				}
+				sim.navdata_period = 1000000 / atoi (optarg);
+				break;
+			case 'b':
+				sim.battery_period = atoll (optarg) * 1000000;
+				break;
+			case 's':
+				if (sim_load_script (&sim, optarg) < 0)
+					return 1;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (sim_open_sockets (&sim, discovery_port, c2d_port) < 0)
+		return 1;
+
+	signal (SIGINT, sim_on_signal);
+	signal (SIGTERM, sim_on_signal);
+
+	fprintf (stderr, "drone-sim: discovery on tcp port %d, c2d on udp "
+			"port %d\n", discovery_port, c2d_port);
+
+	sim.update_time = sim_get_time ();
+	sim.battery_time = sim.update_time;
+
+	pfds[0].fd = sim.discovery_fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = sim.udp_fd;
+	pfds[1].events = POLLIN;
+
+	while (sim_running) {
+		if (poll (pfds, 2, SIM_UPDATE_PERIOD) < 0 && errno != EINTR)
+			break;
+
+		if (pfds[0].revents & POLLIN)
+			sim_accept (&sim, sim_get_time ());
+
+		if (pfds[1].revents & POLLIN)
+			sim_receive (&sim, sim_get_time ());
+
+		sim_update (&sim, sim_get_time ());
+	}
+
+	fprintf (stderr, "drone-sim: %u connections, %u frames received "
+			"(%u duplicates), %u frames sent, %u commands, %u pcmd, "
+			"%u event retries, %u events dropped\n",
+			sim.connections, sim.rx_frames, sim.rx_duplicates,
+			sim.tx_frames, sim.commands, sim.pcmds,
+			sim.event_retries_total, sim.event_drops);
+
+	close (sim.udp_fd);
+	close (sim.discovery_fd);
+
+	return 0;
+}
@@ -0,0 +1,970 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Flight harness: run ui_flight_run () headless on a virtual clock, with
+ * scripted controller input and a simulated drone, so that hours of flying
+ * are checked in seconds.
+ *
+ * usage: flight-harness [-v] [-d duration_s] [-b budget_us] [-g max_gap_ms]
+ *                       [-m max_growth_kb] [-s script]
+ *
+ * The simulated drone replaces drone.c at link time: commands are applied
+ * to a simple flight model stepped once per frame, without any network.
+ * Each platform_wait_vblank () moves the clock by a frame period and
+ * returns once the next controller sample is queued, so runs are repeated
+ * exactly. Script lines are "<time s> <key> [values]", with time counted
+ * from start of script which is replayed in a loop until duration:
+ *   press <button>           press and release on next frame
+ *   hold <button> <s>        hold button for given time
+ *   stick <lx> <ly> <s>      analog stick position, 128 is centered
+ *   end                      loop period, default is last step + 1 s
+ * with buttons select, start, up, right, down, left, ltrigger, rtrigger,
+ * triangle, circle, cross and square.
+ *
+ * A frame overruns when ui spends more than budget between two vblanks, in
+ * real time. A control gap is a hold of a piloting button or stick during
+ * which drone got no piloting command for more than max gap. Memory growth
+ * is heap in use at end of last loop compared to end of second loop. Exit
+ * status is 1 when a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include "check-common.h"
+#include "drone.h"
+#include "platform.h"
+#include "psplog.h"
+#include "ui.h"
+
+#define HARNESS_FRAME_BUDGET 16683 /* us */
+#define HARNESS_MAX_GAP 50 /* ms */
+#define HARNESS_MAX_GROWTH 0 /* KB */
+#define HARNESS_DURATION 3600 /* s */
+
+#define HARNESS_SCRIPT_MAX_STEPS 256
+
+/* memory growth is counted from end of this loop */
+#define HARNESS_WARMUP_LOOPS 2
+
+/* heap is sampled once per virtual second, it walks malloc arenas */
+#define HARNESS_MEMORY_PERIOD 1000000 /* us */
+
+/* flight model, in m, m/s and s */
+#define HARNESS_TAKEOFF_ALTITUDE 1.0
+#define HARNESS_TAKEOFF_SPEED 0.5
+#define HARNESS_LANDING_SPEED 0.5
+#define HARNESS_BATTERY_DRAIN 12.0 /* s per percent while flying */
+/* drone hovers when piloting commands stop for this long */
+#define HARNESS_PCMD_TIMEOUT 200000 /* us */
+
+#define HARNESS_PILOTING_BUTTONS (PLATFORM_BUTTON_UP | PLATFORM_BUTTON_DOWN | \
+		PLATFORM_BUTTON_LEFT | PLATFORM_BUTTON_RIGHT | \
+		PLATFORM_BUTTON_LTRIGGER | PLATFORM_BUTTON_RTRIGGER | \
+		PLATFORM_BUTTON_CROSS | PLATFORM_BUTTON_SQUARE)
+
+typedef enum
+{
+	HARNESS_STEP_PRESS = 0,
+	HARNESS_STEP_HOLD,
+	HARNESS_STEP_STICK,
+	HARNESS_STEP_END
+} HarnessStepType;
+
+typedef struct _HarnessButton HarnessButton;
+typedef struct _HarnessStep HarnessStep;
+typedef struct _HarnessDrone HarnessDrone;
+typedef struct _Harness Harness;
+
+struct _HarnessButton
+{
+	const char *name;
+	unsigned int button;
+};
+
+struct _HarnessStep
+{
+	long long time;
+	HarnessStepType type;
+	unsigned int button;
+	unsigned char lx;
+	unsigned char ly;
+	long long duration;
+};
+
+/* state behind the Drone seen by ui */
+struct _HarnessDrone
+{
+	Drone *drone;
+	double altitude;
+	double battery;
+
+	/* last piloting command */
+	long long pcmd_time;
+	int gaz;
+
+	unsigned int pcmds;
+	unsigned int commands;
+	unsigned int takeoffs;
+};
+
+struct _Harness
+{
+	HarnessStep script[HARNESS_SCRIPT_MAX_STEPS];
+	int n_script_steps;
+	int script_index;
+	long long period;
+
+	long long duration;
+	unsigned int budget;
+	long long max_gap;
+	size_t max_growth;
+	int verbose;
+
+	/* script replay, times are virtual */
+	long long start_time;
+	long long loop_start;
+	unsigned int loops;
+	long long release[32];
+	long long stick_release;
+	unsigned char lx;
+	unsigned char ly;
+
+	/* piloting expected during frame ending at next vblank */
+	int expect_pcmd;
+	long long last_pcmd_time;
+	unsigned int last_pcmds;
+	int in_gap;
+
+	/* real time spent by ui in frames */
+	long long vblank_time;
+	long long frame_start;
+	unsigned long long frames;
+	unsigned long long frame_sum;
+	unsigned int frame_max;
+	unsigned int overruns;
+
+	unsigned int gaps;
+	long long gap_max;
+
+	long long next_memory_sample;
+	size_t memory_baseline;
+	size_t memory_peak;
+	size_t memory_last;
+};
+
+static const HarnessButton harness_buttons[] = {
+	{ "select", PLATFORM_BUTTON_SELECT },
+	{ "start", PLATFORM_BUTTON_START },
+	{ "up", PLATFORM_BUTTON_UP },
+	{ "right", PLATFORM_BUTTON_RIGHT },
+	{ "down", PLATFORM_BUTTON_DOWN },
+	{ "left", PLATFORM_BUTTON_LEFT },
+	{ "ltrigger", PLATFORM_BUTTON_LTRIGGER },
+	{ "rtrigger", PLATFORM_BUTTON_RTRIGGER },
+	{ "triangle", PLATFORM_BUTTON_TRIANGLE },
+	{ "circle", PLATFORM_BUTTON_CIRCLE },
+	{ "cross", PLATFORM_BUTTON_CROSS },
+	{ "square", PLATFORM_BUTTON_SQUARE },
+};
+static const size_t n_harness_buttons =
+	sizeof (harness_buttons) / sizeof (harness_buttons[0]);
+
+/* a minute of flight going through piloting and menus, main menu is walked
+ * from its first entry so that each loop does the same */
+static const char harness_default_script[] =
+	"0.5 press triangle\n"
+	"3 hold cross 2\n"
+	"6 hold up 1.5\n"
+	"8 hold rtrigger 1\n"
+	"10 stick 0 128 1.5\n"
+	"13 stick 128 255 1\n"
+	"15 press start\n"
+	"15.2 press up\n"
+	"15.4 press up\n"
+	"15.6 press up\n"
+	"15.8 press up\n"
+	"16 press down\n"
+	"16.5 press cross\n"
+	"17 press down\n"
+	"17.5 press down\n"
+	"18 press square\n"
+	"18.5 press down\n"
+	"18.7 press down\n"
+	"19 press cross\n"
+	"20 press square\n"
+	"20.5 press start\n"
+	"22 hold left 1\n"
+	"24 hold square 2\n"
+	"27 press triangle\n"
+	"35 end\n";
+
+static Harness harness;
+static HarnessDrone harness_drone;
+
+int running = 1;
+
+static long long
+harness_real_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+harness_button_index (unsigned int button)
+{
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		if (button == (1U << i))
+			return i;
+	}
+
+	return 0;
+}
+
+/*
+ * Simulated drone, drone.h API
+ */
+
+int
+drone_init (Drone * drone)
+{
+	memset (drone, 0, sizeof (*drone));
+	memset (&harness_drone, 0, sizeof (harness_drone));
+	harness_drone.drone = drone;
+	harness_drone.battery = 100.0;
+
+	drone->telemetry.state = DRONE_STATE_LANDED;
+	drone->telemetry.battery = 100;
+	drone->info.hull = 1;
+	drone->telemetry.gps_fixed = 1;
+	drone->telemetry.gps_latitude = 48.8584;
+	drone->telemetry.gps_longitude = 2.2945;
+	drone->telemetry.gps_altitude = 35.0;
+	snprintf (drone->info.software_version,
+			sizeof (drone->info.software_version), "harness");
+	snprintf (drone->info.hardware_version,
+			sizeof (drone->info.hardware_version), "harness");
+	snprintf (drone->info.arcommand_version,
+			sizeof (drone->info.arcommand_version), "harness");
+
+	drone->info.altitude_limit.min = 2;
+	drone->info.altitude_limit.max = 150;
+	drone->info.altitude_limit.current = 20;
+	drone->info.vertical_speed_limit.min = 1;
+	drone->info.vertical_speed_limit.max = 6;
+	drone->info.vertical_speed_limit.current = 1;
+	drone->info.rotation_speed_limit.min = 10;
+	drone->info.rotation_speed_limit.max = 200;
+	drone->info.rotation_speed_limit.current = 100;
+	drone->info.tilt_limit.min = 5;
+	drone->info.tilt_limit.max = 30;
+	drone->info.tilt_limit.current = 15;
+
+	return 0;
+}
+
+void
+drone_deinit (Drone * drone)
+{
+}
+
+int
+drone_connect (Drone * drone, const char * ipv4, int discovery_port,
+		int c2d_port, int d2c_port)
+{
+	drone->connected = 1;
+	return 0;
+}
+
+int
+drone_disconnect (Drone * drone)
+{
+	drone->connected = 0;
+	return 0;
+}
+
+int
+drone_emergency (Drone * drone)
+{
+	harness_drone.commands++;
+	harness_drone.altitude = 0.0;
+	drone->telemetry.state = DRONE_STATE_EMERGENCY;
+	return 0;
+}
+
+int
+drone_takeoff (Drone * drone)
+{
+	harness_drone.commands++;
+	if (drone->telemetry.state == DRONE_STATE_LANDED) {
+		harness_drone.takeoffs++;
+		drone->telemetry.state = DRONE_STATE_TAKING_OFF;
+	}
+	return 0;
+}
+
+int
+drone_landing (Drone * drone)
+{
+	harness_drone.commands++;
+	if (drone->telemetry.state == DRONE_STATE_TAKING_OFF ||
+			drone->telemetry.state == DRONE_STATE_FLYING)
+		drone->telemetry.state = DRONE_STATE_LANDING;
+	return 0;
+}
+
+int
+drone_flat_trim (Drone * drone)
+{
+	harness_drone.commands++;
+	return 0;
+}
+
+int
+drone_sync_state (Drone * drone)
+{
+	return 0;
+}
+
+/* model is stepped from vblank hook, on the flight ui thread */
+void
+drone_get_telemetry (Drone * drone, DroneTelemetry * telemetry)
+{
+	*telemetry = drone->telemetry;
+}
+
+int
+drone_buffer_set_params (int id, int sending_wait_ms, int ack_timeout_ms,
+		int retries, int cells)
+{
+	return 0;
+}
+
+int
+drone_flight_control (Drone * drone, int gaz, int yaw, int pitch, int roll,
+		unsigned int timestamp)
+{
+	harness_drone.pcmds++;
+	harness_drone.pcmd_time = platform_get_time_wide ();
+	harness_drone.gaz = gaz;
+	return 0;
+}
+
+int
+drone_do_flip (Drone * drone, DroneFlip flip)
+{
+	harness_drone.commands++;
+	return 0;
+}
+
+int
+drone_sync_settings (Drone * drone)
+{
+	return 0;
+}
+
+int
+drone_hull_set_active (Drone * drone, int active)
+{
+	harness_drone.commands++;
+	drone->info.hull = active;
+	return 0;
+}
+
+int
+drone_outdoor_flight_set_active (Drone * drone, int active)
+{
+	harness_drone.commands++;
+	drone->info.outdoor = active;
+	return 0;
+}
+
+static void
+harness_setting_set (DroneSetting * setting, int value)
+{
+	harness_drone.commands++;
+	if (value >= setting->min && value <= setting->max)
+		setting->current = value;
+}
+
+int
+drone_altitude_limit_set (Drone * drone, int limit)
+{
+	harness_setting_set (&drone->info.altitude_limit, limit);
+	return 0;
+}
+
+int
+drone_vertical_speed_limit_set (Drone * drone, int limit)
+{
+	harness_setting_set (&drone->info.vertical_speed_limit, limit);
+	return 0;
+}
+
+int
+drone_rotation_speed_limit_set (Drone * drone, int limit)
+{
+	harness_setting_set (&drone->info.rotation_speed_limit, limit);
+	return 0;
+}
+
+int
+drone_max_tilt_set (Drone * drone, int limit)
+{
+	harness_setting_set (&drone->info.tilt_limit, limit);
+	return 0;
+}
+
+int
+drone_streaming_set_active (Drone * drone, int active)
+{
+	return 0;
+}
+
+int
+drone_take_picture (Drone * drone)
+{
+	harness_drone.commands++;
+	return 0;
+}
+
+/* step flight model by @dt s */
+static void
+harness_drone_step (long long now, double dt)
+{
+	HarnessDrone *sim = &harness_drone;
+	Drone *drone = sim->drone;
+	double speed;
+
+	switch (drone->telemetry.state) {
+		case DRONE_STATE_TAKING_OFF:
+			sim->altitude += HARNESS_TAKEOFF_SPEED * dt;
+			if (sim->altitude >= HARNESS_TAKEOFF_ALTITUDE)
+				drone->telemetry.state = DRONE_STATE_FLYING;
+			break;
+
+		case DRONE_STATE_FLYING:
+			if (now - sim->pcmd_time > HARNESS_PCMD_TIMEOUT)
+				break;
+
+			speed = sim->gaz / 100.0 *
+				drone->info.vertical_speed_limit.current;
+			sim->altitude += speed * dt;
+			if (sim->altitude > drone->info.altitude_limit.current)
+				sim->altitude = drone->info.altitude_limit.current;
+			if (sim->altitude < 0.0)
+				sim->altitude = 0.0;
+			break;
+
+		case DRONE_STATE_LANDING:
+			sim->altitude -= HARNESS_LANDING_SPEED * dt;
+			if (sim->altitude <= 0.0) {
+				sim->altitude = 0.0;
+				drone->telemetry.state = DRONE_STATE_LANDED;
+			}
+			break;
+
+		case DRONE_STATE_EMERGENCY:
+			drone->telemetry.state = DRONE_STATE_LANDED;
+			break;
+
+		case DRONE_STATE_LANDED:
+		default:
+			/* battery is swapped between flights */
+			sim->battery = 100.0;
+			break;
+	}
+
+	if (drone->telemetry.state != DRONE_STATE_LANDED) {
+		sim->battery -= dt / HARNESS_BATTERY_DRAIN;
+		if (sim->battery < 0.0)
+			sim->battery = 0.0;
+	}
+
+	drone->telemetry.altitude = (int) (sim->altitude + 0.5);
+	drone->telemetry.battery = (unsigned int) (sim->battery + 0.5);
+}
+
+/*
+ * Script
+ */
+
+static int
+harness_parse_button (const char * name, unsigned int * button)
+{
+	size_t i;
+
+	for (i = 0; i < n_harness_buttons; i++) {
+		if (strcmp (name, harness_buttons[i].name) == 0) {
+			*button = harness_buttons[i].button;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int
+harness_parse_step (const char * line, HarnessStep * step)
+{
+	char key[16];
+	char arg[16];
+	double time;
+	double duration = 0.0;
+	int lx, ly;
+	int n;
+
+	memset (step, 0, sizeof (*step));
+	arg[0] = '\0';
+
+	n = sscanf (line, "%lf %15s %15s", &time, key, arg);
+	if (n < 2 || time < 0.0)
+		return -1;
+
+	step->time = (long long) (time * 1000000.0);
+
+	if (strcmp (key, "press") == 0) {
+		step->type = HARNESS_STEP_PRESS;
+		return harness_parse_button (arg, &step->button);
+	} else if (strcmp (key, "hold") == 0) {
+		step->type = HARNESS_STEP_HOLD;
+		if (sscanf (line, "%*f %*s %*s %lf", &duration) != 1)
+			return -1;
+		step->duration = (long long) (duration * 1000000.0);
+		return harness_parse_button (arg, &step->button);
+	} else if (strcmp (key, "stick") == 0) {
+		step->type = HARNESS_STEP_STICK;
+		if (sscanf (line, "%*f %*s %d %d %lf", &lx, &ly,
+					&duration) != 3)
+			return -1;
+		if (lx < 0 || lx > 255 || ly < 0 || ly > 255)
+			return -1;
+		step->lx = lx;
+		step->ly = ly;
+		step->duration = (long long) (duration * 1000000.0);
+		return 0;
+	} else if (strcmp (key, "end") == 0) {
+		step->type = HARNESS_STEP_END;
+		return 0;
+	}
+
+	return -1;
+}
+
+/* parse script lines, @name is used in errors */
+static int
+harness_load_script (Harness * h, const char * text, const char * name)
+{
+	const char *line = text;
+	int lineno = 0;
+
+	while (*line != '\0') {
+		const char *eol = strchr (line, '\n');
+		char buf[256];
+		size_t len = eol ? (size_t) (eol - line) : strlen (line);
+		HarnessStep *step;
+
+		lineno++;
+		if (len >= sizeof (buf))
+			len = sizeof (buf) - 1;
+		memcpy (buf, line, len);
+		buf[len] = '\0';
+		line = eol ? eol + 1 : line + len;
+
+		if (buf[0] == '#' || buf[strspn (buf, " \t\r")] == '\0')
+			continue;
+
+		if (h->n_script_steps == HARNESS_SCRIPT_MAX_STEPS) {
+			fprintf (stderr, "%s: too many script steps\n", name);
+			return -1;
+		}
+
+		step = &h->script[h->n_script_steps];
+		if (harness_parse_step (buf, step) < 0) {
+			fprintf (stderr, "%s:%d: syntax error\n", name, lineno);
+			return -1;
+		}
+
+		/* steps are run in order */
+		if (h->n_script_steps > 0 &&
+				step->time < h->script[h->n_script_steps - 1].time) {
+			fprintf (stderr, "%s:%d: time goes backward\n", name,
+					lineno);
+			return -1;
+		}
+
+		h->n_script_steps++;
+
+		if (step->type == HARNESS_STEP_END)
+			break;
+	}
+
+	if (h->n_script_steps == 0) {
+		fprintf (stderr, "%s: empty script\n", name);
+		return -1;
+	}
+
+	h->period = h->script[h->n_script_steps - 1].time;
+	if (h->script[h->n_script_steps - 1].type != HARNESS_STEP_END)
+		h->period += 1000000;
+
+	return 0;
+}
+
+static int
+harness_load_script_file (Harness * h, const char * path)
+{
+	char *text;
+	FILE *file;
+	long size;
+	int ret;
+
+	file = fopen (path, "r");
+	if (file == NULL) {
+		fprintf (stderr, "failed to open %s: %s\n", path,
+				strerror (errno));
+		return -1;
+	}
+
+	if (fseek (file, 0, SEEK_END) < 0 || (size = ftell (file)) < 0) {
+		fclose (file);
+		return -1;
+	}
+	rewind (file);
+
+	text = malloc (size + 1);
+	if (text == NULL || fread (text, 1, size, file) != (size_t) size) {
+		fprintf (stderr, "failed to read %s\n", path);
+		free (text);
+		fclose (file);
+		return -1;
+	}
+	text[size] = '\0';
+	fclose (file);
+
+	ret = harness_load_script (h, text, path);
+	free (text);
+
+	return ret;
+}
+
+static void
+harness_run_script (Harness * h, long long now)
+{
+	unsigned int buttons = 0;
+	int expect;
+	int i;
+
+	if (now - h->loop_start >= h->period) {
+		h->loop_start += h->period;
+		h->script_index = 0;
+		h->loops++;
+
+		/* first loops reach steady state, e.g. caches and allocator
+		 * data of threads allocating for the first time */
+		h->memory_last = check_heap_in_use ();
+		if (h->loops == HARNESS_WARMUP_LOOPS)
+			h->memory_baseline = h->memory_last;
+	}
+
+	while (h->script_index < h->n_script_steps) {
+		HarnessStep *step = &h->script[h->script_index];
+
+		if (now - h->loop_start < step->time)
+			break;
+
+		h->script_index++;
+
+		switch (step->type) {
+			case HARNESS_STEP_PRESS:
+				/* released at next frame */
+				h->release[harness_button_index (step->button)] =
+					now + 1;
+				break;
+
+			case HARNESS_STEP_HOLD:
+				h->release[harness_button_index (step->button)] =
+					now + step->duration;
+				break;
+
+			case HARNESS_STEP_STICK:
+				h->lx = step->lx;
+				h->ly = step->ly;
+				h->stick_release = now + step->duration;
+				break;
+
+			case HARNESS_STEP_END:
+			default:
+				break;
+		}
+	}
+
+	for (i = 0; i < 32; i++) {
+		if (h->release[i] > now)
+			buttons |= 1U << i;
+	}
+
+	if (h->stick_release <= now)
+		h->lx = h->ly = 128;
+
+	platform_virtual_set_pad (buttons, h->lx, h->ly);
+
+	/* a press is a single frame and may be meant for a menu, only holds
+	 * are expected to pilot */
+	expect = (h->lx != 128 || h->ly != 128);
+	for (i = 0; i < 32; i++) {
+		if ((HARNESS_PILOTING_BUTTONS & (1U << i)) &&
+				h->release[i] > now + 1)
+			expect = 1;
+	}
+
+	if (expect && !h->expect_pcmd) {
+		h->last_pcmd_time = now;
+		h->in_gap = 0;
+	}
+	h->expect_pcmd = expect;
+}
+
+/* called by platform_wait_vblank () at end of each frame */
+static void
+harness_on_vblank (void * data)
+{
+	Harness *h = data;
+	long long now = platform_get_time_wide ();
+	long long real = harness_real_time ();
+	unsigned int frame = real - h->frame_start;
+
+	/* real time spent on frame, first one includes ui setup */
+	if (h->frames > 0) {
+		h->frame_sum += frame;
+		if (frame > h->frame_max)
+			h->frame_max = frame;
+		if (frame > h->budget) {
+			h->overruns++;
+			if (h->verbose)
+				printf ("%.3f s: frame took %u us\n",
+						(now - h->start_time) / 1000000.0,
+						frame);
+		}
+	}
+	h->frames++;
+
+	/* pad published at previous vblank was used by this frame */
+	if (h->expect_pcmd) {
+		long long gap = now - h->last_pcmd_time;
+
+		if (harness_drone.pcmds != h->last_pcmds) {
+			h->last_pcmd_time = now;
+			h->in_gap = 0;
+		} else if (gap > h->max_gap && !h->in_gap) {
+			h->gaps++;
+			h->in_gap = 1;
+			if (h->verbose)
+				printf ("%.3f s: no piloting command for "
+						"%lld ms\n",
+						(now - h->start_time) / 1000000.0,
+						gap / 1000);
+		}
+
+		if (gap > h->gap_max)
+			h->gap_max = gap;
+	}
+	h->last_pcmds = harness_drone.pcmds;
+
+	harness_drone_step (now, (now - h->vblank_time) / 1000000.0);
+	h->vblank_time = now;
+
+	if (now >= h->next_memory_sample) {
+		size_t heap = check_heap_in_use ();
+
+		if (heap > h->memory_peak)
+			h->memory_peak = heap;
+		h->next_memory_sample = now + HARNESS_MEMORY_PERIOD;
+	}
+
+	if (now - h->start_time >= h->duration) {
+		running = 0;
+		return;
+	}
+
+	harness_run_script (h, now);
+
+	h->frame_start = harness_real_time ();
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-v] [-d duration_s] [-b budget_us] "
+			"[-g max_gap_ms] [-m max_growth_kb] [-s script]\n",
+			name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	Harness *h = &harness;
+	const char *script = NULL;
+	long long real_start, elapsed;
+	long long growth;
+	Drone drone;
+	UI ui;
+	int failed = 0;
+	int opt;
+
+	h->duration = HARNESS_DURATION * 1000000LL;
+	h->budget = HARNESS_FRAME_BUDGET;
+	h->max_gap = HARNESS_MAX_GAP * 1000;
+	h->max_growth = HARNESS_MAX_GROWTH * 1024;
+
+	while ((opt = getopt (argc, argv, "vd:b:g:m:s:")) != -1) {
+		switch (opt) {
+			case 'v':
+				h->verbose = 1;
+				break;
+			case 'd':
+				h->duration = atof (optarg) * 1000000.0;
+				break;
+			case 'b':
+				h->budget = atoi (optarg);
+				break;
+			case 'g':
+				h->max_gap = atoi (optarg) * 1000LL;
+				break;
+			case 'm':
+				h->max_growth = atoi (optarg) * 1024;
+				break;
+			case 's':
+				script = optarg;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc || h->duration <= 0) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (script) {
+		if (harness_load_script_file (h, script) < 0)
+			return 1;
+	} else if (harness_load_script (h, harness_default_script,
+				"default script") < 0) {
+		return 1;
+	}
+
+	if (check_init () < 0)
+		return 1;
+
+	platform_virtual_start (harness_on_vblank, h);
+
+	if (SDL_Init (SDL_INIT_VIDEO) < 0 || TTF_Init () < 0) {
+		fprintf (stderr, "failed to initialize SDL\n");
+		return 1;
+	}
+
+	if (ui_init (&ui, 480, 272) < 0) {
+		fprintf (stderr, "failed to initialize ui\n");
+		return 1;
+	}
+
+	drone_init (&drone);
+	drone_connect (&drone, "127.0.0.1", 0, 0, 0);
+
+	h->start_time = h->loop_start = h->vblank_time =
+		platform_get_time_wide ();
+	h->next_memory_sample = h->start_time;
+	h->memory_peak = h->memory_last = h->memory_baseline =
+		check_heap_in_use ();
+
+	real_start = h->frame_start = harness_real_time ();
+	ui_flight_run (&ui, &drone);
+	elapsed = harness_real_time () - real_start;
+
+	drone_disconnect (&drone);
+	drone_deinit (&drone);
+	ui_deinit (&ui);
+	TTF_Quit ();
+	SDL_Quit ();
+	psplog_deinit ();
+
+	if (platform_get_time_wide () - h->start_time < h->duration) {
+		fprintf (stderr, "flight ui left before end of run\n");
+		failed = 1;
+	}
+
+	growth = 0;
+	if (h->loops > HARNESS_WARMUP_LOOPS)
+		growth = (long long) h->memory_last -
+			(long long) h->memory_baseline;
+
+	printf ("flown %.0f s in %.1f s, %u loops, %llu frames, "
+			"%u takeoffs, %u piloting commands\n",
+			(platform_get_time_wide () - h->start_time) / 1000000.0,
+			elapsed / 1000000.0, h->loops, h->frames,
+			harness_drone.takeoffs, harness_drone.pcmds);
+	printf ("frame time mean %llu us max %u us, %u over %u us budget\n",
+			h->frames > 1 ? h->frame_sum / (h->frames - 1) : 0,
+			h->frame_max, h->overruns, h->budget);
+	printf ("control gaps %u, longest %lld ms\n", h->gaps,
+			h->gap_max / 1000);
+	printf ("heap peak %zu KB, growth %lld bytes over %u loops\n",
+			h->memory_peak / 1024, growth,
+			h->loops > HARNESS_WARMUP_LOOPS ?
+			h->loops - HARNESS_WARMUP_LOOPS : 0);
+
+	if (h->overruns > 0) {
+		fprintf (stderr, "FAIL: %u frames over budget\n", h->overruns);
+		failed = 1;
+	}
+
+	if (h->gaps > 0) {
+		fprintf (stderr, "FAIL: %u control gaps\n", h->gaps);
+		failed = 1;
+	}
+
+	if (growth > (long long) h->max_growth) {
+		fprintf (stderr, "FAIL: heap grew by %lld bytes\n", growth);
+		failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Flight query: index and summarize flights written by flightrec.c.
+ *
+ * usage: flight-query [-s start_s] [-e end_s] [-l link_loss_ms] [-d]
+ *                     flight_file...
+ *
+ * Files are mapped, each one gets a sparse index with time range of its
+ * chunks so that only chunks overlapping [start_s, end_s] are decoded.
+ * For each file and over all of them, it reports maximum altitude, battery
+ * drain rate, intervals without any navdata or event longer than
+ * link_loss_ms, and time from a gaz command to altitude moving that way.
+ * -d prints rows in range as CSV instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "drone.h"
+#include "flightrec.h"
+
+/* altitude change telling drone follows a gaz command */
+#define QUERY_RESPONSE_THRESHOLD 10 /* cm */
+#define QUERY_LINK_LOSS_DEFAULT 500 /* ms */
+
+typedef struct _QueryChunk QueryChunk;
+typedef struct _QueryFile QueryFile;
+typedef struct _QueryCursor QueryCursor;
+typedef struct _QueryStats QueryStats;
+
+/* sparse index entry */
+struct _QueryChunk
+{
+	const FlightRecChunkHeader *header;
+	int32_t first_time;
+	int32_t last_time;
+};
+
+struct _QueryFile
+{
+	const char *path;
+	const uint8_t *data;
+	size_t size;
+	QueryChunk *chunks;
+	int n_chunks;
+};
+
+/* walks rows of a chunk, accumulating differences */
+struct _QueryCursor
+{
+	const FlightRecChunkHeader *header;
+	const uint8_t *columns[FLIGHTREC_N_COLUMNS];
+	uint32_t row;
+	int32_t values[FLIGHTREC_N_COLUMNS];
+};
+
+struct _QueryStats
+{
+	unsigned long rows;
+	int32_t first_time;
+	int32_t last_time;
+
+	int32_t max_altitude;
+	int32_t max_altitude_time;
+
+	/* battery is 0 until first report */
+	int32_t battery_first;
+	int32_t battery_first_time;
+	int32_t battery_last;
+	int32_t battery_last_time;
+
+	int32_t d2c_buffers;
+	int32_t d2c_time;
+	unsigned int link_losses;
+	int32_t link_loss_total;
+
+	/* set by query_stats_finish (), summed over flights */
+	int32_t duration;
+	int32_t drained;
+	int32_t drain_time;
+
+	/* pending gaz command, direction is 0 when none */
+	int gaz;
+	int gaz_direction;
+	int32_t gaz_time;
+	int32_t gaz_altitude;
+	unsigned int gaz_ignored;
+	int32_t *responses;
+	unsigned int n_responses;
+	unsigned int responses_size;
+};
+
+static int32_t query_start = INT32_MIN;
+static int32_t query_end = INT32_MAX;
+static int32_t query_link_loss = QUERY_LINK_LOSS_DEFAULT;
+static int query_dump = 0;
+
+/* packed columns may start at any address, two bytes values are built
+ * from bytes as little endian */
+static int16_t
+query_read_int16 (const uint8_t * column, uint32_t row)
+{
+	const uint8_t *p = column + 2 * row;
+
+	return (int16_t) (p[0] | (p[1] << 8));
+}
+
+static void
+query_cursor_init (QueryCursor * cursor, const FlightRecChunkHeader * header)
+{
+	const uint8_t *column = (const uint8_t *) (header + 1);
+	int i;
+
+	cursor->header = header;
+	cursor->row = 0;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		cursor->columns[i] = column;
+		cursor->values[i] = header->base[i];
+		column += header->n_rows * flightrec_column_get_width (i);
+	}
+}
+
+/* return 0 past last row, first value of each column is always 0 */
+static int
+query_cursor_next (QueryCursor * cursor)
+{
+	uint32_t row = cursor->row;
+	int i;
+
+	if (row >= cursor->header->n_rows)
+		return 0;
+
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		if (flightrec_column_get_width (i) == 1)
+			cursor->values[i] +=
+				((const int8_t *) cursor->columns[i])[row];
+		else
+			cursor->values[i] +=
+				query_read_int16 (cursor->columns[i], row);
+	}
+
+	cursor->row++;
+
+	return 1;
+}
+
+static int
+query_file_index (QueryFile * file)
+{
+	const FlightRecFileHeader *header;
+	size_t row_width = 0;
+	size_t offset;
+	int i;
+
+	header = (const FlightRecFileHeader *) file->data;
+	if (file->size < sizeof (*header) ||
+			memcmp (header->magic, FLIGHTREC_MAGIC,
+				FLIGHTREC_MAGIC_LEN) != 0) {
+		fprintf (stderr, "%s: not a flight recording\n", file->path);
+		return -1;
+	}
+
+	if (header->n_columns != FLIGHTREC_N_COLUMNS)
+		goto other_format;
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++) {
+		if (header->widths[i] != flightrec_column_get_width (i))
+			goto other_format;
+		row_width += header->widths[i];
+	}
+
+	/* chunks are larger than their header */
+	file->chunks = malloc (sizeof (QueryChunk) *
+			(file->size / sizeof (FlightRecChunkHeader) + 1));
+	if (file->chunks == NULL)
+		return -1;
+
+	file->n_chunks = 0;
+	offset = sizeof (*header);
+
+	while (offset + sizeof (FlightRecChunkHeader) <= file->size) {
+		const FlightRecChunkHeader *chunk =
+			(const FlightRecChunkHeader *) (file->data + offset);
+		QueryChunk *entry = &file->chunks[file->n_chunks];
+		const uint8_t *time;
+		uint32_t row;
+
+		if (chunk->magic != FLIGHTREC_CHUNK_MAGIC ||
+				chunk->size > file->size - offset) {
+			fprintf (stderr, "%s: truncated at %zu\n", file->path,
+					offset);
+			break;
+		}
+
+		/* size must match rows exactly, columns are read without
+		 * further checks and offset must move forward */
+		if (chunk->n_rows == 0 ||
+				chunk->n_rows > header->chunk_rows ||
+				chunk->size != sizeof (FlightRecChunkHeader) +
+				chunk->n_rows * row_width) {
+			fprintf (stderr, "%s: invalid chunk at %zu\n",
+					file->path, offset);
+			break;
+		}
+
+		/* time is first column and two bytes wide, only it is
+		 * decoded to index */
+		time = (const uint8_t *) (chunk + 1);
+		entry->header = chunk;
+		entry->first_time = entry->last_time = chunk->base[FLIGHTREC_TIME];
+		for (row = 1; row < chunk->n_rows; row++)
+			entry->last_time += query_read_int16 (time, row);
+
+		file->n_chunks++;
+		offset += chunk->size;
+	}
+
+	return 0;
+
+other_format:
+	fprintf (stderr, "%s: written with other columns\n", file->path);
+	return -1;
+}
+
+static int
+query_file_open (QueryFile * file, const char * path)
+{
+	struct stat st;
+	int fd;
+
+	memset (file, 0, sizeof (*file));
+	file->path = path;
+
+	fd = open (path, O_RDONLY);
+	if (fd < 0 || fstat (fd, &st) < 0)
+		goto failed;
+
+	file->size = st.st_size;
+	if (file->size == 0) {
+		fprintf (stderr, "%s: empty\n", path);
+		close (fd);
+		return -1;
+	}
+
+	file->data = mmap (NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	fd = -1;
+	if (file->data == MAP_FAILED)
+		goto failed;
+
+	return query_file_index (file);
+
+failed:
+	perror (path);
+	if (fd >= 0)
+		close (fd);
+	file->data = NULL;
+	return -1;
+}
+
+static void
+query_file_close (QueryFile * file)
+{
+	if (file->data)
+		munmap ((void *) file->data, file->size);
+	free (file->chunks);
+}
+
+static void
+query_stats_init (QueryStats * stats)
+{
+	memset (stats, 0, sizeof (*stats));
+	stats->max_altitude = INT32_MIN;
+}
+
+static void
+query_stats_add_response (QueryStats * stats, int32_t response)
+{
+	if (stats->n_responses == stats->responses_size) {
+		unsigned int size = stats->responses_size ?
+			stats->responses_size * 2 : 64;
+		int32_t *responses;
+
+		responses = realloc (stats->responses,
+				size * sizeof (*responses));
+		if (responses == NULL)
+			return;
+
+		stats->responses = responses;
+		stats->responses_size = size;
+	}
+
+	stats->responses[stats->n_responses++] = response;
+}
+
+static void
+query_link_loss_found (QueryStats * stats, int32_t start, int32_t end)
+{
+	stats->link_losses++;
+	stats->link_loss_total += end - start;
+
+	printf ("  link loss %.1f-%.1f s (%.1f s)\n", start / 1000.,
+				end / 1000., (end - start) / 1000.);
+}
+
+static void
+query_stats_update (QueryStats * stats, const int32_t * row)
+{
+	int32_t time = row[FLIGHTREC_TIME];
+	int32_t altitude = row[FLIGHTREC_ALTITUDE];
+	int gaz = row[FLIGHTREC_GAZ];
+
+	if (stats->rows++ == 0) {
+		stats->first_time = time;
+		stats->d2c_buffers = row[FLIGHTREC_D2C_BUFFERS];
+		stats->d2c_time = time;
+		/* command held at start of range is not timed */
+		stats->gaz = gaz;
+	}
+	stats->last_time = time;
+
+	if (altitude > stats->max_altitude) {
+		stats->max_altitude = altitude;
+		stats->max_altitude_time = time;
+	}
+
+	if (row[FLIGHTREC_BATTERY] > 0) {
+		if (stats->battery_first == 0) {
+			stats->battery_first = row[FLIGHTREC_BATTERY];
+			stats->battery_first_time = time;
+		}
+		stats->battery_last = row[FLIGHTREC_BATTERY];
+		stats->battery_last_time = time;
+	}
+
+	if (row[FLIGHTREC_D2C_BUFFERS] != stats->d2c_buffers) {
+		if (time - stats->d2c_time > query_link_loss)
+			query_link_loss_found (stats, stats->d2c_time, time);
+		stats->d2c_buffers = row[FLIGHTREC_D2C_BUFFERS];
+		stats->d2c_time = time;
+	}
+
+	/* gaz response is only meaningful in flight */
+	if (row[FLIGHTREC_FLYING_STATE] != DRONE_STATE_FLYING) {
+		stats->gaz_direction = 0;
+		stats->gaz = gaz;
+		return;
+	}
+
+	if (stats->gaz_direction != 0) {
+		if ((altitude - stats->gaz_altitude) * stats->gaz_direction >=
+				QUERY_RESPONSE_THRESHOLD) {
+			query_stats_add_response (stats,
+					time - stats->gaz_time);
+			stats->gaz_direction = 0;
+		} else if (gaz * stats->gaz_direction <= 0) {
+			/* released or reversed before drone moved */
+			stats->gaz_ignored++;
+			stats->gaz_direction = 0;
+		}
+	}
+
+	/* a command is timed from the frame it starts */
+	if (stats->gaz_direction == 0 && stats->gaz == 0 && gaz != 0) {
+		stats->gaz_direction = gaz > 0 ? 1 : -1;
+		stats->gaz_time = time;
+		stats->gaz_altitude = altitude;
+	}
+
+	stats->gaz = gaz;
+}
+
+static void
+query_stats_finish (QueryStats * stats)
+{
+	stats->duration = stats->last_time - stats->first_time;
+	stats->drained = stats->battery_first - stats->battery_last;
+	stats->drain_time = stats->battery_last_time -
+		stats->battery_first_time;
+}
+
+static void
+query_stats_merge (QueryStats * total, const QueryStats * stats)
+{
+	unsigned int i;
+
+	total->rows += stats->rows;
+	total->duration += stats->duration;
+
+	if (stats->max_altitude > total->max_altitude)
+		total->max_altitude = stats->max_altitude;
+
+	/* drain rate over all flights, as if they were one */
+	total->drained += stats->drained;
+	total->drain_time += stats->drain_time;
+
+	total->link_losses += stats->link_losses;
+	total->link_loss_total += stats->link_loss_total;
+
+	total->gaz_ignored += stats->gaz_ignored;
+	for (i = 0; i < stats->n_responses; i++)
+		query_stats_add_response (total, stats->responses[i]);
+}
+
+static int
+query_compare (const void * a, const void * b)
+{
+	int32_t x = *(const int32_t *) a;
+	int32_t y = *(const int32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+query_print_responses (QueryStats * stats)
+{
+	int32_t *r = stats->responses;
+	unsigned int n = stats->n_responses;
+
+	if (n == 0) {
+		printf ("  gaz response none measured, %u ignored\n",
+				stats->gaz_ignored);
+		return;
+	}
+
+	qsort (r, n, sizeof (*r), query_compare);
+	printf ("  gaz response n=%u p50 %d ms p95 %d ms max %d ms, "
+			"%u ignored\n", n, r[n / 2], r[n * 95 / 100], r[n - 1],
+			stats->gaz_ignored);
+}
+
+/* common to a flight and total */
+static void
+query_print_stats (QueryStats * stats)
+{
+	printf ("  max altitude %.2f m\n", stats->max_altitude / 100.);
+
+	if (stats->drain_time > 0)
+		printf ("  battery drain %d%% in %.1f s, %.2f %%/min\n",
+				stats->drained, stats->drain_time / 1000.,
+				stats->drained * 60000. / stats->drain_time);
+	else
+		printf ("  battery drain unknown\n");
+
+	printf ("  link losses %u, %.1f s\n", stats->link_losses,
+			stats->link_loss_total / 1000.);
+	query_print_responses (stats);
+}
+
+static void
+query_dump_header (void)
+{
+	int i;
+
+	printf ("file");
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++)
+		printf (",%s", flightrec_column_get_name (i));
+	printf ("\n");
+}
+
+static void
+query_dump_row (const char * path, const int32_t * row)
+{
+	int i;
+
+	printf ("%s", path);
+	for (i = 0; i < FLIGHTREC_N_COLUMNS; i++)
+		printf (",%d", row[i]);
+	printf ("\n");
+}
+
+/* decode chunks overlapping queried range, return number of rows in it */
+static unsigned long
+query_file_run (QueryFile * file, QueryStats * stats)
+{
+	unsigned long n_rows = 0;
+	int i;
+
+	for (i = 0; i < file->n_chunks; i++) {
+		const QueryChunk *chunk = &file->chunks[i];
+		QueryCursor cursor;
+
+		if (chunk->last_time < query_start)
+			continue;
+		if (chunk->first_time > query_end)
+			break;
+
+		query_cursor_init (&cursor, chunk->header);
+		while (query_cursor_next (&cursor)) {
+			int32_t time = cursor.values[FLIGHTREC_TIME];
+
+			if (time < query_start)
+				continue;
+			if (time > query_end)
+				break;
+
+			n_rows++;
+			if (query_dump)
+				query_dump_row (file->path, cursor.values);
+			else
+				query_stats_update (stats, cursor.values);
+		}
+	}
+
+	/* link still lost at end of range */
+	if (!query_dump && stats->rows > 0 &&
+			stats->last_time - stats->d2c_time > query_link_loss)
+		query_link_loss_found (stats, stats->d2c_time,
+				stats->last_time);
+
+	return n_rows;
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-s start_s] [-e end_s] [-l link_loss_ms] "
+			"[-d] flight_file...\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	QueryStats total;
+	int n_files = 0;
+	int opt;
+	int i;
+
+	while ((opt = getopt (argc, argv, "s:e:l:d")) != -1) {
+		switch (opt) {
+			case 's':
+				query_start = atof (optarg) * 1000;
+				break;
+			case 'e':
+				query_end = atof (optarg) * 1000;
+				break;
+			case 'l':
+				query_link_loss = atoi (optarg);
+				break;
+			case 'd':
+				query_dump = 1;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (query_dump)
+		query_dump_header ();
+
+	query_stats_init (&total);
+
+	for (i = optind; i < argc; i++) {
+		QueryFile file;
+		QueryStats stats;
+
+		if (query_file_open (&file, argv[i]) < 0) {
+			query_file_close (&file);
+			continue;
+		}
+
+		if (!query_dump)
+			printf ("%s: %d chunks\n", file.path, file.n_chunks);
+
+		query_stats_init (&stats);
+		if (query_file_run (&file, &stats) > 0 && !query_dump) {
+			query_stats_finish (&stats);
+			printf ("  %.1f-%.1f s, %lu rows, max altitude at "
+					"%.1f s\n", stats.first_time / 1000.,
+					stats.last_time / 1000., stats.rows,
+					stats.max_altitude_time / 1000.);
+			query_print_stats (&stats);
+			query_stats_merge (&total, &stats);
+			n_files++;
+		}
+
+		free (stats.responses);
+		query_file_close (&file);
+	}
+
+	if (!query_dump && n_files > 1) {
+		printf ("%d flights, %.1f s, %lu rows\n", n_files,
+				total.duration / 1000., total.rows);
+		query_print_stats (&total);
+	}
+
+	free (total.responses);
+
+	return 0;
+}
@@ -0,0 +1,633 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Link benchmark: replay impairment scenarios of tools/link-proxy against
+ * ARNetwork buffers configurations and report piloting command latency and
+ * navdata age, as seen by drone.c.
+ *
+ * usage: link-bench [-t tools_dir] [-o output_dir] [-d duration_s]
+ *                   [-n navdata_hz] [-s seed] bench_file
+ *
+ * Each run starts tools/drone-sim in probe mode behind tools/link-proxy,
+ * connects with drone_connect () and sends piloting commands at frame
+ * rate. Roll of each command is a probe number, simulated drone streams
+ * back last received probe and its receive time, so that command latency
+ * is measured end to end, through ARNetwork buffers and impaired link.
+ * Only last probe received before each navdata is seen, so there are
+ * about as many latency samples as navdata. Probe numbers wrap after 100
+ * commands, latencies above 1.6 s are not measured.
+ *
+ * Bench file lists buffers configurations and scenarios, every scenario is
+ * run with every configuration and same seed:
+ *   config <name>
+ *   buffer <id> [wait=<ms>,ack_timeout=<ms>,retries=<n>,cells=<n>]
+ *   scenario <name>
+ *   c2d <impairment>
+ *   d2c <impairment>
+ * buffer lines apply to last config and are on top of drone.c defaults,
+ * impairment syntax is the one of link-proxy. Logs, packet fates and
+ * simulator output of each run are written in output directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "drone.h"
+#include "platform.h"
+#include "psplog.h"
+
+#define BENCH_MAX_CONFIGS 16
+#define BENCH_MAX_BUFFERS 8
+#define BENCH_MAX_SCENARIOS 16
+#define BENCH_NAME_MAX_LEN 32
+#define BENCH_SPEC_MAX_LEN 128
+#define BENCH_PATH_MAX_LEN 256
+
+/* proxy listens on drone ports, simulator on next ones */
+#define BENCH_DISCOVERY_PORT 44444
+#define BENCH_C2D_PORT 54321
+#define BENCH_D2C_PORT 43210
+#define BENCH_SIM_DISCOVERY_PORT "44445"
+#define BENCH_SIM_C2D_PORT "54322"
+#define BENCH_SIM_UPSTREAM "127.0.0.1:" BENCH_SIM_DISCOVERY_PORT ":" \
+	BENCH_SIM_C2D_PORT
+
+#define BENCH_FRAME_PERIOD 16683 /* us, as vblank */
+#define BENCH_PROBES 100
+#define BENCH_STARTUP_DELAY 300000 /* us */
+#define BENCH_SYNC_DELAY 500000 /* us */
+
+typedef struct _BenchBuffer BenchBuffer;
+typedef struct _BenchConfig BenchConfig;
+typedef struct _BenchScenario BenchScenario;
+typedef struct _BenchResult BenchResult;
+
+struct _BenchBuffer
+{
+	int id;
+	int wait;
+	int ack_timeout;
+	int retries;
+	int cells;
+};
+
+struct _BenchConfig
+{
+	char name[BENCH_NAME_MAX_LEN];
+	BenchBuffer buffers[BENCH_MAX_BUFFERS];
+	int n_buffers;
+};
+
+struct _BenchScenario
+{
+	char name[BENCH_NAME_MAX_LEN];
+	char c2d[BENCH_SPEC_MAX_LEN];
+	char d2c[BENCH_SPEC_MAX_LEN];
+};
+
+/* sent from run process to parent through a pipe, times in us */
+struct _BenchResult
+{
+	int connected;
+	int disconnected;
+	unsigned int connect_time;
+	unsigned int probes;
+	unsigned int navdata;
+	unsigned int latency_p50;
+	unsigned int latency_p95;
+	unsigned int latency_max;
+	unsigned int age_p50;
+	unsigned int age_p95;
+	unsigned int age_max;
+};
+
+static BenchConfig bench_configs[BENCH_MAX_CONFIGS];
+static int n_bench_configs;
+static BenchScenario bench_scenarios[BENCH_MAX_SCENARIOS];
+static int n_bench_scenarios;
+
+static const char *bench_tools_dir = "tools";
+static const char *bench_output_dir = ".";
+static unsigned int bench_duration = 20;
+static const char *bench_navdata_rate = "20";
+static const char *bench_seed = "1";
+
+static int
+bench_parse_buffer (BenchBuffer * buffer, char * line)
+{
+	char *saveptr;
+	char *token;
+
+	buffer->wait = -1;
+	buffer->ack_timeout = -1;
+	buffer->retries = -1;
+	buffer->cells = -1;
+
+	token = strtok_r (line, " \t\n", &saveptr);
+	if (token == NULL)
+		return -1;
+
+	buffer->id = atoi (token);
+
+	token = strtok_r (NULL, " \t\n", &saveptr);
+	if (token == NULL)
+		return 0;
+
+	for (token = strtok_r (token, ",", &saveptr); token != NULL;
+			token = strtok_r (NULL, ",", &saveptr)) {
+		char *value = strchr (token, '=');
+
+		if (value == NULL)
+			return -1;
+
+		*value++ = '\0';
+
+		if (strcmp (token, "wait") == 0)
+			buffer->wait = atoi (value);
+		else if (strcmp (token, "ack_timeout") == 0)
+			buffer->ack_timeout = atoi (value);
+		else if (strcmp (token, "retries") == 0)
+			buffer->retries = atoi (value);
+		else if (strcmp (token, "cells") == 0)
+			buffer->cells = atoi (value);
+		else
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+bench_load (const char * path)
+{
+	BenchConfig *config = NULL;
+	BenchScenario *scenario = NULL;
+	char line[256];
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen (path, "r");
+	if (f == NULL) {
+		fprintf (stderr, "link-bench: failed to open %s: %s\n", path,
+				strerror (errno));
+		return -1;
+	}
+
+	while (fgets (line, sizeof (line), f) != NULL) {
+		char key[16];
+		char *value;
+		int n;
+
+		lineno++;
+
+		if (sscanf (line, "%15s %n", key, &n) < 1 || key[0] == '#')
+			continue;
+
+		value = line + n;
+		value[strcspn (value, "\r\n")] = '\0';
+
+		if (strcmp (key, "config") == 0) {
+			if (n_bench_configs == BENCH_MAX_CONFIGS)
+				goto error;
+			config = &bench_configs[n_bench_configs++];
+			snprintf (config->name, sizeof (config->name), "%s",
+					value);
+		} else if (strcmp (key, "buffer") == 0) {
+			if (config == NULL ||
+					config->n_buffers == BENCH_MAX_BUFFERS)
+				goto error;
+			if (bench_parse_buffer (
+						&config->buffers[config->n_buffers++],
+						value) < 0)
+				goto error;
+		} else if (strcmp (key, "scenario") == 0) {
+			if (n_bench_scenarios == BENCH_MAX_SCENARIOS)
+				goto error;
+			scenario = &bench_scenarios[n_bench_scenarios++];
+			snprintf (scenario->name, sizeof (scenario->name),
+					"%s", value);
+		} else if (strcmp (key, "c2d") == 0 && scenario != NULL) {
+			snprintf (scenario->c2d, sizeof (scenario->c2d), "%s",
+					value);
+		} else if (strcmp (key, "d2c") == 0 && scenario != NULL) {
+			snprintf (scenario->d2c, sizeof (scenario->d2c), "%s",
+					value);
+		} else {
+			goto error;
+		}
+	}
+
+	fclose (f);
+
+	if (n_bench_configs == 0 || n_bench_scenarios == 0) {
+		fprintf (stderr, "link-bench: %s needs at least a config and "
+				"a scenario\n", path);
+		return -1;
+	}
+
+	return 0;
+
+error:
+	fprintf (stderr, "link-bench: %s:%d: invalid line\n", path, lineno);
+	fclose (f);
+	return -1;
+}
+
+static int
+bench_compare (const void * a, const void * b)
+{
+	unsigned int va = *(const unsigned int *) a;
+	unsigned int vb = *(const unsigned int *) b;
+
+	return (va > vb) - (va < vb);
+}
+
+static void
+bench_percentiles (unsigned int * values, unsigned int n, unsigned int * p50,
+		unsigned int * p95, unsigned int * max)
+{
+	if (n == 0) {
+		*p50 = *p95 = *max = 0;
+		return;
+	}
+
+	qsort (values, n, sizeof (*values), bench_compare);
+	*p50 = values[n * 50 / 100];
+	*p95 = values[n * 95 / 100];
+	*max = values[n - 1];
+}
+
+/* simulated drone streams probe in position, see tools/drone-sim.c */
+static void
+bench_read_probe (Drone * drone, double * probe, double * rx_time,
+		double * tx_time)
+{
+	DroneTelemetry telemetry;
+
+	drone_get_telemetry (drone, &telemetry);
+	*probe = telemetry.gps_latitude;
+	*rx_time = telemetry.gps_longitude;
+	*tx_time = telemetry.gps_altitude;
+}
+
+static void
+bench_measure (Drone * drone, BenchResult * result)
+{
+	long long send_times[BENCH_PROBES + 1];
+	unsigned int n_frames = bench_duration * 1000000 / BENCH_FRAME_PERIOD;
+	unsigned int *latencies;
+	unsigned int *ages;
+	unsigned int n_ages = 0;
+	double last_rx_time = 0.0;
+	double last_tx_time = 0.0;
+	long long next_frame;
+	unsigned int i;
+
+	latencies = calloc (n_frames, sizeof (*latencies));
+	ages = calloc (n_frames, sizeof (*ages));
+	if (latencies == NULL || ages == NULL)
+		goto done;
+
+	memset (send_times, 0, sizeof (send_times));
+	next_frame = platform_get_time_wide ();
+
+	for (i = 0; i < n_frames && drone->connected; i++) {
+		int probe = i % BENCH_PROBES + 1;
+		double probe_value, rx_time, tx_time;
+		long long now;
+
+		send_times[probe] = platform_get_time_wide ();
+		drone_flight_control (drone, 0, 0, 0, probe, 0);
+
+		bench_read_probe (drone, &probe_value, &rx_time, &tx_time);
+		now = platform_get_time_wide ();
+
+		if (tx_time > 0.0) {
+			ages[n_ages++] = now - (long long) tx_time;
+			if (tx_time != last_tx_time)
+				result->navdata++;
+			last_tx_time = tx_time;
+		}
+
+		/* new probe reached simulated drone since last frame */
+		probe = (int) probe_value;
+		if (rx_time != last_rx_time && probe >= 1 &&
+				probe <= BENCH_PROBES && send_times[probe] &&
+				(long long) rx_time >= send_times[probe]) {
+			latencies[result->probes++] =
+				(long long) rx_time - send_times[probe];
+			last_rx_time = rx_time;
+		}
+
+		next_frame += BENCH_FRAME_PERIOD;
+		now = platform_get_time_wide ();
+		if (next_frame > now)
+			platform_delay (next_frame - now);
+	}
+
+	result->disconnected = !drone->connected;
+
+	bench_percentiles (latencies, result->probes, &result->latency_p50,
+			&result->latency_p95, &result->latency_max);
+	bench_percentiles (ages, n_ages, &result->age_p50, &result->age_p95,
+			&result->age_max);
+
+done:
+	free (latencies);
+	free (ages);
+}
+
+/* run in its own process, so that each run starts from drone.c defaults */
+static void
+bench_run_client (const BenchScenario * scenario, const BenchConfig * config,
+		int result_fd)
+{
+	char path[BENCH_PATH_MAX_LEN];
+	BenchResult result;
+	Drone drone;
+	long long start;
+	int i;
+
+	memset (&result, 0, sizeof (result));
+
+	snprintf (path, sizeof (path), "%s/%s-%s.log", bench_output_dir,
+			scenario->name, config->name);
+	psplog_init (PSPLOG_CAT_INFO, path, 0);
+
+	if (drone_init (&drone) < 0)
+		goto done;
+
+	for (i = 0; i < config->n_buffers; i++) {
+		const BenchBuffer *buffer = &config->buffers[i];
+
+		if (drone_buffer_set_params (buffer->id, buffer->wait,
+					buffer->ack_timeout, buffer->retries,
+					buffer->cells) < 0)
+			goto deinit;
+	}
+
+	start = platform_get_time_wide ();
+	if (drone_connect (&drone, "127.0.0.1", BENCH_DISCOVERY_PORT,
+				BENCH_C2D_PORT, BENCH_D2C_PORT) < 0)
+		goto deinit;
+
+	result.connected = 1;
+	result.connect_time = platform_get_time_wide () - start;
+
+	drone_sync_state (&drone);
+	drone_sync_settings (&drone);
+	platform_delay (BENCH_SYNC_DELAY);
+
+	bench_measure (&drone, &result);
+
+	drone_disconnect (&drone);
+
+deinit:
+	drone_deinit (&drone);
+
+done:
+	psplog_deinit ();
+
+	if (write (result_fd, &result, sizeof (result)) != sizeof (result))
+		fprintf (stderr, "link-bench: failed to report result\n");
+}
+
+static pid_t
+bench_spawn (char * const argv[], const char * output)
+{
+	pid_t pid;
+	int fd;
+
+	pid = fork ();
+	if (pid != 0)
+		return pid;
+
+	fd = open (output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0) {
+		dup2 (fd, STDERR_FILENO);
+		close (fd);
+	}
+
+	execv (argv[0], argv);
+	fprintf (stderr, "link-bench: failed to run %s: %s\n", argv[0],
+			strerror (errno));
+	_exit (127);
+}
+
+static void
+bench_stop (pid_t pid)
+{
+	if (pid <= 0)
+		return;
+
+	kill (pid, SIGINT);
+	waitpid (pid, NULL, 0);
+}
+
+static int
+bench_run (const BenchScenario * scenario, const BenchConfig * config,
+		BenchResult * result)
+{
+	char sim_path[BENCH_PATH_MAX_LEN];
+	char sim_output[BENCH_PATH_MAX_LEN];
+	char proxy_path[BENCH_PATH_MAX_LEN];
+	char proxy_output[BENCH_PATH_MAX_LEN];
+	char fates[BENCH_PATH_MAX_LEN];
+	char c2d[BENCH_SPEC_MAX_LEN + 16];
+	char d2c[BENCH_SPEC_MAX_LEN + 16];
+	pid_t sim_pid;
+	pid_t proxy_pid;
+	pid_t client_pid;
+	int fds[2];
+	int ret = -1;
+
+	snprintf (sim_path, sizeof (sim_path), "%s/drone-sim",
+			bench_tools_dir);
+	snprintf (sim_output, sizeof (sim_output), "%s/%s-%s.sim.txt",
+			bench_output_dir, scenario->name, config->name);
+	snprintf (proxy_path, sizeof (proxy_path), "%s/link-proxy",
+			bench_tools_dir);
+	snprintf (proxy_output, sizeof (proxy_output), "%s/%s-%s.proxy.txt",
+			bench_output_dir, scenario->name, config->name);
+	snprintf (fates, sizeof (fates), "%s/%s-%s.fates", bench_output_dir,
+			scenario->name, config->name);
+
+	/* an empty impairment is a clean link */
+	snprintf (c2d, sizeof (c2d), "latency=0%s%s",
+			scenario->c2d[0] ? "," : "", scenario->c2d);
+	snprintf (d2c, sizeof (d2c), "latency=0%s%s",
+			scenario->d2c[0] ? "," : "", scenario->d2c);
+
+	{
+		char *sim_argv[] = { sim_path, "-T", "-n",
+			(char *) bench_navdata_rate, "-p",
+			BENCH_SIM_DISCOVERY_PORT, "-c", BENCH_SIM_C2D_PORT,
+			NULL };
+		char *proxy_argv[] = { proxy_path, "-s", (char *) bench_seed,
+			"-l", fates, "-u", c2d, "-d", d2c,
+			BENCH_SIM_UPSTREAM, NULL };
+
+		sim_pid = bench_spawn (sim_argv, sim_output);
+		proxy_pid = bench_spawn (proxy_argv, proxy_output);
+	}
+
+	if (sim_pid < 0 || proxy_pid < 0)
+		goto done;
+
+	/* let them bind their ports */
+	platform_delay (BENCH_STARTUP_DELAY);
+
+	if (pipe (fds) < 0)
+		goto done;
+
+	client_pid = fork ();
+	if (client_pid == 0) {
+		close (fds[0]);
+		bench_run_client (scenario, config, fds[1]);
+		_exit (0);
+	}
+	close (fds[1]);
+
+	if (client_pid > 0) {
+		if (read (fds[0], result, sizeof (*result)) == sizeof (*result))
+			ret = 0;
+		waitpid (client_pid, NULL, 0);
+	}
+	close (fds[0]);
+
+done:
+	bench_stop (proxy_pid);
+	bench_stop (sim_pid);
+	return ret;
+}
+
+static void
+bench_print_header (void)
+{
+	printf ("%-16s %-16s %8s %8s %8s %8s %7s %7s %8s %8s %8s %s\n",
+			"scenario", "config", "connect", "cmd_p50", "cmd_p95",
+			"cmd_max", "samples", "navdata", "age_p50",
+			"age_p95", "age_max", "link");
+}
+
+static void
+bench_print_result (const BenchScenario * scenario, const BenchConfig * config,
+		const BenchResult * result)
+{
+	if (!result->connected) {
+		printf ("%-16s %-16s connection failed\n", scenario->name,
+				config->name);
+		return;
+	}
+
+	/* times in ms */
+	printf ("%-16s %-16s %8.1f %8.1f %8.1f %8.1f %7u %7u %8.1f %8.1f "
+			"%8.1f %s\n", scenario->name, config->name,
+			result->connect_time / 1000.0,
+			result->latency_p50 / 1000.0,
+			result->latency_p95 / 1000.0,
+			result->latency_max / 1000.0, result->probes,
+			result->navdata, result->age_p50 / 1000.0,
+			result->age_p95 / 1000.0, result->age_max / 1000.0,
+			result->disconnected ? "lost" : "ok");
+	fflush (stdout);
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-t tools_dir] [-o output_dir] "
+			"[-d duration_s] [-n navdata_hz] [-s seed] bench_file\n",
+			name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	int opt;
+	int i, j;
+
+	while ((opt = getopt (argc, argv, "t:o:d:n:s:")) != -1) {
+		switch (opt) {
+			case 't':
+				bench_tools_dir = optarg;
+				break;
+			case 'o':
+				bench_output_dir = optarg;
+				break;
+			case 'd':
+				bench_duration = atoi (optarg);
+				break;
+			case 'n':
+				bench_navdata_rate = optarg;
+				break;
+			case 's':
+				bench_seed = optarg;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind >= argc || bench_duration == 0) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (bench_load (argv[optind]) < 0)
+		return 1;
+
+	signal (SIGPIPE, SIG_IGN);
+
+	bench_print_header ();
+
+	for (i = 0; i < n_bench_scenarios; i++) {
+		for (j = 0; j < n_bench_configs; j++) {
+			BenchResult result;
+
+			if (bench_run (&bench_scenarios[i], &bench_configs[j],
+						&result) < 0) {
+				printf ("%-16s %-16s run failed\n",
+						bench_scenarios[i].name,
+						bench_configs[j].name);
+				continue;
+			}
+
+			bench_print_result (&bench_scenarios[i],
+					&bench_configs[j], &result);
+		}
+	}
+
+	return 0;
+}
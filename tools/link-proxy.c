@@ -0,0 +1,687 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Link impairment proxy between drone_connect () and a drone, to replay
+ * bad wifi conditions in a repeatable way.
+ *
+ * Discovery TCP connection is relayed to upstream, with d2c port of
+ * controller replaced by proxy one, then ARNetworkAL datagrams are relayed
+ * both ways. Each direction delays, drops, duplicates and reorders datagrams
+ * and caps bandwidth as configured, random draws come from a seeded
+ * generator so that a scenario gives the same fates on each run.
+ *
+ * usage: link-proxy [-v] [-s seed] [-l fate_log] [-u c2d_impairment]
+ *                   [-d d2c_impairment] [-p discovery_port] [-c c2d_port]
+ *                   [-r d2c_port] [upstream_host:discovery_port:c2d_port]
+ *
+ * Impairments are comma separated, e.g. "latency=40,jitter=10,loss=2":
+ *   latency=<ms>   one way delay
+ *   jitter=<ms>    delay varies uniformly in +/- jitter, order is kept
+ *   loss=<%>       datagrams dropped
+ *   dup=<%>        datagrams sent twice
+ *   reorder=<%>    datagrams held for reorder_delay more, so that followers
+ *                  overtake them
+ *   reorder_delay=<ms>
+ *   rate=<kbit/s>  bandwidth cap, datagrams wait for link to be free
+ *   queue=<n>      datagrams waiting in a direction before tail drop
+ *
+ * Fate log has one line per datagram: receive time in us, direction, first
+ * ARNetworkAL frame type, id and sequence number, size, fate (delivered,
+ * reordered, duplicated, lost or overflow) and applied delay in us.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define PROXY_DISCOVERY_PORT 44444
+#define PROXY_C2D_PORT 54321
+#define PROXY_D2C_PORT 43211
+
+#define PROXY_UPSTREAM "127.0.0.1:44445:54322"
+
+#define PROXY_DATAGRAM_MAX_LEN 4096
+/* datagrams waiting per direction, queue option can only lower it */
+#define PROXY_MAX_PENDING 512
+#define PROXY_DISCOVERY_TIMEOUT 2000 /* ms */
+#define PROXY_JSON_MAX_LEN 512
+
+/* ARNetworkAL frame header: u8 type, u8 id, u8 seq, u32 size */
+#define PROXY_FRAME_HEADER_LEN 7
+
+typedef struct _ProxyImpairment ProxyImpairment;
+typedef struct _ProxyDatagram ProxyDatagram;
+typedef struct _ProxyDirection ProxyDirection;
+
+struct _ProxyImpairment
+{
+	long long latency; /* us */
+	long long jitter; /* us */
+	long long reorder_delay; /* us */
+	double loss; /* % */
+	double dup; /* % */
+	double reorder; /* % */
+	int rate; /* kbit/s, 0 for unlimited */
+	int queue;
+};
+
+struct _ProxyDatagram
+{
+	long long release_time;
+	int size;
+	uint8_t data[PROXY_DATAGRAM_MAX_LEN];
+};
+
+struct _ProxyDirection
+{
+	const char *name;
+	ProxyImpairment impairment;
+
+	/* socket datagrams are sent from and their destination */
+	int fd;
+	struct sockaddr_in dest;
+
+	/* pending datagrams sorted by release time */
+	ProxyDatagram pending[PROXY_MAX_PENDING];
+	int n_pending;
+
+	/* release time of last in order datagram and time link is free
+	 * again with bandwidth cap */
+	long long last_release;
+	long long link_free;
+
+	unsigned int received;
+	unsigned int delivered;
+	unsigned int lost;
+	unsigned int overflows;
+	unsigned int duplicated;
+	unsigned int reordered;
+	unsigned long long bytes;
+};
+
+static volatile int proxy_running = 1;
+
+static ProxyDirection proxy_c2d = { .name = "c2d" };
+static ProxyDirection proxy_d2c = { .name = "d2c" };
+
+static int proxy_verbose;
+static FILE *proxy_fate_log;
+static uint64_t proxy_random_state = 0x853c49e6748fea9bULL;
+
+/* controller address, known after discovery */
+static struct sockaddr_in proxy_controller;
+static int proxy_connected;
+
+static long long
+proxy_get_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+proxy_on_signal (int signum)
+{
+	proxy_running = 0;
+}
+
+/* xorshift64*, same sequence on all hosts for a given seed */
+static double
+proxy_random (void)
+{
+	proxy_random_state ^= proxy_random_state >> 12;
+	proxy_random_state ^= proxy_random_state << 25;
+	proxy_random_state ^= proxy_random_state >> 27;
+
+	return ((proxy_random_state * 0x2545f4914f6cdd1dULL) >> 11) /
+		(double) (1ULL << 53);
+}
+
+static int
+proxy_parse_impairment (ProxyImpairment * impairment, const char * spec)
+{
+	char buf[256];
+	char *saveptr;
+	char *token;
+
+	snprintf (buf, sizeof (buf), "%s", spec);
+
+	for (token = strtok_r (buf, ",", &saveptr); token != NULL;
+			token = strtok_r (NULL, ",", &saveptr)) {
+		char *value = strchr (token, '=');
+		double v;
+
+		if (value == NULL)
+			goto error;
+
+		*value++ = '\0';
+		v = atof (value);
+
+		if (strcmp (token, "latency") == 0)
+			impairment->latency = v * 1000;
+		else if (strcmp (token, "jitter") == 0)
+			impairment->jitter = v * 1000;
+		else if (strcmp (token, "reorder_delay") == 0)
+			impairment->reorder_delay = v * 1000;
+		else if (strcmp (token, "loss") == 0)
+			impairment->loss = v;
+		else if (strcmp (token, "dup") == 0)
+			impairment->dup = v;
+		else if (strcmp (token, "reorder") == 0)
+			impairment->reorder = v;
+		else if (strcmp (token, "rate") == 0)
+			impairment->rate = v;
+		else if (strcmp (token, "queue") == 0)
+			impairment->queue = v;
+		else
+			goto error;
+	}
+
+	if (impairment->queue <= 0 || impairment->queue > PROXY_MAX_PENDING)
+		impairment->queue = PROXY_MAX_PENDING;
+
+	return 0;
+
+error:
+	fprintf (stderr, "link-proxy: invalid impairment '%s'\n", spec);
+	return -1;
+}
+
+static void
+proxy_log_fate (ProxyDirection * dir, const uint8_t * data, int size,
+		long long now, const char * fate, long long delay)
+{
+	if (proxy_fate_log == NULL)
+		return;
+
+	if (size >= PROXY_FRAME_HEADER_LEN)
+		fprintf (proxy_fate_log, "%lld %s %u %u %u %d %s %lld\n", now,
+				dir->name, data[0], data[1], data[2], size,
+				fate, delay);
+	else
+		fprintf (proxy_fate_log, "%lld %s - - - %d %s %lld\n", now,
+				dir->name, size, fate, delay);
+}
+
+static int
+proxy_schedule (ProxyDirection * dir, const uint8_t * data, int size,
+		long long release_time)
+{
+	ProxyDatagram *datagram;
+	int i;
+
+	if (dir->n_pending >= dir->impairment.queue)
+		return -1;
+
+	/* insertion keeps datagrams with same release time in order */
+	for (i = dir->n_pending; i > 0 &&
+			dir->pending[i - 1].release_time > release_time; i--)
+		dir->pending[i] = dir->pending[i - 1];
+
+	datagram = &dir->pending[i];
+	datagram->release_time = release_time;
+	datagram->size = size;
+	memcpy (datagram->data, data, size);
+	dir->n_pending++;
+
+	return 0;
+}
+
+static void
+proxy_impair (ProxyDirection * dir, const uint8_t * data, int size,
+		long long now)
+{
+	const ProxyImpairment *imp = &dir->impairment;
+	const char *fate = "delivered";
+	long long release_time;
+	long long delay;
+	int copies = 1;
+
+	dir->received++;
+
+	if (proxy_random () * 100.0 < imp->loss) {
+		dir->lost++;
+		proxy_log_fate (dir, data, size, now, "lost", 0);
+		return;
+	}
+
+	delay = imp->latency;
+	if (imp->jitter)
+		delay += (proxy_random () * 2.0 - 1.0) * imp->jitter;
+	if (delay < 0)
+		delay = 0;
+
+	release_time = now + delay;
+
+	if (proxy_random () * 100.0 < imp->reorder) {
+		/* held back without moving in order release time */
+		release_time += imp->reorder_delay;
+		fate = "reordered";
+		dir->reordered++;
+	} else {
+		/* jitter does not reorder, as on a real link */
+		if (release_time < dir->last_release)
+			release_time = dir->last_release;
+
+		/* time for datagram to go through capped link */
+		if (imp->rate > 0) {
+			if (release_time < dir->link_free)
+				release_time = dir->link_free;
+			release_time += (long long) size * 8 * 1000 /
+				imp->rate;
+			dir->link_free = release_time;
+		}
+
+		dir->last_release = release_time;
+	}
+
+	if (proxy_random () * 100.0 < imp->dup) {
+		copies = 2;
+		fate = "duplicated";
+		dir->duplicated++;
+	}
+
+	while (copies--) {
+		if (proxy_schedule (dir, data, size, release_time) < 0) {
+			dir->overflows++;
+			proxy_log_fate (dir, data, size, now, "overflow", 0);
+			return;
+		}
+	}
+
+	proxy_log_fate (dir, data, size, now, fate, release_time - now);
+}
+
+static void
+proxy_release (ProxyDirection * dir, long long now)
+{
+	int n = 0;
+	int i;
+
+	while (n < dir->n_pending && dir->pending[n].release_time <= now) {
+		ProxyDatagram *datagram = &dir->pending[n];
+
+		if (sendto (dir->fd, datagram->data, datagram->size, 0,
+					(struct sockaddr *) &dir->dest,
+					sizeof (dir->dest)) < 0) {
+			if (proxy_verbose)
+				fprintf (stderr, "link-proxy: %s send failed: "
+						"%s\n", dir->name,
+						strerror (errno));
+		} else {
+			dir->delivered++;
+			dir->bytes += datagram->size;
+		}
+
+		n++;
+	}
+
+	if (n == 0)
+		return;
+
+	for (i = n; i < dir->n_pending; i++)
+		dir->pending[i - n] = dir->pending[i];
+	dir->n_pending -= n;
+}
+
+static void
+proxy_receive (ProxyDirection * dir, long long now)
+{
+	uint8_t buf[PROXY_DATAGRAM_MAX_LEN];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof (addr);
+	ssize_t len;
+
+	len = recvfrom (dir->fd, buf, sizeof (buf), 0,
+			(struct sockaddr *) &addr, &addr_len);
+	if (len <= 0 || !proxy_connected)
+		return;
+
+	proxy_impair (dir, buf, len, now);
+}
+
+/* read a nul terminated json message, as ARDiscovery sends it */
+static ssize_t
+proxy_read_json (int fd, char * json, size_t size)
+{
+	struct pollfd pfd;
+	size_t len = 0;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (len < size - 1 && poll (&pfd, 1, PROXY_DISCOVERY_TIMEOUT) > 0) {
+		ssize_t n = recv (fd, json + len, size - 1 - len, 0);
+
+		if (n <= 0)
+			break;
+
+		len += n;
+		if (memchr (json, '\0', len) != NULL)
+			return len;
+	}
+
+	return -1;
+}
+
+static void
+proxy_accept (int listen_fd, const struct sockaddr_in * upstream,
+		int d2c_port)
+{
+	char json[PROXY_JSON_MAX_LEN];
+	char rewritten[PROXY_JSON_MAX_LEN];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof (addr);
+	int controller_d2c_port;
+	const char *p;
+	const char *end;
+	ssize_t len;
+	int upstream_fd = -1;
+	int fd;
+
+	fd = accept (listen_fd, (struct sockaddr *) &addr, &addr_len);
+	if (fd < 0)
+		return;
+
+	len = proxy_read_json (fd, json, sizeof (json));
+	if (len < 0)
+		goto error;
+
+	/* controller tells where it listens, upstream must send to proxy
+	 * instead */
+	p = strstr (json, "\"d2c_port\"");
+	if (p == NULL || (p = strchr (p, ':')) == NULL)
+		goto error;
+
+	controller_d2c_port = strtol (p + 1, (char **) &end, 10);
+	snprintf (rewritten, sizeof (rewritten), "%.*s %d%s",
+			(int) (p + 1 - json), json, d2c_port, end);
+	len = strlen (rewritten) + 1;
+
+	upstream_fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (upstream_fd < 0 || connect (upstream_fd,
+				(struct sockaddr *) upstream,
+				sizeof (*upstream)) < 0)
+		goto error;
+
+	/* handshake is one message each way, it only gets latency */
+	usleep (proxy_c2d.impairment.latency);
+	if (send (upstream_fd, rewritten, len, MSG_NOSIGNAL) < 0)
+		goto error;
+
+	len = proxy_read_json (upstream_fd, json, sizeof (json));
+	if (len < 0)
+		goto error;
+
+	usleep (proxy_d2c.impairment.latency);
+	if (send (fd, json, len, MSG_NOSIGNAL) < 0)
+		goto error;
+
+	proxy_controller = addr;
+	proxy_controller.sin_port = htons (controller_d2c_port);
+	proxy_d2c.dest = proxy_controller;
+
+	/* new session, forget datagrams of previous one */
+	proxy_c2d.n_pending = 0;
+	proxy_d2c.n_pending = 0;
+	proxy_connected = 1;
+
+	fprintf (stderr, "link-proxy: controller %s connected, d2c port %d\n",
+			inet_ntoa (addr.sin_addr), controller_d2c_port);
+
+	close (upstream_fd);
+	close (fd);
+	return;
+
+error:
+	fprintf (stderr, "link-proxy: discovery relay failed\n");
+	if (upstream_fd >= 0)
+		close (upstream_fd);
+	close (fd);
+}
+
+static int
+proxy_open_socket (int type, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd;
+
+	fd = socket (AF_INET, type, 0);
+	if (fd < 0)
+		goto error;
+
+	setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_ANY);
+	addr.sin_port = htons (port);
+
+	if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+		goto error;
+
+	if (type == SOCK_STREAM && listen (fd, 1) < 0)
+		goto error;
+
+	return fd;
+
+error:
+	fprintf (stderr, "link-proxy: failed to open port %d: %s\n", port,
+			strerror (errno));
+	if (fd >= 0)
+		close (fd);
+	return -1;
+}
+
+static int
+proxy_parse_upstream (const char * spec, struct sockaddr_in * discovery,
+		struct sockaddr_in * c2d)
+{
+	char host[64];
+	int discovery_port;
+	int c2d_port;
+
+	if (sscanf (spec, "%63[^:]:%d:%d", host, &discovery_port,
+				&c2d_port) != 3)
+		return -1;
+
+	memset (discovery, 0, sizeof (*discovery));
+	discovery->sin_family = AF_INET;
+	if (inet_aton (host, &discovery->sin_addr) == 0)
+		return -1;
+
+	*c2d = *discovery;
+	discovery->sin_port = htons (discovery_port);
+	c2d->sin_port = htons (c2d_port);
+
+	return 0;
+}
+
+static void
+proxy_print_stats (ProxyDirection * dir)
+{
+	fprintf (stderr, "link-proxy: %s: %u received, %u delivered "
+			"(%llu bytes), %u lost, %u overflows, %u duplicated, "
+			"%u reordered\n", dir->name, dir->received,
+			dir->delivered, dir->bytes, dir->lost, dir->overflows,
+			dir->duplicated, dir->reordered);
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-v] [-s seed] [-l fate_log] "
+			"[-u c2d_impairment] [-d d2c_impairment] "
+			"[-p discovery_port] [-c c2d_port] [-r d2c_port] "
+			"[upstream_host:discovery_port:c2d_port]\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	int discovery_port = PROXY_DISCOVERY_PORT;
+	int c2d_port = PROXY_C2D_PORT;
+	int d2c_port = PROXY_D2C_PORT;
+	struct sockaddr_in upstream_discovery;
+	struct pollfd pfds[3];
+	int listen_fd;
+	int opt;
+
+	proxy_c2d.impairment.queue = PROXY_MAX_PENDING;
+	proxy_d2c.impairment.queue = PROXY_MAX_PENDING;
+
+	while ((opt = getopt (argc, argv, "vs:l:u:d:p:c:r:")) != -1) {
+		switch (opt) {
+			case 'v':
+				proxy_verbose = 1;
+				break;
+			case 's':
+				/* state must not be 0 */
+				proxy_random_state ^= strtoull (optarg, NULL, 0) *
+					0x9e3779b97f4a7c15ULL;
+				if (proxy_random_state == 0)
+					proxy_random_state = 1;
+				break;
+			case 'l':
+				proxy_fate_log = fopen (optarg, "w");
+				if (proxy_fate_log == NULL) {
+					fprintf (stderr, "link-proxy: failed to "
+							"open %s: %s\n", optarg,
+							strerror (errno));
+					return 1;
+				}
+				break;
+			case 'u':
+				if (proxy_parse_impairment (&proxy_c2d.impairment,
+							optarg) < 0)
+					return 1;
+				break;
+			case 'd':
+				if (proxy_parse_impairment (&proxy_d2c.impairment,
+							optarg) < 0)
+					return 1;
+				break;
+			case 'p':
+				discovery_port = atoi (optarg);
+				break;
+			case 'c':
+				c2d_port = atoi (optarg);
+				break;
+			case 'r':
+				d2c_port = atoi (optarg);
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (proxy_parse_upstream (optind < argc ? argv[optind] :
+				PROXY_UPSTREAM, &upstream_discovery,
+				&proxy_c2d.dest) < 0) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	listen_fd = proxy_open_socket (SOCK_STREAM, discovery_port);
+	proxy_c2d.fd = proxy_open_socket (SOCK_DGRAM, c2d_port);
+	proxy_d2c.fd = proxy_open_socket (SOCK_DGRAM, d2c_port);
+	if (listen_fd < 0 || proxy_c2d.fd < 0 || proxy_d2c.fd < 0)
+		return 1;
+
+	signal (SIGINT, proxy_on_signal);
+	signal (SIGTERM, proxy_on_signal);
+
+	pfds[0].fd = listen_fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = proxy_c2d.fd;
+	pfds[1].events = POLLIN;
+	pfds[2].fd = proxy_d2c.fd;
+	pfds[2].events = POLLIN;
+
+	while (proxy_running) {
+		struct timespec timeout = { 0, 10000000 };
+		long long now = proxy_get_time ();
+		long long next = now + 10000;
+
+		/* wake up for next release, datagrams are sent with sub
+		 * millisecond accuracy */
+		if (proxy_c2d.n_pending &&
+				proxy_c2d.pending[0].release_time < next)
+			next = proxy_c2d.pending[0].release_time;
+		if (proxy_d2c.n_pending &&
+				proxy_d2c.pending[0].release_time < next)
+			next = proxy_d2c.pending[0].release_time;
+
+		if (next > now) {
+			timeout.tv_sec = 0;
+			timeout.tv_nsec = (next - now) * 1000;
+		} else {
+			timeout.tv_nsec = 0;
+		}
+
+		if (ppoll (pfds, 3, &timeout, NULL) < 0 && errno != EINTR)
+			break;
+
+		now = proxy_get_time ();
+
+		if (pfds[0].revents & POLLIN)
+			proxy_accept (listen_fd, &upstream_discovery,
+					d2c_port);
+		if (pfds[1].revents & POLLIN)
+			proxy_receive (&proxy_c2d, now);
+		if (pfds[2].revents & POLLIN)
+			proxy_receive (&proxy_d2c, now);
+
+		proxy_release (&proxy_c2d, now);
+		proxy_release (&proxy_d2c, now);
+	}
+
+	proxy_print_stats (&proxy_c2d);
+	proxy_print_stats (&proxy_d2c);
+
+	if (proxy_fate_log)
+		fclose (proxy_fate_log);
+
+	close (proxy_d2c.fd);
+	close (proxy_c2d.fd);
+	close (listen_fd);
+
+	return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Menu heap check: open and close menus thousands of times, then check
+ * that heap came back where it was.
+ *
+ * usage: menu-soak [-v] [-n cycles] [-g max_growth_kb]
+ *
+ * Each cycle builds a menu holding every entry type with a scrolling
+ * viewport, walks it with presses changing each value, renders it and
+ * frees it, as flight menus do when opened and closed. Run it from a
+ * directory holding DejaVuSans.ttf.
+ *
+ * Exit status is 1 when menu arena is still in use after a cycle, or when
+ * heap grew by more than max_growth_kb between end of the first
+ * MENU_SOAK_WARMUP_CYCLES cycles and end of last one. Heap covers SDL
+ * surfaces of glyph cache too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include "check-common.h"
+#include "memtrack.h"
+#include "menu.h"
+#include "platform.h"
+#include "psplog.h"
+
+#define MENU_SOAK_CYCLES 10000
+#define MENU_SOAK_MAX_GROWTH 0 /* KB */
+
+/* heap growth is counted from end of this cycle, first cycles fill
+ * allocator free lists, see check_heap_in_use () */
+#define MENU_SOAK_WARMUP_CYCLES 10
+
+#define MENU_SOAK_WIDTH 480
+#define MENU_SOAK_HEIGHT 272
+#define MENU_SOAK_VIEWPORT_HEIGHT 150
+
+#define MENU_SOAK_N(array) (sizeof (array) / sizeof ((array)[0]))
+
+/* down through every entry, changing values on the way, then back up to
+ * button which closes menu */
+static const unsigned int menu_soak_presses[] = {
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_RIGHT,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_RIGHT, PLATFORM_BUTTON_LEFT,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_RIGHT, PLATFORM_BUTTON_RIGHT,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_LEFT,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_CROSS
+};
+
+static int menu_soak_verbose = 0;
+
+int running = 1;
+
+static int
+menu_soak_add (Menu * menu, MenuEntry * entry)
+{
+	if (entry == NULL)
+		return -1;
+
+	return menu_add_entry (menu, entry);
+}
+
+static Menu *
+menu_soak_menu_new (TTF_Font * font)
+{
+	MenuSwitchEntry *switch_entry;
+	MenuScaleEntry *scale;
+	MenuComboBoxEntry *combo;
+	Menu *menu;
+	char label[32];
+	int i;
+
+	menu = menu_new (font, MENU_CANCEL_ON_START | MENU_BACK_ON_CIRCLE);
+	if (menu == NULL)
+		return NULL;
+
+	menu_set_viewport_height (menu, MENU_SOAK_VIEWPORT_HEIGHT);
+
+	switch_entry = menu_switch_entry_new (menu, 1, "switch");
+	if (switch_entry)
+		menu_switch_entry_set_values_labels (switch_entry, "no", "yes");
+
+	scale = menu_scale_entry_new (menu, 2, "scale", 0, 100);
+	if (scale)
+		menu_scale_entry_set_value (scale, 50);
+
+	combo = menu_combo_box_entry_new (menu, 3, "combo");
+	if (combo) {
+		menu_combo_box_entry_append (combo, 0, "first");
+		menu_combo_box_entry_append (combo, 1, "second");
+		menu_combo_box_entry_append (combo, 2, "third");
+	}
+
+	if (menu_soak_add (menu, (MenuEntry *)
+				menu_button_entry_new (menu, 0, "close")) < 0 ||
+			menu_soak_add (menu, (MenuEntry *) switch_entry) < 0 ||
+			menu_soak_add (menu, (MenuEntry *) scale) < 0 ||
+			menu_soak_add (menu, (MenuEntry *) combo) < 0)
+		goto error;
+
+	/* enough labels to scroll */
+	for (i = 0; i < 8; i++) {
+		snprintf (label, sizeof (label), "label %d", i);
+		if (menu_soak_add (menu, (MenuEntry *)
+					menu_label_entry_new (menu, 4 + i,
+						label)) < 0)
+			goto error;
+	}
+
+	return menu;
+
+error:
+	menu_free (menu);
+	return NULL;
+}
+
+static int
+menu_soak_cycle (TTF_Font * font, SDL_Surface * screen)
+{
+	SDL_Rect position = { 20, 20, 0, 0 };
+	MenuState state = MENU_STATE_VISIBLE;
+	Menu *menu;
+	size_t i;
+
+	menu = menu_soak_menu_new (font);
+	if (menu == NULL) {
+		fprintf (stderr, "menu-soak: failed to create menu\n");
+		return -1;
+	}
+
+	menu_render_to (menu, screen, &position);
+
+	for (i = 0; i < MENU_SOAK_N (menu_soak_presses) &&
+			state == MENU_STATE_VISIBLE; i++) {
+		state = menu_handle_press (menu, menu_soak_presses[i], i);
+		menu_render_to (menu, screen, &position);
+	}
+
+	if (state != MENU_STATE_CLOSE ||
+			menu_get_selected_id (menu) != 0) {
+		fprintf (stderr, "menu-soak: menu closed before end of "
+				"presses\n");
+		menu_free (menu);
+		return -1;
+	}
+
+	menu_free (menu);
+	return 0;
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-v] [-n cycles] [-g max_growth_kb]\n",
+			name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	unsigned int cycles = MENU_SOAK_CYCLES;
+	long long max_growth = MENU_SOAK_MAX_GROWTH * 1024LL;
+	size_t heap_baseline, heap_last;
+	MemtrackStats stats;
+	SDL_Surface *screen;
+	TTF_Font *font;
+	unsigned int i;
+	int failed = 0;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "vn:g:")) != -1) {
+		switch (opt) {
+			case 'v':
+				menu_soak_verbose = 1;
+				break;
+			case 'n':
+				cycles = atoi (optarg);
+				break;
+			case 'g':
+				max_growth = atoi (optarg) * 1024LL;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc || cycles == 0) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (check_init () < 0)
+		return 1;
+
+	if (SDL_Init (SDL_INIT_VIDEO) < 0 || TTF_Init () < 0) {
+		fprintf (stderr, "menu-soak: failed to initialize SDL\n");
+		return 1;
+	}
+
+	screen = SDL_SetVideoMode (MENU_SOAK_WIDTH, MENU_SOAK_HEIGHT, 32,
+			SDL_SWSURFACE);
+	font = TTF_OpenFont ("DejaVuSans.ttf", 16);
+	if (screen == NULL || font == NULL) {
+		fprintf (stderr, "menu-soak: failed to open screen or font\n");
+		return 1;
+	}
+
+	heap_baseline = heap_last = check_heap_in_use ();
+
+	for (i = 0; i < cycles; i++) {
+		if (menu_soak_cycle (font, screen) < 0) {
+			failed = 1;
+			break;
+		}
+
+		/* each menu gives back all of its arena when freed */
+		memtrack_get (MEMTRACK_TAG_ARENA, &stats);
+		if (stats.bytes > 0) {
+			fprintf (stderr, "FAIL: %u arena bytes left after "
+					"cycle %u\n", (unsigned int) stats.bytes,
+					i + 1);
+			failed = 1;
+			break;
+		}
+
+		heap_last = check_heap_in_use ();
+		if (i + 1 == MENU_SOAK_WARMUP_CYCLES)
+			heap_baseline = heap_last;
+
+		if (menu_soak_verbose)
+			printf ("cycle %u: heap %u bytes\n", i + 1,
+					(unsigned int) heap_last);
+	}
+
+	TTF_CloseFont (font);
+	TTF_Quit ();
+	SDL_Quit ();
+	psplog_deinit ();
+
+	if (i <= MENU_SOAK_WARMUP_CYCLES)
+		heap_baseline = heap_last;
+
+	memtrack_get (MEMTRACK_TAG_ARENA, &stats);
+	printf ("%u cycles, arena peak %u bytes, %u allocations, "
+			"heap growth %lld bytes\n", i,
+			(unsigned int) stats.peak, stats.allocs,
+			(long long) heap_last - (long long) heap_baseline);
+
+	if ((long long) heap_last - (long long) heap_baseline > max_growth) {
+		fprintf (stderr, "FAIL: heap grew by %lld bytes\n",
+				(long long) heap_last - (long long) heap_baseline);
+		failed = 1;
+	}
+
+	return failed;
+}
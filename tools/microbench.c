@@ -0,0 +1,915 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Micro benchmarks of hot paths, on desktop build.
+ *
+ * usage: microbench [-t tools_dir] [-c capture_file] [-b baseline.json]
+ *                   [-r max_regression_percent] [-o output.json]
+ *
+ * Measures encoding and queuing of each drone_* command, decoding of
+ * navdata, text and menu entries rendering, menu frames, psplog_print ()
+ * and connection to tools/drone-sim, started from tools_dir. Navdata come
+ * from a capture of tools/capture-replay format when given, or are
+ * generated. Run it from a directory holding DejaVuSans.ttf, with
+ * SDL_VIDEODRIVER=dummy to stay headless.
+ *
+ * Results are times, lower is better, written as a flat JSON object. With
+ * a baseline written by a previous run, every result is compared to it and
+ * exit status is 1 when one is slower by more than max_regression_percent
+ * or missing from this run. It is 1 as well when drone-sim can't be
+ * reached, since drone_* results are then missing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <libARCommands/ARCommands.h>
+
+#include "capture.h"
+#include "color.h"
+#include "drone.h"
+#include "input.h"
+#include "menu.h"
+#include "metrics.h"
+#include "platform.h"
+#include "ui.h"
+#include "psplog.h"
+
+#define BENCH_MAX_RESULTS 64
+#define BENCH_NAME_MAX_LEN 48
+#define BENCH_PATH_MAX_LEN 256
+
+/* best of several batches, to leave out scheduling noise */
+#define BENCH_BATCHES 5
+
+#define BENCH_DISCOVERY_PORT 44444
+#define BENCH_C2D_PORT 54321
+#define BENCH_D2C_PORT 43210
+#define BENCH_CONNECTIONS 5
+#define BENCH_SIM_START_DELAY 300000 /* us */
+#define BENCH_SYNC_TIMEOUT 2000000 /* us */
+
+/* commands are queued faster than drone acknowledges them, buffers are
+ * made large enough to never reject one while measuring */
+#define BENCH_COMMANDS 64
+#define BENCH_COMMAND_CELLS \
+	(BENCH_COMMANDS * BENCH_BATCHES * BENCH_N_DRONE_COMMANDS)
+
+/* navdata generated when no capture is given */
+#define BENCH_NAVDATA_BUFFERS 64
+#define BENCH_NAVDATA_MAX_SIZE 128
+
+/* psplog ring has 64 records, writer gets time to empty it between
+ * batches so that records are not dropped */
+#define BENCH_LOG_RECORDS 32
+#define BENCH_LOG_PAUSE 50000 /* us */
+
+#define BENCH_MENU_ENTRIES 12
+
+typedef struct _BenchResult BenchResult;
+typedef struct _BenchCommand BenchCommand;
+typedef struct _BenchCommandData BenchCommandData;
+typedef struct _BenchNavdata BenchNavdata;
+typedef struct _BenchMenuData BenchMenuData;
+
+typedef void (*BenchFunc) (void * data, int i);
+
+struct _BenchResult
+{
+	char name[BENCH_NAME_MAX_LEN];
+	double value;
+};
+
+struct _BenchCommand
+{
+	const char *name;
+	int (*send) (Drone * drone, int i);
+};
+
+struct _BenchCommandData
+{
+	Drone *drone;
+	const BenchCommand *command;
+};
+
+/* navdata buffers decoded in turn */
+struct _BenchNavdata
+{
+	uint8_t (*buffers)[BENCH_NAVDATA_MAX_SIZE];
+	int *sizes;
+	int n;
+};
+
+struct _BenchMenuData
+{
+	UI *ui;
+	Menu *menu;
+	MenuEntryType type;
+};
+
+static const char *bench_tools_dir = "tools";
+static const char *bench_capture = NULL;
+static const char *bench_baseline = NULL;
+static const char *bench_output = NULL;
+static double bench_max_regression = 10.0;
+
+static BenchResult bench_results[BENCH_MAX_RESULTS];
+static int bench_n_results = 0;
+
+/* used by ui.c */
+int running = 1;
+
+static long long
+bench_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+bench_add_result (const char * name, double value)
+{
+	BenchResult *result;
+
+	if (bench_n_results == BENCH_MAX_RESULTS)
+		return;
+
+	result = &bench_results[bench_n_results++];
+	snprintf (result->name, sizeof (result->name), "%s", name);
+	result->value = value;
+
+	fprintf (stderr, "%-36s %12.1f\n", name, value);
+}
+
+/* run @n calls per batch, record fastest batch mean in ns per call */
+static void
+bench_run (const char * name, BenchFunc func, void * data, int n,
+		unsigned int pause)
+{
+	double best = 0;
+	int batch, i;
+
+	for (batch = 0; batch < BENCH_BATCHES; batch++) {
+		long long start = bench_now ();
+		double mean;
+
+		for (i = 0; i < n; i++)
+			func (data, i);
+
+		mean = (double) (bench_now () - start) / n;
+		if (batch == 0 || mean < best)
+			best = mean;
+
+		if (pause)
+			platform_delay (pause);
+	}
+
+	bench_add_result (name, best);
+}
+
+/*
+ * drone_* commands
+ */
+static int
+bench_emergency (Drone * drone, int i)
+{
+	return drone_emergency (drone);
+}
+
+static int
+bench_takeoff (Drone * drone, int i)
+{
+	return drone_takeoff (drone);
+}
+
+static int
+bench_landing (Drone * drone, int i)
+{
+	return drone_landing (drone);
+}
+
+static int
+bench_flat_trim (Drone * drone, int i)
+{
+	return drone_flat_trim (drone);
+}
+
+static int
+bench_sync_state (Drone * drone, int i)
+{
+	return drone_sync_state (drone);
+}
+
+static int
+bench_flight_control (Drone * drone, int i)
+{
+	return drone_flight_control (drone, i % 100, 0, -(i % 100), 10, 0);
+}
+
+static int
+bench_do_flip (Drone * drone, int i)
+{
+	return drone_do_flip (drone, i % 4);
+}
+
+static int
+bench_sync_settings (Drone * drone, int i)
+{
+	return drone_sync_settings (drone);
+}
+
+static int
+bench_hull (Drone * drone, int i)
+{
+	return drone_hull_set_active (drone, i & 1);
+}
+
+static int
+bench_outdoor (Drone * drone, int i)
+{
+	return drone_outdoor_flight_set_active (drone, i & 1);
+}
+
+static int
+bench_altitude_limit (Drone * drone, int i)
+{
+	return drone_altitude_limit_set (drone, 10 + i % 100);
+}
+
+static int
+bench_vertical_speed_limit (Drone * drone, int i)
+{
+	return drone_vertical_speed_limit_set (drone, 1 + i % 5);
+}
+
+static int
+bench_rotation_speed_limit (Drone * drone, int i)
+{
+	return drone_rotation_speed_limit_set (drone, 10 + i % 100);
+}
+
+static int
+bench_max_tilt (Drone * drone, int i)
+{
+	return drone_max_tilt_set (drone, 5 + i % 25);
+}
+
+static int
+bench_streaming (Drone * drone, int i)
+{
+	return drone_streaming_set_active (drone, 0);
+}
+
+static int
+bench_take_picture (Drone * drone, int i)
+{
+	return drone_take_picture (drone);
+}
+
+static const BenchCommand bench_commands[] = {
+	{ "emergency", bench_emergency },
+	{ "takeoff", bench_takeoff },
+	{ "landing", bench_landing },
+	{ "flat_trim", bench_flat_trim },
+	{ "sync_state", bench_sync_state },
+	{ "flight_control", bench_flight_control },
+	{ "do_flip", bench_do_flip },
+	{ "sync_settings", bench_sync_settings },
+	{ "hull_set_active", bench_hull },
+	{ "outdoor_flight_set_active", bench_outdoor },
+	{ "altitude_limit_set", bench_altitude_limit },
+	{ "vertical_speed_limit_set", bench_vertical_speed_limit },
+	{ "rotation_speed_limit_set", bench_rotation_speed_limit },
+	{ "max_tilt_set", bench_max_tilt },
+	{ "streaming_set_active", bench_streaming },
+	{ "take_picture", bench_take_picture }
+};
+
+#define BENCH_N_DRONE_COMMANDS \
+	((int) (sizeof (bench_commands) / sizeof (bench_commands[0])))
+
+static void
+bench_command_run (void * data, int i)
+{
+	BenchCommandData *d = data;
+
+	d->command->send (d->drone, i);
+}
+
+static void
+bench_drone_commands (Drone * drone)
+{
+	BenchCommandData data;
+	char name[BENCH_NAME_MAX_LEN];
+	int i;
+
+	data.drone = drone;
+
+	for (i = 0; i < BENCH_N_DRONE_COMMANDS; i++) {
+		data.command = &bench_commands[i];
+		snprintf (name, sizeof (name), "cmd_%s_ns",
+				bench_commands[i].name);
+		bench_run (name, bench_command_run, &data, BENCH_COMMANDS, 0);
+	}
+}
+
+/*
+ * connection to simulated drone
+ */
+static pid_t
+bench_spawn_sim (void)
+{
+	char path[BENCH_PATH_MAX_LEN];
+	pid_t pid;
+
+	snprintf (path, sizeof (path), "%s/drone-sim", bench_tools_dir);
+
+	pid = fork ();
+	if (pid != 0)
+		return pid;
+
+	execl (path, path, (char *) NULL);
+	fprintf (stderr, "microbench: failed to run %s: %s\n", path,
+			strerror (errno));
+	_exit (127);
+}
+
+static int
+bench_compare_ll (const void * a, const void * b)
+{
+	long long x = *(const long long *) a;
+	long long y = *(const long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* connect, wait for all states and disconnect a few times, leave last
+ * connection up. Return -1 if drone can't be reached */
+static int
+bench_connect (Drone * drone)
+{
+	long long connect[BENCH_CONNECTIONS];
+	long long sync[BENCH_CONNECTIONS];
+	int i;
+
+	for (i = 0; i < BENCH_CONNECTIONS; i++) {
+		long long start;
+		long long timeout;
+
+		if (i > 0)
+			drone_disconnect (drone);
+
+		start = bench_now ();
+		if (drone_connect (drone, "127.0.0.1", BENCH_DISCOVERY_PORT,
+					BENCH_C2D_PORT, BENCH_D2C_PORT) < 0)
+			return -1;
+		connect[i] = bench_now () - start;
+
+		drone->state_sync = 0;
+		drone_sync_state (drone);
+		timeout = start + BENCH_SYNC_TIMEOUT * 1000LL;
+		while (!drone->state_sync && bench_now () < timeout)
+			platform_delay (100);
+		sync[i] = bench_now () - start;
+	}
+
+	qsort (connect, BENCH_CONNECTIONS, sizeof (long long),
+			bench_compare_ll);
+	qsort (sync, BENCH_CONNECTIONS, sizeof (long long), bench_compare_ll);
+	bench_add_result ("connect_us", connect[BENCH_CONNECTIONS / 2] / 1e3);
+	bench_add_result ("connect_sync_us", sync[BENCH_CONNECTIONS / 2] / 1e3);
+
+	return 0;
+}
+
+/*
+ * navdata decoding
+ */
+static int
+bench_navdata_load (BenchNavdata * navdata, const char * path)
+{
+	FILE *file;
+	CaptureRecordHeader header;
+	char magic[CAPTURE_MAGIC_LEN];
+	int size = 0;
+
+	file = fopen (path, "rb");
+	if (file == NULL) {
+		perror (path);
+		return -1;
+	}
+
+	if (fread (magic, 1, sizeof (magic), file) != sizeof (magic) ||
+			memcmp (magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0) {
+		fprintf (stderr, "%s is not a capture file\n", path);
+		fclose (file);
+		return -1;
+	}
+
+	/* header is little endian as host */
+	while (fread (&header, sizeof (header), 1, file) == 1) {
+		uint8_t payload[CAPTURE_PAYLOAD_MAX];
+
+		if (header.size > CAPTURE_PAYLOAD_MAX ||
+				fread (payload, 1, header.size, file) !=
+				header.size)
+			break;
+
+		if (header.buffer_id != DRONE_NAVDATA_ID)
+			continue;
+
+		if (navdata->n == size) {
+			size = size ? size * 2 : 256;
+			navdata->buffers = realloc (navdata->buffers,
+					size * BENCH_NAVDATA_MAX_SIZE);
+			navdata->sizes = realloc (navdata->sizes,
+					size * sizeof (int));
+			if (!navdata->buffers || !navdata->sizes)
+				break;
+		}
+
+		memcpy (navdata->buffers[navdata->n], payload, header.size);
+		navdata->sizes[navdata->n++] = header.size;
+	}
+
+	fclose (file);
+
+	return navdata->n > 0 ? 0 : -1;
+}
+
+/* same mix as a Bebop streams while flying */
+static int
+bench_navdata_generate (BenchNavdata * navdata)
+{
+	int i;
+
+	navdata->buffers = malloc (BENCH_NAVDATA_BUFFERS *
+			BENCH_NAVDATA_MAX_SIZE);
+	navdata->sizes = malloc (BENCH_NAVDATA_BUFFERS * sizeof (int));
+	if (!navdata->buffers || !navdata->sizes)
+		return -1;
+
+	for (i = 0; i < BENCH_NAVDATA_BUFFERS; i++) {
+		uint8_t *buf = navdata->buffers[i];
+		int32_t size = 0;
+
+		switch (i % 4) {
+			case 0:
+			case 2:
+				ARCOMMANDS_Generator_GenerateARDrone3PilotingStateAltitudeChanged (
+						buf, BENCH_NAVDATA_MAX_SIZE,
+						&size, i * 0.1);
+				break;
+			case 1:
+				ARCOMMANDS_Generator_GenerateARDrone3PilotingStatePositionChanged (
+						buf, BENCH_NAVDATA_MAX_SIZE,
+						&size, 48.8789 + i * 1e-6,
+						2.3677, 35.0);
+				break;
+			case 3:
+				if (i % 32 == 3)
+					ARCOMMANDS_Generator_GenerateCommonCommonStateBatteryStateChanged (
+							buf,
+							BENCH_NAVDATA_MAX_SIZE,
+							&size, 100 - i / 32);
+				else
+					ARCOMMANDS_Generator_GenerateARDrone3PilotingStateFlyingStateChanged (
+							buf,
+							BENCH_NAVDATA_MAX_SIZE,
+							&size,
+							ARCOMMANDS_ARDRONE3_PILOTINGSTATE_FLYINGSTATECHANGED_STATE_HOVERING);
+				break;
+		}
+
+		navdata->sizes[i] = size;
+	}
+
+	navdata->n = BENCH_NAVDATA_BUFFERS;
+
+	return 0;
+}
+
+static void
+bench_decode_run (void * data, int i)
+{
+	BenchNavdata *navdata = data;
+	int index = i % navdata->n;
+
+	ARCOMMANDS_Decoder_DecodeBuffer (navdata->buffers[index],
+			navdata->sizes[index]);
+}
+
+static void
+bench_decode (void)
+{
+	BenchNavdata navdata;
+	int ret;
+
+	memset (&navdata, 0, sizeof (navdata));
+
+	if (bench_capture)
+		ret = bench_navdata_load (&navdata, bench_capture);
+	else
+		ret = bench_navdata_generate (&navdata);
+
+	if (ret < 0)
+		fprintf (stderr, "microbench: no navdata to decode\n");
+	else
+		bench_run ("decode_navdata_ns", bench_decode_run, &navdata,
+				10000, 0);
+
+	free (navdata.buffers);
+	free (navdata.sizes);
+}
+
+/*
+ * text and menus
+ */
+static void
+bench_render_text_run (void * data, int i)
+{
+	SDL_Surface *text;
+
+	text = ui_render_text ((UI *) data, &color_black, "altitude: %lf",
+			i * 0.01);
+	SDL_FreeSurface (text);
+}
+
+static void
+bench_menu_entry_run (void * data, int i)
+{
+	BenchMenuData *d = data;
+	MenuEntry *entry = NULL;
+	MenuComboBoxEntry *combo;
+
+	switch (d->type) {
+		case MENU_ENTRY_TYPE_LABEL:
+			entry = (MenuEntry *) menu_label_entry_new (d->menu, i,
+					"Drone information");
+			break;
+		case MENU_ENTRY_TYPE_BUTTON:
+			entry = (MenuEntry *) menu_button_entry_new (d->menu,
+					i, "Piloting settings");
+			break;
+		case MENU_ENTRY_TYPE_SWITCH:
+			entry = (MenuEntry *) menu_switch_entry_new (d->menu,
+					i, "Hull protection");
+			break;
+		case MENU_ENTRY_TYPE_SCALE:
+			entry = (MenuEntry *) menu_scale_entry_new (d->menu, i,
+					"Altitude limit", 0, 150);
+			break;
+		case MENU_ENTRY_TYPE_COMBOBOX:
+			combo = menu_combo_box_entry_new (d->menu, i,
+					"Analog stick");
+			if (combo) {
+				menu_combo_box_entry_append (combo, 0, "Off");
+				menu_combo_box_entry_append (combo, 1,
+						"Roll/Pitch");
+				menu_combo_box_entry_append (combo, 2,
+						"Yaw/Gaz");
+			}
+			entry = (MenuEntry *) combo;
+			break;
+		default:
+			break;
+	}
+
+	if (entry == NULL)
+		return;
+
+	/* rendering happens when entry is added */
+	menu_add_entry (d->menu, entry);
+	menu_remove_entry (d->menu, entry);
+}
+
+static Menu *
+bench_menu_new (UI * ui)
+{
+	Menu *menu;
+	int i;
+
+	menu = menu_new (ui->font, MENU_BACK_ON_CIRCLE);
+	if (menu == NULL)
+		return NULL;
+
+	for (i = 0; i < BENCH_MENU_ENTRIES; i++) {
+		char title[32];
+
+		snprintf (title, sizeof (title), "Entry %d", i);
+		if (i % 3 == 1)
+			menu_add_entry (menu, (MenuEntry *)
+					menu_scale_entry_new (menu, i, title,
+						0, 100));
+		else if (i % 3 == 2)
+			menu_add_entry (menu, (MenuEntry *)
+					menu_switch_entry_new (menu, i,
+						title));
+		else
+			menu_add_entry (menu, (MenuEntry *)
+					menu_button_entry_new (menu, i,
+						title));
+	}
+
+	menu_set_viewport_height (menu, 200);
+
+	return menu;
+}
+
+static void
+bench_menu_frame_run (void * data, int i)
+{
+	BenchMenuData *d = data;
+	SDL_Rect position = { 40, 40, 0, 0 };
+
+	menu_update (d->menu);
+	menu_render_to (d->menu, d->ui->screen, &position);
+}
+
+/* selection moves every frame, menu scrolls */
+static void
+bench_menu_navigate_run (void * data, int i)
+{
+	BenchMenuData *d = data;
+	SDL_Rect position = { 40, 40, 0, 0 };
+
+	menu_handle_press (d->menu, (i / BENCH_MENU_ENTRIES) & 1 ?
+			PLATFORM_BUTTON_UP : PLATFORM_BUTTON_DOWN, i * 16666);
+	menu_render_to (d->menu, d->ui->screen, &position);
+}
+
+static void
+bench_ui (UI * ui)
+{
+	static const struct {
+		MenuEntryType type;
+		const char *name;
+	} entries[] = {
+		{ MENU_ENTRY_TYPE_LABEL, "menu_label_entry_ns" },
+		{ MENU_ENTRY_TYPE_BUTTON, "menu_button_entry_ns" },
+		{ MENU_ENTRY_TYPE_SWITCH, "menu_switch_entry_ns" },
+		{ MENU_ENTRY_TYPE_SCALE, "menu_scale_entry_ns" },
+		{ MENU_ENTRY_TYPE_COMBOBOX, "menu_combo_box_entry_ns" }
+	};
+	BenchMenuData data;
+	unsigned int i;
+
+	bench_run ("ui_render_text_ns", bench_render_text_run, ui, 200, 0);
+
+	data.ui = ui;
+
+	for (i = 0; i < sizeof (entries) / sizeof (entries[0]); i++) {
+		/* entries memory is only released with menu */
+		data.menu = menu_new (ui->font, 0);
+		if (data.menu == NULL)
+			return;
+
+		data.type = entries[i].type;
+		bench_run (entries[i].name, bench_menu_entry_run, &data, 100,
+				0);
+		menu_free (data.menu);
+	}
+
+	data.menu = bench_menu_new (ui);
+	if (data.menu == NULL)
+		return;
+
+	bench_run ("menu_frame_ns", bench_menu_frame_run, &data, 500, 0);
+	bench_run ("menu_navigate_ns", bench_menu_navigate_run, &data, 500, 0);
+	menu_free (data.menu);
+}
+
+/*
+ * log
+ */
+static void
+bench_log_run (void * data, int i)
+{
+	PSPLOG_INFO ("benchmark record %d altitude %d state %s", i, i * 3,
+			"flying");
+}
+
+/*
+ * results
+ */
+static int
+bench_write_results (void)
+{
+	FILE *file = stdout;
+	int i;
+
+	if (bench_output) {
+		file = fopen (bench_output, "w");
+		if (file == NULL) {
+			perror (bench_output);
+			return -1;
+		}
+	}
+
+	/* one result per line, baseline is read back line by line */
+	fprintf (file, "{\n");
+	for (i = 0; i < bench_n_results; i++)
+		fprintf (file, "  \"%s\": %.1f%s\n", bench_results[i].name,
+				bench_results[i].value,
+				i < bench_n_results - 1 ? "," : "");
+	fprintf (file, "}\n");
+
+	if (file != stdout)
+		fclose (file);
+
+	return 0;
+}
+
+/* return number of regressions, results missing from this run count as
+ * regressions too */
+static int
+bench_compare_baseline (void)
+{
+	char line[256];
+	FILE *file;
+	int regressions = 0;
+
+	file = fopen (bench_baseline, "r");
+	if (file == NULL) {
+		perror (bench_baseline);
+		return 1;
+	}
+
+	fprintf (stderr, "\n%-36s %12s %12s %8s\n", "vs baseline", "before",
+			"now", "change");
+
+	while (fgets (line, sizeof (line), file)) {
+		char name[BENCH_NAME_MAX_LEN];
+		double before;
+		int i;
+
+		if (sscanf (line, " \"%47[^\"]\": %lf", name, &before) != 2)
+			continue;
+
+		for (i = 0; i < bench_n_results; i++) {
+			const BenchResult *result = &bench_results[i];
+			double change;
+
+			if (strcmp (result->name, name) != 0)
+				continue;
+
+			change = before > 0 ?
+				(result->value - before) * 100 / before : 0;
+			fprintf (stderr, "%-36s %12.1f %12.1f %+7.1f%%%s\n",
+					name, before, result->value, change,
+					change > bench_max_regression ?
+					" REGRESSION" : "");
+			if (change > bench_max_regression)
+				regressions++;
+			break;
+		}
+
+		if (i == bench_n_results) {
+			fprintf (stderr, "%-36s %12.1f %12s %8s MISSING\n", name,
+					before, "-", "-");
+			regressions++;
+		}
+	}
+
+	fclose (file);
+
+	return regressions;
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-t tools_dir] [-c capture_file] "
+			"[-b baseline.json] [-r max_regression_percent] "
+			"[-o output.json]\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	Drone drone;
+	UI ui;
+	pid_t sim;
+	int connected = 0;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "t:c:b:r:o:")) != -1) {
+		switch (opt) {
+			case 't':
+				bench_tools_dir = optarg;
+				break;
+			case 'c':
+				bench_capture = optarg;
+				break;
+			case 'b':
+				bench_baseline = optarg;
+				break;
+			case 'r':
+				bench_max_regression = atof (optarg);
+				break;
+			case 'o':
+				bench_output = optarg;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	platform_init (NULL);
+
+	if (psplog_init (PSPLOG_CAT_INFO, "microbench.log", PSPLOG_BINARY) < 0)
+		return 1;
+
+	if (SDL_Init (SDL_INIT_VIDEO) < 0 || TTF_Init () < 0) {
+		fprintf (stderr, "microbench: failed to initialize SDL\n");
+		return 1;
+	}
+
+	if (ui_init (&ui, 480, 272) < 0) {
+		fprintf (stderr, "microbench: failed to initialize ui\n");
+		return 1;
+	}
+
+	/* drone callbacks are registered by drone_init () and also used to
+	 * decode navdata */
+	drone_init (&drone);
+	drone_buffer_set_params (DRONE_COMMAND_ACK_ID, -1, -1, -1,
+			BENCH_COMMAND_CELLS);
+	drone_buffer_set_params (DRONE_COMMAND_EMERGENCY_ID, -1, -1, -1,
+			BENCH_COMMAND_CELLS);
+
+	bench_run ("psplog_print_ns", bench_log_run, NULL, BENCH_LOG_RECORDS,
+			BENCH_LOG_PAUSE);
+	bench_decode ();
+	bench_ui (&ui);
+
+	sim = bench_spawn_sim ();
+	platform_delay (BENCH_SIM_START_DELAY);
+
+	if (sim > 0 && bench_connect (&drone) == 0) {
+		connected = 1;
+		bench_drone_commands (&drone);
+		drone_disconnect (&drone);
+	} else {
+		fprintf (stderr, "microbench: failed to connect to %s/drone-sim\n",
+				bench_tools_dir);
+	}
+
+	if (sim > 0) {
+		kill (sim, SIGINT);
+		waitpid (sim, NULL, 0);
+	}
+
+	drone_deinit (&drone);
+	ui_deinit (&ui);
+	TTF_Quit ();
+	SDL_Quit ();
+	psplog_deinit ();
+
+	if (bench_write_results () < 0)
+		return 1;
+
+	if (bench_baseline && bench_compare_baseline () > 0)
+		return 1;
+
+	/* drone command results are missing, don't let it pass unnoticed even
+	 * without baseline */
+	if (!connected)
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+#
+# Expand a binary psplog file into text.
+#
+# usage: psplog-decode.py psplog_fmt.txt log.bin
+#
+# Format table is generated at build time by psplog-fmtgen.py, it must match
+# the sources the log was produced with.
+
+import bisect
+import re
+import struct
+import sys
+
+MAGIC = b'PSPLOGB1'
+HEADER = struct.Struct('<HBBII')
+FLAG_TRUNCATED = 1
+SITE_DROPPED = 0
+SITE_SUPPRESSED = 1
+
+CATEGORIES = ('ERROR', 'WARNING', 'INFO', 'DEBUG', 'TRACE')
+
+# indexed by PSPLOG_MODULE_* values of psplog.h
+MODULES = ('default', 'main', 'drone', 'ui', 'menu', 'input', 'latency',
+        'psplog', 'metrics', 'trace', 'platform', 'capture',
+        'flightrec', 'memtrack')
+
+SPEC_RE = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?'
+        r'([hlLqjzt]*)([diuoxXcpneEfFgGaAs%])')
+
+
+class Table:
+    def __init__(self, path):
+        # per module sorted lines, to find the call site when compiler
+        # reports line of the end of a multi-line call
+        self.sites = {}
+
+        with open(path, encoding='utf-8') as f:
+            for entry in f:
+                module, line, category, fmt = entry.rstrip('\n').split('\t', 3)
+                fmt = fmt.encode('latin-1').decode('unicode_escape')
+                self.sites.setdefault(int(module), []).append(
+                        (int(line), fmt))
+
+        for lines in self.sites.values():
+            lines.sort()
+
+    def lookup(self, site):
+        lines = self.sites.get(site >> 16)
+        if not lines:
+            return None
+
+        i = bisect.bisect_right(lines, (site & 0xffff, '￿')) - 1
+        if i < 0:
+            return None
+
+        return lines[i][1]
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.data):
+            raise EOFError
+        value, = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += size
+        return value
+
+    def string(self):
+        size = self.take('<B')
+        if self.pos + size > len(self.data):
+            raise EOFError
+        value = self.data[self.pos:self.pos + size]
+        self.pos += size
+        return value.decode('latin-1')
+
+
+def expand(fmt, args):
+    # mirror of psplog_encode () format walk
+    out = []
+    last = 0
+
+    for spec in SPEC_RE.finditer(fmt):
+        flags, width, precision, length, conv = spec.groups()
+        out.append(fmt[last:spec.start()])
+        last = spec.end()
+
+        if conv == '%':
+            out.append('%')
+            continue
+
+        try:
+            if width == '*':
+                width = str(args.take('<i'))
+            if precision == '*':
+                precision = str(args.take('<i'))
+
+            pyspec = '%' + flags + (width or '')
+            if precision is not None:
+                pyspec += '.' + precision
+
+            lng = sum(1 for c in length if c in 'lLqj')
+
+            if conv in 'diuoxXc':
+                if lng >= 2:
+                    value = args.take('<q')
+                    mask = 0xffffffffffffffff
+                else:
+                    value = args.take('<i')
+                    mask = 0xffffffff
+                if conv in 'uoxX':
+                    value &= mask
+                if conv == 'c':
+                    value = chr(value & 0xff)
+                out.append((pyspec + conv.replace('u', 'd')
+                        .replace('i', 'd')) % value)
+            elif conv in 'pn':
+                value = args.take('<I')
+                if conv == 'p':
+                    out.append('0x%x' % value)
+            elif conv in 'eEfFgGaA':
+                value = args.take('<d')
+                out.append((pyspec + conv.replace('a', 'e')
+                        .replace('A', 'E')) % value)
+            elif conv == 's':
+                out.append((pyspec + 's') % args.string())
+        except EOFError:
+            out.append('<truncated>')
+            return ''.join(out)
+
+    out.append(fmt[last:])
+    return ''.join(out)
+
+
+def decode(table, data, output):
+    if not data.startswith(MAGIC):
+        raise ValueError('not a binary psplog file')
+
+    pos = len(MAGIC)
+    while pos + HEADER.size <= len(data):
+        size, category, flags, site, timestamp = \
+                HEADER.unpack_from(data, pos)
+        if size < HEADER.size:
+            raise ValueError('corrupted record at offset %d' % pos)
+
+        args = Reader(data[pos + HEADER.size:pos + size])
+        pos += size
+
+        if category < len(CATEGORIES):
+            name = CATEGORIES[category]
+        else:
+            name = '?????'
+
+        if site == SITE_DROPPED:
+            message = '%u records dropped' % args.take('<I')
+        elif site == SITE_SUPPRESSED:
+            limited = args.take('<I')
+            module = limited >> 16
+            if module < len(MODULES):
+                module = MODULES[module]
+            message = '%s:%d: %u similar records suppressed' % (module,
+                    limited & 0xffff, args.take('<I'))
+        else:
+            fmt = table.lookup(site)
+            if fmt is None:
+                message = '<unknown site %d:%d>' % (site >> 16,
+                        site & 0xffff)
+            else:
+                message = expand(fmt, args)
+
+        if flags & FLAG_TRUNCATED:
+            message += ' <truncated>'
+
+        output.write('[%10.6f] %s %s\n' % (timestamp / 1000000.0, name,
+                message))
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: %s psplog_fmt.txt log.bin\n' % argv[0])
+        return 1
+
+    table = Table(argv[1])
+
+    with open(argv[2], 'rb') as f:
+        data = f.read()
+
+    decode(table, data, sys.stdout)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
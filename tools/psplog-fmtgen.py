@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+#
+# Generate psplog format table from sources.
+#
+# usage: psplog-fmtgen.py psplog.h file.c... > psplog_fmt.txt
+#
+# Each PSPLOG_* call site gets a line:
+#   module <tab> line <tab> category <tab> format
+# where format is the C string literal content, escapes left as is.
+
+import re
+import sys
+
+MODULE_VALUE_RE = re.compile(r'^#define\s+(PSPLOG_MODULE_\w+)\s+(\d+)', re.M)
+MODULE_RE = re.compile(r'^#define\s+PSPLOG_MODULE\s+(PSPLOG_MODULE_\w+)', re.M)
+CALL_RE = re.compile(
+        r'\bPSPLOG_(ERROR|WARNING|INFO|DEBUG|TRACE)(?:_LIMITED)?\s*\(')
+LITERAL_RE = re.compile(r'\s*(?:/\*.*?\*/\s*)*"((?:[^"\\]|\\.)*)"', re.S)
+
+
+def read_modules(header):
+    with open(header) as f:
+        return dict((name, int(value))
+                for name, value in MODULE_VALUE_RE.findall(f.read()))
+
+
+def scan(path, modules):
+    with open(path) as f:
+        text = f.read()
+
+    m = MODULE_RE.search(text)
+    module = modules[m.group(1)] if m else modules['PSPLOG_MODULE_DEFAULT']
+
+    for call in CALL_RE.finditer(text):
+        line_start = text.rfind('\n', 0, call.start()) + 1
+        if text[line_start:call.start()].lstrip().startswith('#define'):
+            continue
+
+        # format is one or more concatenated string literals
+        fmt = ''
+        pos = call.end()
+        while True:
+            lit = LITERAL_RE.match(text, pos)
+            if lit is None:
+                break
+            fmt += lit.group(1)
+            pos = lit.end()
+
+        line = text.count('\n', 0, call.start()) + 1
+
+        if pos == call.end():
+            sys.stderr.write('%s:%d: format is not a literal, skipped\n' %
+                    (path, line))
+            continue
+
+        yield module, line, call.group(1), fmt
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write('usage: %s psplog.h file.c...\n' % argv[0])
+        return 1
+
+    modules = read_modules(argv[1])
+
+    for path in argv[2:]:
+        if not path.endswith('.c'):
+            continue
+
+        for module, line, category, fmt in scan(path, modules):
+            sys.stdout.write('%d\t%d\t%s\t%s\n' %
+                    (module, line, category, fmt))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
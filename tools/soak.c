@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Soak test: go through menus and connect to and disconnect from a drone
+ * thousands of times, then check that memory came back where it was.
+ *
+ * usage: soak [-v] [-t tools_dir] [-c connections] [-m menus]
+ *             [-g max_growth_kb]
+ *
+ * Each cycle selects "Connect to drone" in main menu, connects to
+ * tools/drone-sim started from tools_dir, opens and closes flight menus
+ * with piloting settings and drone information submenus until -m menu
+ * rounds are spread over -c connections, leaves flight ui from its menu
+ * and disconnects. Ui runs on the virtual clock of platform-linux.c with
+ * scripted presses, so that menus cost no frame wait. Run it from a
+ * directory holding DejaVuSans.ttf.
+ *
+ * Peak and leaked bytes are reported for each memtrack tag, along with the
+ * process heap which also covers SDL surfaces. Exit status is 1 when
+ * tracked memory is still in use at end, or when heap grew by more than
+ * max_growth_kb between end of second cycle and end of last one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+#include "check-common.h"
+#include "drone.h"
+#include "memtrack.h"
+#include "platform.h"
+#include "psplog.h"
+#include "ui.h"
+
+#define SOAK_DISCOVERY_PORT 44444
+#define SOAK_C2D_PORT 54321
+#define SOAK_D2C_PORT 43210
+#define SOAK_SIM_START_DELAY 300000 /* us */
+#define SOAK_PATH_MAX_LEN 256
+
+#define SOAK_CONNECTIONS 1000
+#define SOAK_MENUS 5000
+#define SOAK_MAX_GROWTH 0 /* KB */
+
+/* heap growth is counted from end of this cycle */
+#define SOAK_WARMUP_CYCLES 2
+
+/* heap peak is sampled every this many frames */
+#define SOAK_HEAP_PERIOD 64
+
+#define SOAK_MAX_SEGMENTS 4
+
+#define SOAK_N(array) (sizeof (array) / sizeof ((array)[0]))
+
+typedef struct _SoakSegment SoakSegment;
+
+/* presses to play, each one lasts a frame and is followed by a frame with
+ * all buttons released */
+struct _SoakSegment
+{
+	const unsigned int *buttons;
+	size_t n_buttons;
+	unsigned int repeat;
+};
+
+/* first entry is selected */
+static const unsigned int soak_main_menu_connect[] = {
+	PLATFORM_BUTTON_CROSS
+};
+
+/* main menu then piloting settings and drone information, main menu is
+ * walked from its first entry since it keeps last selection */
+static const unsigned int soak_flight_menu_round[] = {
+	PLATFORM_BUTTON_START,
+	PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_UP, PLATFORM_BUTTON_UP,
+	PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_CROSS,
+	PLATFORM_BUTTON_SQUARE,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_CROSS,
+	PLATFORM_BUTTON_SQUARE,
+	PLATFORM_BUTTON_START
+};
+
+/* "Return to main menu" is the last entry */
+static const unsigned int soak_flight_leave[] = {
+	PLATFORM_BUTTON_START,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN, PLATFORM_BUTTON_DOWN,
+	PLATFORM_BUTTON_CROSS
+};
+
+static const char *soak_tools_dir = "tools";
+static int soak_verbose = 0;
+
+static SoakSegment soak_segments[SOAK_MAX_SEGMENTS];
+static int soak_n_segments = 0;
+static int soak_segment = 0;
+static unsigned int soak_round = 0;
+static size_t soak_index = 0;
+static int soak_pressed = 0;
+
+static unsigned long soak_frames = 0;
+static size_t soak_heap_peak = 0;
+
+int running = 1;
+
+static long long
+soak_real_time (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+soak_play (const unsigned int * buttons, size_t n_buttons,
+		unsigned int repeat)
+{
+	SoakSegment *segment;
+
+	if (soak_n_segments == SOAK_MAX_SEGMENTS || repeat == 0)
+		return;
+
+	segment = &soak_segments[soak_n_segments++];
+	segment->buttons = buttons;
+	segment->n_buttons = n_buttons;
+	segment->repeat = repeat;
+}
+
+static int
+soak_is_playing (void)
+{
+	return soak_segment < soak_n_segments;
+}
+
+static void
+soak_play_reset (void)
+{
+	soak_n_segments = 0;
+	soak_segment = 0;
+	soak_round = 0;
+	soak_index = 0;
+}
+
+/* called by platform_wait_vblank () at end of each frame */
+static void
+soak_on_vblank (void * data)
+{
+	SoakSegment *segment;
+
+	soak_frames++;
+	if (soak_frames % SOAK_HEAP_PERIOD == 0) {
+		size_t heap = check_heap_in_use ();
+
+		if (heap > soak_heap_peak)
+			soak_heap_peak = heap;
+	}
+
+	if (soak_pressed || !soak_is_playing ()) {
+		platform_virtual_set_pad (0, 128, 128);
+		soak_pressed = 0;
+		return;
+	}
+
+	segment = &soak_segments[soak_segment];
+	platform_virtual_set_pad (segment->buttons[soak_index], 128, 128);
+	soak_pressed = 1;
+
+	if (++soak_index < segment->n_buttons)
+		return;
+
+	soak_index = 0;
+	if (++soak_round < segment->repeat)
+		return;
+
+	soak_round = 0;
+	soak_segment++;
+}
+
+static pid_t
+soak_spawn_sim (void)
+{
+	char path[SOAK_PATH_MAX_LEN];
+	pid_t pid;
+
+	snprintf (path, sizeof (path), "%s/drone-sim", soak_tools_dir);
+
+	pid = fork ();
+	if (pid != 0)
+		return pid;
+
+	execl (path, path, (char *) NULL);
+	fprintf (stderr, "soak: failed to run %s: %s\n", path,
+			strerror (errno));
+	_exit (127);
+}
+
+/* one pass through main menu, flight ui and its menus, return -1 when it
+ * didn't go as scripted */
+static int
+soak_cycle (UI * ui, Drone * drone, unsigned int menus)
+{
+	int ret;
+
+	soak_play_reset ();
+	soak_play (soak_main_menu_connect, SOAK_N (soak_main_menu_connect), 1);
+	if (ui_main_menu_run (ui) != MAIN_MENU_CONNECT) {
+		fprintf (stderr, "soak: main menu didn't select connect\n");
+		return -1;
+	}
+
+	if (drone_connect (drone, "127.0.0.1", SOAK_DISCOVERY_PORT,
+				SOAK_C2D_PORT, SOAK_D2C_PORT) < 0) {
+		fprintf (stderr, "soak: failed to connect to %s/drone-sim\n",
+				soak_tools_dir);
+		return -1;
+	}
+
+	/* as main.c does */
+	drone_sync_state (drone);
+	drone_streaming_set_active (drone, 0);
+	drone_sync_settings (drone);
+
+	soak_play_reset ();
+	soak_play (soak_flight_menu_round, SOAK_N (soak_flight_menu_round),
+			menus);
+	soak_play (soak_flight_leave, SOAK_N (soak_flight_leave), 1);
+	ret = ui_flight_run (ui, drone);
+
+	drone_disconnect (drone);
+
+	if (ret != FLIGHT_UI_MAIN_MENU || soak_is_playing ()) {
+		fprintf (stderr, "soak: flight ui left before end of script\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+soak_report (size_t heap_baseline, size_t heap_last, unsigned int cycles)
+{
+	MemtrackStats stats;
+	int i;
+
+	for (i = 0; i <= MEMTRACK_N_TAGS; i++) {
+		memtrack_get (i, &stats);
+		printf ("%-6s peak %8u bytes, leaked %6u bytes, "
+				"%u allocations\n", memtrack_tag_get_name (i),
+				(unsigned int) stats.peak,
+				(unsigned int) stats.bytes, stats.allocs);
+	}
+
+	printf ("heap   peak %8u bytes, growth %6lld bytes over %u cycles\n",
+			(unsigned int) soak_heap_peak,
+			(long long) heap_last - (long long) heap_baseline,
+			cycles > SOAK_WARMUP_CYCLES ?
+			cycles - SOAK_WARMUP_CYCLES : 0);
+}
+
+static void
+usage (const char * name)
+{
+	fprintf (stderr, "usage: %s [-v] [-t tools_dir] [-c connections] "
+			"[-m menus] [-g max_growth_kb]\n", name);
+}
+
+int
+main (int argc, char ** argv)
+{
+	unsigned int connections = SOAK_CONNECTIONS;
+	unsigned int menus = SOAK_MENUS;
+	long long max_growth = SOAK_MAX_GROWTH * 1024LL;
+	size_t heap_baseline, heap_last;
+	MemtrackStats total;
+	long long start;
+	unsigned int i;
+	Drone drone;
+	UI ui;
+	pid_t sim;
+	int failed = 0;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "vt:c:m:g:")) != -1) {
+		switch (opt) {
+			case 'v':
+				soak_verbose = 1;
+				break;
+			case 't':
+				soak_tools_dir = optarg;
+				break;
+			case 'c':
+				connections = atoi (optarg);
+				break;
+			case 'm':
+				menus = atoi (optarg);
+				break;
+			case 'g':
+				max_growth = atoi (optarg) * 1024LL;
+				break;
+			default:
+				usage (argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc || connections == 0) {
+		usage (argv[0]);
+		return 1;
+	}
+
+	if (check_init () < 0)
+		return 1;
+
+	platform_virtual_start (soak_on_vblank, NULL);
+
+	if (SDL_Init (SDL_INIT_VIDEO) < 0 || TTF_Init () < 0) {
+		fprintf (stderr, "soak: failed to initialize SDL\n");
+		return 1;
+	}
+
+	if (ui_init (&ui, 480, 272) < 0) {
+		fprintf (stderr, "soak: failed to initialize ui\n");
+		return 1;
+	}
+
+	if (drone_init (&drone) < 0) {
+		fprintf (stderr, "soak: failed to initialize drone\n");
+		return 1;
+	}
+
+	sim = soak_spawn_sim ();
+	if (sim < 0) {
+		fprintf (stderr, "soak: failed to start drone-sim\n");
+		return 1;
+	}
+	usleep (SOAK_SIM_START_DELAY);
+
+	start = soak_real_time ();
+	heap_baseline = heap_last = check_heap_in_use ();
+
+	for (i = 0; i < connections; i++) {
+		/* menu rounds spread evenly over connections */
+		unsigned int n = menus / connections +
+			(i < menus % connections);
+
+		if (soak_cycle (&ui, &drone, n) < 0) {
+			failed = 1;
+			break;
+		}
+
+		heap_last = check_heap_in_use ();
+		if (heap_last > soak_heap_peak)
+			soak_heap_peak = heap_last;
+		if (i + 1 == SOAK_WARMUP_CYCLES)
+			heap_baseline = heap_last;
+
+		if (soak_verbose)
+			printf ("cycle %u: heap %u bytes\n", i + 1,
+					(unsigned int) heap_last);
+	}
+
+	kill (sim, SIGINT);
+	waitpid (sim, NULL, 0);
+
+	drone_deinit (&drone);
+	ui_deinit (&ui);
+	TTF_Quit ();
+	SDL_Quit ();
+	psplog_deinit ();
+
+	printf ("%u cycles, %u menu rounds, %lu frames in %.1f s\n", i, menus,
+			soak_frames, (soak_real_time () - start) / 1000000.0);
+
+	if (i <= SOAK_WARMUP_CYCLES)
+		heap_baseline = heap_last;
+	soak_report (heap_baseline, heap_last, i);
+
+	memtrack_get (MEMTRACK_N_TAGS, &total);
+	if (total.bytes > 0) {
+		fprintf (stderr, "FAIL: %u tracked bytes leaked\n",
+				(unsigned int) total.bytes);
+		failed = 1;
+	}
+
+	if ((long long) heap_last - (long long) heap_baseline > max_growth) {
+		fprintf (stderr, "FAIL: heap grew by %lld bytes\n",
+				(long long) heap_last - (long long) heap_baseline);
+		failed = 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "platform.h"
+#include "trace.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_TRACE
+#include "psplog.h"
+
+#define TRACE_WRITE_BUFFER_LEN 4096
+#define TRACE_LINE_LEN 160
+
+#define TRACE_BARRIER() PLATFORM_BARRIER ()
+
+typedef struct _TraceEvent TraceEvent;
+typedef struct _TraceRing TraceRing;
+
+struct _TraceEvent
+{
+	long long timestamp;
+	const char *name;
+	char phase;
+};
+
+/* written by its thread only */
+struct _TraceRing
+{
+	unsigned int thid;
+	volatile unsigned int head;
+	TraceEvent events[TRACE_RING_SIZE];
+};
+
+static TraceRing trace_rings[TRACE_MAX_THREADS];
+static volatile int trace_n_rings = 0;
+static volatile int trace_recording = 0;
+
+static char trace_write_buffer[TRACE_WRITE_BUFFER_LEN]
+	__attribute__((aligned(64)));
+
+void
+trace_start (void)
+{
+	trace_recording = 0;
+	TRACE_BARRIER ();
+
+	/* threads are assigned a ring again, previous ones may be gone */
+	trace_n_rings = 0;
+	TRACE_BARRIER ();
+
+	trace_recording = 1;
+}
+
+void
+trace_stop (void)
+{
+	trace_recording = 0;
+}
+
+int
+trace_is_recording (void)
+{
+	return trace_recording;
+}
+
+static TraceRing *
+trace_get_ring (void)
+{
+	unsigned int thid = platform_thread_get_id ();
+	TraceRing *ring = NULL;
+	int intr;
+	int i;
+
+	for (i = 0; i < trace_n_rings; i++) {
+		if (trace_rings[i].thid == thid)
+			return &trace_rings[i];
+	}
+
+	/* first event of this thread, other threads may register too */
+	intr = platform_critical_enter ();
+	if (trace_n_rings < TRACE_MAX_THREADS) {
+		ring = &trace_rings[trace_n_rings];
+		ring->thid = thid;
+		ring->head = 0;
+		TRACE_BARRIER ();
+		trace_n_rings++;
+	}
+	platform_critical_leave (intr);
+
+	return ring;
+}
+
+static void
+trace_record (char phase, const char * name)
+{
+	TraceRing *ring;
+	TraceEvent *event;
+
+	if (!trace_recording)
+		return;
+
+	ring = trace_get_ring ();
+	if (ring == NULL)
+		return;
+
+	event = &ring->events[ring->head & (TRACE_RING_SIZE - 1)];
+	event->timestamp = platform_get_time_wide ();
+	event->name = name;
+	event->phase = phase;
+
+	TRACE_BARRIER ();
+	ring->head++;
+}
+
+void
+trace_begin (const char * name)
+{
+	trace_record ('B', name);
+}
+
+void
+trace_end (const char * name)
+{
+	trace_record ('E', name);
+}
+
+void
+trace_instant (const char * name)
+{
+	trace_record ('i', name);
+}
+
+/* append to write buffer, writing it when full */
+static int
+trace_write (int fd, size_t * len, const char * data, size_t size)
+{
+	if (*len + size > TRACE_WRITE_BUFFER_LEN) {
+		if (platform_file_write (fd, trace_write_buffer, *len) != (int) *len)
+			return -1;
+		*len = 0;
+	}
+
+	memcpy (trace_write_buffer + *len, data, size);
+	*len += size;
+
+	return 0;
+}
+
+static int
+trace_dump_ring (int fd, size_t * len, TraceRing * ring, int * first)
+{
+	char name[32];
+	char line[TRACE_LINE_LEN];
+	unsigned int head = ring->head;
+	unsigned int i;
+	int size;
+
+	if (platform_thread_get_name (ring->thid, name, sizeof (name)) < 0)
+		snprintf (name, sizeof (name), "thread %u", ring->thid);
+
+	size = snprintf (line, TRACE_LINE_LEN,
+			"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			*first ? "" : ",\n", ring->thid, name);
+	if (trace_write (fd, len, line, size) < 0)
+		return -1;
+	*first = 0;
+
+	/* oldest event first, ring may have wrapped */
+	for (i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+			i != head; i++) {
+		TraceEvent *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+
+		size = snprintf (line, TRACE_LINE_LEN,
+				",\n{\"name\":\"%s\",\"ph\":\"%c\",%s"
+				"\"ts\":%llu,\"pid\":1,\"tid\":%u}",
+				event->name, event->phase,
+				event->phase == 'i' ? "\"s\":\"t\"," : "",
+				(unsigned long long) event->timestamp,
+				ring->thid);
+		if (trace_write (fd, len, line, size) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+trace_dump (const char * path)
+{
+	static const char header[] = "{\"traceEvents\":[\n";
+	static const char footer[] = "\n]}\n";
+	size_t len = 0;
+	int first = 1;
+	int fd;
+	int i;
+
+	trace_stop ();
+
+	fd = platform_file_create (path);
+	if (fd < 0) {
+		PSPLOG_ERROR ("failed to open %s", path);
+		return -1;
+	}
+
+	if (trace_write (fd, &len, header, strlen (header)) < 0)
+		goto write_failed;
+
+	for (i = 0; i < trace_n_rings; i++) {
+		if (trace_dump_ring (fd, &len, &trace_rings[i], &first) < 0)
+			goto write_failed;
+	}
+
+	if (trace_write (fd, &len, footer, strlen (footer)) < 0)
+		goto write_failed;
+
+	if (len > 0 && platform_file_write (fd, trace_write_buffer, len) != (int) len)
+		goto write_failed;
+
+	platform_file_close (fd);
+	return 0;
+
+write_failed:
+	PSPLOG_ERROR ("failed to write trace");
+	platform_file_close (fd);
+	return -1;
+}
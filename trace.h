@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2015, Aurélien Zanelli <aurelien.zanelli@darkosphere.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* threads which can record events, events of other threads are ignored */
+#define TRACE_MAX_THREADS 8
+
+/* events kept per thread, oldest are overwritten, must be a power of 2 */
+#define TRACE_RING_SIZE 512
+
+/* clear events and start recording, recording is off by default so that
+ * trace points cost a test when not in use */
+void trace_start (void);
+void trace_stop (void);
+int trace_is_recording (void);
+
+/*
+ * Record an event for calling thread, with a us timestamp
+ *
+ * Each thread writes to its own ring so recording takes no lock. Names must
+ * be string literals since only their address is kept. A begin must be
+ * matched by an end of the same name in the same thread.
+ */
+void trace_begin (const char * name);
+void trace_end (const char * name);
+void trace_instant (const char * name);
+
+/* write recorded events as Chrome trace_event JSON, to be loaded in
+ * chrome://tracing or Perfetto. Recording is stopped first. Writing takes
+ * a while, don't call it from flight loop. */
+int trace_dump (const char * path);
+
+#endif
@@ -25,23 +25,45 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <pspuser.h>
-#include <pspdisplay.h>
-#include <pspctrl.h>
-#include <psputility_netconf.h>
-#include <pspgu.h>
-
 #include "ui.h"
+#include "input.h"
 #include "menu.h"
 #include "color.h"
+#include "latency.h"
+#include "metrics.h"
+#include "platform.h"
+#include "capture.h"
+#include "flightrec.h"
+#include "trace.h"
+#define PSPLOG_MODULE PSPLOG_MODULE_UI
 #include "psplog.h"
 
 extern int running;
 
-unsigned int __attribute__((aligned(16))) list[4096];
+#define UI_NOTIFICATION_DURATION 3000000 /* us */
+#define UI_NOTIFICATION_PADDING 4
+
+#define UI_LATENCY_DUMP_PATH PLATFORM_DATA_DIR "latency.txt"
+#define UI_TRACE_DUMP_PATH PLATFORM_DATA_DIR "trace.json"
+#define UI_CAPTURE_PATH PLATFORM_DATA_DIR "capture.bin"
+#define UI_FLIGHTREC_PATH PLATFORM_DATA_DIR "flight.bin"
+
+/* trace and statistics files are written below flight loop priority */
+#define UI_SAVE_PRIORITY 0x30
+#define UI_SAVE_STACK_SIZE 0x1000
+
+/* log console and statistics page are drawn below top bar */
+#define UI_LOG_CONSOLE_TOP 20
 
-#define EVENT_BUTTON_DOWN(latch, button) \
-	(((latch)->uiPress & (button)) && ((latch)->uiMake & (button)))
+/* statistics page is refreshed at this period, rates are computed over it */
+#define UI_STATS_PERIOD 1000000 /* us */
+#define UI_STATS_COLUMNS 2
+/* latency histograms are last and have their own overlay, they would not
+ * fit on screen */
+#define UI_STATS_N METRICS_LATENCY_INPUT
+
+/* piloting commands are percents */
+#define UI_CLAMP_COMMAND(x) ((x) > 100 ? 100 : ((x) < -100 ? -100 : (x)))
 
 enum
 {
@@ -50,6 +72,14 @@ enum
 	FLIGHT_MAIN_MENU_PILOTING_SETTINGS,
 	FLIGHT_MAIN_MENU_CONTROLS_SETTINGS,
 	FLIGHT_MAIN_MENU_DRONE_INFO,
+	FLIGHT_MAIN_MENU_LATENCY_OVERLAY,
+	FLIGHT_MAIN_MENU_LATENCY_DUMP,
+	FLIGHT_MAIN_MENU_LOG_CONSOLE,
+	FLIGHT_MAIN_MENU_STATS,
+	FLIGHT_MAIN_MENU_TRACE,
+	FLIGHT_MAIN_MENU_CAPTURE,
+	FLIGHT_MAIN_MENU_FLIGHTREC,
+	FLIGHT_MAIN_MENU_N
 };
 
 enum
@@ -60,6 +90,7 @@ enum
 	PILOTING_SETTINGS_MENU_VERTICAL_SPEED_LIMIT,
 	PILOTING_SETTINGS_MENU_ROTATION_SPEED_LIMIT,
 	PILOTING_SETTINGS_MENU_TILT_LIMIT,
+	PILOTING_SETTINGS_MENU_N
 };
 
 enum
@@ -69,6 +100,10 @@ enum
 	CONTROLS_SETTINGS_ROLL,
 	CONTROLS_SETTINGS_GAZ,
 	CONTROLS_SETTINGS_SELECT_BINDING,
+	CONTROLS_SETTINGS_ANALOG_MODE,
+	CONTROLS_SETTINGS_ANALOG_DEADZONE,
+	CONTROLS_SETTINGS_ANALOG_EXPO,
+	CONTROLS_SETTINGS_N
 };
 
 enum
@@ -85,8 +120,62 @@ enum
 	DRONE_INFO_MENU_DRONE_HW = 0,
 	DRONE_INFO_MENU_DRONE_SW,
 	DRONE_INFO_MENU_ARCOMMAND_VERSION,
+	DRONE_INFO_MENU_N
 };
 
+/*
+ * Fill analog curve for a given axis.
+ * Table is indexed by raw stick position (center at 128) and gives the
+ * command in [-rate, rate]. deadzone and expo are in percent.
+ */
+static void
+ui_analog_curve_build (signed char * curve, int rate, int deadzone, int expo)
+{
+	const float dz = deadzone / 100.0f;
+	const float e = expo / 100.0f;
+	int i;
+
+	for (i = 0; i < UI_ANALOG_CURVE_SIZE; i++) {
+		float x = (i - 128) / 127.0f;
+		float sign = 1.0f;
+		float y;
+
+		if (x < 0) {
+			sign = -1.0f;
+			x = -x;
+		}
+
+		if (x > 1.0f)
+			x = 1.0f;
+
+		if (x <= dz) {
+			curve[i] = 0;
+			continue;
+		}
+
+		/* rescale outside deadzone so output starts from 0 */
+		x = (x - dz) / (1.0f - dz);
+
+		/* blend linear and cubic response */
+		y = (1.0f - e) * x + e * x * x * x;
+
+		curve[i] = (signed char) (sign * (y * rate + 0.5f));
+	}
+}
+
+static void
+ui_analog_curves_update (UI * ui)
+{
+	ui_analog_curve_build (ui->analog_yaw, ui->setting_yaw,
+			ui->setting_analog_deadzone, ui->setting_analog_expo);
+	ui_analog_curve_build (ui->analog_pitch, ui->setting_pitch,
+			ui->setting_analog_deadzone, ui->setting_analog_expo);
+	ui_analog_curve_build (ui->analog_roll, ui->setting_roll,
+			ui->setting_analog_deadzone, ui->setting_analog_expo);
+	ui_analog_curve_build (ui->analog_gaz, ui->setting_gaz,
+			ui->setting_analog_deadzone, ui->setting_analog_expo);
+}
+
 static int
 ui_flight_battery_update (UI * ui, unsigned int percent)
 {
@@ -133,8 +222,9 @@ blit_failed:
 }
 
 static int
-ui_flight_state_update (UI * ui, DroneState state)
+ui_flight_state_update (UI * ui, DroneState state, int connected)
 {
+	const SDL_Color *color = &color_white;
 	SDL_Surface *text;
 	SDL_Rect position;
 	const char *state_str;
@@ -169,7 +259,13 @@ ui_flight_state_update (UI * ui, DroneState state)
 			break;
 	}
 
-	text = TTF_RenderText_Blended (ui->font, state_str, color_white);
+	/* last state received is not the current one anymore */
+	if (!connected) {
+		state_str = "DISCONNECTED";
+		color = &color_red;
+	}
+
+	text = TTF_RenderText_Blended (ui->font, state_str, *color);
 	if (text == NULL)
 		goto no_text;
 
@@ -223,7 +319,7 @@ blit_failed:
 
 #define BUFFER_LEN 255
 
-static SDL_Surface *
+SDL_Surface *
 ui_render_text (UI * ui, const SDL_Color * color, const char *fmt, ...)
 {
 	va_list ap;
@@ -238,13 +334,13 @@ ui_render_text (UI * ui, const SDL_Color * color, const char *fmt, ...)
 }
 
 static int
-ui_flight_gps_update (UI * ui, Drone * drone)
+ui_flight_gps_update (UI * ui, const DroneTelemetry * telemetry)
 {
 	SDL_Surface *text;
 	SDL_Rect position;
 
-	text = ui_render_text (ui, &color_black, "gps: %s", drone->gps_fixed ?
-			"yes" : "no");
+	text = ui_render_text (ui, &color_black, "gps: %s",
+			telemetry->gps_fixed ? "yes" : "no");
 	if (text == NULL)
 		goto no_text;
 
@@ -259,7 +355,7 @@ ui_flight_gps_update (UI * ui, Drone * drone)
 	SDL_FreeSurface (text);
 
 	text = ui_render_text (ui, &color_black, "latitude: %lf",
-			drone->gps_latitude);
+			telemetry->gps_latitude);
 	if (text == NULL)
 		goto no_text;
 
@@ -270,7 +366,7 @@ ui_flight_gps_update (UI * ui, Drone * drone)
 	SDL_FreeSurface (text);
 
 	text = ui_render_text (ui, &color_black, "longitude: %lf",
-			drone->gps_longitude);
+			telemetry->gps_longitude);
 	if (text == NULL)
 		goto no_text;
 
@@ -281,7 +377,7 @@ ui_flight_gps_update (UI * ui, Drone * drone)
 	SDL_FreeSurface (text);
 
 	text = ui_render_text (ui, &color_black, "altitude: %lf",
-			drone->gps_altitude);
+			telemetry->gps_altitude);
 	if (text == NULL)
 		goto no_text;
 
@@ -302,472 +398,1240 @@ blit_failed:
 	SDL_FreeSurface (text);
 	return -1;
 }
-static int
-ui_flight_update (UI * ui, Drone * drone)
+static void
+ui_notification_remove (UI * ui, int index)
 {
-	SDL_Rect top_bar;
-	int ret;
-
-	/* clear screen */
-	SDL_FillRect (ui->screen, NULL,
-			SDL_MapRGB (ui->screen->format, 28, 142, 207));
+	int i;
 
-	/* draw top bar */
-	top_bar.x = 0;
-	top_bar.y = 0;
-	top_bar.w = ui->screen->w;
-	top_bar.h = 20;
-	SDL_FillRect (ui->screen, &top_bar,
-			SDL_MapRGB(ui->screen->format, 0, 0, 0));
+	SDL_FreeSurface (ui->notifications[index].surface);
 
-	ret = ui_flight_battery_update (ui, drone->battery);
-	ret = ui_flight_state_update (ui, drone->state);
-	ret = ui_flight_altitude_update (ui, drone->altitude);
-	ret = ui_flight_gps_update (ui, drone);
+	for (i = index; i < ui->n_notifications - 1; i++)
+		ui->notifications[i] = ui->notifications[i + 1];
 
-	return ret;
+	ui->n_notifications--;
+	ui->notifications[ui->n_notifications].surface = NULL;
+	metrics_gauge_set (METRICS_UI_NOTIFICATIONS, ui->n_notifications);
 }
 
-static void
-on_hull_switch_toggle (MenuSwitchEntry * entry, void * userdata)
+void
+ui_notify (UI * ui, const char * fmt, ...)
 {
-	Drone *drone = (Drone *) userdata;
-	unsigned int value = menu_switch_entry_get_active (entry);
+	va_list ap;
+	char buf[BUFFER_LEN] = { 0, };
+	SDL_Surface *text;
+	SDL_Surface *surface;
+	SDL_Rect position;
 
-	if (value != drone->hull)
-		drone_hull_set_active (drone, value);
+	va_start (ap, fmt);
+	vsnprintf (buf, BUFFER_LEN, fmt, ap);
+	va_end (ap);
+	buf[BUFFER_LEN - 1] = 0;
+
+	PSPLOG_INFO ("notification: %s", buf);
+
+	/* render once, notification is then only blitted each frame */
+	text = ui_render_text (ui, &color_white, "%s", buf);
+	if (text == NULL)
+		goto no_text;
+
+	surface = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCALPHA,
+			text->w + 2 * UI_NOTIFICATION_PADDING,
+			text->h + 2 * UI_NOTIFICATION_PADDING, 32, 0, 0, 0, 0);
+	if (surface == NULL)
+		goto no_surface;
+
+	SDL_FillRect (surface, NULL, SDL_MapRGB (surface->format, 0, 0, 0));
+	position.x = UI_NOTIFICATION_PADDING;
+	position.y = UI_NOTIFICATION_PADDING;
+	SDL_BlitSurface (text, NULL, surface, &position);
+	SDL_SetAlpha (surface, SDL_SRCALPHA, 200);
+	SDL_FreeSurface (text);
+
+	if (ui->n_notifications == UI_NOTIFICATIONS_MAX)
+		ui_notification_remove (ui, 0);
+
+	ui->notifications[ui->n_notifications].surface = surface;
+	ui->notifications[ui->n_notifications].expire_time =
+		platform_get_time () + UI_NOTIFICATION_DURATION;
+	ui->n_notifications++;
+	metrics_gauge_set (METRICS_UI_NOTIFICATIONS, ui->n_notifications);
+
+	return;
+
+no_text:
+	PSPLOG_ERROR ("failed to render text");
+	return;
+
+no_surface:
+	PSPLOG_ERROR ("failed to create notification surface");
+	SDL_FreeSurface (text);
 }
 
-static void
-on_outdoor_flight_switch_toggle (MenuSwitchEntry * entry, void * userdata)
+void
+ui_notify_clear (UI * ui)
 {
-	Drone *drone = (Drone *) userdata;
-	unsigned int value = menu_switch_entry_get_active (entry);
-
-	if (value != drone->outdoor)
-		drone_outdoor_flight_set_active (drone, value);
+	while (ui->n_notifications > 0)
+		ui_notification_remove (ui, 0);
 }
 
+/* drop expired notifications and draw the others centered on screen */
 static int
-ui_piloting_settings_menu (UI * ui, Drone * drone)
+ui_notifications_update (UI * ui)
 {
-	Menu *menu;
-	MenuSwitchEntry *hull_switch;
-	MenuSwitchEntry *outdoor_flight_switch;
-	MenuScaleEntry *altitude_limit_scale;
-	MenuScaleEntry *vertical_limit_scale;
-	MenuScaleEntry *rotation_limit_scale;
-	MenuScaleEntry *tilt_limit_scale;
+	unsigned int now = platform_get_time ();
 	SDL_Rect position;
-	SDL_Surface *frame;
-	SDL_Rect menu_frame;
-	MenuState ret;
-
-	menu = menu_new (ui->font, MENU_CANCEL_ON_START | MENU_BACK_ON_CIRCLE);
+	int i;
+
+	i = 0;
+	while (i < ui->n_notifications) {
+		if ((int) (now - ui->notifications[i].expire_time) >= 0)
+			ui_notification_remove (ui, i);
+		else
+			i++;
+	}
 
-	/* hull presence selection */
-	hull_switch = menu_switch_entry_new (PILOTING_SETTINGS_MENU_HULL,
-			"Hull set");
-	menu_switch_entry_set_values_labels (hull_switch, "no", "yes");
-	menu_switch_entry_set_active (hull_switch, drone->hull);
-	menu_switch_entry_set_toggled_callback (hull_switch,
-			on_hull_switch_toggle, drone);
+	position.y = ui->screen->h / 2;
 
-	/* outdoor flight */
-	outdoor_flight_switch =
-		menu_switch_entry_new (PILOTING_SETTINGS_MENU_OUTDOOR_FLIGHT,
-				"outdoor flight");
-	menu_switch_entry_set_values_labels (outdoor_flight_switch, "no", "yes");
-	menu_switch_entry_set_active (outdoor_flight_switch, drone->outdoor);
-	menu_switch_entry_set_toggled_callback (outdoor_flight_switch,
-			on_outdoor_flight_switch_toggle, drone);
+	for (i = 0; i < ui->n_notifications; i++) {
+		SDL_Surface *surface = ui->notifications[i].surface;
 
-	/* altitude limit settings */
-	altitude_limit_scale =
-		menu_scale_entry_new (PILOTING_SETTINGS_MENU_ALTITUDE_LIMIT,
-				"altitude limit (m)", drone->altitude_limit.min,
-				drone->altitude_limit.max);
-	menu_scale_entry_set_value (altitude_limit_scale,
-			drone->altitude_limit.current);
+		position.x = (ui->screen->w - surface->w) / 2;
+		if (SDL_BlitSurface (surface, NULL, ui->screen, &position) < 0) {
+			PSPLOG_ERROR ("failed to blit notification");
+			return -1;
+		}
 
-	/* vertical speed limit settings */
-	vertical_limit_scale =
-		menu_scale_entry_new (PILOTING_SETTINGS_MENU_VERTICAL_SPEED_LIMIT,
-				"vertical speed limit (m/s)",
-				drone->vertical_speed_limit.min,
-				drone->vertical_speed_limit.max);
-	menu_scale_entry_set_value (vertical_limit_scale,
-			drone->vertical_speed_limit.current);
+		position.y += surface->h + 2;
+	}
 
-	/* rotation speed limit settings */
-	rotation_limit_scale =
-		menu_scale_entry_new (PILOTING_SETTINGS_MENU_ROTATION_SPEED_LIMIT,
-				"rotation speed limit (deg/s)",
-				drone->rotation_speed_limit.min,
-				drone->rotation_speed_limit.max);
-	menu_scale_entry_set_value (rotation_limit_scale,
-			drone->rotation_speed_limit.current);
+	return 0;
+}
 
-	/* rotation speed limit settings */
-	tilt_limit_scale =
-		menu_scale_entry_new (PILOTING_SETTINGS_MENU_TILT_LIMIT,
-				"tilt limit (deg)",
-				drone->tilt_limit.min,
-				drone->tilt_limit.max);
-	menu_scale_entry_set_value (tilt_limit_scale,
-			drone->tilt_limit.current);
+static int
+ui_save_run (void * data)
+{
+	UI *ui = (UI *) data;
 
-	menu_add_entry (menu, (MenuEntry *) hull_switch);
-	menu_add_entry (menu, (MenuEntry *) outdoor_flight_switch);
-	menu_add_entry (menu, (MenuEntry *) altitude_limit_scale);
-	menu_add_entry (menu, (MenuEntry *) vertical_limit_scale);
-	menu_add_entry (menu, (MenuEntry *) rotation_limit_scale);
-	menu_add_entry (menu, (MenuEntry *) tilt_limit_scale);
+	ui->save_result = ui->save_func (ui->save_path);
+	PLATFORM_BARRIER ();
+	ui->save_done = 1;
 
-	/* center position in screen */
-	position.x = (ui->screen->w - menu_get_width(menu)) / 2;
-	position.y = (ui->screen->h - menu_get_height(menu)) / 2;
+	return 0;
+}
 
-	/* to fill a rectangle in background to delimitate menu */
-	menu_frame.x = position.x - 5;
-	menu_frame.y = position.y - 5;
-	menu_frame.w = menu_get_width (menu) + 10;
-	menu_frame.h = menu_get_height (menu) + 10;
-	frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCCOLORKEY | SDL_SRCALPHA,
-			menu_frame.w, menu_frame.h, 32, 0, 0, 0, 0);
-	SDL_FillRect (frame, NULL, SDL_MapRGB (frame->format, 0, 0, 0));
-	SDL_SetAlpha (frame, SDL_SRCALPHA, 200);
+/* notify and return 1 when a file is still being saved */
+static int
+ui_save_is_busy (UI * ui)
+{
+	if (ui->save_thread < 0)
+		return 0;
 
-	while (running) {
-		/*redraw flight ui */
-		ui_flight_update(ui, drone);
-
-		ret = menu_update (menu);
-		switch (ret) {
-			case MENU_STATE_VISIBLE:
-				/* sync option with drone */
-				menu_switch_entry_set_active (hull_switch,
-						drone->hull);
-				menu_switch_entry_set_active (outdoor_flight_switch,
-						drone->outdoor);
-
-				SDL_BlitSurface (frame, NULL, ui->screen,
-						&menu_frame);
-				menu_render_to (menu, ui->screen, &position);
-				sceDisplayWaitVblankStart ();
-				SDL_Flip (ui->screen);
-				break;
+	ui_notify (ui, "Previous save still in progress");
+	return 1;
+}
 
-			case MENU_STATE_CLOSE:
-			case MENU_STATE_CANCELLED:
-			default:
-				goto done;
-				break;
+/* call @func from save thread, a notification is shown when it returns */
+static int
+ui_save_start (UI * ui, UISaveFunc func, const char * path,
+		const char * done_msg, const char * failed_msg)
+{
+	if (ui_save_is_busy (ui))
+		return -1;
 
-		}
+	ui->save_func = func;
+	ui->save_path = path;
+	ui->save_done_msg = done_msg;
+	ui->save_failed_msg = failed_msg;
+	ui->save_result = -1;
+	ui->save_done = 0;
+
+	ui->save_thread = platform_thread_create ("ui_save", ui_save_run, ui,
+			UI_SAVE_PRIORITY, UI_SAVE_STACK_SIZE);
+	if (ui->save_thread < 0) {
+		PSPLOG_ERROR ("failed to start save thread");
+		ui_notify (ui, "%s", failed_msg);
+		return -1;
 	}
 
-done:
-	/* send new scale entries value to drone, not done in callback
-	 * to avoid flooding drone and because it can't work well in our side
-	 * due to local update and callback for drones for previously sent
-	 * values. */
-	drone_altitude_limit_set (drone,
-			menu_scale_entry_get_value (altitude_limit_scale));
-	drone_vertical_speed_limit_set (drone,
-			menu_scale_entry_get_value (vertical_limit_scale));
-	drone_rotation_speed_limit_set (drone,
-			menu_scale_entry_get_value (rotation_limit_scale));
-	drone_max_tilt_set (drone,
-			menu_scale_entry_get_value (tilt_limit_scale));
+	return 0;
+}
 
-	menu_free (menu);
-	return ret;
+/* join save thread once done, or wait for it if @wait is set */
+static void
+ui_save_finish (UI * ui, int wait)
+{
+	if (ui->save_thread < 0 || (!wait && !ui->save_done))
+		return;
+
+	platform_thread_join (ui->save_thread);
+	ui->save_thread = -1;
+
+	ui_notify (ui, "%s", ui->save_result == 0 ? ui->save_done_msg :
+			ui->save_failed_msg);
 }
 
+/* debug overlay with control latency statistics at bottom of screen */
 static int
-ui_controls_settings_menu (UI * ui, Drone * drone)
+ui_flight_latency_update (UI * ui)
 {
-	Menu *menu;
-	MenuScaleEntry *yaw_scale;
-	MenuScaleEntry *pitch_scale;
-	MenuScaleEntry *roll_scale;
-	MenuScaleEntry *gaz_scale;
-	MenuComboBoxEntry *select_binding;
+	SDL_Surface *text;
 	SDL_Rect position;
-	SDL_Surface *frame;
-	SDL_Rect menu_frame;
-	MenuState ret;
+	int stage;
 
-	menu = menu_new (ui->font, MENU_CANCEL_ON_START | MENU_BACK_ON_CIRCLE);
-
-	yaw_scale = menu_scale_entry_new (CONTROLS_SETTINGS_YAW, "yaw", 0, 100);
-	menu_scale_entry_set_value (yaw_scale, ui->setting_yaw);
+	position.x = 0;
+	position.y = ui->screen->h -
+		LATENCY_N_STAGES * TTF_FontLineSkip (ui->font);
 
-	pitch_scale = menu_scale_entry_new (CONTROLS_SETTINGS_PITCH, "pitch", 0,
-			100);
-	menu_scale_entry_set_value (pitch_scale, ui->setting_pitch);
+	for (stage = 0; stage < LATENCY_N_STAGES; stage++) {
+		MetricsValue hist;
 
-	roll_scale = menu_scale_entry_new (CONTROLS_SETTINGS_ROLL, "roll", 0,
-			100);
-	menu_scale_entry_set_value (roll_scale, ui->setting_roll);
+		latency_get_histogram (stage, &hist);
 
-	gaz_scale = menu_scale_entry_new (CONTROLS_SETTINGS_GAZ, "gaz", 0, 100);
-	menu_scale_entry_set_value (gaz_scale, ui->setting_gaz);
+		text = ui_render_text (ui, &color_black,
+				"%s: n %u avg %llu p50 <%u p99 <%u max %u us",
+				latency_stage_get_name (stage), hist.value,
+				hist.value ? hist.sum / hist.value : 0,
+				metrics_histogram_get_percentile (&hist, 50),
+				metrics_histogram_get_percentile (&hist, 99),
+				hist.max);
+		if (text == NULL)
+			goto no_text;
 
-	select_binding =
-		menu_combo_box_entry_new (CONTROLS_SETTINGS_SELECT_BINDING,
-				"select binding");
-	menu_combo_box_entry_append (select_binding, SELECT_BIND_TAKE_PICTURE,
-			"take picture");
-	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_FRONT,
-			"front flip");
-	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_BACK,
-			"back flip");
-	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_LEFT,
-			"left flip");
-	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_RIGHT,
-			"right flip");
-	menu_combo_box_entry_set_value (select_binding,
-			ui->setting_select_binding);
+		if (SDL_BlitSurface (text, NULL, ui->screen, &position) < 0)
+			goto blit_failed;
 
-	menu_add_entry (menu, (MenuEntry *) yaw_scale);
-	menu_add_entry (menu, (MenuEntry *) pitch_scale);
-	menu_add_entry (menu, (MenuEntry *) roll_scale);
-	menu_add_entry (menu, (MenuEntry *) gaz_scale);
-	menu_add_entry (menu, (MenuEntry *) select_binding);
+		position.y += TTF_FontLineSkip (ui->font);
+		SDL_FreeSurface (text);
+	}
 
-	/* center position in screen */
-	position.x = (ui->screen->w - menu_get_width (menu)) / 2;
-	position.y = (ui->screen->h - menu_get_height (menu)) / 2;
+	return 0;
 
-	/* to fill a rectangle in background to delimitate menu */
-	menu_frame.x = position.x - 5;
-	menu_frame.y = position.y - 5;
-	menu_frame.w = menu_get_width (menu) + 10;
-	menu_frame.h = menu_get_height (menu) + 10;
-	frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCCOLORKEY | SDL_SRCALPHA,
-			menu_frame.w, menu_frame.h, 32, 0, 0, 0, 0);
-	SDL_FillRect (frame, NULL, SDL_MapRGB (frame->format, 0, 0, 0));
-	SDL_SetAlpha (frame, SDL_SRCALPHA, 200);
+no_text:
+	PSPLOG_ERROR ("failed to render text");
+	return -1;
 
-	while (running) {
-		/*redraw flight ui */
-		ui_flight_update(ui, drone);
-
-		ret = menu_update (menu);
-		switch (ret) {
-			case MENU_STATE_VISIBLE:
-				SDL_BlitSurface (frame, NULL, ui->screen,
-						&menu_frame);
-				menu_render_to (menu, ui->screen, &position);
-				sceDisplayWaitVblankStart ();
-				SDL_Flip (ui->screen);
-				break;
+blit_failed:
+	PSPLOG_ERROR ("failed to blit text to screen");
+	SDL_FreeSurface (text);
+	return -1;
+}
 
-			case MENU_STATE_CLOSE:
-			case MENU_STATE_CANCELLED:
-			default:
-				goto done;
-				break;
+static void
+ui_log_console_close (UI * ui)
+{
+	int i;
 
-		}
+	for (i = 0; i < UI_LOG_CONSOLE_LINES; i++) {
+		if (ui->log_console_lines[i].surface)
+			SDL_FreeSurface (ui->log_console_lines[i].surface);
+		ui->log_console_lines[i].surface = NULL;
 	}
 
-done:
-	/* store value to ui */
-	ui->setting_yaw = menu_scale_entry_get_value (yaw_scale);
-	ui->setting_pitch = menu_scale_entry_get_value (pitch_scale);
-	ui->setting_roll = menu_scale_entry_get_value (roll_scale);
-	ui->setting_gaz = menu_scale_entry_get_value (gaz_scale);
-	ui->setting_select_binding =
-		menu_combo_box_entry_get_value (select_binding);
-
-	menu_free (menu);
-	return ret;
+	if (ui->log_console_frame)
+		SDL_FreeSurface (ui->log_console_frame);
+
+	ui->log_console_frame = NULL;
+	ui->show_log_console = 0;
 }
 
 static int
-ui_drone_info_menu (UI * ui, Drone * drone)
+ui_log_console_open (UI * ui)
 {
-	Menu *menu;
-	MenuLabelEntry *drone_sw;
-	MenuLabelEntry *drone_hw;
-	MenuLabelEntry *arcommand_version;
-	char tmp[128] = { 0, };
-	SDL_Rect position;
-	SDL_Surface *frame;
-	SDL_Rect menu_frame;
-	MenuState ret;
+	ui_log_console_close (ui);
 
-	menu = menu_new (ui->font, MENU_CANCEL_ON_START | MENU_BACK_ON_CIRCLE);
+	ui->log_console_frame = SDL_CreateRGBSurface (SDL_HWSURFACE |
+			SDL_SRCALPHA, ui->screen->w,
+			ui->screen->h - UI_LOG_CONSOLE_TOP, 32, 0, 0, 0, 0);
+	if (ui->log_console_frame == NULL) {
+		PSPLOG_ERROR ("failed to create log console frame");
+		return -1;
+	}
 
-	snprintf (tmp, 127, "Drone HW: %s", drone->hardware_version);
-	drone_hw = menu_label_entry_new (DRONE_INFO_MENU_DRONE_HW, tmp);
+	SDL_FillRect (ui->log_console_frame, NULL,
+			SDL_MapRGB (ui->log_console_frame->format, 0, 0, 0));
+	SDL_SetAlpha (ui->log_console_frame, SDL_SRCALPHA, 200);
 
-	snprintf (tmp, 127, "Drone SW: %s", drone->software_version);
-	drone_sw = menu_label_entry_new (DRONE_INFO_MENU_DRONE_HW, tmp);
+	ui->log_console_scroll = 0;
+	ui->show_log_console = 1;
 
-	snprintf (tmp, 127, "Protocol version: %s", drone->arcommand_version);
-	arcommand_version =
-		menu_label_entry_new (DRONE_INFO_MENU_ARCOMMAND_VERSION, tmp);
+	return 0;
+}
 
-	menu_add_entry (menu, (MenuEntry *) drone_hw);
-	menu_add_entry (menu, (MenuEntry *) drone_sw);
-	menu_add_entry (menu, (MenuEntry *) arcommand_version);
+static int
+ui_log_console_get_n_lines (UI * ui)
+{
+	int n_lines = ui->log_console_frame->h / TTF_FontLineSkip (ui->font);
 
-	/* center position in screen */
-	position.x = (ui->screen->w - menu_get_width (menu)) / 2;
-	position.y = (ui->screen->h - menu_get_height (menu)) / 2;
+	return n_lines < UI_LOG_CONSOLE_LINES ? n_lines : UI_LOG_CONSOLE_LINES;
+}
 
-	/* to fill a rectangle in background to delimitate menu */
-	menu_frame.x = position.x - 5;
-	menu_frame.y = position.y - 5;
-	menu_frame.w = menu_get_width (menu) + 10;
-	menu_frame.h = menu_get_height (menu) + 10;
-	frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCCOLORKEY | SDL_SRCALPHA,
-			menu_frame.w, menu_frame.h, 32, 0, 0, 0, 0);
-	SDL_FillRect (frame, NULL, SDL_MapRGB (frame->format, 0, 0, 0));
-	SDL_SetAlpha (frame, SDL_SRCALPHA, 200);
+/* up/down scroll a line, left/right a page, square or start close */
+static void
+ui_log_console_handle_press (UI * ui, const InputEvent * event)
+{
+	unsigned int page = ui_log_console_get_n_lines (ui);
 
-	while (running) {
-		/*redraw flight ui */
-		ui_flight_update(ui, drone);
-
-		ret = menu_update (menu);
-		switch (ret) {
-			case MENU_STATE_VISIBLE:
-				SDL_BlitSurface (frame, NULL, ui->screen,
-						&menu_frame);
-				menu_render_to (menu, ui->screen, &position);
-				sceDisplayWaitVblankStart ();
-				SDL_Flip (ui->screen);
-				break;
+	switch (event->button) {
+		case PLATFORM_BUTTON_UP:
+			ui->log_console_scroll++;
+			break;
 
-			case MENU_STATE_CANCELLED:
-			case MENU_STATE_CLOSE:
-			default:
-				goto done;
-				break;
-		}
-	}
+		case PLATFORM_BUTTON_DOWN:
+			if (ui->log_console_scroll > 0)
+				ui->log_console_scroll--;
+			break;
 
-done:
-	menu_free (menu);
-	return ret;
+		case PLATFORM_BUTTON_LEFT:
+			ui->log_console_scroll += page;
+			break;
+
+		case PLATFORM_BUTTON_RIGHT:
+			if (ui->log_console_scroll > page)
+				ui->log_console_scroll -= page;
+			else
+				ui->log_console_scroll = 0;
+			break;
+
+		case PLATFORM_BUTTON_SQUARE:
+		case PLATFORM_BUTTON_START:
+			ui_log_console_close (ui);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* draw visible records, newest at bottom, only records which weren't
+ * visible on previous frame are rendered */
+static int
+ui_log_console_update (UI * ui)
+{
+	unsigned int count = psplog_history_get_count ();
+	unsigned int n_lines = ui_log_console_get_n_lines (ui);
+	unsigned int oldest;
+	unsigned int first;
+	unsigned int end;
+	unsigned int seq;
+	SDL_Rect position;
+
+	oldest = count > PSPLOG_HISTORY_SIZE ? count - PSPLOG_HISTORY_SIZE : 0;
+
+	/* stop scrolling at oldest record, scroll 0 follows new records */
+	if (count - oldest <= n_lines)
+		ui->log_console_scroll = 0;
+	else if (ui->log_console_scroll > count - oldest - n_lines)
+		ui->log_console_scroll = count - oldest - n_lines;
+
+	end = count - ui->log_console_scroll;
+	first = end - oldest > n_lines ? end - n_lines : oldest;
+
+	position.x = 0;
+	position.y = UI_LOG_CONSOLE_TOP;
+	SDL_BlitSurface (ui->log_console_frame, NULL, ui->screen, &position);
+
+	for (seq = first; seq != end; seq++) {
+		UILogLine *line =
+			&ui->log_console_lines[seq & (UI_LOG_CONSOLE_LINES - 1)];
+
+		if (line->surface == NULL || line->seq != seq) {
+			enum psplog_category cat;
+			char text[PSPLOG_HISTORY_LINE_LEN];
+			const SDL_Color *color;
+
+			if (line->surface)
+				SDL_FreeSurface (line->surface);
+			line->surface = NULL;
+
+			/* not written yet, retry on next frame */
+			if (psplog_history_get (seq, text, sizeof (text),
+						&cat) < 0)
+				goto next;
+
+			if (cat == PSPLOG_CAT_ERROR)
+				color = &color_red;
+			else if (cat == PSPLOG_CAT_WARNING)
+				color = &color_yellow;
+			else
+				color = &color_white;
+
+			/* font renders nothing from an empty string */
+			line->surface = TTF_RenderText_Blended (ui->font,
+					text[0] ? text : " ", *color);
+			if (line->surface == NULL)
+				goto no_text;
+
+			line->seq = seq;
+		}
+
+		if (SDL_BlitSurface (line->surface, NULL, ui->screen,
+					&position) < 0)
+			goto blit_failed;
+
+next:
+		position.y += TTF_FontLineSkip (ui->font);
+	}
+
+	return 0;
+
+no_text:
+	PSPLOG_ERROR ("failed to render text");
+	return -1;
+
+blit_failed:
+	PSPLOG_ERROR ("failed to blit text to screen");
+	return -1;
+}
+
+static void
+ui_stats_close (UI * ui)
+{
+	int i;
+
+	for (i = 0; i < METRICS_N; i++) {
+		if (ui->stats_lines[i])
+			SDL_FreeSurface (ui->stats_lines[i]);
+		ui->stats_lines[i] = NULL;
+	}
+
+	if (ui->stats_frame)
+		SDL_FreeSurface (ui->stats_frame);
+
+	ui->stats_frame = NULL;
+	ui->show_stats = 0;
 }
 
 static int
-ui_flight_main_menu (UI * ui, Drone * drone)
+ui_stats_open (UI * ui)
+{
+	int rows = (UI_STATS_N + UI_STATS_COLUMNS - 1) / UI_STATS_COLUMNS;
+	int i;
+
+	ui_stats_close (ui);
+
+	ui->stats_frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCALPHA,
+			ui->screen->w, rows * TTF_FontLineSkip (ui->font), 32,
+			0, 0, 0, 0);
+	if (ui->stats_frame == NULL) {
+		PSPLOG_ERROR ("failed to create statistics frame");
+		return -1;
+	}
+
+	SDL_FillRect (ui->stats_frame, NULL,
+			SDL_MapRGB (ui->stats_frame->format, 0, 0, 0));
+	SDL_SetAlpha (ui->stats_frame, SDL_SRCALPHA, 200);
+
+	/* rates are computed from next refresh on */
+	for (i = 0; i < UI_STATS_N; i++) {
+		MetricsValue value;
+
+		metrics_get (i, &value);
+		ui->stats_prev[i] = value.value;
+	}
+
+	ui->stats_refresh_time = platform_get_time () - UI_STATS_PERIOD;
+	ui->show_stats = 1;
+
+	return 0;
+}
+
+/* render all metrics, with counters rates since previous refresh */
+static int
+ui_stats_refresh (UI * ui, unsigned int now)
+{
+	unsigned int elapsed = now - ui->stats_refresh_time;
+	int i;
+
+	for (i = 0; i < UI_STATS_N; i++) {
+		MetricsValue value;
+		SDL_Surface *text;
+
+		metrics_get (i, &value);
+
+		switch (metrics_get_type (i)) {
+			case METRICS_TYPE_COUNTER:
+				text = ui_render_text (ui, &color_white,
+						"%s %u %llu/s",
+						metrics_get_name (i), value.value,
+						(value.value - ui->stats_prev[i]) *
+						1000000ULL / elapsed);
+				break;
+
+			case METRICS_TYPE_HISTOGRAM:
+				text = ui_render_text (ui, &color_white,
+						"%s p50<%u max %u",
+						metrics_get_name (i),
+						metrics_histogram_get_percentile (
+							&value, 50),
+						value.max);
+				break;
+
+			case METRICS_TYPE_GAUGE:
+			default:
+				text = ui_render_text (ui, &color_white,
+						"%s %u", metrics_get_name (i),
+						value.value);
+				break;
+		}
+
+		if (text == NULL) {
+			PSPLOG_ERROR ("failed to render text");
+			return -1;
+		}
+
+		if (ui->stats_lines[i])
+			SDL_FreeSurface (ui->stats_lines[i]);
+		ui->stats_lines[i] = text;
+		ui->stats_prev[i] = value.value;
+	}
+
+	ui->stats_refresh_time = now;
+
+	return 0;
+}
+
+/* draw statistics page, text is only rendered once per period */
+static int
+ui_stats_update (UI * ui)
+{
+	unsigned int now = platform_get_time ();
+	int rows = (UI_STATS_N + UI_STATS_COLUMNS - 1) / UI_STATS_COLUMNS;
+	SDL_Rect position;
+	int i;
+
+	if (now - ui->stats_refresh_time >= UI_STATS_PERIOD &&
+			ui_stats_refresh (ui, now) < 0)
+		return -1;
+
+	position.x = 0;
+	position.y = UI_LOG_CONSOLE_TOP;
+	SDL_BlitSurface (ui->stats_frame, NULL, ui->screen, &position);
+
+	for (i = 0; i < UI_STATS_N; i++) {
+		if (ui->stats_lines[i] == NULL)
+			continue;
+
+		position.x = (i / rows) * ui->screen->w / UI_STATS_COLUMNS;
+		position.y = UI_LOG_CONSOLE_TOP +
+			(i % rows) * TTF_FontLineSkip (ui->font);
+
+		if (SDL_BlitSurface (ui->stats_lines[i], NULL, ui->screen,
+					&position) < 0) {
+			PSPLOG_ERROR ("failed to blit text to screen");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+ui_flight_update (UI * ui, const DroneTelemetry * telemetry, int connected)
+{
+	SDL_Rect top_bar;
+	int ret;
+
+	/* clear screen */
+	SDL_FillRect (ui->screen, NULL,
+			SDL_MapRGB (ui->screen->format, 28, 142, 207));
+
+	/* draw top bar */
+	top_bar.x = 0;
+	top_bar.y = 0;
+	top_bar.w = ui->screen->w;
+	top_bar.h = 20;
+	SDL_FillRect (ui->screen, &top_bar,
+			SDL_MapRGB(ui->screen->format, 0, 0, 0));
+
+	ret = ui_flight_state_update (ui, telemetry->state, connected);
+
+	/* don't show stale telemetry as live once connection is lost */
+	if (connected) {
+		ret = ui_flight_battery_update (ui, telemetry->battery);
+		ret = ui_flight_altitude_update (ui, telemetry->altitude);
+		ret = ui_flight_gps_update (ui, telemetry);
+	}
+
+	if (ui->show_latency)
+		ret = ui_flight_latency_update (ui);
+
+	if (ui->show_stats)
+		ret = ui_stats_update (ui);
+
+	ui_save_finish (ui, 0);
+	if (capture_finish (0) > 0)
+		ui_notify (ui, "Capture saved");
+	if (flightrec_finish (0) > 0)
+		ui_notify (ui, "Flight recording saved");
+	ret = ui_notifications_update (ui);
+
+	return ret;
+}
+
+/* menus are kept below top bar with room for their frame */
+#define UI_MENU_MARGIN 25
+
+static Menu *
+ui_menu_new (UI * ui, int options)
 {
 	Menu *menu;
+
+	menu = menu_new (ui->font, options);
+	if (menu == NULL)
+		return NULL;
+
+	/* long menus scroll instead of running off screen */
+	menu_set_viewport_height (menu, ui->screen->h - 2 * UI_MENU_MARGIN);
+
+	return menu;
+}
+
+static void
+on_hull_switch_toggle (MenuSwitchEntry * entry, void * userdata)
+{
+	Drone *drone = (Drone *) userdata;
+	unsigned int value = menu_switch_entry_get_active (entry);
+
+	if (value != drone->info.hull)
+		drone_hull_set_active (drone, value);
+}
+
+static void
+on_outdoor_flight_switch_toggle (MenuSwitchEntry * entry, void * userdata)
+{
+	Drone *drone = (Drone *) userdata;
+	unsigned int value = menu_switch_entry_get_active (entry);
+
+	if (value != drone->info.outdoor)
+		drone_outdoor_flight_set_active (drone, value);
+}
+
+/* flight menus are stepped from flight loop, one at a time, so that piloting
+ * and flight ui keep running while a menu is shown */
+typedef enum
+{
+	UI_FLIGHT_MENU_NONE = 0,
+	UI_FLIGHT_MENU_MAIN,
+	UI_FLIGHT_MENU_PILOTING_SETTINGS,
+	UI_FLIGHT_MENU_CONTROLS_SETTINGS,
+	UI_FLIGHT_MENU_DRONE_INFO
+} UIFlightMenuId;
+
+/* enums of menus differ, compare them as int */
+#define UI_MAX(a, b) ((int) (a) > (int) (b) ? (int) (a) : (int) (b))
+
+/* number of entries of largest flight menu */
+#define UI_FLIGHT_MENU_MAX_ENTRIES \
+	UI_MAX (UI_MAX (FLIGHT_MAIN_MENU_N, PILOTING_SETTINGS_MENU_N), \
+			UI_MAX (CONTROLS_SETTINGS_N, DRONE_INFO_MENU_N))
+
+/* buttons used by menus and log console, they don't pilot while one is
+ * shown */
+#define UI_FLIGHT_MENU_BUTTONS (PLATFORM_BUTTON_UP | PLATFORM_BUTTON_DOWN | \
+		PLATFORM_BUTTON_LEFT | PLATFORM_BUTTON_RIGHT | \
+		PLATFORM_BUTTON_CROSS | PLATFORM_BUTTON_SQUARE)
+
+typedef struct _UIFlightMenu UIFlightMenu;
+
+struct _UIFlightMenu
+{
+	UIFlightMenuId id;
+	Menu *menu;
+
+	/* entries indexed by their id */
+	MenuEntry *entries[UI_FLIGHT_MENU_MAX_ENTRIES];
+
+	SDL_Surface *frame;
+	SDL_Rect frame_rect;
+	SDL_Rect position;
+
+	/* to restore selection when coming back to main menu */
+	int main_selected_id;
+};
+
+static void
+ui_flight_menu_add (UIFlightMenu * fm, int id, MenuEntry * entry)
+{
+	if (id < 0 || id >= UI_FLIGHT_MENU_MAX_ENTRIES) {
+		PSPLOG_ERROR ("invalid flight menu entry id %d", id);
+		return;
+	}
+
+	fm->entries[id] = entry;
+	menu_add_entry (fm->menu, entry);
+}
+
+static void
+ui_piloting_settings_menu_build (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	MenuSwitchEntry *hull_switch;
+	MenuSwitchEntry *outdoor_flight_switch;
+	MenuScaleEntry *altitude_limit_scale;
+	MenuScaleEntry *vertical_limit_scale;
+	MenuScaleEntry *rotation_limit_scale;
+	MenuScaleEntry *tilt_limit_scale;
+
+	/* hull presence selection */
+	hull_switch = menu_switch_entry_new (fm->menu,
+			PILOTING_SETTINGS_MENU_HULL, "Hull set");
+	menu_switch_entry_set_values_labels (hull_switch, "no", "yes");
+	menu_switch_entry_set_active (hull_switch, drone->info.hull);
+	menu_switch_entry_set_toggled_callback (hull_switch,
+			on_hull_switch_toggle, drone);
+
+	/* outdoor flight */
+	outdoor_flight_switch =
+		menu_switch_entry_new (fm->menu,
+				PILOTING_SETTINGS_MENU_OUTDOOR_FLIGHT,
+				"outdoor flight");
+	menu_switch_entry_set_values_labels (outdoor_flight_switch, "no", "yes");
+	menu_switch_entry_set_active (outdoor_flight_switch, drone->info.outdoor);
+	menu_switch_entry_set_toggled_callback (outdoor_flight_switch,
+			on_outdoor_flight_switch_toggle, drone);
+
+	/* altitude limit settings */
+	altitude_limit_scale =
+		menu_scale_entry_new (fm->menu,
+				PILOTING_SETTINGS_MENU_ALTITUDE_LIMIT,
+				"altitude limit (m)",
+				drone->info.altitude_limit.min,
+				drone->info.altitude_limit.max);
+	menu_scale_entry_set_value (altitude_limit_scale,
+			drone->info.altitude_limit.current);
+
+	/* vertical speed limit settings */
+	vertical_limit_scale =
+		menu_scale_entry_new (fm->menu,
+				PILOTING_SETTINGS_MENU_VERTICAL_SPEED_LIMIT,
+				"vertical speed limit (m/s)",
+				drone->info.vertical_speed_limit.min,
+				drone->info.vertical_speed_limit.max);
+	menu_scale_entry_set_value (vertical_limit_scale,
+			drone->info.vertical_speed_limit.current);
+
+	/* rotation speed limit settings */
+	rotation_limit_scale =
+		menu_scale_entry_new (fm->menu,
+				PILOTING_SETTINGS_MENU_ROTATION_SPEED_LIMIT,
+				"rotation speed limit (deg/s)",
+				drone->info.rotation_speed_limit.min,
+				drone->info.rotation_speed_limit.max);
+	menu_scale_entry_set_value (rotation_limit_scale,
+			drone->info.rotation_speed_limit.current);
+
+	/* rotation speed limit settings */
+	tilt_limit_scale =
+		menu_scale_entry_new (fm->menu, PILOTING_SETTINGS_MENU_TILT_LIMIT,
+				"tilt limit (deg)",
+				drone->info.tilt_limit.min,
+				drone->info.tilt_limit.max);
+	menu_scale_entry_set_value (tilt_limit_scale,
+			drone->info.tilt_limit.current);
+
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_HULL,
+			(MenuEntry *) hull_switch);
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_OUTDOOR_FLIGHT,
+			(MenuEntry *) outdoor_flight_switch);
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_ALTITUDE_LIMIT,
+			(MenuEntry *) altitude_limit_scale);
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_VERTICAL_SPEED_LIMIT,
+			(MenuEntry *) vertical_limit_scale);
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_ROTATION_SPEED_LIMIT,
+			(MenuEntry *) rotation_limit_scale);
+	ui_flight_menu_add (fm, PILOTING_SETTINGS_MENU_TILT_LIMIT,
+			(MenuEntry *) tilt_limit_scale);
+}
+
+static void
+ui_piloting_settings_menu_sync (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	/* sync option with drone */
+	menu_switch_entry_set_active (
+			(MenuSwitchEntry *) fm->entries[PILOTING_SETTINGS_MENU_HULL],
+			drone->info.hull);
+	menu_switch_entry_set_active ((MenuSwitchEntry *)
+			fm->entries[PILOTING_SETTINGS_MENU_OUTDOOR_FLIGHT],
+			drone->info.outdoor);
+}
+
+static void
+ui_piloting_settings_menu_apply (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	/* send new scale entries value to drone, not done in callback
+	 * to avoid flooding drone and because it can't work well in our side
+	 * due to local update and callback for drones for previously sent
+	 * values. */
+	drone_altitude_limit_set (drone,
+			menu_scale_entry_get_value ((MenuScaleEntry *)
+				fm->entries[PILOTING_SETTINGS_MENU_ALTITUDE_LIMIT]));
+	drone_vertical_speed_limit_set (drone,
+			menu_scale_entry_get_value ((MenuScaleEntry *)
+				fm->entries[PILOTING_SETTINGS_MENU_VERTICAL_SPEED_LIMIT]));
+	drone_rotation_speed_limit_set (drone,
+			menu_scale_entry_get_value ((MenuScaleEntry *)
+				fm->entries[PILOTING_SETTINGS_MENU_ROTATION_SPEED_LIMIT]));
+	drone_max_tilt_set (drone,
+			menu_scale_entry_get_value ((MenuScaleEntry *)
+				fm->entries[PILOTING_SETTINGS_MENU_TILT_LIMIT]));
+}
+
+static void
+ui_controls_settings_menu_build (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	MenuScaleEntry *yaw_scale;
+	MenuScaleEntry *pitch_scale;
+	MenuScaleEntry *roll_scale;
+	MenuScaleEntry *gaz_scale;
+	MenuComboBoxEntry *select_binding;
+	MenuComboBoxEntry *analog_mode;
+	MenuScaleEntry *deadzone_scale;
+	MenuScaleEntry *expo_scale;
+
+	yaw_scale = menu_scale_entry_new (fm->menu, CONTROLS_SETTINGS_YAW,
+			"yaw", 0, 100);
+	menu_scale_entry_set_value (yaw_scale, ui->setting_yaw);
+
+	pitch_scale = menu_scale_entry_new (fm->menu, CONTROLS_SETTINGS_PITCH,
+			"pitch", 0, 100);
+	menu_scale_entry_set_value (pitch_scale, ui->setting_pitch);
+
+	roll_scale = menu_scale_entry_new (fm->menu, CONTROLS_SETTINGS_ROLL,
+			"roll", 0, 100);
+	menu_scale_entry_set_value (roll_scale, ui->setting_roll);
+
+	gaz_scale = menu_scale_entry_new (fm->menu, CONTROLS_SETTINGS_GAZ,
+			"gaz", 0, 100);
+	menu_scale_entry_set_value (gaz_scale, ui->setting_gaz);
+
+	select_binding =
+		menu_combo_box_entry_new (fm->menu,
+				CONTROLS_SETTINGS_SELECT_BINDING,
+				"select binding");
+	menu_combo_box_entry_append (select_binding, SELECT_BIND_TAKE_PICTURE,
+			"take picture");
+	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_FRONT,
+			"front flip");
+	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_BACK,
+			"back flip");
+	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_LEFT,
+			"left flip");
+	menu_combo_box_entry_append (select_binding, SELECT_BIND_FLIP_RIGHT,
+			"right flip");
+	menu_combo_box_entry_set_value (select_binding,
+			ui->setting_select_binding);
+
+	analog_mode = menu_combo_box_entry_new (fm->menu,
+			CONTROLS_SETTINGS_ANALOG_MODE, "analog stick");
+	menu_combo_box_entry_append (analog_mode, ANALOG_MODE_OFF, "off");
+	menu_combo_box_entry_append (analog_mode, ANALOG_MODE_ROLL_PITCH,
+			"roll/pitch");
+	menu_combo_box_entry_append (analog_mode, ANALOG_MODE_YAW_GAZ,
+			"yaw/gaz");
+	menu_combo_box_entry_set_value (analog_mode, ui->setting_analog_mode);
+
+	deadzone_scale = menu_scale_entry_new (fm->menu,
+			CONTROLS_SETTINGS_ANALOG_DEADZONE, "stick deadzone (%)",
+			0, 50);
+	menu_scale_entry_set_value (deadzone_scale,
+			ui->setting_analog_deadzone);
+
+	expo_scale = menu_scale_entry_new (fm->menu,
+			CONTROLS_SETTINGS_ANALOG_EXPO, "stick expo (%)", 0, 100);
+	menu_scale_entry_set_value (expo_scale, ui->setting_analog_expo);
+
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_YAW, (MenuEntry *) yaw_scale);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_PITCH,
+			(MenuEntry *) pitch_scale);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_ROLL,
+			(MenuEntry *) roll_scale);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_GAZ, (MenuEntry *) gaz_scale);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_SELECT_BINDING,
+			(MenuEntry *) select_binding);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_ANALOG_MODE,
+			(MenuEntry *) analog_mode);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_ANALOG_DEADZONE,
+			(MenuEntry *) deadzone_scale);
+	ui_flight_menu_add (fm, CONTROLS_SETTINGS_ANALOG_EXPO,
+			(MenuEntry *) expo_scale);
+}
+
+static void
+ui_controls_settings_menu_apply (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	MenuEntry **entries = fm->entries;
+
+	/* store value to ui */
+	ui->setting_yaw = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_YAW]);
+	ui->setting_pitch = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_PITCH]);
+	ui->setting_roll = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_ROLL]);
+	ui->setting_gaz = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_GAZ]);
+	ui->setting_select_binding = menu_combo_box_entry_get_value (
+			(MenuComboBoxEntry *)
+			entries[CONTROLS_SETTINGS_SELECT_BINDING]);
+	ui->setting_analog_mode = menu_combo_box_entry_get_value (
+			(MenuComboBoxEntry *) entries[CONTROLS_SETTINGS_ANALOG_MODE]);
+	ui->setting_analog_deadzone = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_ANALOG_DEADZONE]);
+	ui->setting_analog_expo = menu_scale_entry_get_value (
+			(MenuScaleEntry *) entries[CONTROLS_SETTINGS_ANALOG_EXPO]);
+	ui_analog_curves_update (ui);
+}
+
+static void
+ui_drone_info_menu_build (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	MenuLabelEntry *drone_sw;
+	MenuLabelEntry *drone_hw;
+	MenuLabelEntry *arcommand_version;
+	char tmp[128] = { 0, };
+
+	snprintf (tmp, 127, "Drone HW: %s", drone->info.hardware_version);
+	drone_hw = menu_label_entry_new (fm->menu, DRONE_INFO_MENU_DRONE_HW,
+			tmp);
+
+	snprintf (tmp, 127, "Drone SW: %s", drone->info.software_version);
+	drone_sw = menu_label_entry_new (fm->menu, DRONE_INFO_MENU_DRONE_SW,
+			tmp);
+
+	snprintf (tmp, 127, "Protocol version: %s",
+			drone->info.arcommand_version);
+	arcommand_version =
+		menu_label_entry_new (fm->menu,
+				DRONE_INFO_MENU_ARCOMMAND_VERSION, tmp);
+
+	ui_flight_menu_add (fm, DRONE_INFO_MENU_DRONE_HW,
+			(MenuEntry *) drone_hw);
+	ui_flight_menu_add (fm, DRONE_INFO_MENU_DRONE_SW,
+			(MenuEntry *) drone_sw);
+	ui_flight_menu_add (fm, DRONE_INFO_MENU_ARCOMMAND_VERSION,
+			(MenuEntry *) arcommand_version);
+}
+
+static void
+ui_flight_main_menu_build (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
 	MenuButtonEntry *quit;
 	MenuButtonEntry *flat_trim;
 	MenuButtonEntry *piloting_settings;
 	MenuButtonEntry *controls_settings;
 	MenuButtonEntry *drone_info;
-	SDL_Rect position;
-	SDL_Surface *frame;
-	SDL_Rect menu_frame;
-	int selected_id = -1;
-	MenuState submenu_state;
-
-	menu = menu_new (ui->font, MENU_CANCEL_ON_START | MENU_BACK_ON_CIRCLE);
-
-	quit = menu_button_entry_new (FLIGHT_MAIN_MENU_QUIT,
+	MenuButtonEntry *latency_overlay;
+	MenuButtonEntry *latency_save;
+	MenuButtonEntry *log_console;
+	MenuButtonEntry *stats;
+	MenuButtonEntry *trace;
+	MenuButtonEntry *capture;
+	MenuButtonEntry *flightrec;
+
+	quit = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_QUIT,
 			"Return to main menu");
-	flat_trim = menu_button_entry_new (FLIGHT_MAIN_MENU_FLAT_TRIM,
+	flat_trim = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_FLAT_TRIM,
 			"Do flat trim");
-	piloting_settings = menu_button_entry_new (
+	piloting_settings = menu_button_entry_new (fm->menu,
 			FLIGHT_MAIN_MENU_PILOTING_SETTINGS,
 			"Piloting settings");
-	controls_settings =
-		menu_button_entry_new (FLIGHT_MAIN_MENU_CONTROLS_SETTINGS,
+	controls_settings = menu_button_entry_new (fm->menu,
+			FLIGHT_MAIN_MENU_CONTROLS_SETTINGS,
 			"Controls settings");
-	drone_info = menu_button_entry_new (FLIGHT_MAIN_MENU_DRONE_INFO,
-			"Drone information");
+	drone_info = menu_button_entry_new (fm->menu,
+			FLIGHT_MAIN_MENU_DRONE_INFO, "Drone information");
+	latency_overlay = menu_button_entry_new (fm->menu,
+			FLIGHT_MAIN_MENU_LATENCY_OVERLAY,
+			"Toggle latency overlay");
+	latency_save = menu_button_entry_new (fm->menu,
+			FLIGHT_MAIN_MENU_LATENCY_DUMP,
+			"Save latency statistics");
+	log_console = menu_button_entry_new (fm->menu,
+			FLIGHT_MAIN_MENU_LOG_CONSOLE, "Show log console");
+	stats = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_STATS,
+			"Toggle statistics page");
+	trace = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_TRACE,
+			trace_is_recording () ? "Save trace" : "Record trace");
+	capture = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_CAPTURE,
+			capture_is_recording () ? "Stop capture" : "Record capture");
+	flightrec = menu_button_entry_new (fm->menu, FLIGHT_MAIN_MENU_FLIGHTREC,
+			flightrec_is_recording () ? "Stop flight recorder" :
+			"Start flight recorder");
+
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_FLAT_TRIM,
+			(MenuEntry *) flat_trim);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_PILOTING_SETTINGS,
+			(MenuEntry *) piloting_settings);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_CONTROLS_SETTINGS,
+			(MenuEntry *) controls_settings);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_DRONE_INFO,
+			(MenuEntry *) drone_info);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_LATENCY_OVERLAY,
+			(MenuEntry *) latency_overlay);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_LATENCY_DUMP,
+			(MenuEntry *) latency_save);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_LOG_CONSOLE,
+			(MenuEntry *) log_console);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_STATS, (MenuEntry *) stats);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_TRACE, (MenuEntry *) trace);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_CAPTURE, (MenuEntry *) capture);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_FLIGHTREC,
+			(MenuEntry *) flightrec);
+	ui_flight_menu_add (fm, FLIGHT_MAIN_MENU_QUIT, (MenuEntry *) quit);
+
+	if (fm->main_selected_id >= 0 && fm->entries[fm->main_selected_id])
+		menu_select_entry (fm->menu,
+				fm->entries[fm->main_selected_id]);
+}
 
-	menu_add_entry (menu, (MenuEntry *) flat_trim);
-	menu_add_entry (menu, (MenuEntry *) piloting_settings);
-	menu_add_entry (menu, (MenuEntry *) controls_settings);
-	menu_add_entry (menu, (MenuEntry *) drone_info);
-	menu_add_entry (menu, (MenuEntry *) quit);
+/* apply shown menu values and release it */
+static void
+ui_flight_menu_close (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	switch (fm->id) {
+		case UI_FLIGHT_MENU_PILOTING_SETTINGS:
+			ui_piloting_settings_menu_apply (ui, drone, fm);
+			break;
 
-	/* center position in screen */
-	position.x = (ui->screen->w - menu_get_width (menu)) / 2;
-	position.y = (ui->screen->h - menu_get_height (menu)) / 2;
+		case UI_FLIGHT_MENU_CONTROLS_SETTINGS:
+			ui_controls_settings_menu_apply (ui, drone, fm);
+			break;
 
-	/* to fill a rectangle in background to delimitate menu */
-	menu_frame.x = position.x - 5;
-	menu_frame.y = position.y - 5;
-	menu_frame.w = menu_get_width (menu) + 10;
-	menu_frame.h = menu_get_height (menu) + 10;
-	frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCCOLORKEY | SDL_SRCALPHA,
-			menu_frame.w, menu_frame.h, 32, 0, 0, 0, 0);
-	SDL_FillRect (frame, NULL, SDL_MapRGB (frame->format, 0, 0, 0));
-	SDL_SetAlpha (frame, SDL_SRCALPHA, 200);
+		default:
+			break;
+	}
 
-mm_display:
-	while (running) {
-		MenuCloseResult res;
+	if (fm->frame)
+		SDL_FreeSurface (fm->frame);
 
-		selected_id = -1;
-		/*redraw flight ui */
-		ui_flight_update(ui, drone);
+	if (fm->menu)
+		menu_free (fm->menu);
 
-		switch (menu_update (menu)) {
-			case MENU_STATE_CLOSE:
-				selected_id = menu_get_selected_id (menu);
-				res = menu_get_close_result (menu);
+	fm->id = UI_FLIGHT_MENU_NONE;
+	fm->menu = NULL;
+	fm->frame = NULL;
+	memset (fm->entries, 0, sizeof (fm->entries));
+}
 
-				if (res == MENU_CLOSE_RESULT_BACK)
-					selected_id = -1;
-				goto done;
-				break;
+/* replace shown menu, if any, by the given one */
+static int
+ui_flight_menu_open (UI * ui, Drone * drone, UIFlightMenu * fm,
+		UIFlightMenuId id)
+{
+	ui_flight_menu_close (ui, drone, fm);
 
-			case MENU_STATE_VISIBLE:
-				SDL_BlitSurface (frame, NULL, ui->screen,
-						&menu_frame);
-				menu_render_to (menu, ui->screen, &position);
-				sceDisplayWaitVblankStart ();
-				SDL_Flip (ui->screen);
-				break;
+	fm->menu = ui_menu_new (ui, MENU_CANCEL_ON_START | MENU_BACK_ON_SQUARE);
+	if (fm->menu == NULL)
+		goto no_menu;
 
-			case MENU_STATE_CANCELLED:
-			default:
-				goto done;
-		}
+	switch (id) {
+		case UI_FLIGHT_MENU_MAIN:
+			ui_flight_main_menu_build (ui, drone, fm);
+			break;
+
+		case UI_FLIGHT_MENU_PILOTING_SETTINGS:
+			ui_piloting_settings_menu_build (ui, drone, fm);
+			break;
+
+		case UI_FLIGHT_MENU_CONTROLS_SETTINGS:
+			ui_controls_settings_menu_build (ui, drone, fm);
+			break;
+
+		case UI_FLIGHT_MENU_DRONE_INFO:
+			ui_drone_info_menu_build (ui, drone, fm);
+			break;
+
+		default:
+			goto no_menu;
 	}
 
-done:
+	fm->id = id;
+
+	/* center position in screen */
+	fm->position.x = (ui->screen->w - menu_get_width (fm->menu)) / 2;
+	fm->position.y = (ui->screen->h - menu_get_height (fm->menu)) / 2;
+
+	/* to fill a rectangle in background to delimitate menu */
+	fm->frame_rect.x = fm->position.x - 5;
+	fm->frame_rect.y = fm->position.y - 5;
+	fm->frame_rect.w = menu_get_width (fm->menu) + 10;
+	fm->frame_rect.h = menu_get_height (fm->menu) + 10;
+	fm->frame = SDL_CreateRGBSurface (SDL_HWSURFACE | SDL_SRCCOLORKEY |
+			SDL_SRCALPHA, fm->frame_rect.w, fm->frame_rect.h, 32,
+			0, 0, 0, 0);
+	if (fm->frame == NULL)
+		goto no_frame;
+
+	SDL_FillRect (fm->frame, NULL, SDL_MapRGB (fm->frame->format, 0, 0, 0));
+	SDL_SetAlpha (fm->frame, SDL_SRCALPHA, 200);
+
+	return 0;
+
+no_menu:
+	PSPLOG_ERROR ("failed to create flight menu %d", id);
+	ui_flight_menu_close (ui, drone, fm);
+	return -1;
+
+no_frame:
+	PSPLOG_ERROR ("failed to create flight menu frame");
+	ui_flight_menu_close (ui, drone, fm);
+	return -1;
+}
+
+/* main menu button activated, return 1 to leave flight ui */
+static int
+ui_flight_main_menu_activate (UI * ui, Drone * drone, UIFlightMenu * fm)
+{
+	int selected_id = menu_get_selected_id (fm->menu);
+
+	fm->main_selected_id = selected_id;
+
 	switch (selected_id) {
+		case FLIGHT_MAIN_MENU_QUIT:
+			ui_flight_menu_close (ui, drone, fm);
+			return 1;
+
 		case FLIGHT_MAIN_MENU_FLAT_TRIM:
 			drone_flat_trim (drone);
-			submenu_state = MENU_STATE_CLOSE;
+			ui_notify (ui, "Flat trim requested");
 			break;
 
 		case FLIGHT_MAIN_MENU_PILOTING_SETTINGS:
-			submenu_state = ui_piloting_settings_menu (ui, drone);
+			ui_flight_menu_open (ui, drone, fm,
+					UI_FLIGHT_MENU_PILOTING_SETTINGS);
 			break;
 
 		case FLIGHT_MAIN_MENU_CONTROLS_SETTINGS:
-			submenu_state = ui_controls_settings_menu (ui, drone);
+			ui_flight_menu_open (ui, drone, fm,
+					UI_FLIGHT_MENU_CONTROLS_SETTINGS);
 			break;
 
 		case FLIGHT_MAIN_MENU_DRONE_INFO:
-			submenu_state = ui_drone_info_menu (ui, drone);
+			ui_flight_menu_open (ui, drone, fm,
+					UI_FLIGHT_MENU_DRONE_INFO);
+			break;
+
+		case FLIGHT_MAIN_MENU_LATENCY_OVERLAY:
+			ui->show_latency = !ui->show_latency;
+			ui_flight_menu_close (ui, drone, fm);
+			break;
+
+		case FLIGHT_MAIN_MENU_LATENCY_DUMP:
+			ui_save_start (ui, latency_dump, UI_LATENCY_DUMP_PATH,
+					"Latency statistics saved",
+					"Failed to save latency statistics");
+			break;
+
+		case FLIGHT_MAIN_MENU_LOG_CONSOLE:
+			ui_flight_menu_close (ui, drone, fm);
+			ui_log_console_open (ui);
+			break;
+
+		case FLIGHT_MAIN_MENU_STATS:
+			if (ui->show_stats)
+				ui_stats_close (ui);
+			else
+				ui_stats_open (ui);
+			ui_flight_menu_close (ui, drone, fm);
+			break;
+
+		case FLIGHT_MAIN_MENU_TRACE:
+			ui_flight_menu_close (ui, drone, fm);
+			/* rings must not be reset while a trace is written */
+			if (ui_save_is_busy (ui))
+				break;
+
+			if (!trace_is_recording ()) {
+				trace_start ();
+				break;
+			}
+
+			/* stop now so that menu offers to record again */
+			trace_stop ();
+			ui_save_start (ui, trace_dump, UI_TRACE_DUMP_PATH,
+					"Trace saved", "Failed to save trace");
+			break;
+
+		case FLIGHT_MAIN_MENU_CAPTURE:
+			ui_flight_menu_close (ui, drone, fm);
+			/* writer saves and closes file, ui_flight_update ()
+			 * notifies once it is done */
+			if (capture_is_recording ())
+				capture_stop ();
+			else if (capture_finish (0) < 0)
+				ui_notify (ui,
+						"Previous capture still being saved");
+			else if (capture_start (UI_CAPTURE_PATH) == 0)
+				ui_notify (ui, "Recording capture");
+			else
+				ui_notify (ui, "Failed to start capture");
+			break;
+
+		case FLIGHT_MAIN_MENU_FLIGHTREC:
+			ui_flight_menu_close (ui, drone, fm);
+			if (flightrec_is_recording ())
+				flightrec_stop ();
+			else if (flightrec_finish (0) < 0)
+				ui_notify (ui,
+						"Previous flight recording still being saved");
+			else if (flightrec_start (UI_FLIGHTREC_PATH) == 0)
+				ui_notify (ui, "Recording flight");
+			else
+				ui_notify (ui, "Failed to start flight recorder");
 			break;
 
 		default:
-			submenu_state = MENU_STATE_CANCELLED;
 			break;
 	}
 
-	if (submenu_state == MENU_STATE_CLOSE)
-		goto mm_display;
+	return 0;
+}
+
+/* feed a button press to shown menu, return 1 to leave flight ui */
+static int
+ui_flight_menu_handle_press (UI * ui, Drone * drone, UIFlightMenu * fm,
+		const InputEvent * event)
+{
+	switch (menu_handle_press (fm->menu, event->button, event->timestamp)) {
+		case MENU_STATE_VISIBLE:
+			break;
 
-	menu_free (menu);
-	return selected_id;
+		case MENU_STATE_CLOSE:
+			/* back from a submenu goes to main menu */
+			if (fm->id != UI_FLIGHT_MENU_MAIN)
+				ui_flight_menu_open (ui, drone, fm,
+						UI_FLIGHT_MENU_MAIN);
+			else if (menu_get_close_result (fm->menu) ==
+					MENU_CLOSE_RESULT_BACK)
+				ui_flight_menu_close (ui, drone, fm);
+			else
+				return ui_flight_main_menu_activate (ui, drone,
+						fm);
+			break;
+
+		case MENU_STATE_CANCELLED:
+		default:
+			ui_flight_menu_close (ui, drone, fm);
+			break;
+	}
+
+	return 0;
+}
+
+/* step shown menu for a frame and draw it over flight ui */
+static void
+ui_flight_menu_update (UI * ui, Drone * drone, UIFlightMenu * fm,
+		const PlatformPad * pad)
+{
+	if (fm->id == UI_FLIGHT_MENU_NONE)
+		return;
+
+	menu_handle_held (fm->menu, pad);
+
+	if (fm->id == UI_FLIGHT_MENU_PILOTING_SETTINGS)
+		ui_piloting_settings_menu_sync (ui, drone, fm);
+
+	SDL_BlitSurface (fm->frame, NULL, ui->screen, &fm->frame_rect);
+	menu_render_to (fm->menu, ui->screen, &fm->position);
 }
 
 int
@@ -788,14 +1652,29 @@ ui_init (UI * ui, int width, int height)
 		goto no_font;
 
 	/* initialize controller */
-	sceCtrlSetSamplingCycle (0); /* in ms: 0=VSYNC */
-	sceCtrlSetSamplingMode (PSP_CTRL_MODE_ANALOG);
+	if (input_init () < 0)
+		goto no_input;
 
 	ui->setting_yaw = 50;
 	ui->setting_pitch = 50;
 	ui->setting_roll = 50;
 	ui->setting_gaz = 75;
 	ui->setting_select_binding = SELECT_BIND_TAKE_PICTURE;
+	ui->setting_analog_mode = ANALOG_MODE_ROLL_PITCH;
+	ui->setting_analog_deadzone = 15;
+	ui->setting_analog_expo = 30;
+	ui->show_latency = 0;
+	ui->n_notifications = 0;
+	memset (ui->notifications, 0, sizeof (ui->notifications));
+	ui->show_log_console = 0;
+	ui->log_console_scroll = 0;
+	ui->log_console_frame = NULL;
+	memset (ui->log_console_lines, 0, sizeof (ui->log_console_lines));
+	ui->show_stats = 0;
+	ui->stats_frame = NULL;
+	memset (ui->stats_lines, 0, sizeof (ui->stats_lines));
+	ui->save_thread = -1;
+	ui_analog_curves_update (ui);
 
 	return 0;
 
@@ -806,11 +1685,20 @@ no_screen:
 no_font:
 	PSPLOG_ERROR ("failed to open font");
 	return -1;
+
+no_input:
+	PSPLOG_ERROR ("failed to initialize input");
+	TTF_CloseFont (ui->font);
+	ui->font = NULL;
+	return -1;
 }
 
 void
 ui_deinit(UI * ui)
 {
+	ui_notify_clear (ui);
+	input_deinit ();
+
 	if (ui->font)
 		TTF_CloseFont (ui->font);
 }
@@ -823,7 +1711,6 @@ ui_main_menu_run (UI * ui)
 	MenuButtonEntry *exit_button;
 	SDL_Surface *screen = ui->screen;
 	SDL_Surface *title;
-	TTF_Font *font = ui->font;
 	SDL_Rect position;
 	SDL_Rect title_position;
 	SDL_Surface *frame;
@@ -835,10 +1722,10 @@ ui_main_menu_run (UI * ui)
 	title_position.x = (screen->w - title->w) / 2;
 	title_position.y = 20;
 
-	main_menu = menu_new (font, 0);
-	connect_button = menu_button_entry_new (MAIN_MENU_CONNECT,
-			"Connect to drone");
-	exit_button = menu_button_entry_new (MAIN_MENU_EXIT, "Exit");
+	main_menu = ui_menu_new (ui, 0);
+	connect_button = menu_button_entry_new (main_menu,
+			MAIN_MENU_CONNECT, "Connect to drone");
+	exit_button = menu_button_entry_new (main_menu, MAIN_MENU_EXIT, "Exit");
 
 	menu_add_entry (main_menu, (MenuEntry *) connect_button);
 	menu_add_entry (main_menu, (MenuEntry *) exit_button);
@@ -870,7 +1757,7 @@ ui_main_menu_run (UI * ui)
 				SDL_BlitSurface (title, NULL, screen, &title_position);
 				SDL_BlitSurface (frame, NULL, screen, &menu_frame);
 				menu_render_to (main_menu, screen, &position);
-				sceDisplayWaitVblankStart ();
+				platform_wait_vblank ();
 				SDL_Flip (screen);
 				break;
 		}
@@ -878,6 +1765,7 @@ ui_main_menu_run (UI * ui)
 
 done:
 	SDL_FreeSurface (frame);
+	SDL_FreeSurface (title);
 	menu_free (main_menu);
 	return selected_id;
 }
@@ -888,256 +1776,256 @@ done:
 int
 ui_network_dialog_run (UI * ui)
 {
-	pspUtilityNetconfData conf;
-	struct pspUtilityNetconfAdhoc adhoc_params;
-	unsigned int swap_count = 0;
-	SceCtrlLatch latch;
-
-	memset(&conf, 0, sizeof (conf));
-	memset(&adhoc_params, 0, sizeof (adhoc_params));
-
-	conf.base.size = sizeof (conf);
-	conf.base.language = PSP_SYSTEMPARAM_LANGUAGE_ENGLISH;
-	conf.base.buttonSwap = PSP_UTILITY_ACCEPT_CROSS;
+	int ret = platform_network_dialog_run ();
 
-	/* Thread priorities */
-	conf.base.graphicsThread = 17;
-	conf.base.accessThread = 19;
-	conf.base.fontThread = 18;
-	conf.base.soundThread = 16;
+	/* buttons pressed while dialog had focus were meant for it */
+	input_flush ();
 
-	conf.action = PSP_NETCONF_ACTION_CONNECTAP;
-	conf.adhocparam = &adhoc_params;
-
-	sceUtilityNetconfInitStart (&conf);
-
-	while (running) {
-		int done = 0;
-
-		/* directly use GU to avoid flickering with SDL */
-		sceGuStart (GU_DIRECT, list);
-		sceGuClearColor (0xff554433);
-		sceGuClearDepth (0);
-		sceGuClear (GU_COLOR_BUFFER_BIT|GU_DEPTH_BUFFER_BIT);
-		sceGuFinish ();
-		sceGuSync (0,0);
-
-		switch (sceUtilityNetconfGetStatus ()) {
-			case PSP_UTILITY_DIALOG_NONE:
-				break;
+	return ret;
+}
 
-			case PSP_UTILITY_DIALOG_VISIBLE:
-				sceUtilityNetconfUpdate (1);
-				break;
+void
+ui_msg_dialog (UI * ui, const char * msg)
+{
+	platform_msg_dialog (msg);
 
-			case PSP_UTILITY_DIALOG_QUIT:
-				sceUtilityNetconfShutdownStart ();
-				break;
+	/* buttons pressed while dialog had focus were meant for it */
+	input_flush ();
+}
 
-			case PSP_UTILITY_DIALOG_FINISHED:
-				done = 1;
+/* handle a button press event, return 1 to leave flight ui */
+static int
+ui_flight_handle_press (UI * ui, Drone * drone, UIFlightMenu * fm,
+		const DroneTelemetry * telemetry, const InputEvent * event)
+{
+	int is_flying = (telemetry->state == DRONE_STATE_TAKING_OFF) ||
+		(telemetry->state == DRONE_STATE_FLYING);
+
+	/* emergency and takeoff/landing are always available, even with a
+	 * menu shown */
+	switch (event->button) {
+		case PLATFORM_BUTTON_TRIANGLE:
+			if (!drone->connected)
 				break;
 
-			default:
-				break;
-		}
+			if (is_flying)
+				drone_landing (drone);
+			else
+				drone_takeoff (drone);
+			return 0;
 
-		sceDisplayWaitVblankStart ();
-		sceGuSwapBuffers ();
-		swap_count++;
+		case PLATFORM_BUTTON_CIRCLE:
+			if (drone->connected)
+				drone_emergency (drone);
+			return 0;
 
-		if (done)
+		default:
 			break;
 	}
 
-	/* hack for SDL compatibility.
-	 * if it end up on an odd buffer, SDL won't be displayed.
-	 * ie SDL will display in an hidden buffer
-	 */
-	if (swap_count & 1)
-		sceGuSwapBuffers ();
-
-	/* message dialog seems to causes strange latch behavior, next read
-	 * of latch will contains all button pressed during dialog.
-	 * read one to reset it */
-	sceCtrlReadLatch (&latch);
+	if (fm->id != UI_FLIGHT_MENU_NONE)
+		return ui_flight_menu_handle_press (ui, drone, fm, event);
 
-	return conf.base.result;
-}
-
-void
-ui_msg_dialog (UI * ui, const char * msg)
-{
-	pspUtilityMsgDialogParams params;
-	unsigned int swap_count = 0;
-	SceCtrlLatch latch;
-
-	memset (&params, 0, sizeof (params));
-
-	params.base.size = sizeof (params);
-	params.base.language = PSP_SYSTEMPARAM_LANGUAGE_ENGLISH;
-	params.base.buttonSwap = PSP_UTILITY_ACCEPT_CROSS;
-
-	/* Thread priorities */
-	params.base.graphicsThread = 17;
-	params.base.accessThread = 19;
-	params.base.fontThread = 18;
-	params.base.soundThread = 16;
-
-	params.mode = PSP_UTILITY_MSGDIALOG_MODE_TEXT;
-	params.options = PSP_UTILITY_MSGDIALOG_OPTION_TEXT;
-	snprintf (params.message, 512, msg);
-
-	sceUtilityMsgDialogInitStart (&params);
+	if (ui->show_log_console) {
+		ui_log_console_handle_press (ui, event);
+		return 0;
+	}
 
-	while (running) {
-		int done = 0;
-
-		/* directly use GU to avoid flickering with SDL */
-		sceGuStart (GU_DIRECT, list);
-		sceGuClearColor (0xff554433);
-		sceGuClearDepth (0);
-		sceGuClear (GU_COLOR_BUFFER_BIT|GU_DEPTH_BUFFER_BIT);
-		sceGuFinish ();
-		sceGuSync (0,0);
-
-		switch (sceUtilityMsgDialogGetStatus ()) {
-			case PSP_UTILITY_DIALOG_NONE:
-				break;
-			case PSP_UTILITY_DIALOG_VISIBLE:
-				sceUtilityMsgDialogUpdate (1);
-				break;
-			case PSP_UTILITY_DIALOG_QUIT:
-				sceUtilityMsgDialogShutdownStart ();
-				break;
-			case PSP_UTILITY_DIALOG_FINISHED:
-				done = 1;
+	switch (event->button) {
+		case PLATFORM_BUTTON_SELECT:
+			if (!drone->connected)
 				break;
-			default:
-				break;
-		}
 
-		sceDisplayWaitVblankStart ();
-		sceGuSwapBuffers ();
-		swap_count++;
+			switch (ui->setting_select_binding) {
+				case SELECT_BIND_TAKE_PICTURE:
+					drone_take_picture (drone);
+					break;
+				case SELECT_BIND_FLIP_FRONT:
+					drone_do_flip (drone, DRONE_FLIP_FRONT);
+					break;
+				case SELECT_BIND_FLIP_BACK:
+					drone_do_flip (drone, DRONE_FLIP_BACK);
+					break;
+				case SELECT_BIND_FLIP_RIGHT:
+					drone_do_flip (drone, DRONE_FLIP_RIGHT);
+					break;
+				case SELECT_BIND_FLIP_LEFT:
+					drone_do_flip (drone, DRONE_FLIP_LEFT);
+					break;
+				default:
+					break;
+			}
+			break;
+
+		case PLATFORM_BUTTON_START:
+			ui_flight_menu_open (ui, drone, fm, UI_FLIGHT_MENU_MAIN);
+			break;
 
-		if (done)
+		default:
 			break;
 	}
 
-	/* hack for SDL compatibility.
-	 * if it end up on an odd buffer, SDL won't be displayed.
-	 * ie SDL will display in an hidden buffer
-	 */
-	if (swap_count & 1)
-		sceGuSwapBuffers ();
-
-	/* message dialog seems to causes strange latch behavior, next read
-	 * of latch will contains all button pressed during dialog.
-	 * read one to reset it */
-	sceCtrlReadLatch (&latch);
+	return 0;
 }
 
 int
 ui_flight_run (UI * ui, Drone * drone)
 {
+	UIFlightMenu flight_menu;
+	unsigned int frame_time = 0;
+	unsigned int disconnect_time = 0;
 	int ret = 0;
-	int is_flying = 0;
+	int connected = 1;
+
+	memset (&flight_menu, 0, sizeof (flight_menu));
+	flight_menu.id = UI_FLIGHT_MENU_NONE;
+	flight_menu.main_selected_id = -1;
+
+	/* don't replay presses done before entering flight */
+	input_flush ();
+	latency_reset ();
+	ui_notify_clear (ui);
 
 	while (running) {
-		SceCtrlData pad;
-		SceCtrlLatch latch;
+		DroneTelemetry telemetry;
+		PlatformPad pad;
+		InputEvent event;
+		unsigned int buttons;
+		unsigned int now = platform_get_time ();
+		int quit = 0;
 		int yaw = 0;
 		int pitch = 0;
 		int roll = 0;
 		int gaz = 0;
 
-		if (!drone->connected) {
-			ui_msg_dialog (ui, "Connection to drone lost");
+		if (frame_time != 0)
+			metrics_histogram_record (METRICS_UI_FRAME_TIME,
+					now - frame_time);
+		frame_time = now;
+		metrics_counter_inc (METRICS_UI_FRAMES);
+		trace_begin ("frame");
+
+		/* piloting is disabled and hud shows DISCONNECTED until
+		 * notification was shown, then main menu can reconnect */
+		if (connected && !drone->connected) {
+			ui_notify (ui, "Connection to drone lost");
+			connected = 0;
+			disconnect_time = now;
+		}
+
+		if (!connected &&
+				now - disconnect_time >= UI_NOTIFICATION_DURATION) {
+			trace_end ("frame");
 			ret = FLIGHT_UI_MAIN_MENU;
 			break;
 		}
 
-		ui_flight_update (ui, drone);
+		/* rx threads keep updating drone, the whole frame works on a
+		 * single consistent state */
+		drone_get_telemetry (drone, &telemetry);
 
-		sceCtrlReadBufferPositive (&pad, 1);
-		sceCtrlReadLatch (&latch);
+		trace_begin ("input");
+		while (!quit && input_poll_event (&event)) {
+			metrics_counter_inc (METRICS_UI_INPUT_EVENTS);
 
-		is_flying = (drone->state == DRONE_STATE_TAKING_OFF) ||
-			(drone->state == DRONE_STATE_FLYING);
-
-		/* Check triangle and circle transition */
-		if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_TRIANGLE)) {
-			if (is_flying)
-				drone_landing (drone);
-			else
-				drone_takeoff (drone);
+			if (event.type == INPUT_EVENT_PRESS)
+				quit = ui_flight_handle_press (ui, drone,
+						&flight_menu, &telemetry,
+						&event);
 		}
+		trace_end ("input");
 
-		if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_CIRCLE)) {
-			drone_emergency (drone);
-			is_flying = 0;
+		if (quit) {
+			trace_end ("frame");
+			ret = FLIGHT_UI_MAIN_MENU;
+			break;
 		}
 
-		if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_SELECT)) {
-			switch (ui->setting_select_binding) {
-				case SELECT_BIND_TAKE_PICTURE:
-					drone_take_picture (drone);
-					break;
-				case SELECT_BIND_FLIP_FRONT:
-					drone_do_flip (drone, DRONE_FLIP_FRONT);
-					break;
-				case SELECT_BIND_FLIP_BACK:
-					drone_do_flip (drone, DRONE_FLIP_BACK);
-					break;
-				case SELECT_BIND_FLIP_RIGHT:
-					drone_do_flip (drone, DRONE_FLIP_RIGHT);
-					break;
-				case SELECT_BIND_FLIP_LEFT:
-					drone_do_flip (drone, DRONE_FLIP_LEFT);
-					break;
-				default:
-					break;
-			}
-		}
+		input_get_state (&pad);
 
-		if (EVENT_BUTTON_DOWN (&latch, PSP_CTRL_START)) {
-			if (ui_flight_main_menu (ui, drone) ==
-					FLIGHT_MAIN_MENU_QUIT) {
-				ret = FLIGHT_UI_MAIN_MENU;
-				break;
-			}
-		}
+		trace_begin ("flight_ui");
+		ui_flight_update (ui, &telemetry, connected);
+		trace_end ("flight_ui");
+
+		trace_begin ("menu");
+		ui_flight_menu_update (ui, drone, &flight_menu, &pad);
+
+		if (ui->show_log_console)
+			ui_log_console_update (ui);
+		trace_end ("menu");
 
 		/* Send flight control */
-		if (pad.Buttons != 0) {
-			if (pad.Buttons & PSP_CTRL_CROSS)
+		trace_begin ("piloting");
+		buttons = pad.buttons;
+		if (flight_menu.id != UI_FLIGHT_MENU_NONE ||
+				ui->show_log_console)
+			buttons &= ~UI_FLIGHT_MENU_BUTTONS;
+
+		if (buttons != 0) {
+			if (buttons & PLATFORM_BUTTON_CROSS)
 				gaz += ui->setting_gaz;
-			if (pad.Buttons & PSP_CTRL_SQUARE)
+			if (buttons & PLATFORM_BUTTON_SQUARE)
 				gaz -= ui->setting_gaz;
 
-			if (pad.Buttons & PSP_CTRL_LTRIGGER)
+			if (buttons & PLATFORM_BUTTON_LTRIGGER)
 				yaw -= ui->setting_yaw;
-			if (pad.Buttons & PSP_CTRL_RTRIGGER)
+			if (buttons & PLATFORM_BUTTON_RTRIGGER)
 				yaw += ui->setting_yaw;
 
-			if (pad.Buttons & PSP_CTRL_UP)
+			if (buttons & PLATFORM_BUTTON_UP)
 				pitch += ui->setting_pitch;
-			if (pad.Buttons & PSP_CTRL_DOWN)
+			if (buttons & PLATFORM_BUTTON_DOWN)
 				pitch -= ui->setting_pitch;
 
-			if (pad.Buttons & PSP_CTRL_LEFT)
+			if (buttons & PLATFORM_BUTTON_LEFT)
 				roll -= ui->setting_roll;
-			if (pad.Buttons & PSP_CTRL_RIGHT)
+			if (buttons & PLATFORM_BUTTON_RIGHT)
 				roll += ui->setting_roll;
 		}
 
-		if (gaz || yaw || pitch || roll)
-			drone_flight_control (drone, gaz, yaw, pitch, roll);
+		/* stick up is Ly = 0, flip it so that up is positive */
+		switch (ui->setting_analog_mode) {
+			case ANALOG_MODE_ROLL_PITCH:
+				roll += ui->analog_roll[pad.lx];
+				pitch += ui->analog_pitch[255 - pad.ly];
+				break;
 
-		sceDisplayWaitVblankStart ();
+			case ANALOG_MODE_YAW_GAZ:
+				yaw += ui->analog_yaw[pad.lx];
+				gaz += ui->analog_gaz[255 - pad.ly];
+				break;
+
+			default:
+				break;
+		}
+
+		gaz = UI_CLAMP_COMMAND (gaz);
+		yaw = UI_CLAMP_COMMAND (yaw);
+		pitch = UI_CLAMP_COMMAND (pitch);
+		roll = UI_CLAMP_COMMAND (roll);
+
+		if (connected && (gaz || yaw || pitch || roll)) {
+			drone_flight_control (drone, gaz, yaw, pitch, roll,
+					pad.timestamp);
+			flightrec_sample (gaz, yaw, pitch, roll);
+		} else if (connected)
+			flightrec_sample (0, 0, 0, 0);
+		trace_end ("piloting");
+
+		trace_begin ("vsync");
+		platform_wait_vblank ();
 		SDL_Flip (ui->screen);
+		trace_end ("vsync");
+
+		trace_end ("frame");
 	}
 
+	/* apply settings of a menu left open */
+	ui_flight_menu_close (ui, drone, &flight_menu);
+	ui_save_finish (ui, 1);
+	ui_log_console_close (ui);
+	ui_stats_close (ui);
+	ui_notify_clear (ui);
+
 	return ret;
 }
@@ -32,6 +32,7 @@
 #include <SDL/SDL_ttf.h>
 
 #include "drone.h"
+#include "metrics.h"
 
 enum
 {
@@ -45,7 +46,42 @@ enum
 	FLIGHT_UI_MAIN_MENU = 1
 };
 
+/* axes controlled by analog stick */
+enum
+{
+	ANALOG_MODE_OFF = 0,
+	ANALOG_MODE_ROLL_PITCH,
+	ANALOG_MODE_YAW_GAZ
+};
+
+/* one entry per analog stick raw position */
+#define UI_ANALOG_CURVE_SIZE 256
+
+/* notifications shown at once, oldest is dropped on overflow */
+#define UI_NOTIFICATIONS_MAX 4
+
+/* log records shown at once by log console, must be a power of 2 */
+#define UI_LOG_CONSOLE_LINES 16
+
 typedef struct _ui UI;
+typedef struct _ui_notification UINotification;
+typedef struct _ui_log_line UILogLine;
+
+/* writes some statistics to a file, returns 0 on success */
+typedef int (*UISaveFunc) (const char * path);
+
+struct _ui_notification
+{
+	SDL_Surface *surface;
+	unsigned int expire_time;
+};
+
+/* rendered log record, kept while record is visible */
+struct _ui_log_line
+{
+	SDL_Surface *surface;
+	unsigned int seq;
+};
 
 struct _ui
 {
@@ -57,6 +93,45 @@ struct _ui
 	int setting_roll;
 	int setting_gaz;
 	int setting_select_binding;
+	int setting_analog_mode;
+	int setting_analog_deadzone;
+	int setting_analog_expo;
+	int show_latency;
+
+	/* non blocking messages drawn over flight ui, oldest first */
+	UINotification notifications[UI_NOTIFICATIONS_MAX];
+	int n_notifications;
+
+	/* log console overlay, lines are indexed by record number modulo
+	 * UI_LOG_CONSOLE_LINES so that scrolling only renders new lines */
+	int show_log_console;
+	unsigned int log_console_scroll;
+	SDL_Surface *log_console_frame;
+	UILogLine log_console_lines[UI_LOG_CONSOLE_LINES];
+
+	/* statistics page, counters values at last refresh give rates */
+	int show_stats;
+	unsigned int stats_refresh_time;
+	unsigned int stats_prev[METRICS_N];
+	SDL_Surface *stats_lines[METRICS_N];
+	SDL_Surface *stats_frame;
+
+	/* file saved by a low priority thread while flight loop goes on,
+	 * one at a time. Thread is -1 when there is none */
+	int save_thread;
+	UISaveFunc save_func;
+	const char *save_path;
+	const char *save_done_msg;
+	const char *save_failed_msg;
+	volatile int save_result;
+	volatile int save_done;
+
+	/* analog position to command lookup tables, built from settings
+	 * so that flight loop does no computation per sample */
+	signed char analog_yaw[UI_ANALOG_CURVE_SIZE];
+	signed char analog_pitch[UI_ANALOG_CURVE_SIZE];
+	signed char analog_roll[UI_ANALOG_CURVE_SIZE];
+	signed char analog_gaz[UI_ANALOG_CURVE_SIZE];
 };
 
 int ui_init (UI * ui, int width, int height);
@@ -64,7 +139,18 @@ void ui_deinit (UI * ui);
 
 int ui_main_menu_run (UI * ui);
 int ui_network_dialog_run (UI * ui);
+
+/* modal system dialog, it blocks caller so don't use it during flight */
 void ui_msg_dialog (UI * ui, const char * msg);
+
+/* queue a message to be shown for a few seconds over flight ui */
+void ui_notify (UI * ui, const char * fmt, ...);
+void ui_notify_clear (UI * ui);
+
+/* render formatted text with ui font, caller frees returned surface */
+SDL_Surface *ui_render_text (UI * ui, const SDL_Color * color,
+		const char * fmt, ...);
+
 int ui_flight_run (UI * ui, Drone * drone);
 
 #endif